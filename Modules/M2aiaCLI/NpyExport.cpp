@@ -0,0 +1,173 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+
+#include <itksys/SystemTools.hxx>
+#include <m2IntervalVector.h>
+#include <m2NpyExport.h>
+#include <m2SpectrumImage.h>
+#include <mitkCommandLineParser.h>
+#include <mitkIOUtil.h>
+#include <stdlib.h>
+
+std::map<std::string, us::Any> CommandlineParsing(int argc, char *argv[]);
+
+int main(int argc, char *argv[])
+{
+  std::map<std::string, us::Any> argsMap;
+  std::string params = "";
+
+  if (argc > 1)
+  {
+    argsMap = CommandlineParsing(argc, argv);
+    auto ifs = std::ifstream(argsMap["parameterfile"].ToString());
+    params = std::string(std::istreambuf_iterator<char>{ifs}, {});
+  }
+
+  using namespace std::string_literals;
+  std::map<std::string, std::string> pMap;
+  const auto bsc_s = m2::Find(params, "baseline-correction", "None"s, pMap);
+  const auto bsc_hw = m2::Find(params, "baseline-correction-hw", int(50), pMap);
+  const auto sm_s = m2::Find(params, "smoothing", "None"s, pMap);
+  const auto sm_hw = m2::Find(params, "smoothing-hw", int(2), pMap);
+  const auto norm = m2::Find(params, "normalization", "None"s, pMap);
+  const auto pool = m2::Find(params, "pooling", "Maximum"s, pMap);
+  const auto tol = m2::Find(params, "tolerance", double(10), pMap);
+  const auto ppm = m2::Find(params, "tolerance-ppm", bool(true), pMap);
+
+  if (argsMap.find("parameterfile") == argsMap.end())
+  {
+    try
+    {
+      using namespace itksys;
+      auto cwd = SystemTools::GetCurrentWorkingDirectory();
+      auto path = SystemTools::ConvertToOutputPath(SystemTools::JoinPath({cwd, "/m2NpyExport.txt.sample"}));
+      std::ofstream ofs(path);
+      for (auto kv : pMap)
+      {
+        ofs << "(" << kv.first << " " << kv.second << ")\n";
+      }
+      MITK_INFO << "A dummy parameter file was written to " << path;
+      return 0;
+    }
+    catch (std::exception &e)
+    {
+      MITK_INFO << "Error on writing a dummy parameter file! " << e.what();
+      return 2;
+    }
+  }
+
+  auto image = mitk::IOUtil::Load(argsMap["input"].ToString()).front();
+  auto features = mitk::IOUtil::Load(argsMap["features"].ToString()).front();
+
+  for (auto kv : argsMap)
+  {
+    MITK_INFO << kv.first << " " << kv.second.ToString();
+  }
+
+  auto sImage = dynamic_cast<m2::SpectrumImage *>(image.GetPointer());
+  auto intervals = dynamic_cast<m2::IntervalVector *>(features.GetPointer());
+  if (!sImage || !intervals)
+  {
+    MITK_ERROR << "A spectrum image and a centroid list (*.csv) are required for the export!";
+    return 1;
+  }
+
+  sImage->SetBaselineCorrectionStrategy(static_cast<m2::BaselineCorrectionType>(m2::BASECOR_MAPPINGS.at(bsc_s)));
+  sImage->SetBaseLineCorrectionHalfWindowSize(bsc_hw);
+
+  sImage->SetSmoothingStrategy(static_cast<m2::SmoothingType>(m2::SMOOTHING_MAPPINGS.at(sm_s)));
+  sImage->SetSmoothingHalfWindowSize(sm_hw);
+
+  sImage->SetNormalizationStrategy(static_cast<m2::NormalizationStrategyType>(m2::NORMALIZATION_MAPPINGS.at(norm)));
+  sImage->SetRangePoolingStrategy(static_cast<m2::RangePoolingStrategyType>(m2::POOLING_MAPPINGS.at(pool)));
+  sImage->SetTolerance(tol);
+  sImage->SetUseToleranceInPPM(ppm);
+
+  sImage->InitializeImageAccess();
+
+  try
+  {
+    m2::NpyExport::Write(argsMap["output"].ToString(), sImage, intervals);
+  }
+  catch (std::exception &e)
+  {
+    MITK_ERROR << e.what();
+    return 2;
+  }
+  return 0;
+}
+
+std::map<std::string, us::Any> CommandlineParsing(int argc, char *argv[])
+{
+  mitkCommandLineParser parser;
+  parser.setArgumentPrefix("--", "-");
+  // required params
+  parser.addArgument("input",
+                     "i",
+                     mitkCommandLineParser::Image,
+                     "Input Image",
+                     "Path to the input spectrum image (e.g. imzML)",
+                     us::Any(),
+                     false,
+                     false,
+                     false,
+                     mitkCommandLineParser::Input);
+  parser.addArgument("features",
+                     "f",
+                     mitkCommandLineParser::File,
+                     "Centroid list",
+                     "Path to the centroid list (*.csv) defining the columns of the matrix",
+                     us::Any(),
+                     false,
+                     false,
+                     false,
+                     mitkCommandLineParser::Input);
+  parser.addArgument("parameterfile",
+                     "p",
+                     mitkCommandLineParser::File,
+                     "Parameter file",
+                     "A dummy parameter file can be generated by calling the app without any arguments.",
+                     us::Any(),
+                     false,
+                     false,
+                     false,
+                     mitkCommandLineParser::Input);
+  parser.addArgument("output",
+                     "o",
+                     mitkCommandLineParser::File,
+                     "Output matrix",
+                     "Path to the output *.npy (pixels x features); coordinates, mask and features are written next to it",
+                     us::Any(),
+                     false,
+                     false,
+                     false,
+                     mitkCommandLineParser::Output);
+
+  // Miniapp Infos
+  parser.setCategory("M2aia Tools");
+  parser.setTitle("NumPy matrix export");
+  parser.setDescription(
+    "Reads a spectrum image and writes a dense pixel x feature matrix as memory-mappable .npy. https://m2aia.de (https://bio.tools/m2aia)");
+  parser.setContributor("Jonas Cordes");
+
+  auto parsedArgs = parser.parseArguments(argc, argv);
+  if (parsedArgs.size() == 0)
+  {
+    exit(EXIT_SUCCESS);
+  }
+
+  return parsedArgs;
+}
@@ -5,4 +5,12 @@ set(MODULE_TESTS
   m2ElxUtilTest.cpp
   m2SignalGroupBinningTest.cpp
   m2BaselineTest.cpp
+  m2IntervalTableTest.cpp
+  m2TiledSpectrumImageIOTest.cpp
+  m2HalfFloatTest.cpp
+  m2CompactMzAxesTest.cpp
+  m2NpyExportTest.cpp
+  m2NormalizationTest.cpp
+  m2IonImageSchedulerTest.cpp
+  m2ImzMLBinaryDataWriterTest.cpp
 )
@@ -0,0 +1,156 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <cppunit/TestAssert.h>
+#include <m2CompactMzAxes.h>
+#include <m2TestFixture.h>
+#include <mitkTestingMacros.h>
+#include <random>
+#include <signal/m2PeakDetection.h>
+#include <vector>
+
+class m2CompactMzAxesTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2CompactMzAxesTestSuite);
+  MITK_TEST(SetGet_ValuesEqual);
+  MITK_TEST(Set_IdenticalAxesShared);
+  MITK_TEST(Set_NotAscendingNotEncoded);
+  MITK_TEST(Set_OverBudgetNotEncoded);
+  MITK_TEST(Subrange_EqualsSignalSubrange);
+  CPPUNIT_TEST_SUITE_END();
+
+private:
+  // ascending m/z values with irregular spacing, more than one block
+  static std::vector<double> MakeAxis(unsigned int seed, std::size_t n = 1000)
+  {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> step(1e-4, 0.5);
+    std::vector<double> mzs(n);
+    double mz = 100;
+    for (auto &v : mzs)
+      v = (mz += step(gen));
+    return mzs;
+  }
+
+public:
+  void SetGet_ValuesEqual()
+  {
+    m2::CompactMzAxes axes(3);
+    const auto a = MakeAxis(1), b = MakeAxis(2, 7);
+    const std::vector<float> c{400.5f, 400.5f, 401.25f};
+    axes.Set(0, a.data(), a.size());
+    axes.Set(1, b.data(), b.size());
+    axes.Set(2, c.data(), c.size());
+    axes.Finalize();
+
+    std::vector<double> decoded;
+    axes.Get(0, decoded);
+    CPPUNIT_ASSERT_EQUAL(a.size(), decoded.size());
+    for (std::size_t i = 0; i < a.size(); ++i)
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(a[i], decoded[i], m2::CompactMzAxes::GridSpacing / 2);
+
+    axes.Get(1, decoded);
+    CPPUNIT_ASSERT_EQUAL(b.size(), decoded.size());
+    for (std::size_t i = 0; i < b.size(); ++i)
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(b[i], decoded[i], m2::CompactMzAxes::GridSpacing / 2);
+
+    axes.Get(2, decoded);
+    CPPUNIT_ASSERT_EQUAL(c.size(), axes.GetLength(2));
+    for (std::size_t i = 0; i < c.size(); ++i)
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(c[i], decoded[i], m2::CompactMzAxes::GridSpacing / 2);
+  }
+
+  void Set_IdenticalAxesShared()
+  {
+    m2::CompactMzAxes axes(4);
+    const auto a = MakeAxis(1), b = MakeAxis(2);
+    axes.Set(0, a.data(), a.size());
+    axes.Set(1, b.data(), b.size());
+    axes.Set(2, a.data(), a.size());
+    axes.Set(3, a.data(), a.size());
+    axes.Finalize();
+
+    CPPUNIT_ASSERT_EQUAL(std::size_t(2), axes.GetNumberOfDistinctAxes());
+    std::vector<double> x, y;
+    axes.Get(0, x);
+    axes.Get(3, y);
+    CPPUNIT_ASSERT(x == y);
+    axes.Get(1, y);
+    CPPUNIT_ASSERT(x != y);
+  }
+
+  void Set_NotAscendingNotEncoded()
+  {
+    m2::CompactMzAxes axes(2);
+    const std::vector<double> descending{300, 200, 100}, negative{-1, 100, 200};
+    axes.Set(0, descending.data(), descending.size());
+    axes.Set(1, negative.data(), negative.size());
+    axes.Finalize();
+    CPPUNIT_ASSERT(!axes.Contains(0));
+    CPPUNIT_ASSERT(!axes.Contains(1));
+  }
+
+  void Set_OverBudgetNotEncoded()
+  {
+    const auto a = MakeAxis(1), b = MakeAxis(2);
+    m2::CompactMzAxes probe(1);
+    probe.Set(0, a.data(), a.size());
+    probe.Finalize();
+
+    // room for one encoding, the second distinct axis is read from disk
+    m2::CompactMzAxes axes(3);
+    axes.SetMemoryBudget(probe.GetMemorySize());
+    axes.Set(0, a.data(), a.size());
+    axes.Set(1, b.data(), b.size());
+    axes.Set(2, a.data(), a.size());
+    axes.Finalize();
+    CPPUNIT_ASSERT(axes.Contains(0));
+    CPPUNIT_ASSERT(!axes.Contains(1));
+    CPPUNIT_ASSERT(axes.Contains(2));
+    CPPUNIT_ASSERT_EQUAL(std::size_t(1), axes.GetNumberOfSpectraOverBudget());
+  }
+
+  void Subrange_EqualsSignalSubrange()
+  {
+    m2::CompactMzAxes axes(1);
+    const auto a = MakeAxis(3);
+    axes.Set(0, a.data(), a.size());
+    axes.Finalize();
+    std::vector<double> decoded;
+    axes.Get(0, decoded);
+
+    std::mt19937 gen(4);
+    std::uniform_real_distribution<double> center(a.front() - 10, a.back() + 10), tol(0, 2);
+    std::vector<std::pair<double, double>> bounds{{0, 1}, {a.front(), a.front()}, {decoded[63], decoded[64]},
+                                                  {decoded[500], decoded[500]}, {a.back() + 1, a.back() + 2}};
+    for (int i = 0; i < 1000; ++i)
+    {
+      const auto c = center(gen), t = tol(gen);
+      bounds.emplace_back(c - t, c + t);
+    }
+
+    for (const auto &[lower, upper] : bounds)
+    {
+      const auto expected = m2::Signal::Subrange(decoded, lower, upper);
+      const auto actual = axes.Subrange(0, lower, upper);
+      CPPUNIT_ASSERT_EQUAL(expected.second, actual.second);
+      if (expected.second)
+        CPPUNIT_ASSERT_EQUAL(expected.first, actual.first);
+    }
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2CompactMzAxes)
@@ -25,6 +25,7 @@ class m2CoreMappingsTestSuite : public m2::TestFixture
 {
   CPPUNIT_TEST_SUITE(m2CoreMappingsTestSuite);
   MITK_TEST(CreateSwitches);
+  MITK_TEST(NumericTypeMappings_EqualEnumValues);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -116,6 +117,7 @@ private:
       case m2::NumericType::None:
       case m2::NumericType::Float:
       case m2::NumericType::Double:
+      case m2::NumericType::Half:
 
         // add your new case here
         {
@@ -145,6 +147,13 @@ public:
     Switch(m2::SpectrumType::None);
     
   }
+
+  void NumericTypeMappings_EqualEnumValues()
+  {
+    // the CLI casts the mapped values to m2::NumericType
+    for (auto type : {m2::NumericType::None, m2::NumericType::Float, m2::NumericType::Double, m2::NumericType::Half})
+      CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(type), m2::CORE_MAPPINGS.at(m2::to_string(type)));
+  }
 };
 
 MITK_TEST_SUITE_REGISTRATION(m2CoreMappings)
@@ -20,6 +20,9 @@ See LICENSE.txt for details.
 #include <m2SpectrumContainerImage.h>
 #include <m2TestingConfig.h>
 #include <m2TestFixture.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkImagePixelWriteAccessor.h>
+#include <mitkLabelSetImage.h>
 #include <mitkTestingMacros.h>
 #include <numeric>
 #include <random>
@@ -31,6 +34,8 @@ class m2FSMImageIOTestSuite : public m2::TestFixture
   CPPUNIT_TEST_SUITE(m2FSMImageIOTestSuite);
   MITK_TEST(LoadTestData_shouldReturnTrue);
   MITK_TEST(InitializeImageAccess_shouldReturnTrue);
+  MITK_TEST(GetImage_channelMajorShouldEqualPixelMajor);
+  MITK_TEST(GetImages_shouldEqualGetImage);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -90,6 +95,98 @@ public:
     CPPUNIT_ASSERT_EQUAL(true, equal(begin(ints), end(ints), begin(reference)));
 	
   }
+
+  void GetImage_channelMajorShouldEqualPixelMajor()
+  {
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("Markierung.fsm", M2AIA_DATA_DIR));
+    m2::SpectrumContainerImage::Pointer fsmImage = dynamic_cast<m2::SpectrumContainerImage *>(v.back().GetPointer());
+    fsmImage->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    fsmImage->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    fsmImage->SetSmoothingStrategy(m2::SmoothingType::None);
+    fsmImage->InitializeImageAccess();
+
+    const auto &xs = fsmImage->GetXAxis();
+    const auto C = fsmImage->GetNumberOfChannels();
+    const auto N = fsmImage->GetSpectra().size();
+    CPPUNIT_ASSERT_EQUAL(xs.size(), C);
+
+    fsmImage->SetImageLayout(m2::SpectrumContainerImage::SpectralDataLayout::ChannelMajor);
+    for (const std::size_t c : {std::size_t(0), C / 2, C - 1})
+    {
+      const auto channel = fsmImage->GetChannelData(c);
+      for (unsigned int i = 0; i < N; ++i)
+        CPPUNIT_ASSERT_EQUAL(fsmImage->GetSpectrumData(i)[c], channel.get()[i]);
+    }
+    CPPUNIT_ASSERT(fsmImage->GetChannelData(C) == nullptr);
+
+    // a single channel (range pooling) and a range of channels (mean derivative)
+    const auto width = std::abs(xs[C / 2 + 1] - xs[C / 2]);
+    for (const double tol : {width / 4, 5 * width})
+    {
+      const auto x = xs[C / 2];
+      mitk::Image::Pointer pixelMajor = fsmImage->mitk::Image::Clone();
+      mitk::Image::Pointer channelMajor = fsmImage->mitk::Image::Clone();
+
+      fsmImage->SetImageLayout(m2::SpectrumContainerImage::SpectralDataLayout::PixelMajor);
+      fsmImage->GetImage(x, tol, fsmImage->GetMaskImage(), pixelMajor);
+      fsmImage->SetImageLayout(m2::SpectrumContainerImage::SpectralDataLayout::ChannelMajor);
+      fsmImage->GetImage(x, tol, fsmImage->GetMaskImage(), channelMajor);
+
+      mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> a(pixelMajor), b(channelMajor);
+      const auto n = std::accumulate(fsmImage->GetDimensions(), fsmImage->GetDimensions() + 3, std::size_t(1), std::multiplies<std::size_t>());
+      for (std::size_t i = 0; i < n; ++i)
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(a.GetData()[i], b.GetData()[i], 1e-5 * std::max(1.0f, std::abs(a.GetData()[i])));
+    }
+  }
+
+  void GetImages_shouldEqualGetImage()
+  {
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("Markierung.fsm", M2AIA_DATA_DIR));
+    m2::SpectrumContainerImage::Pointer fsmImage = dynamic_cast<m2::SpectrumContainerImage *>(v.back().GetPointer());
+    fsmImage->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    fsmImage->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    fsmImage->SetSmoothingStrategy(m2::SmoothingType::None);
+    fsmImage->InitializeImageAccess();
+
+    // every third pixel is outside of the mask
+    const auto n = std::accumulate(fsmImage->GetDimensions(), fsmImage->GetDimensions() + 3, std::size_t(1), std::multiplies<std::size_t>());
+    mitk::Image::Pointer mask = fsmImage->GetMaskImage()->Clone();
+    {
+      mitk::ImagePixelWriteAccessor<mitk::LabelSetImage::PixelType, 3> acc(mask);
+      for (std::size_t i = 0; i < n; i += 3)
+        acc.GetData()[i] = 0;
+    }
+
+    // single channels (range pooling) and overlapping channel ranges (mean derivative), unordered
+    const auto &xs = fsmImage->GetXAxis();
+    const auto C = xs.size();
+    const auto width = std::abs(xs[C / 2 + 1] - xs[C / 2]);
+    const std::vector<double> centers = {xs[C / 2], xs[C / 4], xs[C / 2 + 2], xs[C / 4]};
+    const std::vector<double> tols = {width / 4, 5 * width, 3 * width, width / 4};
+
+    for (const auto layout : {m2::SpectrumContainerImage::SpectralDataLayout::PixelMajor,
+                              m2::SpectrumContainerImage::SpectralDataLayout::ChannelMajor})
+    {
+      fsmImage->SetImageLayout(layout);
+      std::vector<m2::DisplayImagePixelType> values;
+      fsmImage->GetImages(centers, tols, mask, values);
+      CPPUNIT_ASSERT_EQUAL(n * centers.size(), values.size());
+
+      mitk::Image::Pointer ionImage = fsmImage->mitk::Image::Clone();
+      for (std::size_t k = 0; k < centers.size(); ++k)
+      {
+        fsmImage->GetImage(centers[k], tols[k], mask, ionImage);
+        mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(ionImage);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          const auto expected = acc.GetData()[i];
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, values[i * centers.size() + k], 1e-5 * std::max(1.0f, std::abs(expected)));
+          if (i % 3 == 0)
+            CPPUNIT_ASSERT_EQUAL(m2::DisplayImagePixelType(0), values[i * centers.size() + k]);
+        }
+      }
+    }
+  }
 };
 
 MITK_TEST_SUITE_REGISTRATION(m2FSMImageIO)
@@ -0,0 +1,137 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <cmath>
+#include <cppunit/TestAssert.h>
+#include <cstring>
+#include <limits>
+#include <m2HalfFloat.h>
+#include <m2TestFixture.h>
+#include <mitkTestingMacros.h>
+#include <vector>
+
+class m2HalfFloatTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2HalfFloatTestSuite);
+  MITK_TEST(Normals_RoundTrip);
+  MITK_TEST(Subnormals_RoundTrip);
+  MITK_TEST(Overflow_ToInfinity);
+  MITK_TEST(NaN_StaysNaN);
+  MITK_TEST(Arrays_EqualScalarConversion);
+  CPPUNIT_TEST_SUITE_END();
+
+private:
+  using u16 = std::uint16_t;
+
+  static bool IsNaN(u16 h) { return (h & 0x7c00) == 0x7c00 && (h & 0x3ff); }
+
+  static std::uint32_t Bits(float f)
+  {
+    std::uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+  }
+
+public:
+  void Normals_RoundTrip()
+  {
+    CPPUNIT_ASSERT_EQUAL(u16(0x3c00), m2::HalfFloat::FromFloat(1.0f));
+    CPPUNIT_ASSERT_EQUAL(u16(0xc000), m2::HalfFloat::FromFloat(-2.0f));
+    CPPUNIT_ASSERT_EQUAL(u16(0x7bff), m2::HalfFloat::FromFloat(65504.0f));
+    CPPUNIT_ASSERT_EQUAL(u16(0x0400), m2::HalfFloat::FromFloat(std::ldexp(1.0f, -14)));
+    CPPUNIT_ASSERT_EQUAL(0.333251953125f, m2::HalfFloat::ToFloat(u16(0x3555)));
+
+    // round to nearest even
+    CPPUNIT_ASSERT_EQUAL(u16(0x3c00), m2::HalfFloat::FromFloat(1.0f + std::ldexp(1.0f, -11)));
+    CPPUNIT_ASSERT_EQUAL(u16(0x3c02), m2::HalfFloat::FromFloat(1.0f + 3 * std::ldexp(1.0f, -11)));
+
+    // every finite half value is exact in float
+    for (unsigned int h = 0; h < 0x10000; ++h)
+      if (!IsNaN(u16(h)))
+        CPPUNIT_ASSERT_EQUAL(u16(h), m2::HalfFloat::FromFloat(m2::HalfFloat::ToFloat(u16(h))));
+  }
+
+  void Subnormals_RoundTrip()
+  {
+    const auto ulp = std::ldexp(1.0f, -24);
+    CPPUNIT_ASSERT_EQUAL(ulp, m2::HalfFloat::ToFloat(u16(0x0001)));
+    CPPUNIT_ASSERT_EQUAL(1023 * ulp, m2::HalfFloat::ToFloat(u16(0x03ff)));
+    CPPUNIT_ASSERT_EQUAL(u16(0x0001), m2::HalfFloat::FromFloat(ulp));
+    CPPUNIT_ASSERT_EQUAL(u16(0x8001), m2::HalfFloat::FromFloat(-ulp));
+
+    // halfway cases round to even
+    CPPUNIT_ASSERT_EQUAL(u16(0x0000), m2::HalfFloat::FromFloat(ulp / 2));
+    CPPUNIT_ASSERT_EQUAL(u16(0x0002), m2::HalfFloat::FromFloat(3 * ulp / 2));
+    CPPUNIT_ASSERT_EQUAL(u16(0x0000), m2::HalfFloat::FromFloat(std::numeric_limits<float>::denorm_min()));
+  }
+
+  void Overflow_ToInfinity()
+  {
+    CPPUNIT_ASSERT_EQUAL(u16(0x7bff), m2::HalfFloat::FromFloat(65519.0f));
+    CPPUNIT_ASSERT_EQUAL(u16(0x7c00), m2::HalfFloat::FromFloat(65520.0f));
+    CPPUNIT_ASSERT_EQUAL(u16(0x7c00), m2::HalfFloat::FromFloat(1e10f));
+    CPPUNIT_ASSERT_EQUAL(u16(0xfc00), m2::HalfFloat::FromFloat(-1e10f));
+    CPPUNIT_ASSERT_EQUAL(u16(0x7c00), m2::HalfFloat::FromFloat(std::numeric_limits<float>::infinity()));
+    CPPUNIT_ASSERT(std::isinf(m2::HalfFloat::ToFloat(u16(0xfc00))));
+    CPPUNIT_ASSERT(m2::HalfFloat::ToFloat(u16(0xfc00)) < 0);
+  }
+
+  void NaN_StaysNaN()
+  {
+    CPPUNIT_ASSERT(IsNaN(m2::HalfFloat::FromFloat(std::numeric_limits<float>::quiet_NaN())));
+    CPPUNIT_ASSERT(IsNaN(m2::HalfFloat::FromFloat(-std::numeric_limits<float>::quiet_NaN())));
+    CPPUNIT_ASSERT(std::isnan(m2::HalfFloat::ToFloat(u16(0x7e00))));
+    CPPUNIT_ASSERT(std::isnan(m2::HalfFloat::ToFloat(u16(0x7c01))));
+  }
+
+  void Arrays_EqualScalarConversion()
+  {
+    // the array functions use F16C if available, odd lengths cover the scalar tail
+    std::vector<u16> hs(0x10000);
+    for (unsigned int h = 0; h < hs.size(); ++h)
+      hs[h] = u16(h);
+    std::vector<float> fs(hs.size());
+    m2::HalfFloat::ToFloat(hs.data(), hs.size() - 3, fs.data());
+    for (unsigned int h = 0; h < hs.size() - 3; ++h)
+    {
+      if (IsNaN(hs[h]))
+        CPPUNIT_ASSERT(std::isnan(fs[h]));
+      else
+        CPPUNIT_ASSERT_EQUAL(Bits(m2::HalfFloat::ToFloat(hs[h])), Bits(fs[h]));
+    }
+
+    // float bit patterns spread over the whole range
+    std::vector<float> in;
+    for (std::uint64_t u = 0; u <= 0xffffffffull; u += 65521)
+    {
+      const auto bits = std::uint32_t(u);
+      float f;
+      std::memcpy(&f, &bits, sizeof(f));
+      in.push_back(f);
+    }
+    std::vector<u16> out(in.size());
+    m2::HalfFloat::FromFloat(in.data(), in.size(), out.data());
+    for (std::size_t i = 0; i < in.size(); ++i)
+    {
+      if (std::isnan(in[i]))
+        CPPUNIT_ASSERT(IsNaN(out[i]));
+      else
+        CPPUNIT_ASSERT_EQUAL(m2::HalfFloat::FromFloat(in[i]), out[i]);
+    }
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2HalfFloat)
@@ -0,0 +1,165 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cppunit/TestAssert.h>
+#include <fstream>
+#include <iterator>
+#include <itksys/SystemTools.hxx>
+#include <m2ImzMLBinaryDataWriter.h>
+#include <m2TestFixture.h>
+#include <mitkIOUtil.h>
+#include <mitkTestingMacros.h>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class m2ImzMLBinaryDataWriterTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2ImzMLBinaryDataWriterTestSuite);
+  MITK_TEST(WriteOrdered_manyBatches_shouldAppendInOrder);
+  MITK_TEST(WriteOrdered_throwingEncoder_shouldRethrowAfterWriterJoined);
+  CPPUNIT_TEST_SUITE_END();
+
+private:
+  // more spectra than fit into one batch (8192)
+  static constexpr unsigned int N = 20000;
+  static constexpr unsigned int Threads = 4;
+
+  // 1 to 7 bytes derived from the id, so a misplaced spectrum changes the file
+  static void Encode(unsigned int id, std::vector<char> &bytes)
+  {
+    bytes.assign(id % 7 + 1, char(id * 31 + 7));
+    bytes.front() = char(id);
+  }
+
+  static std::vector<unsigned int> Ids()
+  {
+    std::vector<unsigned int> ids(N);
+    for (unsigned int i = 0; i < N; ++i)
+      ids[i] = i;
+    return ids;
+  }
+
+public:
+  void WriteOrdered_manyBatches_shouldAppendInOrder()
+  {
+    using itksys::SystemTools;
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-writer-XXXXXX");
+    const auto path = tmpDir + "/ordered.ibd";
+
+    // completion order of encode; the first spectrum of each batch finishes last
+    std::vector<unsigned int> completed;
+    std::mutex completedMutex;
+    std::vector<unsigned int> ids;
+    std::vector<unsigned long long> offsets, lengths;
+    {
+      m2::ImzMLBinaryDataWriter writer(path, false);
+      writer.WriteOrdered(
+        Ids(),
+        Threads,
+        1,
+        [&](unsigned int id, std::vector<char> &bytes)
+        {
+          if (id % 8192 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          Encode(id, bytes);
+          std::lock_guard<std::mutex> lock(completedMutex);
+          completed.push_back(id);
+        },
+        [&](unsigned int id, unsigned long long offset, unsigned long long numberOfBytes)
+        {
+          ids.push_back(id);
+          offsets.push_back(offset);
+          lengths.push_back(numberOfBytes);
+        });
+      writer.Flush();
+    }
+
+    CPPUNIT_ASSERT_EQUAL(size_t(N), completed.size());
+    CPPUNIT_ASSERT(!std::is_sorted(completed.begin(), completed.end()));
+
+    std::ifstream f(path, std::ifstream::binary);
+    const std::vector<char> file((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    CPPUNIT_ASSERT_EQUAL(size_t(N), ids.size());
+    unsigned long long expectedOffset = 0;
+    std::vector<char> expected;
+    for (unsigned int i = 0; i < N; ++i)
+    {
+      Encode(i, expected);
+      CPPUNIT_ASSERT_EQUAL(i, ids[i]);
+      CPPUNIT_ASSERT_EQUAL(expectedOffset, offsets[i]);
+      CPPUNIT_ASSERT_EQUAL((unsigned long long)expected.size(), lengths[i]);
+      CPPUNIT_ASSERT(offsets[i] + lengths[i] <= file.size());
+      CPPUNIT_ASSERT(std::equal(expected.begin(), expected.end(), file.begin() + offsets[i]));
+      expectedOffset += lengths[i];
+    }
+    CPPUNIT_ASSERT_EQUAL((unsigned long long)file.size(), expectedOffset);
+
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void WriteOrdered_throwingEncoder_shouldRethrowAfterWriterJoined()
+  {
+    using itksys::SystemTools;
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-writer-XXXXXX");
+    const auto path = tmpDir + "/throwing.ibd";
+
+    // the second batch fails while the writer still appends the first one
+    std::atomic<unsigned int> written{0};
+    bool thrown = false;
+    {
+      m2::ImzMLBinaryDataWriter writer(path, false);
+      try
+      {
+        writer.WriteOrdered(
+          Ids(),
+          Threads,
+          1,
+          [](unsigned int id, std::vector<char> &bytes)
+          {
+            if (id == 10000)
+              throw std::runtime_error("encode failed");
+            Encode(id, bytes);
+          },
+          [&](unsigned int id, unsigned long long, unsigned long long)
+          {
+            if (id == 8191)
+              std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            ++written;
+          });
+      }
+      catch (const std::runtime_error &e)
+      {
+        thrown = std::string(e.what()) == "encode failed";
+        // the complete first batch was written before the exception left WriteOrdered
+        CPPUNIT_ASSERT_EQUAL(8192u, written.load());
+      }
+    }
+
+    CPPUNIT_ASSERT(thrown);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CPPUNIT_ASSERT_EQUAL(8192u, written.load());
+
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2ImzMLBinaryDataWriter)
@@ -15,14 +15,34 @@ See LICENSE.txt for details.
 ===================================================================*/
 
 #include "mitkIOUtil.h"
+#include <Poco/SHA1Engine.h>
 #include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <itksys/SystemTools.hxx>
+#include <m2ElxRegistrationHelper.h>
 #include <signal/m2Normalization.h>
+#include <m2BinaryDataCompression.h>
+#include <m2ImzMLChannelCubeFile.h>
+#include <m2ImzMLEngine.h>
+#include <m2ImzMLImageIO.h>
+#include <m2ImzMLIndexFile.h>
+#include <m2ImzMLParser.h>
 #include <m2ImzMLSpectrumImage.h>
+#include <m2SpectrumImageStack.h>
 #include <m2TestingConfig.h>
 #include <m2TestFixture.h>
+#include <mitkCoreServices.h>
+#include <mitkIPreferences.h>
+#include <mitkIPreferencesService.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkImagePixelWriteAccessor.h>
+#include <mitkLabelSetImage.h>
 #include <mitkTestingMacros.h>
 #include <numeric>
 #include <random>
+#include <tuple>
 
 //#include <boost/algorithm/string.hpp>
 
@@ -31,6 +51,18 @@ class m2ImzMLImageIOTestSuite : public m2::TestFixture
   CPPUNIT_TEST_SUITE(m2ImzMLImageIOTestSuite);
   MITK_TEST(LoadTestData_shouldReturnTrue);
   MITK_TEST(InitializeImageAccess_shouldReturnTrue);
+  MITK_TEST(LoadIndexFile_shouldEqualParsedMetaData);
+  MITK_TEST(GetImages_shouldEqualGetImage);
+  MITK_TEST(GetImages_processedCentroidShouldEqualGetImage);
+  MITK_TEST(GetImage_repeatedQueryShouldHitCache);
+  MITK_TEST(Zlib_deflateInflateShouldRoundTrip);
+  MITK_TEST(WriteZlibCompressed_shouldEqualUncompressedSpectra);
+  MITK_TEST(ChannelCube_shouldEqualIbdReads);
+  MITK_TEST(WriteRegionOfInterest_shouldEqualSourceSpectra);
+  MITK_TEST(WriteSHA1_shouldEqualDigestOfIbd);
+  MITK_TEST(SpectrumTemplate_compiledShouldEqualTemplateEngine);
+  MITK_TEST(WriteProcessed_shouldRoundTripSpectra);
+  MITK_TEST(WriteStack_shouldRoundTripSlicesAndKeepSliceSettings);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -90,6 +122,749 @@ public:
     CPPUNIT_ASSERT_EQUAL(true, equal(begin(ints), end(ints), begin(reference)));
 	
   }
+
+  void LoadIndexFile_shouldEqualParsedMetaData()
+  {
+    // work on a copy with a private cache directory, the shared test data is not modified
+    using itksys::SystemTools;
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-index-XXXXXX");
+    const auto dataDir = tmpDir + "/data";
+    const auto cacheDir = tmpDir + "/cache";
+    SystemTools::MakeDirectory(dataDir);
+    for (const std::string name : {"lipid.imzML", "lipid.ibd"})
+      SystemTools::CopyFileAlways(GetTestDataFilePath(name, M2AIA_DATA_DIR), dataDir + "/" + name);
+    SystemTools::PutEnv("M2AIA_CACHE_DIR=" + cacheDir);
+
+    // loading creates the index file in the cache directory
+    auto v = mitk::IOUtil::Load(dataDir + "/lipid.imzML");
+    m2::ImzMLSpectrumImage::Pointer loaded = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    CPPUNIT_ASSERT(loaded != nullptr);
+    const auto indexPath = m2::ImzMLIndexFile::GetIndexFilePath(loaded->GetImzMLDataPath());
+    CPPUNIT_ASSERT(SystemTools::FileExists(indexPath));
+    CPPUNIT_ASSERT_EQUAL(SystemTools::CollapseFullPath(cacheDir),
+                         SystemTools::CollapseFullPath(SystemTools::GetParentDirectory(indexPath)));
+    CPPUNIT_ASSERT(!SystemTools::FileExists(dataDir + "/lipid" + m2::ImzMLIndexFile::Extension));
+
+    auto parsed = m2::ImzMLSpectrumImage::New();
+    parsed->SetImzMLDataPath(loaded->GetImzMLDataPath());
+    parsed->SetBinaryDataPath(loaded->GetBinaryDataPath());
+    m2::ImzMLParser::ReadImageMetaData(parsed);
+    m2::ImzMLParser::ReadImageSpectrumMetaData(parsed);
+
+    auto indexed = m2::ImzMLSpectrumImage::New();
+    indexed->SetImzMLDataPath(loaded->GetImzMLDataPath());
+    indexed->SetBinaryDataPath(loaded->GetBinaryDataPath());
+    CPPUNIT_ASSERT(m2::ImzMLIndexFile::Read(indexed));
+
+    const auto &a = parsed->GetSpectra();
+    const auto &b = indexed->GetSpectra();
+    CPPUNIT_ASSERT_EQUAL(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+      CPPUNIT_ASSERT_EQUAL(a[i].mzOffset, b[i].mzOffset);
+      CPPUNIT_ASSERT_EQUAL(a[i].intOffset, b[i].intOffset);
+      CPPUNIT_ASSERT_EQUAL(a[i].mzLength, b[i].mzLength);
+      CPPUNIT_ASSERT_EQUAL(a[i].intLength, b[i].intLength);
+      CPPUNIT_ASSERT(a[i].index == b[i].index);
+    }
+
+    CPPUNIT_ASSERT_EQUAL(parsed->GetPropertyValue<unsigned>("[IMS:1000042] max count of pixels x"),
+                         indexed->GetPropertyValue<unsigned>("[IMS:1000042] max count of pixels x"));
+    CPPUNIT_ASSERT_EQUAL(parsed->GetPropertyValue<double>("[IMS:1000046] pixel size x"),
+                         indexed->GetPropertyValue<double>("[IMS:1000046] pixel size x"));
+    CPPUNIT_ASSERT_EQUAL(parsed->GetPropertyValue<std::string>("m2aia.imzml.mzGroupID"),
+                         indexed->GetPropertyValue<std::string>("m2aia.imzml.mzGroupID"));
+
+    v.clear();
+    loaded = nullptr;
+    parsed = nullptr;
+    indexed = nullptr;
+    SystemTools::UnPutEnv("M2AIA_CACHE_DIR");
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void GetImages_shouldEqualGetImage()
+  {
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer imzMLImage = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    imzMLImage->SetNormalizationStrategy(m2::NormalizationStrategyType::TIC);
+    imzMLImage->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    imzMLImage->SetSmoothingStrategy(m2::SmoothingType::None);
+    imzMLImage->InitializeImageAccess();
+
+    // unordered and overlapping ranges
+    const std::vector<double> xs = {imzMLImage->GetXMax() - 1, imzMLImage->GetXMin() + 1,
+                                    (imzMLImage->GetXMin() + imzMLImage->GetXMax()) / 2, imzMLImage->GetXMin() + 1.05};
+    std::vector<double> tols(xs.size());
+    std::transform(xs.begin(), xs.end(), tols.begin(), [&](double x) { return imzMLImage->ApplyTolerance(x); });
+
+    std::vector<m2::DisplayImagePixelType> values;
+    imzMLImage->GetImages(xs, tols, imzMLImage->GetMaskImage(), values);
+
+    mitk::Image::Pointer ionImage = imzMLImage->mitk::Image::Clone();
+    const auto N = std::accumulate(imzMLImage->GetDimensions(), imzMLImage->GetDimensions() + 3, size_t(1), std::multiplies<size_t>());
+    CPPUNIT_ASSERT_EQUAL(N * xs.size(), values.size());
+    for (size_t k = 0; k < xs.size(); ++k)
+    {
+      imzMLImage->GetImage(xs[k], tols[k], imzMLImage->GetMaskImage(), ionImage);
+      mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(ionImage);
+      for (size_t i = 0; i < N; ++i)
+        CPPUNIT_ASSERT_EQUAL(acc.GetData()[i], values[i * xs.size() + k]);
+    }
+  }
+
+  void GetImages_processedCentroidShouldEqualGetImage()
+  {
+    using itksys::SystemTools;
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer source = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    source->InitializeImageAccess();
+
+    // processed centroid fixture: a varying subset of every 13th channel per spectrum
+    auto intervals = m2::IntervalVector::New();
+    for (size_t c = 0; c < source->GetXAxis().size(); c += 13)
+      intervals->GetIntervals().emplace_back(source->GetXAxis()[c], 0);
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-centroid-XXXXXX");
+    const auto path = tmpDir + "/lipid_centroid.imzML";
+    {
+      m2::ImzMLImageIO io;
+      io.SetDataTypeXAxis(m2::NumericType::Double);
+      io.SetDataTypeYAxis(m2::NumericType::Float);
+      io.SetSpectrumFormat(m2::SpectrumFormat::ProcessedCentroid);
+      io.SetIntervalVector(intervals);
+      io.SetOutputLocation(path);
+      io.mitk::AbstractFileIOWriter::SetInput(source);
+      io.Write();
+    }
+
+    auto *preferences = mitk::CoreServices::GetPreferencesService()->GetSystemPreferences();
+    const auto compactMzAxes = preferences->GetBool("m2aia.imzml.compact_mz_axes", true);
+
+    // the merge reads m/z axes from the compact in-memory copy or from the ibd
+    for (const bool compact : {true, false})
+    {
+      preferences->PutBool("m2aia.imzml.compact_mz_axes", compact);
+      auto w = mitk::IOUtil::Load(path);
+      m2::ImzMLSpectrumImage::Pointer image = dynamic_cast<m2::ImzMLSpectrumImage *>(w.back().GetPointer());
+      CPPUNIT_ASSERT(image != nullptr);
+      CPPUNIT_ASSERT(image->GetSpectrumType().Format == m2::SpectrumFormat::ProcessedCentroid);
+      image->SetNormalizationStrategy(m2::NormalizationStrategyType::TIC);
+      image->InitializeImageAccess();
+
+      // every third pixel is outside of the mask
+      const auto N = std::accumulate(image->GetDimensions(), image->GetDimensions() + 3, size_t(1), std::multiplies<size_t>());
+      mitk::Image::Pointer mask = image->GetMaskImage()->Clone();
+      {
+        mitk::ImagePixelWriteAccessor<mitk::LabelSetImage::PixelType, 3> acc(mask);
+        for (size_t i = 0; i < N; i += 3)
+          acc.GetData()[i] = 0;
+      }
+
+      // unordered, overlapping and empty ranges
+      const auto &centers = intervals->GetIntervals();
+      const std::vector<double> xs = {centers[centers.size() / 2].x.mean(),
+                                      centers[1].x.mean(),
+                                      centers[centers.size() / 2 + 1].x.mean(),
+                                      (centers[2].x.mean() + centers[3].x.mean()) / 2,
+                                      centers[centers.size() / 2].x.mean()};
+      const std::vector<double> tols = {image->ApplyTolerance(xs[0]),
+                                        image->ApplyTolerance(xs[1]),
+                                        1.5 * (xs[2] - xs[0]),
+                                        1e-9,
+                                        image->ApplyTolerance(xs[4])};
+
+      std::vector<m2::DisplayImagePixelType> values;
+      image->GetImages(xs, tols, mask, values);
+      CPPUNIT_ASSERT_EQUAL(N * xs.size(), values.size());
+
+      mitk::Image::Pointer ionImage = image->mitk::Image::Clone();
+      for (size_t k = 0; k < xs.size(); ++k)
+      {
+        image->GetImage(xs[k], tols[k], mask, ionImage);
+        mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(ionImage);
+        for (size_t i = 0; i < N; ++i)
+          CPPUNIT_ASSERT_EQUAL(acc.GetData()[i], values[i * xs.size() + k]);
+      }
+    }
+
+    preferences->PutBool("m2aia.imzml.compact_mz_axes", compactMzAxes);
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void GetImage_repeatedQueryShouldHitCache()
+  {
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer imzMLImage = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    imzMLImage->SetNormalizationStrategy(m2::NormalizationStrategyType::TIC);
+    imzMLImage->InitializeImageAccess();
+
+    const auto x = (imzMLImage->GetXMin() + imzMLImage->GetXMax()) / 2;
+    const auto tol = imzMLImage->ApplyTolerance(x);
+    const auto N = std::accumulate(imzMLImage->GetDimensions(), imzMLImage->GetDimensions() + 3, size_t(1), std::multiplies<size_t>());
+    auto &cache = imzMLImage->GetIonImageCache();
+
+    mitk::Image::Pointer first = imzMLImage->mitk::Image::Clone();
+    mitk::Image::Pointer second = imzMLImage->mitk::Image::Clone();
+    imzMLImage->GetImage(x, tol, imzMLImage->GetMaskImage(), first);
+    const auto hits = cache.GetHits();
+    imzMLImage->GetImage(x, tol, imzMLImage->GetMaskImage(), second);
+    CPPUNIT_ASSERT_EQUAL(hits + 1, cache.GetHits());
+    {
+      mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> a(first), b(second);
+      CPPUNIT_ASSERT(std::equal(a.GetData(), a.GetData() + N, b.GetData()));
+    }
+
+    // a different processing setting is a different image
+    imzMLImage->SetRangePoolingStrategy(m2::RangePoolingStrategyType::Maximum);
+    const auto misses = cache.GetMisses();
+    imzMLImage->GetImage(x, tol, imzMLImage->GetMaskImage(), second);
+    CPPUNIT_ASSERT_EQUAL(misses + 1, cache.GetMisses());
+
+    // so is a modified normalization image
+    imzMLImage->GetNormalizationImage()->Modified();
+    imzMLImage->GetImage(x, tol, imzMLImage->GetMaskImage(), second);
+    CPPUNIT_ASSERT_EQUAL(misses + 2, cache.GetMisses());
+    imzMLImage->GetImage(x, tol, imzMLImage->GetMaskImage(), second);
+    CPPUNIT_ASSERT_EQUAL(misses + 2, cache.GetMisses());
+
+    // and a modified mask
+    imzMLImage->GetMaskImage()->Modified();
+    imzMLImage->GetImage(x, tol, imzMLImage->GetMaskImage(), second);
+    CPPUNIT_ASSERT_EQUAL(misses + 3, cache.GetMisses());
+
+    // entries are removed with their image
+    const auto entries = cache.GetNumberOfEntries();
+    CPPUNIT_ASSERT(entries >= 4);
+    v.clear();
+    imzMLImage = nullptr;
+    CPPUNIT_ASSERT_EQUAL(entries - 4, cache.GetNumberOfEntries());
+  }
+
+  void Zlib_deflateInflateShouldRoundTrip()
+  {
+    std::vector<float> values(10000);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(0, 1000);
+    std::generate(values.begin(), values.end(), [&]() { return dist(gen); });
+    const auto bytes = values.size() * sizeof(float);
+
+    std::vector<char> encoded;
+    const auto n = m2::Zlib::Deflate(reinterpret_cast<const char *>(values.data()), bytes, encoded);
+    CPPUNIT_ASSERT(n > 0);
+
+    std::vector<float> decoded(values.size());
+    CPPUNIT_ASSERT(m2::Zlib::Inflate(encoded.data(), n, reinterpret_cast<char *>(decoded.data()), bytes));
+    CPPUNIT_ASSERT(values == decoded);
+
+    // leading part only
+    std::vector<float> prefix(100);
+    CPPUNIT_ASSERT(m2::Zlib::Inflate(encoded.data(), n, reinterpret_cast<char *>(prefix.data()), prefix.size() * sizeof(float)));
+    CPPUNIT_ASSERT(std::equal(prefix.begin(), prefix.end(), values.begin()));
+
+    // truncated stream and more requested bytes than encoded
+    CPPUNIT_ASSERT(!m2::Zlib::Inflate(encoded.data(), n / 2, reinterpret_cast<char *>(decoded.data()), bytes));
+    std::vector<float> larger(values.size() + 1);
+    CPPUNIT_ASSERT(!m2::Zlib::Inflate(encoded.data(), n, reinterpret_cast<char *>(larger.data()), larger.size() * sizeof(float)));
+  }
+
+  void WriteZlibCompressed_shouldEqualUncompressedSpectra()
+  {
+    using itksys::SystemTools;
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer source = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    source->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    source->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    source->SetSmoothingStrategy(m2::SmoothingType::None);
+    source->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    source->InitializeImageAccess();
+
+    // compressed fixture written by the exporter
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-zlib-XXXXXX");
+    const auto path = tmpDir + "/lipid_zlib.imzML";
+    {
+      m2::ImzMLImageIO io;
+      io.SetDataTypeXAxis(m2::NumericType::Float);
+      io.SetDataTypeYAxis(m2::NumericType::Float);
+      io.SetSpectrumFormat(m2::SpectrumFormat::ContinuousProfile);
+      io.SetUseZlibCompression(true);
+      io.SetOutputLocation(path);
+      io.mitk::AbstractFileIOWriter::SetInput(source);
+      io.Write();
+    }
+
+    // the arrays are flagged as zlib compression [MS:1000574]
+    {
+      std::ifstream f(path);
+      const std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+      CPPUNIT_ASSERT(text.find("MS:1000574") != std::string::npos);
+    }
+    CPPUNIT_ASSERT(SystemTools::FileLength(tmpDir + "/lipid_zlib.ibd") <
+                   SystemTools::FileLength(source->GetBinaryDataPath()));
+
+    auto w = mitk::IOUtil::Load(path);
+    m2::ImzMLSpectrumImage::Pointer compressed = dynamic_cast<m2::ImzMLSpectrumImage *>(w.back().GetPointer());
+    CPPUNIT_ASSERT(compressed != nullptr);
+    compressed->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    compressed->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    compressed->SetSmoothingStrategy(m2::SmoothingType::None);
+    compressed->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    compressed->InitializeImageAccess();
+
+    CPPUNIT_ASSERT_EQUAL(source->GetSpectra().size(), compressed->GetSpectra().size());
+    std::vector<float> xa, ya, xb, yb;
+    for (unsigned int i = 0; i < source->GetSpectra().size(); ++i)
+    {
+      source->GetSpectrumFloat(i, xa, ya);
+      compressed->GetSpectrumFloat(i, xb, yb);
+      CPPUNIT_ASSERT(xa == xb);
+      CPPUNIT_ASSERT(ya == yb);
+    }
+
+    w.clear();
+    compressed = nullptr;
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void ChannelCube_shouldEqualIbdReads()
+  {
+    using itksys::SystemTools;
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-cube-XXXXXX");
+    SystemTools::PutEnv("M2AIA_CACHE_DIR=" + tmpDir);
+
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer image = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    image->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    image->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    image->SetSmoothingStrategy(m2::SmoothingType::None);
+    image->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    image->InitializeImageAccess();
+
+    const auto N = image->GetSpectra().size();
+    std::vector<double> ys;
+    image->GetIntensities(0, ys);
+    const auto C = ys.size();
+
+    // the cube requests every spectrum exactly once
+    std::vector<unsigned int> requests(N, 0);
+    const auto reader = [&](std::uint64_t first, std::uint64_t n, char *block)
+    {
+      auto *values = reinterpret_cast<double *>(block);
+      std::vector<double> ints;
+      for (std::uint64_t i = 0; i < n; ++i)
+      {
+        ++requests[first + i];
+        image->GetIntensities(first + i, ints);
+        std::copy(ints.begin(), ints.end(), values + i * C);
+      }
+    };
+    CPPUNIT_ASSERT(m2::ImzMLChannelCubeFile::Write(image, sizeof(double), C, reader));
+    CPPUNIT_ASSERT(std::all_of(requests.begin(), requests.end(), [](unsigned int r) { return r == 1; }));
+
+    const auto cubePath = m2::ImzMLChannelCubeFile::GetCubeFilePath(image->GetImzMLDataPath());
+    CPPUNIT_ASSERT_EQUAL(SystemTools::CollapseFullPath(tmpDir),
+                         SystemTools::CollapseFullPath(SystemTools::GetParentDirectory(cubePath)));
+
+    auto cube = m2::ImzMLChannelCubeFile::Open(image, sizeof(double), C);
+    CPPUNIT_ASSERT(cube != nullptr);
+    CPPUNIT_ASSERT_EQUAL(std::uint64_t(N), cube->GetNumberOfSpectra());
+    CPPUNIT_ASSERT_EQUAL(std::uint64_t(C), cube->GetNumberOfChannels());
+    for (unsigned int i = 0; i < N; ++i)
+    {
+      image->GetIntensities(i, ys);
+      for (std::uint64_t c = 0; c < C; ++c)
+        CPPUNIT_ASSERT_EQUAL(ys[c], cube->Channel<double>(c)[i]);
+    }
+
+    // a cube of a different value type does not match
+    CPPUNIT_ASSERT(m2::ImzMLChannelCubeFile::Open(image, sizeof(float), C) == nullptr);
+
+    cube = nullptr;
+    v.clear();
+    image = nullptr;
+    SystemTools::UnPutEnv("M2AIA_CACHE_DIR");
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void WriteRegionOfInterest_shouldEqualSourceSpectra()
+  {
+    using itksys::SystemTools;
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer source = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    source->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    source->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    source->SetSmoothingStrategy(m2::SmoothingType::None);
+    source->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    source->InitializeImageAccess();
+
+    // label 2: every second row of the right two thirds, i.e. a region with an offset and gaps
+    using LabelType = mitk::LabelSetImage::PixelType;
+    const auto *dims = source->GetDimensions();
+    auto roi = mitk::Image::New();
+    roi->Initialize(mitk::MakeScalarPixelType<LabelType>(), *source->GetGeometry());
+    std::vector<unsigned int> expected;
+    {
+      mitk::ImagePixelWriteAccessor<LabelType, 3> acc(roi);
+      std::fill(acc.GetData(), acc.GetData() + std::size_t(dims[0]) * dims[1] * dims[2], LabelType(0));
+      const auto &spectra = source->GetSpectra();
+      for (unsigned int i = 0; i < spectra.size(); ++i)
+      {
+        const auto &index = spectra[i].index;
+        const bool inside = index[0] >= itk::IndexValueType(dims[0] / 3) && index[1] % 2 == 0;
+        acc.SetPixelByIndex(index, inside ? 2 : 1);
+        if (inside)
+          expected.push_back(i);
+      }
+    }
+    CPPUNIT_ASSERT(!expected.empty());
+
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-roi-XXXXXX");
+    const auto path = tmpDir + "/lipid_roi.imzML";
+    {
+      m2::ImzMLImageIO io;
+      io.SetRegionOfInterest(roi, 2);
+      io.SetOutputLocation(path);
+      io.mitk::AbstractFileIOWriter::SetInput(source);
+      io.Write();
+    }
+
+    auto w = mitk::IOUtil::Load(path);
+    m2::ImzMLSpectrumImage::Pointer region = dynamic_cast<m2::ImzMLSpectrumImage *>(w.back().GetPointer());
+    CPPUNIT_ASSERT(region != nullptr);
+    region->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    region->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    region->SetSmoothingStrategy(m2::SmoothingType::None);
+    region->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    region->InitializeImageAccess();
+
+    // spectra are matched by their order in z, y, x, the positions are shifted by the same offset
+    const auto &spectra = region->GetSpectra();
+    CPPUNIT_ASSERT_EQUAL(expected.size(), spectra.size());
+    std::vector<unsigned int> ids(spectra.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    const auto byPosition = [](const auto &all)
+    {
+      return [&all](unsigned int a, unsigned int b)
+      {
+        const auto &i = all[a].index, &j = all[b].index;
+        return std::make_tuple(i[2], i[1], i[0]) < std::make_tuple(j[2], j[1], j[0]);
+      };
+    };
+    std::sort(ids.begin(), ids.end(), byPosition(spectra));
+    std::sort(expected.begin(), expected.end(), byPosition(source->GetSpectra()));
+
+    std::vector<float> xa, ya, xb, yb;
+    const auto &first = source->GetSpectra()[expected[0]].index;
+    for (size_t k = 0; k < ids.size(); ++k)
+    {
+      const auto &a = source->GetSpectra()[expected[k]].index;
+      const auto &b = spectra[ids[k]].index;
+      for (unsigned int d = 0; d < 3; ++d)
+        CPPUNIT_ASSERT_EQUAL(a[d] - first[d], b[d] - spectra[ids[0]].index[d]);
+
+      source->GetSpectrumFloat(expected[k], xa, ya);
+      region->GetSpectrumFloat(ids[k], xb, yb);
+      CPPUNIT_ASSERT(xa == xb);
+      CPPUNIT_ASSERT(ya == yb);
+    }
+
+    w.clear();
+    region = nullptr;
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void WriteSHA1_shouldEqualDigestOfIbd()
+  {
+    using itksys::SystemTools;
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer source = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-sha1-XXXXXX");
+    const auto readText = [](const std::string &path)
+    {
+      std::ifstream f(path, std::ifstream::binary);
+      return std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    };
+    const auto write = [&](const std::string &path, bool computeSHA1)
+    {
+      m2::ImzMLImageIO io;
+      io.SetComputeSHA1(computeSHA1);
+      io.SetOutputLocation(path);
+      io.mitk::AbstractFileIOWriter::SetInput(source);
+      io.Write();
+    };
+
+    // [IMS:1000091] holds the digest of the complete ibd file, uuid included
+    write(tmpDir + "/lipid_sha1.imzML", true);
+    {
+      const auto text = readText(tmpDir + "/lipid_sha1.imzML");
+      const auto param = text.find("accession=\"IMS:1000091\"");
+      CPPUNIT_ASSERT(param != std::string::npos);
+      const auto first = text.find("value=\"", param) + 7;
+      const auto written = text.substr(first, text.find('"', first) - first);
+
+      const auto ibd = readText(tmpDir + "/lipid_sha1.ibd");
+      Poco::SHA1Engine engine;
+      engine.update(ibd.data(), ibd.size());
+      CPPUNIT_ASSERT_EQUAL(Poco::SHA1Engine::digestToHex(engine.digest()), written);
+    }
+
+    // the {#sha1sum} section is dropped if the digest is not computed
+    write(tmpDir + "/lipid_nosha1.imzML", false);
+    CPPUNIT_ASSERT(readText(tmpDir + "/lipid_nosha1.imzML").find("IMS:1000091") == std::string::npos);
+
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void SpectrumTemplate_compiledShouldEqualTemplateEngine()
+  {
+    m2::ImzMLImageIO io;
+    const auto &keys = io.GetSpectrumTemplateKeys();
+    const m2::CompiledTemplate compiled(io.GetSpectrumTemplate(), keys);
+
+    const std::map<std::string, std::string> spectrum = {{"index", "12"},
+                                                         {"x", "3"},
+                                                         {"y", "45"},
+                                                         {"z", "1"},
+                                                         {"mz_len", "2000"},
+                                                         {"mz_enc_len", "8000"},
+                                                         {"mz_offset", "16"},
+                                                         {"int_len", "2000"},
+                                                         {"int_enc_len", "1234"},
+                                                         {"int_offset", "18446744073709551615"},
+                                                         {"tic", "1.5e6"}};
+
+    // as written by Write (tic unset), without the optional z and with all sections
+    for (const auto &unset : std::vector<std::vector<std::string>>{{"tic"}, {"tic", "z"}, {}})
+    {
+      auto context = spectrum;
+      for (const auto &key : unset)
+        context.erase(key);
+
+      std::vector<m2::CompiledTemplate::Value> values(keys.size());
+      for (size_t i = 0; i < keys.size(); ++i)
+      {
+        const auto it = context.find(keys[i]);
+        if (it != context.end() && keys[i] == "tic")
+          values[i] = std::string_view(it->second);
+        else if (it != context.end())
+          values[i] = std::stoull(it->second);
+      }
+
+      std::string rendered;
+      compiled.Render(values.data(), rendered);
+      CPPUNIT_ASSERT_EQUAL(m2::TemplateEngine::render(io.GetSpectrumTemplate(), context), rendered);
+    }
+  }
+
+  void WriteProcessed_shouldRoundTripSpectra()
+  {
+    using itksys::SystemTools;
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer source = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    source->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    source->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    source->SetSmoothingStrategy(m2::SmoothingType::None);
+    source->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    source->InitializeImageAccess();
+
+    // centroids on every 97th channel; without tolerance each interval pools exactly that channel
+    source->SetUseToleranceInPPM(false);
+    source->SetTolerance(0);
+    std::vector<size_t> channels;
+    auto intervals = m2::IntervalVector::New();
+    for (size_t c = 0; c < source->GetXAxis().size(); c += 97)
+    {
+      channels.push_back(c);
+      intervals->GetIntervals().emplace_back(source->GetXAxis()[c], 0);
+    }
+
+    std::map<std::tuple<itk::IndexValueType, itk::IndexValueType, itk::IndexValueType>, unsigned int> sourceIds;
+    for (unsigned int i = 0; i < source->GetSpectra().size(); ++i)
+    {
+      const auto &index = source->GetSpectra()[i].index;
+      sourceIds[std::make_tuple(index[0], index[1], index[2])] = i;
+    }
+
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-processed-XXXXXX");
+    for (const auto format : {m2::SpectrumFormat::ProcessedProfile, m2::SpectrumFormat::ProcessedCentroid})
+      for (const bool zlib : {false, true})
+      {
+        const auto path = tmpDir + "/lipid_" + m2::to_string(format) + (zlib ? "_zlib" : "") + ".imzML";
+        {
+          m2::ImzMLImageIO io;
+          io.SetDataTypeXAxis(m2::NumericType::Float);
+          io.SetDataTypeYAxis(m2::NumericType::Float);
+          io.SetSpectrumFormat(format);
+          io.SetUseZlibCompression(zlib);
+          io.SetIntervalVector(intervals);
+          io.SetOutputLocation(path);
+          io.mitk::AbstractFileIOWriter::SetInput(source);
+          io.Write();
+        }
+
+        {
+          std::ifstream f(path);
+          const std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+          CPPUNIT_ASSERT_EQUAL(zlib, text.find("MS:1000574") != std::string::npos);
+        }
+
+        auto w = mitk::IOUtil::Load(path);
+        m2::ImzMLSpectrumImage::Pointer result = dynamic_cast<m2::ImzMLSpectrumImage *>(w.back().GetPointer());
+        CPPUNIT_ASSERT(result != nullptr);
+        CPPUNIT_ASSERT(any(result->GetSpectrumType().Format & m2::SpectrumFormat::Processed));
+        result->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+        result->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+        result->SetSmoothingStrategy(m2::SmoothingType::None);
+        result->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+        result->InitializeImageAccess();
+        CPPUNIT_ASSERT_EQUAL(source->GetSpectra().size(), result->GetSpectra().size());
+
+        std::vector<double> xs, ys;
+        std::vector<float> ex, ey, rx, ry;
+        for (unsigned int i = 0; i < result->GetSpectra().size(); ++i)
+        {
+          const auto &index = result->GetSpectra()[i].index;
+          const auto it = sourceIds.find(std::make_tuple(index[0], index[1], index[2]));
+          CPPUNIT_ASSERT(it != sourceIds.end());
+          source->GetSpectrum(it->second, xs, ys);
+
+          // the exported arrays, converted to the float output type
+          ex.clear();
+          ey.clear();
+          if (format == m2::SpectrumFormat::ProcessedProfile)
+          {
+            ex.assign(std::begin(xs), std::end(xs));
+            ey.assign(std::begin(ys), std::end(ys));
+          }
+          else
+          {
+            for (const auto c : channels)
+              if (ys[c] != 0)
+              {
+                ex.push_back(xs[c]);
+                ey.push_back(ys[c]);
+              }
+          }
+
+          result->GetSpectrumFloat(i, rx, ry);
+          CPPUNIT_ASSERT(ex == rx);
+          CPPUNIT_ASSERT(ey == ry);
+        }
+
+        w.clear();
+        result = nullptr;
+      }
+
+    SystemTools::RemoveADirectory(tmpDir);
+  }
+
+  void WriteStack_shouldRoundTripSlicesAndKeepSliceSettings()
+  {
+    using itksys::SystemTools;
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m2::ImzMLSpectrumImage::Pointer slice = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    slice->InitializeImageAccess();
+
+    // settings of the slice differ from the settings of the stack
+    slice->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::TopHat);
+    slice->SetBaseLineCorrectionHalfWindowSize(50);
+    slice->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    slice->SetSmoothingStrategy(m2::SmoothingType::Gaussian);
+    slice->SetSmoothingHalfWindowSize(3);
+    slice->SetIntensityTransformationStrategy(m2::IntensityTransformationType::SquareRoot);
+
+    // the same image on both slices, untransformed
+    auto stack = m2::SpectrumImageStack::New(2, 0.01);
+    for (unsigned int z = 0; z < 2; ++z)
+    {
+      auto helper = std::make_shared<m2::ElxRegistrationHelper>();
+      helper->SetImageData(slice, slice);
+      helper->SetRegistrationParameters({});
+      stack->Insert(z, helper);
+    }
+    stack->InitializeProcessor();
+    stack->InitializeGeometry();
+    stack->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    stack->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    stack->SetSmoothingStrategy(m2::SmoothingType::None);
+    stack->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+
+    auto intervals = m2::IntervalVector::New();
+    const auto &xAxis = slice->GetXAxis();
+    for (size_t c = xAxis.size() / 8; c < xAxis.size(); c += xAxis.size() / 4)
+      intervals->GetIntervals().emplace_back(xAxis[c], 0);
+    const auto K = intervals->GetIntervals().size();
+
+    const auto tmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-stack-XXXXXX");
+    const auto path = tmpDir + "/stack.imzML";
+    {
+      m2::ImzMLImageIO io;
+      io.SetDataTypeXAxis(m2::NumericType::Float);
+      io.SetDataTypeYAxis(m2::NumericType::Float);
+      io.SetSpectrumFormat(m2::SpectrumFormat::ContinuousCentroid);
+      io.SetIntervalVector(intervals);
+      io.SetOutputLocation(path);
+      io.mitk::AbstractFileIOWriter::SetInput(stack);
+      io.Write();
+    }
+
+    CPPUNIT_ASSERT(slice->GetBaselineCorrectionStrategy() == m2::BaselineCorrectionType::TopHat);
+    CPPUNIT_ASSERT_EQUAL(50u, slice->GetBaseLineCorrectionHalfWindowSize());
+    CPPUNIT_ASSERT(slice->GetNormalizationStrategy() == m2::NormalizationStrategyType::None);
+    CPPUNIT_ASSERT(slice->GetSmoothingStrategy() == m2::SmoothingType::Gaussian);
+    CPPUNIT_ASSERT_EQUAL(3u, slice->GetSmoothingHalfWindowSize());
+    CPPUNIT_ASSERT(slice->GetIntensityTransformationStrategy() == m2::IntensityTransformationType::SquareRoot);
+
+    // ion images of the slice with the settings of the stack
+    slice->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    slice->SetSmoothingStrategy(m2::SmoothingType::None);
+    slice->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    const auto dims = slice->GetDimensions();
+    const size_t sliceN = size_t(dims[0]) * dims[1];
+    std::vector<float> expected(K * sliceN);
+    mitk::Image::Pointer ionImage = slice->mitk::Image::Clone();
+    for (size_t k = 0; k < K; ++k)
+    {
+      const auto x = intervals->GetIntervals()[k].x.mean();
+      slice->GetImage(x, stack->ApplyTolerance(x), slice->GetMaskImage(), ionImage);
+      mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(ionImage);
+      std::copy(acc.GetData(), acc.GetData() + sliceN, expected.begin() + k * sliceN);
+    }
+
+    auto w = mitk::IOUtil::Load(path);
+    m2::ImzMLSpectrumImage::Pointer result = dynamic_cast<m2::ImzMLSpectrumImage *>(w.back().GetPointer());
+    CPPUNIT_ASSERT(result != nullptr);
+    result->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    result->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    result->SetSmoothingStrategy(m2::SmoothingType::None);
+    result->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    result->InitializeImageAccess();
+    CPPUNIT_ASSERT_EQUAL(2u, result->GetDimensions()[2]);
+
+    // both slices hold every spectrum of the slice image
+    std::vector<size_t> perSlice(2, 0);
+    std::vector<float> xs, ys;
+    for (unsigned int i = 0; i < result->GetSpectra().size(); ++i)
+    {
+      const auto &index = result->GetSpectra()[i].index;
+      CPPUNIT_ASSERT(index[2] == 0 || index[2] == 1);
+      ++perSlice[index[2]];
+
+      result->GetSpectrumFloat(i, xs, ys);
+      CPPUNIT_ASSERT_EQUAL(K, ys.size());
+      for (size_t k = 0; k < K; ++k)
+      {
+        CPPUNIT_ASSERT_EQUAL(float(intervals->GetIntervals()[k].x.mean()), xs[k]);
+        CPPUNIT_ASSERT_EQUAL(expected[k * sliceN + index[1] * dims[0] + index[0]], ys[k]);
+      }
+    }
+    CPPUNIT_ASSERT_EQUAL(slice->GetSpectra().size(), perSlice[0]);
+    CPPUNIT_ASSERT_EQUAL(slice->GetSpectra().size(), perSlice[1]);
+
+    w.clear();
+    result = nullptr;
+    SystemTools::RemoveADirectory(tmpDir);
+  }
 };
 
 MITK_TEST_SUITE_REGISTRATION(m2ImzMLImageIO)
@@ -0,0 +1,110 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <cppunit/TestAssert.h>
+#include <cstdint>
+#include <fstream>
+#include <m2IntervalTable.h>
+#include <m2IntervalVector.h>
+#include <m2TestFixture.h>
+#include <mitkExceptionMacro.h>
+#include <mitkIOUtil.h>
+#include <mitkTestingMacros.h>
+#include <itksys/SystemTools.hxx>
+
+class m2IntervalTableTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2IntervalTableTestSuite);
+  MITK_TEST(WriteRead_IntervalVector_ColumnsEqual);
+  MITK_TEST(Open_CorruptedDescriptions_Throws);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void WriteRead_IntervalVector_ColumnsEqual()
+  {
+    auto source = m2::IntervalVector::New();
+    source->SetType(m2::SpectrumFormat::ProcessedCentroid);
+    source->SetInfo("overview.centroids");
+    source->SetNumberOfSourcePixels(7);
+    for (unsigned int i = 0; i < 1000; ++i)
+    {
+      m2::Interval I(400 + i * 0.1, i % 13, i % 5);
+      I.x.add(400 + i * 0.1 + 0.002);
+      if (i % 10 == 0)
+        I.description = "peak " + std::to_string(i);
+      source->GetIntervals().push_back(I);
+    }
+
+    const auto path = mitk::IOUtil::CreateTemporaryFile("intervals_XXXXXX.m2intervals");
+    mitk::IOUtil::Save(source, path);
+
+    auto data = mitk::IOUtil::Load(path);
+    auto target = dynamic_cast<m2::IntervalVector *>(data.at(0).GetPointer());
+    CPPUNIT_ASSERT(target);
+    CPPUNIT_ASSERT(target->GetTable());
+    CPPUNIT_ASSERT_EQUAL(std::size_t(1000), target->GetNumberOfIntervals());
+    CPPUNIT_ASSERT_EQUAL(source->GetInfo(), target->GetInfo());
+    CPPUNIT_ASSERT_EQUAL(7u, target->GetNumberOfSourcePixels());
+
+    // column access without materialization
+    CPPUNIT_ASSERT(source->GetXMean() == target->GetXMean());
+    CPPUNIT_ASSERT(source->GetYMax() == target->GetYMax());
+    CPPUNIT_ASSERT(source->GetXCount() == target->GetXCount());
+
+    const auto &intervals = target->GetIntervals();
+    CPPUNIT_ASSERT(!target->GetTable());
+    for (std::size_t i = 0; i < intervals.size(); ++i)
+    {
+      CPPUNIT_ASSERT_EQUAL(source->GetIntervals()[i].sourceId, intervals[i].sourceId);
+      CPPUNIT_ASSERT_EQUAL(source->GetIntervals()[i].description, intervals[i].description);
+    }
+
+    data.clear();
+    itksys::SystemTools::RemoveFile(path);
+  }
+
+  void Open_CorruptedDescriptions_Throws()
+  {
+    std::vector<m2::Interval> intervals;
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+      intervals.emplace_back(400 + i, 1);
+      intervals.back().description = "peak " + std::to_string(i);
+    }
+    const auto path = mitk::IOUtil::CreateTemporaryFile("intervals_XXXXXX.m2intervals");
+    m2::IntervalTable::Write(path, intervals, m2::SpectrumFormat::Centroid, "", 1);
+    CPPUNIT_ASSERT_EQUAL(std::string("peak 9"), m2::IntervalTable::Open(path)->GetDescription(9));
+
+    // the description bytes of the header (offset 40) no longer end at the last description offset
+    {
+      std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+      std::uint64_t descriptionBytes;
+      f.seekg(40);
+      f.read(reinterpret_cast<char *>(&descriptionBytes), sizeof(descriptionBytes));
+      ++descriptionBytes;
+      f.seekp(40);
+      f.write(reinterpret_cast<const char *>(&descriptionBytes), sizeof(descriptionBytes));
+      f.seekp(0, std::ios::end);
+      f.put(0);
+    }
+    CPPUNIT_ASSERT_THROW(m2::IntervalTable::Open(path), mitk::Exception);
+
+    itksys::SystemTools::RemoveFile(path);
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2IntervalTable)
@@ -0,0 +1,253 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cppunit/TestAssert.h>
+#include <m2IonImageScheduler.h>
+#include <m2SpectrumImage.h>
+#include <m2TestFixture.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkImagePixelWriteAccessor.h>
+#include <mitkTestingMacros.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  // Spectrum image whose ion image requests block until they are released or cancelled.
+  // A request zero-fills the image first (like a partially generated image) and fills it with x on success.
+  class BlockingSpectrumImage final : public m2::SpectrumImage
+  {
+  public:
+    mitkClassMacro(BlockingSpectrumImage, m2::SpectrumImage);
+    itkFactorylessNewMacro(Self);
+
+    bool TryGetImage(double x, double, const mitk::Image *, mitk::Image *img, const std::atomic<bool> &cancelled) const override
+    {
+      Fill(img, 0);
+      {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Requests.push_back(x);
+      }
+      m_Started.notify_all();
+
+      while (!cancelled && !m_Released)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      if (cancelled)
+        return false;
+
+      Fill(img, x);
+      return true;
+    }
+
+    void Release() { m_Released = true; }
+
+    /// @brief Blocks until n requests were started, returns false on timeout.
+    bool WaitForRequests(std::size_t n) const
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      return m_Started.wait_for(lock, std::chrono::seconds(10), [&]() { return m_Requests.size() >= n; });
+    }
+
+    std::vector<double> GetRequests() const
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      return m_Requests;
+    }
+
+    static void Fill(mitk::Image *img, m2::DisplayImagePixelType value)
+    {
+      mitk::ImagePixelWriteAccessor<m2::DisplayImagePixelType, 3> acc(img);
+      const auto *dims = img->GetDimensions();
+      std::fill(acc.GetData(), acc.GetData() + dims[0] * dims[1] * dims[2], value);
+    }
+
+    void InitializeProcessor() override {}
+    void InitializeGeometry() override {}
+    void InitializeImageAccess() override {}
+    void InitializeNormalizationImage(m2::NormalizationStrategyType) override {}
+    void GetSpectrumFloat(unsigned int, std::vector<float> &, std::vector<float> &) const override {}
+    void GetSpectrum(unsigned int, std::vector<double> &, std::vector<double> &) const override {}
+    void GetIntensitiesFloat(unsigned int, std::vector<float> &) const override {}
+    void GetIntensities(unsigned int, std::vector<double> &) const override {}
+
+  private:
+    mutable std::mutex m_Mutex;
+    mutable std::condition_variable m_Started;
+    mutable std::vector<double> m_Requests;
+    std::atomic<bool> m_Released{false};
+  };
+} // namespace
+
+class m2IonImageSchedulerTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2IonImageSchedulerTestSuite);
+  MITK_TEST(Submit_SupersedesPendingAndCancelsRunning);
+  MITK_TEST(Submit_CoalescesEqualRequests);
+  MITK_TEST(CancelAll_KeepsTarget);
+  MITK_TEST(Wait_ReturnsWhenIdle);
+  MITK_TEST(Destructor_CancelsRequests);
+  CPPUNIT_TEST_SUITE_END();
+
+private:
+  static mitk::Image::Pointer MakeTarget(m2::DisplayImagePixelType value)
+  {
+    unsigned int dims[3] = {3, 2, 1};
+    auto target = mitk::Image::New();
+    target->Initialize(mitk::MakeScalarPixelType<m2::DisplayImagePixelType>(), 3, dims);
+    BlockingSpectrumImage::Fill(target, value);
+    return target;
+  }
+
+  static void AssertTarget(mitk::Image *target, m2::DisplayImagePixelType value)
+  {
+    mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(target);
+    for (unsigned int i = 0; i < 6; ++i)
+      CPPUNIT_ASSERT_EQUAL(value, acc.GetData()[i]);
+  }
+
+  static bool Get(const std::shared_future<bool> &future)
+  {
+    CPPUNIT_ASSERT(future.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    return future.get();
+  }
+
+public:
+  void Submit_SupersedesPendingAndCancelsRunning()
+  {
+    auto image = BlockingSpectrumImage::New();
+    auto target = MakeTarget(7);
+    m2::IonImageScheduler scheduler;
+
+    auto running = scheduler.Submit(image, 1, 0.1, nullptr, target);
+    CPPUNIT_ASSERT(image->WaitForRequests(1));
+    auto superseded = scheduler.Submit(image, 2, 0.1, nullptr, target);
+    auto latest = scheduler.Submit(image, 3, 0.1, nullptr, target);
+
+    CPPUNIT_ASSERT(!Get(superseded));
+    CPPUNIT_ASSERT(!Get(running));
+    image->Release();
+    CPPUNIT_ASSERT(Get(latest));
+
+    CPPUNIT_ASSERT(image->GetRequests() == std::vector<double>({1, 3}));
+    AssertTarget(target, 3);
+  }
+
+  void Submit_CoalescesEqualRequests()
+  {
+    auto a = BlockingSpectrumImage::New();
+    auto b = BlockingSpectrumImage::New();
+    auto targetA = MakeTarget(0);
+    auto targetB = MakeTarget(0);
+    m2::IonImageScheduler scheduler;
+
+    std::atomic<unsigned int> callbacks{0};
+    const auto onFinished = [&callbacks](bool generated)
+    {
+      if (generated)
+        ++callbacks;
+    };
+
+    // equal to the running request
+    auto runningA = scheduler.Submit(a, 1, 0.1, nullptr, targetA, onFinished);
+    CPPUNIT_ASSERT(a->WaitForRequests(1));
+    auto coalescedA = scheduler.Submit(a, 1, 0.1, nullptr, targetA, onFinished);
+
+    // equal to the pending request
+    auto pendingB = scheduler.Submit(b, 2, 0.1, nullptr, targetB, onFinished);
+    auto coalescedB = scheduler.Submit(b, 2, 0.1, nullptr, targetB, onFinished);
+
+    a->Release();
+    b->Release();
+    CPPUNIT_ASSERT(Get(runningA) && Get(coalescedA) && Get(pendingB) && Get(coalescedB));
+    scheduler.Wait();
+
+    CPPUNIT_ASSERT_EQUAL(4u, callbacks.load());
+    CPPUNIT_ASSERT(a->GetRequests() == std::vector<double>({1}));
+    CPPUNIT_ASSERT(b->GetRequests() == std::vector<double>({2}));
+    AssertTarget(targetA, 1);
+    AssertTarget(targetB, 2);
+  }
+
+  void CancelAll_KeepsTarget()
+  {
+    auto a = BlockingSpectrumImage::New();
+    auto b = BlockingSpectrumImage::New();
+    auto targetA = MakeTarget(7);
+    auto targetB = MakeTarget(7);
+    m2::IonImageScheduler scheduler;
+
+    auto running = scheduler.Submit(a, 1, 0.1, nullptr, targetA);
+    CPPUNIT_ASSERT(a->WaitForRequests(1));
+    auto pending = scheduler.Submit(b, 2, 0.1, nullptr, targetB);
+
+    scheduler.CancelAll();
+    CPPUNIT_ASSERT(!Get(pending));
+    CPPUNIT_ASSERT(!Get(running));
+    scheduler.Wait();
+
+    // the cancelled request zero-filled its scratch image only
+    CPPUNIT_ASSERT(b->GetRequests().empty());
+    AssertTarget(targetA, 7);
+    AssertTarget(targetB, 7);
+  }
+
+  void Wait_ReturnsWhenIdle()
+  {
+    auto image = BlockingSpectrumImage::New();
+    auto target = MakeTarget(0);
+    m2::IonImageScheduler scheduler;
+
+    auto future = scheduler.Submit(image, 5, 0.1, nullptr, target);
+    CPPUNIT_ASSERT(image->WaitForRequests(1));
+    std::thread release([&image]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      image->Release();
+    });
+    scheduler.Wait();
+    release.join();
+
+    CPPUNIT_ASSERT(future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    CPPUNIT_ASSERT(future.get());
+    AssertTarget(target, 5);
+  }
+
+  void Destructor_CancelsRequests()
+  {
+    auto a = BlockingSpectrumImage::New();
+    auto b = BlockingSpectrumImage::New();
+    auto targetA = MakeTarget(7);
+    auto targetB = MakeTarget(7);
+    std::shared_future<bool> running, pending;
+    {
+      m2::IonImageScheduler scheduler;
+      running = scheduler.Submit(a, 1, 0.1, nullptr, targetA);
+      CPPUNIT_ASSERT(a->WaitForRequests(1));
+      pending = scheduler.Submit(b, 2, 0.1, nullptr, targetB);
+    }
+
+    CPPUNIT_ASSERT(!Get(running));
+    CPPUNIT_ASSERT(!Get(pending));
+    CPPUNIT_ASSERT(b->GetRequests().empty());
+    AssertTarget(targetA, 7);
+    AssertTarget(targetB, 7);
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2IonImageScheduler)
@@ -0,0 +1,73 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <cppunit/TestAssert.h>
+#include <m2TestFixture.h>
+#include <mitkTestingMacros.h>
+#include <random>
+#include <signal/m2Normalization.h>
+#include <vector>
+
+class m2NormalizationTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2NormalizationTestSuite);
+  MITK_TEST(GetNormalizationFactors_EqualGetNormalizationFactor);
+  MITK_TEST(GetNormalizationFactors_EmptySpectrumIsOne);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void GetNormalizationFactors_EqualGetNormalizationFactor()
+  {
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> intensity(0, 1000);
+    std::uniform_real_distribution<double> step(1e-3, 0.1);
+
+    for (const std::size_t n : {1, 2, 3, 64, 1001})
+    {
+      std::vector<double> xs(n);
+      std::vector<float> ys(n);
+      double x = 100;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        xs[i] = (x += step(gen));
+        ys[i] = intensity(gen);
+      }
+
+      const auto factors = m2::Signal::GetNormalizationFactors(xs.begin(), xs.end(), ys.begin(), ys.end());
+      const auto &types = m2::Signal::SpectrumNormalizationStrategyTypeList;
+      for (std::size_t t = 0; t < types.size(); ++t)
+      {
+        const auto expected = m2::Signal::GetNormalizationFactor(types[t], xs.begin(), xs.end(), ys.begin(), ys.end());
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, factors[t], 1e-9 * std::max(1.0, std::abs(expected)));
+      }
+    }
+  }
+
+  void GetNormalizationFactors_EmptySpectrumIsOne()
+  {
+    const std::vector<double> xs;
+    const std::vector<float> ys;
+    const auto factors = m2::Signal::GetNormalizationFactors(xs.begin(), xs.end(), ys.begin(), ys.end());
+    const auto &types = m2::Signal::SpectrumNormalizationStrategyTypeList;
+    for (std::size_t t = 0; t < types.size(); ++t)
+    {
+      CPPUNIT_ASSERT_EQUAL(1.0, factors[t]);
+      CPPUNIT_ASSERT_EQUAL(1.0, m2::Signal::GetNormalizationFactor(types[t], xs.begin(), xs.end(), ys.begin(), ys.end()));
+    }
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2Normalization)
@@ -0,0 +1,140 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <cppunit/TestAssert.h>
+#include <fstream>
+#include <itksys/SystemTools.hxx>
+#include <m2ImzMLSpectrumImage.h>
+#include <m2IntervalVector.h>
+#include <m2NpyExport.h>
+#include <m2TestFixture.h>
+#include <m2TestingConfig.h>
+#include <mitkIOUtil.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkImagePixelWriteAccessor.h>
+#include <mitkLabelSetImage.h>
+#include <mitkTestingMacros.h>
+#include <npy/npy.hpp>
+#include <numeric>
+
+class m2NpyExportTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2NpyExportTestSuite);
+  MITK_TEST(Write_lipid_LoadedArraysEqualIonImages);
+  MITK_TEST(Write_EmptyMask_Throws);
+  CPPUNIT_TEST_SUITE_END();
+
+private:
+  m2::ImzMLSpectrumImage::Pointer m_Image;
+  m2::IntervalVector::Pointer m_Features;
+  std::string m_TmpDir;
+
+public:
+  void setUp() override
+  {
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m_Image = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    CPPUNIT_ASSERT(m_Image != nullptr);
+    m_Image->SetNormalizationStrategy(m2::NormalizationStrategyType::None);
+    m_Image->SetBaselineCorrectionStrategy(m2::BaselineCorrectionType::None);
+    m_Image->SetSmoothingStrategy(m2::SmoothingType::None);
+    m_Image->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+    m_Image->SetImageNormalizationStrategy(m2::ImageNormalizationStrategyType::None);
+    m_Image->SetRangePoolingStrategy(m2::RangePoolingStrategyType::Maximum);
+    m_Image->InitializeImageAccess();
+
+    m_Features = m2::IntervalVector::New();
+    for (const auto x : {m_Image->GetXMin() + 1, (m_Image->GetXMin() + m_Image->GetXMax()) / 2, m_Image->GetXMax() - 1})
+      m_Features->GetIntervals().emplace_back(x, 0);
+
+    m_TmpDir = mitk::IOUtil::CreateTemporaryDirectory("m2aia-npy-XXXXXX");
+  }
+
+  void tearDown() override
+  {
+    m_Image = nullptr;
+    m_Features = nullptr;
+    itksys::SystemTools::RemoveADirectory(m_TmpDir);
+  }
+
+  void Write_lipid_LoadedArraysEqualIonImages()
+  {
+    const auto path = m_TmpDir + "/lipid.npy";
+    m2::NpyExport::Write(path, m_Image, m_Features);
+
+    // header of the memory mapped matrix
+    {
+      std::ifstream f(path, std::ios::binary);
+      const auto header = npy::parse_header(npy::read_header(f));
+      CPPUNIT_ASSERT(!header.fortran_order);
+      CPPUNIT_ASSERT(header.dtype.tie() == npy::dtype_map.at(std::type_index(typeid(float))).tie());
+    }
+
+    std::vector<unsigned long> shape;
+    std::vector<float> matrix;
+    npy::LoadArrayFromNumpy(path, shape, matrix);
+    std::vector<unsigned long> coordinatesShape;
+    std::vector<int> coordinates;
+    npy::LoadArrayFromNumpy(m_TmpDir + "/lipid_coordinates.npy", coordinatesShape, coordinates);
+    std::vector<unsigned long> featuresShape;
+    std::vector<double> features;
+    npy::LoadArrayFromNumpy(m_TmpDir + "/lipid_features.npy", featuresShape, features);
+    std::vector<unsigned long> maskShape;
+    std::vector<mitk::LabelSetImage::PixelType> mask;
+    npy::LoadArrayFromNumpy(m_TmpDir + "/lipid_mask.npy", maskShape, mask);
+
+    const auto *dims = m_Image->GetDimensions();
+    const auto N = std::size_t(dims[0]) * dims[1] * dims[2];
+    const auto centers = m_Features->GetXMean();
+    mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3> maskAccess(m_Image->GetMaskImage());
+    const auto rows = std::size_t(std::count_if(maskAccess.GetData(), maskAccess.GetData() + N, [](auto v) { return v != 0; }));
+
+    CPPUNIT_ASSERT(shape == std::vector<unsigned long>({rows, centers.size()}));
+    CPPUNIT_ASSERT(coordinatesShape == std::vector<unsigned long>({rows, 3}));
+    CPPUNIT_ASSERT(featuresShape == std::vector<unsigned long>({centers.size()}));
+    CPPUNIT_ASSERT(maskShape == std::vector<unsigned long>({dims[2], dims[1], dims[0]}));
+    CPPUNIT_ASSERT(features == centers);
+    CPPUNIT_ASSERT(std::equal(mask.begin(), mask.end(), maskAccess.GetData()));
+
+    // column j equals the ion image of feature j at the row's pixel
+    mitk::Image::Pointer ionImage = m_Image->mitk::Image::Clone();
+    for (std::size_t j = 0; j < centers.size(); ++j)
+    {
+      m_Image->GetImage(centers[j], m_Image->ApplyTolerance(centers[j]), m_Image->GetMaskImage(), ionImage);
+      mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(ionImage);
+      for (std::size_t r = 0; r < rows; ++r)
+      {
+        const itk::Index<3> index = {{coordinates[3 * r], coordinates[3 * r + 1], coordinates[3 * r + 2]}};
+        CPPUNIT_ASSERT(maskAccess.GetPixelByIndex(index) != 0);
+        const auto expected = acc.GetPixelByIndex(index);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, matrix[r * centers.size() + j], 1e-5 * std::max(1.0f, std::abs(expected)));
+      }
+    }
+  }
+
+  void Write_EmptyMask_Throws()
+  {
+    {
+      mitk::ImagePixelWriteAccessor<mitk::LabelSetImage::PixelType, 3> acc(m_Image->GetMaskImage());
+      const auto *dims = m_Image->GetDimensions();
+      std::fill(acc.GetData(), acc.GetData() + std::size_t(dims[0]) * dims[1] * dims[2], 0);
+    }
+    CPPUNIT_ASSERT_THROW(m2::NpyExport::Write(m_TmpDir + "/empty.npy", m_Image, m_Features), mitk::Exception);
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2NpyExport)
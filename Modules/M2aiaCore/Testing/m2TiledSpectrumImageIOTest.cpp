@@ -0,0 +1,144 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <cppunit/TestAssert.h>
+#include <itksys/SystemTools.hxx>
+#include <m2ImzMLSpectrumImage.h>
+#include <m2TestFixture.h>
+#include <m2TestingConfig.h>
+#include <m2TiledSpectrumImage.h>
+#include <m2TiledSpectrumStore.h>
+#include <mitkIOUtil.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkTestingMacros.h>
+#include <numeric>
+
+class m2TiledSpectrumImageIOTestSuite : public m2::TestFixture
+{
+  CPPUNIT_TEST_SUITE(m2TiledSpectrumImageIOTestSuite);
+  MITK_TEST(WriteRead_lipid_RawIntensitiesEqual);
+  MITK_TEST(WriteRead_lipid_ProcessedSpectraAndImagesEqual);
+
+  CPPUNIT_TEST_SUITE_END();
+
+private:
+  m2::ImzMLSpectrumImage::Pointer m_Source;
+  m2::TiledSpectrumImage::Pointer m_Target;
+  std::string m_Path;
+
+  static void SetProcessing(m2::SpectrumImage *image,
+                            m2::NormalizationStrategyType normalization,
+                            m2::SmoothingType smoothing,
+                            m2::BaselineCorrectionType baseline)
+  {
+    image->SetNormalizationStrategy(normalization);
+    image->SetSmoothingStrategy(smoothing);
+    image->SetSmoothingHalfWindowSize(2);
+    image->SetBaselineCorrectionStrategy(baseline);
+    image->SetBaseLineCorrectionHalfWindowSize(10);
+    image->SetIntensityTransformationStrategy(m2::IntensityTransformationType::None);
+  }
+
+  static void AssertClose(double expected, double actual)
+  {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, actual, 1e-4 * std::max(1.0, std::abs(expected)));
+  }
+
+public:
+  void setUp() override
+  {
+    auto v = mitk::IOUtil::Load(GetTestDataFilePath("lipid.imzML", M2AIA_DATA_DIR));
+    m_Source = dynamic_cast<m2::ImzMLSpectrumImage *>(v.back().GetPointer());
+    CPPUNIT_ASSERT(m_Source != nullptr);
+
+    // the store is written from a processed image, it has to keep the raw values
+    SetProcessing(m_Source, m2::NormalizationStrategyType::TIC, m2::SmoothingType::Gaussian, m2::BaselineCorrectionType::TopHat);
+    m_Source->InitializeImageAccess();
+
+    m_Path = mitk::IOUtil::CreateTemporaryFile("lipid_XXXXXX.m2tiles");
+    m2::TiledSpectrumStore::Write(m_Path, m_Source);
+
+    auto w = mitk::IOUtil::Load(m_Path);
+    m_Target = dynamic_cast<m2::TiledSpectrumImage *>(w.back().GetPointer());
+    CPPUNIT_ASSERT(m_Target != nullptr);
+  }
+
+  void tearDown() override
+  {
+    m_Source = nullptr;
+    m_Target = nullptr;
+    itksys::SystemTools::RemoveFile(m_Path);
+  }
+
+  void WriteRead_lipid_RawIntensitiesEqual()
+  {
+    SetProcessing(m_Target, m2::NormalizationStrategyType::None, m2::SmoothingType::None, m2::BaselineCorrectionType::None);
+    m_Target->InitializeImageAccess();
+
+    const auto N = m_Source->GetSpectra().size();
+    CPPUNIT_ASSERT_EQUAL(N, m_Target->GetStore()->GetSpectra().size());
+
+    std::vector<double> xs, txs;
+    std::vector<float> ys;
+    std::vector<double> tys;
+    for (unsigned int i = 0; i < N; ++i)
+    {
+      m_Source->GetXValues(i, xs);
+      m_Source->GetRawIntensitiesFloat(i, ys);
+      m_Target->GetSpectrum(i, txs, tys);
+      CPPUNIT_ASSERT(xs == txs);
+      CPPUNIT_ASSERT_EQUAL(ys.size(), tys.size());
+      for (size_t k = 0; k < ys.size(); ++k)
+        CPPUNIT_ASSERT_EQUAL(double(ys[k]), tys[k]);
+    }
+  }
+
+  void WriteRead_lipid_ProcessedSpectraAndImagesEqual()
+  {
+    SetProcessing(m_Target, m2::NormalizationStrategyType::TIC, m2::SmoothingType::Gaussian, m2::BaselineCorrectionType::TopHat);
+    m_Target->InitializeImageAccess();
+
+    std::vector<float> xs, ys, txs, tys;
+    for (unsigned int i = 0; i < m_Source->GetSpectra().size(); i += 7)
+    {
+      m_Source->GetSpectrumFloat(i, xs, ys);
+      m_Target->GetSpectrumFloat(i, txs, tys);
+      CPPUNIT_ASSERT(xs == txs);
+      CPPUNIT_ASSERT_EQUAL(ys.size(), tys.size());
+      for (size_t k = 0; k < ys.size(); ++k)
+        AssertClose(ys[k], tys[k]);
+    }
+
+    // ion images with kernel based processing differ at the range borders (see GetImagesPrivate)
+    for (m2::SpectrumImage *image : {static_cast<m2::SpectrumImage *>(m_Source), static_cast<m2::SpectrumImage *>(m_Target)})
+      SetProcessing(image, m2::NormalizationStrategyType::TIC, m2::SmoothingType::None, m2::BaselineCorrectionType::None);
+
+    const auto N = std::accumulate(m_Source->GetDimensions(), m_Source->GetDimensions() + 3, size_t(1), std::multiplies<size_t>());
+    mitk::Image::Pointer a = m_Source->mitk::Image::Clone();
+    mitk::Image::Pointer b = m_Target->mitk::Image::Clone();
+    for (const auto x : {m_Source->GetXMin() + 1, (m_Source->GetXMin() + m_Source->GetXMax()) / 2})
+    {
+      const auto tol = m_Source->ApplyTolerance(x);
+      m_Source->GetImage(x, tol, nullptr, a);
+      m_Target->GetImage(x, tol, nullptr, b);
+      mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> accA(a), accB(b);
+      for (size_t i = 0; i < N; ++i)
+        AssertClose(accA.GetData()[i], accB.GetData()[i]);
+    }
+  }
+};
+
+MITK_TEST_SUITE_REGISTRATION(m2TiledSpectrumImageIO)
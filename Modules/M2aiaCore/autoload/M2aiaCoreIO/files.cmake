@@ -3,6 +3,7 @@ set(CPP_FILES
   m2OpenSlideIO.cpp
   m2FSMImageIO.cpp
   m2IntervalVectorIO.cpp
+  m2IntervalTableIO.cpp
   m2MicroscopyTiffImageIO.cpp
 )
 
@@ -27,6 +27,8 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 #include <m2ImzMLImageIO.h>
 #include <m2OpenSlideIO.h>
 #include <m2IntervalVectorIO.h>
+#include <m2IntervalTableIO.h>
+#include <m2TiledSpectrumImageIO.h>
 namespace m2
 {
   /**
@@ -45,6 +47,8 @@ namespace m2
       m_FileIOs.push_back(new FSMImageIO());
       m_FileIOs.push_back(new MicroscopyTiffImageIO());
       m_FileIOs.push_back(new IntervalVectorIO());
+      m_FileIOs.push_back(new IntervalTableIO());
+      m_FileIOs.push_back(new TiledSpectrumImageIO());
     }
     void Unload(us::ModuleContext *) override
     {
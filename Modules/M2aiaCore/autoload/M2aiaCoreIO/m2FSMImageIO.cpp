@@ -32,13 +32,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 ===================================================================*/
 
+#include <algorithm>
 #include <functional>
 #include <itkOpenSlideImageIO.h>
 #include <itksys/SystemTools.hxx>
 #include <m2FSMImageIO.h>
 #include <m2SpectrumContainerImage.h>
 #include <map>
+#include <mitkCoreServices.h>
 #include <mitkIOUtil.h>
+#include <mitkIPreferences.h>
+#include <mitkIPreferencesService.h>
 #include <mitkImageCast.h>
 
 namespace m2
@@ -140,7 +144,14 @@ namespace m2
                                                   "background_scans",
                                                   "ir_laser_wave_number_unit"};
 
-    std::vector<std::vector<float>> spectraDataVectors;
+    // spectra (data blocks) are streamed into the preallocated intensity matrix of the image,
+    // the sum spectrum is accumulated on the fly
+    auto fsmImage = m2::SpectrumContainerImage::New();
+    bool headerRead = false;
+    bool inverse = false;
+    std::size_t numberOfSpectra = 0;
+    std::size_t maxNumberOfSpectra = 0;
+    std::vector<double> sum;
 
     auto fsize = inFile.tellg();
     inFile.seekg(0, std::ios::end);
@@ -158,8 +169,40 @@ namespace m2
       if (!inFile)
         break;
 
+      if (block_id == 5105)
+      {
+        if (!headerRead)
+          mitkThrow() << "FSM spectrum data block found before the image header block.";
+
+        const std::size_t channels = block_size / sizeof(float);
+        if (numberOfSpectra == 0)
+        {
+          maxNumberOfSpectra = std::size_t(dimensions[0]) * std::size_t(dimensions[1]);
+          fsmImage->AllocateSpectralData(maxNumberOfSpectra, channels);
+          sum.assign(channels, 0);
+        }
+        else if (channels != fsmImage->GetNumberOfChannels())
+          mitkThrow() << "FSM spectrum data blocks differ in size (" << channels << " and "
+                      << fsmImage->GetNumberOfChannels() << " values).";
+        if (numberOfSpectra == maxNumberOfSpectra)
+          mitkThrow() << "FSM file contains more spectra than pixels (" << maxNumberOfSpectra << ").";
+
+        auto *ys = fsmImage->GetSpectrumData(numberOfSpectra);
+        inFile.seekg(start_byte);
+        inFile.read(reinterpret_cast<char *>(ys), channels * sizeof(float));
+        start_byte += n_bytes;
+        if (!inFile)
+          break;
+
+        if (inverse)
+          std::reverse(ys, ys + channels);
+        for (std::size_t c = 0; c < channels; ++c)
+          sum[c] += ys[c];
+        ++numberOfSpectra;
+        continue;
+      }
+
       start_byte += read(start_byte, n_bytes, s);
-      std::vector<float> data;
 
       switch (block_id)
       {
@@ -190,6 +233,9 @@ namespace m2
           Print(meta_names, meta);
           Print(dimension_names, dimensions);
           Print(residual_names, residuals);
+
+          headerRead = true;
+          inverse = meta[3] > meta[4]; // z_start > z_end
         }
         break;
         case 5104:
@@ -235,17 +281,16 @@ namespace m2
           Print(information_names, information);
         }
         break;
-        case 5105:
-          data.resize(s.size() / sizeof(float));
-          memcpy(data.data(), s.data(), s.size());
-          spectraDataVectors.push_back(data);
-          break;
         default:
           break;
       }
     }
 
-    auto fsmImage = m2::SpectrumContainerImage::New();
+    if (numberOfSpectra == 0)
+      mitkThrow() << "FSM file contains no spectra: " << this->GetInputLocation();
+    if (numberOfSpectra < maxNumberOfSpectra)
+      fsmImage->ResizeSpectralData(numberOfSpectra);
+
     fsmImage->SetPropertyValue<unsigned>("dim_x", dimensions[0]); // n_x
     fsmImage->SetPropertyValue<unsigned>("dim_y", dimensions[1]); // n_z
     fsmImage->SetPropertyValue<unsigned>("dim_z", 1);
@@ -265,8 +310,6 @@ namespace m2
     auto start = meta[3];
     auto end = meta[4];
 
-    bool inverse = start > end;
-
     if (inverse)
       std::swap(start, end);
 
@@ -280,37 +323,32 @@ namespace m2
 
     fsmImage->InitializeGeometry();
 
-    itk::Image<m2::DisplayImagePixelType, 3>::Pointer ionImage;
-    mitk::CastToItkImage(fsmImage, ionImage);
-
-    auto sit = spectraDataVectors.begin();
-    itk::ImageRegionIteratorWithIndex<itk::Image<m2::DisplayImagePixelType, 3>> it(
-      ionImage, ionImage->GetLargestPossibleRegion());
-
-    unsigned long i = 0;
-    while (!it.IsAtEnd())
+    // spectra are stored in image order (x fastest)
+    auto &spectra = fsmImage->GetSpectra();
+    spectra.resize(numberOfSpectra);
+    const auto nx = std::size_t(dimensions[0]);
+    const auto ny = std::size_t(dimensions[1]);
+    for (std::size_t i = 0; i < numberOfSpectra; ++i)
     {
-      m2::SpectrumContainerImage::SpectrumData spectrum;
-      spectrum.data.resize(spectraDataVectors.front().size(), 0);
-
-      if (inverse)
-      {
-        std::copy(std::rbegin(*sit), std::rend(*sit), std::begin(spectrum.data));
-      }
-      else
-      {
-        spectrum.data = std::move(*sit);
-      }
-
-      spectrum.id = i;
-      spectrum.index = it.GetIndex();
-      fsmImage->GetSpectra().emplace_back(spectrum);
-
-      ++i;
-      ++sit;
-      ++it;
+      spectra[i].id = i;
+      spectra[i].index = {{itk::IndexValueType(i % nx), itk::IndexValueType((i / nx) % ny), 0}};
     }
 
+    auto &sumSpectrum = fsmImage->GetSumSpectrum();
+    auto &meanSpectrum = fsmImage->GetMeanSpectrum();
+    sumSpectrum = sum;
+    meanSpectrum.resize(sum.size());
+    std::transform(std::begin(sum),
+                   std::end(sum),
+                   std::begin(meanSpectrum),
+                   [numberOfSpectra](double v) { return v / double(numberOfSpectra); });
+
+    // band images over large mosaics stream a wavenumber-major copy of the intensities
+    if (auto *preferencesService = mitk::CoreServices::GetPreferencesService())
+      if (auto *preferences = preferencesService->GetSystemPreferences())
+        if (preferences->GetBool("m2aia.spectra.wavenumber_major_copy", false))
+          fsmImage->SetImageLayout(m2::SpectrumContainerImage::SpectralDataLayout::ChannelMajor);
+
     LoadAssociatedData(fsmImage);
 
     return {fsmImage.GetPointer()};
@@ -0,0 +1,71 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+
+#include <m2IntervalTable.h>
+#include <m2IntervalTableIO.h>
+
+namespace m2
+{
+  IntervalTableIO::IntervalTableIO()
+    : AbstractFileIO(m2::IntervalVector::GetStaticNameOfClass(), INTERVALTABLE_MIMETYPE(), "Binary Centroid Data (M²aia)")
+  {
+    AbstractFileWriter::SetRanking(5);
+    AbstractFileReader::SetRanking(10);
+    this->RegisterService();
+  }
+
+  mitk::IFileIO::ConfidenceLevel IntervalTableIO::GetWriterConfidenceLevel() const
+  {
+    if (dynamic_cast<const m2::IntervalVector *>(this->GetInput()))
+      return Supported;
+    return Unsupported;
+  }
+
+  void IntervalTableIO::Write()
+  {
+    ValidateOutputLocation();
+    const auto *input = static_cast<const m2::IntervalVector *>(this->GetInput());
+
+    // a mapped table is written as is, otherwise the intervals are written column by column
+    if (auto table = input->GetTable())
+      table->Write(GetOutputLocation());
+    else
+      m2::IntervalTable::Write(GetOutputLocation(),
+                               input->GetIntervals(),
+                               input->GetType(),
+                               input->GetInfo(),
+                               input->GetNumberOfSourcePixels());
+  }
+
+  mitk::IFileIO::ConfidenceLevel IntervalTableIO::GetReaderConfidenceLevel() const
+  {
+    if (AbstractFileIO::GetReaderConfidenceLevel() == Unsupported)
+      return Unsupported;
+    return Supported;
+  }
+
+  std::vector<mitk::BaseData::Pointer> IntervalTableIO::DoRead()
+  {
+    auto table = m2::IntervalTable::Open(GetInputLocation());
+    auto data = m2::IntervalVector::New();
+    data->SetTable(table);
+    data->SetProperty("m2aia.helper.spectrum.xaxis.count", mitk::IntProperty::New(table->Size()));
+    MITK_INFO << "Read " << table->Size() << " intervals from " << GetInputLocation();
+    return {data.GetPointer()};
+  }
+
+  IntervalTableIO *IntervalTableIO::IOClone() const { return new IntervalTableIO(*this); }
+} // namespace m2
@@ -0,0 +1,63 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreIOExports.h>
+
+#include <mitkAbstractFileIO.h>
+#include <mitkIOMimeTypes.h>
+#include <m2IntervalVector.h>
+
+namespace m2
+{
+  /**
+   * Writes/Reads interval vectors in the binary columnar format (*.m2intervals, see m2::IntervalTable).
+   *
+   * Intended for large lists (e.g. pixel-wise peak picking). The file is memory mapped on
+   * reading and the interval vector references its columns until the intervals are accessed
+   * as objects.
+   */
+  class M2AIACOREIO_EXPORT IntervalTableIO : public mitk::AbstractFileIO
+  {
+  public:
+    IntervalTableIO();
+
+    std::string INTERVALTABLE_MIMETYPE_NAME()
+    {
+      static std::string name = mitk::IOMimeTypes::DEFAULT_BASE_NAME() + ".m2intervals";
+      return name;
+    }
+
+    mitk::CustomMimeType INTERVALTABLE_MIMETYPE()
+    {
+      mitk::CustomMimeType mimeType(INTERVALTABLE_MIMETYPE_NAME());
+      mimeType.AddExtension("m2intervals");
+      mimeType.SetCategory("Centroids");
+      mimeType.SetComment("Binary list of centroids");
+      return mimeType;
+    }
+
+    std::vector<mitk::BaseData::Pointer> DoRead() override;
+    ConfidenceLevel GetReaderConfidenceLevel() const override;
+
+    void Write() override;
+    ConfidenceLevel GetWriterConfidenceLevel() const override;
+
+  private:
+    IntervalTableIO *IOClone() const override;
+  };
+
+} // namespace m2
@@ -10,6 +10,18 @@ set(H_FILES
   include/m2ImzMLImageIO.h
   # include/m2ImzMLImage3DIO.h
   include/m2ImzMLEngine.h
+  include/m2BinaryDataCompression.h
+  include/m2HalfFloat.h
+  include/m2ImzMLBinaryDataWriter.h
+  include/m2ImzMLChannelCubeFile.h
+  include/m2CompactMzAxes.h
+  include/m2ImzMLIndexFile.h
+  include/m2ImzMLNormalizationFile.h
+  include/m2TiledSpectrumStore.h
+  include/m2TiledSpectrumImageIO.h
+  include/m2NpyExport.h
+  include/m2MemoryMappedFile.h
+  include/m2AlignedAllocator.h
   include/m2TestFixture.h
   include/m2SubdivideImage2DFilter.h
   include/m2ShiftMapImageFilter.h
@@ -23,7 +35,11 @@ set(H_FILES
   include/m2ImzMLSpectrumImage.h
   include/m2ImzMLSpectrumImageSource.hpp
   include/m2SpectrumContainerImage.h
+  include/m2TiledSpectrumImage.h
+  include/m2IonImageScheduler.h
+  include/m2IonImageCache.h
   include/m2IntervalVector.h
+  include/m2IntervalTable.h
   include/m2DataNodePredicates.h
   include/signal/m2Baseline.h
   include/signal/m2EstimateFwhm.h
@@ -49,6 +65,9 @@ set(CPP_FILES
   m2CoreObjectFactory.cpp 
   m2ImzMLSpectrumImage.cpp
   m2SpectrumContainerImage.cpp
+  m2TiledSpectrumImage.cpp
+  m2IonImageScheduler.cpp
+  m2IonImageCache.cpp
   m2SubdivideImage2DFilter.cpp
   m2SpectrumImageDataInteractor.cpp
   m2IntervalVector.cpp
@@ -59,6 +78,18 @@ set(CPP_FILES
   IO/m2ImzMLImageIO.cpp
   # IO/m2ImzMLImage3DIO.cpp
   IO/m2ImzMLEngine.cpp
+  IO/m2BinaryDataCompression.cpp
+  IO/m2HalfFloat.cpp
+  IO/m2ImzMLBinaryDataWriter.cpp
+  IO/m2ImzMLChannelCubeFile.cpp
+  IO/m2CompactMzAxes.cpp
+  IO/m2ImzMLIndexFile.cpp
+  IO/m2ImzMLNormalizationFile.cpp
+  IO/m2TiledSpectrumStore.cpp
+  IO/m2TiledSpectrumImageIO.cpp
+  IO/m2NpyExport.cpp
+  IO/m2IntervalTable.cpp
+  IO/m2MemoryMappedFile.cpp
   IO/m2PythonWrapper.cpp
 )
 
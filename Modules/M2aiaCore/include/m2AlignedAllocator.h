@@ -0,0 +1,70 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace m2
+{
+  /**
+   * @brief Allocator returning memory aligned to Alignment bytes (cache line by default),
+   * e.g. for large intensity matrices processed with vector instructions.
+   */
+  template <class T, std::size_t Alignment = 64>
+  struct AlignedAllocator
+  {
+    static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0,
+                  "Alignment must be a power of two and not weaker than alignof(T)");
+
+    using value_type = T;
+
+    template <class U>
+    struct rebind
+    {
+      using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+      return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T *p, std::size_t) noexcept { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template <class U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept
+    {
+      return true;
+    }
+    template <class U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept
+    {
+      return false;
+    }
+  };
+
+  template <class T, std::size_t Alignment = 64>
+  using AlignedVector = std::vector<T, AlignedAllocator<T, Alignment>>;
+
+} // namespace m2
@@ -0,0 +1,41 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstddef>
+#include <vector>
+
+namespace m2
+{
+  namespace Zlib
+  {
+    /**
+     * @brief Inflate a zlib stream (MS:1000574) into dest.
+     * Decompression stops as soon as destBytes are written, i.e. only the
+     * leading part of a binary data array is decompressed if dest is smaller
+     * than the complete array.
+     * @return false if the stream is corrupted or contains less than destBytes.
+     */
+    M2AIACORE_EXPORT bool Inflate(const char *src, std::size_t srcBytes, char *dest, std::size_t destBytes) noexcept;
+
+    /**
+     * @brief Deflate srcBytes into a zlib stream. The result replaces the content of dest.
+     * @return number of bytes of the compressed stream
+     */
+    M2AIACORE_EXPORT std::size_t Deflate(const char *src, std::size_t srcBytes, std::vector<char> &dest, int level = 6);
+  } // namespace Zlib
+} // namespace m2
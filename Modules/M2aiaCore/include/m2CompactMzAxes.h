@@ -0,0 +1,128 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace m2
+{
+  /**
+   * @class CompactMzAxes
+   * @brief In-memory copy of the m/z arrays of processed spectra.
+   *
+   * Values are held as integer keys on a global grid (GridSpacing) and delta coded
+   * (LEB128 varints). Every BlockSize values the absolute key is stored, so range queries
+   * decode at most one block. Spectra with identical m/z arrays share their encoding.
+   *
+   * Spectra whose m/z array is not ascending (or contains negative values) are not encoded,
+   * see Contains(). Neither are spectra whose distinct encoding would exceed the memory
+   * budget, their m/z arrays are read from disk.
+   */
+  class M2AIACORE_EXPORT CompactMzAxes
+  {
+  public:
+    static constexpr double GridSpacing = 1e-7;
+    static constexpr unsigned int BlockSize = 64;
+    static constexpr std::size_t DefaultMemoryBudget = std::size_t(1) << 30;
+
+    CompactMzAxes() = default;
+    explicit CompactMzAxes(std::size_t numberOfSpectra) { Resize(numberOfSpectra); }
+
+    void Resize(std::size_t numberOfSpectra);
+
+    /// @brief Upper bound of the bytes of distinct encodings, set before the first call of Set().
+    void SetMemoryBudget(std::size_t bytes) { m_MemoryBudget = bytes; }
+    std::size_t GetMemoryBudget() const { return m_MemoryBudget; }
+
+    /**
+     * @brief Encode the m/z array of spectrum id, identical encodings are stored once.
+     * Calls for distinct ids may run concurrently. Finalize() has to be called afterwards.
+     */
+    template <class MassAxisType>
+    void Set(std::size_t id, const MassAxisType *mzs, std::size_t n)
+    {
+      thread_local std::vector<std::uint64_t> keys;
+      keys.resize(n);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        const double v = mzs[i] / GridSpacing + 0.5;
+        if (!(v >= 0) || v >= 1.8e19 || (i > 0 && mzs[i] < mzs[i - 1]) || n >= NotEncoded)
+        {
+          m_Entries[id].length = NotEncoded;
+          return;
+        }
+        keys[i] = static_cast<std::uint64_t>(v);
+      }
+      Encode(id, keys.data(), n);
+    }
+
+    /// @brief Release the memory only needed while encoding.
+    void Finalize();
+
+    bool Contains(std::size_t id) const { return id < m_Entries.size() && m_Entries[id].length != NotEncoded; }
+
+    std::size_t GetLength(std::size_t id) const { return m_Entries[id].length; }
+
+    /// @brief Decode all values of spectrum id.
+    void Get(std::size_t id, std::vector<double> &mzs) const;
+
+    /**
+     * @brief Index and count of the values in [lower, upper] of spectrum id.
+     * Same result as m2::Signal::Subrange on the decoded m/z array, i.e. values
+     * closer than GridSpacing / 2 to a bound may be classified differently than on disk.
+     */
+    std::pair<unsigned int, unsigned int> Subrange(std::size_t id, double lower, double upper) const;
+
+    /// @brief Bytes held in memory.
+    std::size_t GetMemorySize() const;
+
+    /// @brief Number of distinct encodings.
+    std::size_t GetNumberOfDistinctAxes() const { return m_NumberOfDistinctAxes; }
+
+    /// @brief Number of spectra not encoded because the memory budget was exhausted.
+    std::size_t GetNumberOfSpectraOverBudget() const { return m_NumberOfSpectraOverBudget; }
+
+  private:
+    static constexpr std::uint32_t NotEncoded = 0xffffffff;
+
+    struct Entry
+    {
+      std::uint64_t offset = 0;
+      std::uint32_t length = NotEncoded;
+    };
+
+    void Encode(std::size_t id, const std::uint64_t *keys, std::size_t n);
+
+    /// @brief Index of the first value >= x (strict: > x).
+    std::size_t Bound(const Entry &e, double x, bool strict) const;
+
+    std::vector<Entry> m_Entries;
+    std::vector<std::uint8_t> m_Data;
+    std::size_t m_MemoryBudget = DefaultMemoryBudget;
+    std::size_t m_NumberOfDistinctAxes = 0;
+    std::size_t m_NumberOfSpectraOverBudget = 0;
+
+    /// @brief Hash of an encoding to its offset and size in m_Data, guarded by m_Mutex while encoding.
+    std::unordered_multimap<std::size_t, std::pair<std::uint64_t, std::size_t>> m_Offsets;
+    std::mutex m_Mutex;
+  };
+
+} // namespace m2
@@ -106,7 +106,8 @@ namespace m2
   {
     None = 0,
     Float = 1,
-    Double = 2
+    Double = 2,
+    Half = 3
   };
 
   inline std::string to_string(const NumericType &type) noexcept
@@ -119,6 +120,8 @@ namespace m2
         return "Float";
       case NumericType::Double:
         return "Double";
+      case NumericType::Half:
+        return "Half";
     }
     return "";
   }
@@ -133,6 +136,8 @@ namespace m2
         return sizeof(float);
       case NumericType::Double:
         return sizeof(double);
+      case NumericType::Half:
+        return 2;
     }
     return 0;
   }
@@ -174,8 +179,9 @@ namespace m2
                                                                 {"Sum", 4},
                                                                 {"Variance", 5},
                                                                 {"PeakIndicators", 6},
-                                                                {"Float", 0},
-                                                                {"Double", 1}};
+                                                                {"Float", 1},
+                                                                {"Double", 2},
+                                                                {"Half", 3}};
 
   using DisplayImagePixelType = float;
   using NormImagePixelType = float;
@@ -0,0 +1,39 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace m2
+{
+  /**
+   * @brief IEEE 754 half precision (16-bit float [MS:1000520]) conversion of binary data arrays.
+   * The F16C instructions are used if the CPU supports them.
+   */
+  namespace HalfFloat
+  {
+    /// @brief Widen n half precision values to float.
+    M2AIACORE_EXPORT void ToFloat(const std::uint16_t *src, std::size_t n, float *dest) noexcept;
+
+    /// @brief Narrow n float values to half precision (round to nearest even).
+    M2AIACORE_EXPORT void FromFloat(const float *src, std::size_t n, std::uint16_t *dest) noexcept;
+
+    M2AIACORE_EXPORT float ToFloat(std::uint16_t h) noexcept;
+    M2AIACORE_EXPORT std::uint16_t FromFloat(float f) noexcept;
+  } // namespace HalfFloat
+} // namespace m2
@@ -16,6 +16,8 @@ See LICENSE.txt for details.
 #pragma once
 
 #include <M2aiaCoreExports.h>
+#include <atomic>
+#include <m2CoreCommon.h>
 #include <mitkImage.h>
 #include <vector>
 #include <signal/m2SignalCommon.h>
@@ -30,10 +32,18 @@ namespace m2
     virtual void GetYValues(unsigned int /*id*/, std::vector<double> &){};
     virtual void GetXValues(unsigned int /*id*/, std::vector<float> &) {};
     virtual void GetXValues(unsigned int /*id*/, std::vector<double> &) {};
+    /// @brief Intensities as stored in the source (no normalization or signal processing).
+    virtual void GetRawYValues(unsigned int /*id*/, std::vector<float> &) {};
 
     virtual void InitializeImageAccess() {};
     virtual void InitializeGeometry() {};
-    virtual void GetImagePrivate(double /*x*/ , double  /*tol*/, const mitk::Image * /*mask*/, mitk::Image * /*target*/) {};
+    /// @brief Returns false if the request was cancelled (the target is incomplete then).
+    virtual bool GetImagePrivate(double /*x*/ , double  /*tol*/, const mitk::Image * /*mask*/, mitk::Image * /*target*/,
+                                 const std::atomic<bool> * /*cancelled*/) { return false; };
+    virtual void GetImagesPrivate(const std::vector<double> & /*xs*/,
+                                  const std::vector<double> & /*tols*/,
+                                  const mitk::Image * /*mask*/,
+                                  m2::DisplayImagePixelType * /*values*/) {};
     virtual void InitializeNormalizationImage(m2::NormalizationStrategyType /*type*/){};
   };
 
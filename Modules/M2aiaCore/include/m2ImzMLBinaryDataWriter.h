@@ -0,0 +1,101 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Poco
+{
+  class SHA1Engine;
+}
+
+namespace m2
+{
+  /**
+   * @class ImzMLBinaryDataWriter
+   * @brief Buffered append-only writer for the *.ibd file of an imzML export.
+   *
+   * WriteOrdered encodes spectra in parallel batches while the previous batch is
+   * appended by a single writer thread in the given order. Offsets are assigned by
+   * the writer, the stream is not flushed per spectrum.
+   *
+   * The SHA-1 digest of the file [IMS:1000091] is updated from the appended bytes,
+   * the written file is never read back.
+   */
+  class M2AIACORE_EXPORT ImzMLBinaryDataWriter
+  {
+  public:
+    /**
+     * @brief Encode the binary data of spectrum id into bytes. Called concurrently.
+     */
+    using EncodeFunction = std::function<void(unsigned int id, std::vector<char> &bytes)>;
+
+    /**
+     * @brief Called in order on the writer thread after the bytes of spectrum id were appended at offset.
+     */
+    using WrittenFunction =
+      std::function<void(unsigned int id, unsigned long long offset, unsigned long long numberOfBytes)>;
+
+    /**
+     * @brief Create (or truncate) the file at path.
+     */
+    explicit ImzMLBinaryDataWriter(const std::string &path,
+                                   bool computeSHA1 = true,
+                                   unsigned long long bufferSize = 16ull << 20);
+    ~ImzMLBinaryDataWriter();
+
+    ImzMLBinaryDataWriter(const ImzMLBinaryDataWriter &) = delete;
+    ImzMLBinaryDataWriter &operator=(const ImzMLBinaryDataWriter &) = delete;
+
+    /**
+     * @brief Append n bytes and return the offset they were written at.
+     */
+    unsigned long long Append(const char *data, unsigned long long n);
+    unsigned long long GetOffset() const { return m_Offset; }
+
+    /**
+     * @brief Encode the spectra ids with the given number of threads and append them in order.
+     * bytesPerSpectrum is an estimate used to bound the memory of a batch.
+     * The first exception thrown by encode or written is rethrown once no thread uses the batches anymore.
+     */
+    void WriteOrdered(const std::vector<unsigned int> &ids,
+                      unsigned int threads,
+                      unsigned long long bytesPerSpectrum,
+                      const EncodeFunction &encode,
+                      const WrittenFunction &written);
+
+    void Flush();
+
+    /**
+     * @brief Hex digest of all appended bytes. Finalizes the digest, call after the last Append.
+     * Empty if SHA-1 computation is disabled.
+     */
+    std::string GetSHA1();
+
+  private:
+    std::vector<char> m_Buffer;
+    std::ofstream m_Stream;
+    unsigned long long m_Offset = 0;
+    std::unique_ptr<Poco::SHA1Engine> m_SHA1;
+    std::string m_Digest;
+  };
+
+} // namespace m2
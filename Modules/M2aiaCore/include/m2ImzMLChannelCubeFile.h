@@ -0,0 +1,107 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstdint>
+#include <functional>
+#include <m2MemoryMappedFile.h>
+#include <memory>
+#include <string>
+
+namespace m2
+{
+  class ImzMLSpectrumImage;
+
+  /**
+   * @class ImzMLChannelCubeFile
+   * @brief Transposed (channel-major) copy of continuous profile intensities (<name>.m2cube).
+   *
+   * In the *.ibd file all intensities of a spectrum are stored consecutively. An ion
+   * image of a m/z range therefore requires one read per spectrum. The channel cube
+   * stores the raw intensities of all spectra for channel c consecutively (at
+   * c * numberOfSpectra + spectrumId), so an ion image of the channel range
+   * [first, first + n) is a single contiguous slab in the file.
+   *
+   * The cube is written in two streaming passes: groups of spectra are read once and
+   * stored channel-major per group in a temporary file, which is then gathered block by
+   * block of channels into the cube. The cube is only valid for the imzML/ibd pair (see
+   * ImzMLIndexFile::FileIdentity) it was created from.
+   */
+  class M2AIACORE_EXPORT ImzMLChannelCubeFile
+  {
+  public:
+    static constexpr char Extension[] = ".m2cube";
+    static constexpr unsigned int Version = 1;
+
+    /**
+     * @brief Fill block with all intensities of the spectra [firstSpectrum, firstSpectrum + numberOfSpectra).
+     * The value of spectrum i and channel c is expected at block[(i - firstSpectrum) * numberOfChannels + c].
+     */
+    using SpectrumReader =
+      std::function<void(std::uint64_t firstSpectrum, std::uint64_t numberOfSpectra, char *block)>;
+
+    /**
+     * @brief Path of the channel cube file for a given imzML file path (see ImzMLIndexFile::GetSidecarPath).
+     */
+    static std::string GetCubeFilePath(const std::string &imzMLPath);
+
+    /**
+     * @brief Open the channel cube of data.
+     * @return nullptr if no cube with the expected value size and shape exists for the imzML/ibd pair.
+     */
+    static std::shared_ptr<const ImzMLChannelCubeFile> Open(const m2::ImzMLSpectrumImage *data,
+                                                            unsigned int valueBytes,
+                                                            std::uint64_t numberOfChannels);
+
+    /**
+     * @brief Create the channel cube of data.
+     * Every spectrum is requested exactly once from reader (in groups of consecutive spectra).
+     * @return false if the file could not be written (e.g. read-only location).
+     */
+    static bool Write(const m2::ImzMLSpectrumImage *data,
+                      unsigned int valueBytes,
+                      std::uint64_t numberOfChannels,
+                      const SpectrumReader &reader);
+
+    std::uint64_t GetNumberOfSpectra() const { return m_NumberOfSpectra; }
+    std::uint64_t GetNumberOfChannels() const { return m_NumberOfChannels; }
+
+    /**
+     * @brief Values of the channel c for all spectra, followed by the values of channel c + 1 ...
+     */
+    template <class DataType>
+    const DataType *Channel(std::uint64_t c) const noexcept
+    {
+      return m_File.Pointer<DataType>(m_DataOffset + c * m_NumberOfSpectra * sizeof(DataType));
+    }
+
+    /**
+     * @brief Hint the OS that the channels [first, first + n) are read next.
+     */
+    void WillNeed(std::uint64_t first, std::uint64_t n) const;
+
+    explicit ImzMLChannelCubeFile(const std::string &path);
+
+  private:
+    m2::MemoryMappedFile m_File;
+    std::uint64_t m_NumberOfSpectra = 0;
+    std::uint64_t m_NumberOfChannels = 0;
+    std::uint64_t m_ValueBytes = 0;
+    std::uint64_t m_DataOffset = 0;
+  };
+
+} // namespace m2
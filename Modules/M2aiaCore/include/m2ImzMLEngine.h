@@ -19,6 +19,8 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 #include <M2aiaCoreExports.h>
 #include <map>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 namespace m2
@@ -40,4 +42,66 @@ namespace m2
                               char from = '{',
                               char to = '}');
   };
-} // namespace ImzML
+
+  /**
+   * @class CompiledTemplate
+   * @brief A template parsed once into literal fragments, value slots and sections.
+   *
+   * Same syntax and semantics as TemplateEngine::render: {key} is replaced by the value
+   * of key, {#key}...{/key} is removed if key has no value. Keys are resolved to slot
+   * indices on construction, rendering appends to a reusable buffer without any search.
+   */
+  class M2AIACORE_EXPORT CompiledTemplate
+  {
+  public:
+    /**
+     * @brief A slot value: absent, an integer or a string.
+     */
+    class Value
+    {
+    public:
+      Value() = default;
+      Value(unsigned long long v) : m_Type(Type::Integer), m_Integer(v) {}
+      Value(std::string_view v) : m_Type(Type::String), m_String(v) {}
+
+    private:
+      friend class CompiledTemplate;
+      enum class Type
+      {
+        None,
+        Integer,
+        String
+      };
+      Type m_Type = Type::None;
+      unsigned long long m_Integer = 0;
+      std::string_view m_String;
+    };
+
+    CompiledTemplate(const std::string &view,
+                     const std::vector<std::string> &keys,
+                     char from = '{',
+                     char to = '}');
+
+    /**
+     * @brief Append the rendered template to out. values[i] is the value of keys[i].
+     */
+    void Render(const Value *values, std::string &out) const;
+
+  private:
+    struct Op
+    {
+      enum class Type
+      {
+        Literal,
+        Slot,
+        Section
+      };
+      Type type;
+      std::size_t first;  // literal offset or key index
+      std::size_t length; // literal length or number of ops enclosed by the section
+    };
+
+    std::string m_View;
+    std::vector<Op> m_Ops;
+  };
+} // namespace m2
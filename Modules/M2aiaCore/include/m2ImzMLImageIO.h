@@ -23,6 +23,7 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 #include <mitkImage.h>
 #include <mitkItkImageIO.h>
 
+#include <m2ImzMLBinaryDataWriter.h>
 #include <m2IntervalVector.h>
 #include <m2ImzMLSpectrumImage.h>
 #include <m2SpectrumImageStack.h>
@@ -78,14 +79,51 @@ namespace m2
     void SetDataTypeYAxis(m2::NumericType type){m_DataTypeYAxis = type;}
     void SetSpectrumFormat(m2::SpectrumFormat type){m_SpectrumFormat = type;}
 
+    /**
+     * @brief Write m/z and intensity arrays zlib compressed [MS:1000574].
+     */
+    void SetUseZlibCompression(bool value){m_UseZlibCompression = value;}
+
+    /**
+     * @brief Compute the ibd SHA-1 checksum [IMS:1000091] while writing. If false, only the UUID is written.
+     */
+    void SetComputeSHA1(bool value){m_ComputeSHA1 = value;}
+
+    /**
+     * @brief The spectrum element template and the keys of its value slots, in the order used by Write.
+     */
+    const std::string &GetSpectrumTemplate() const { return IMZML_SPECTRUM_TEMPLATE; }
+    const std::vector<std::string> &GetSpectrumTemplateKeys() const { return IMZML_SPECTRUM_TEMPLATE_KEYS; }
+
+    /**
+     * @brief Export only the spectra inside of the region of interest (pixels > 0, or == label if label > 0).
+     * The binary data arrays are copied from the source ibd without signal processing, the format,
+     * data types and compression of the source imzML are kept. Positions are re-indexed to the
+     * bounding box of the region. Requires an m2::ImzMLSpectrumImage input.
+     */
+    void SetRegionOfInterest(const mitk::Image *roi, unsigned int label = 0)
+    {
+      m_RegionOfInterest = roi;
+      m_RegionOfInterestLabel = label;
+    }
+
     ConfidenceLevel GetWriterConfidenceLevel() const override;
     std::string GetIBDOutputPath() const;
     std::string GetImzMLOutputPath() const;
-    void WriteContinuousProfile(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra) const;
-    void WriteContinuousCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra) const;
-    void WriteContinuousCentroid3DStack(const m2::SpectrumImageStack *) const;
-    void WriteProcessedProfile(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra) const;
-    void WriteProcessedCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra) const;
+    void WriteContinuousProfile(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra, m2::ImzMLBinaryDataWriter & writer) const;
+    void WriteContinuousCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra, m2::ImzMLBinaryDataWriter & writer) const;
+    /**
+     * @brief Writes the warped slices of the stack as one 3D imzML (continuous centroid on the intervals).
+     * spectra is filled with the meta data of the written pixels (the stack mask).
+     */
+    void WriteContinuousCentroid3DStack(const m2::SpectrumImageStack * stack, m2::ImzMLSpectrumImage::SpectrumVectorType & spectra, m2::ImzMLBinaryDataWriter & writer) const;
+    void WriteProcessedProfile(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra, m2::ImzMLBinaryDataWriter & writer) const;
+    void WriteProcessedCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType & spectra, m2::ImzMLBinaryDataWriter & writer) const;
+    /**
+     * @brief Copies the binary data arrays of the spectra ids from the source ibd (consecutive arrays as one block)
+     * and updates their offsets and encoded lengths.
+     */
+    void WriteRegionOfInterest(const m2::ImzMLSpectrumImage * input, const std::vector<unsigned int> & ids, m2::ImzMLSpectrumImage::SpectrumVectorType & spectra, m2::ImzMLBinaryDataWriter & writer) const;
 
     static inline bool CheckDimensions(mitk::Image * parent, const mitk::Image * child){
       auto dims_a = parent->GetDimensions();
@@ -154,6 +192,10 @@ namespace m2
     m2::NumericType m_DataTypeXAxis = m2::NumericType::Float;
     m2::NumericType m_DataTypeYAxis = m2::NumericType::Float;
     m2::SpectrumFormat m_SpectrumFormat = m2::SpectrumFormat::None;
+    bool m_UseZlibCompression = false;
+    bool m_ComputeSHA1 = true;
+    mitk::Image::ConstPointer m_RegionOfInterest;
+    unsigned int m_RegionOfInterestLabel = 0;
 
   
     std::map<std::string, std::string> TextToCodeMap = {{"16-bit float"s, "1000520"s},
@@ -201,7 +243,7 @@ namespace m2
       "<cvParam cvRef=\"MS\" accession=\"MS:{spectrumtype_code}\" name=\"{spectrumtype}\" value=\"\"/>\n"
       "<cvParam cvRef=\"IMS\" accession=\"IMS:{mode_code}\" name=\"{mode}\" value=\"\"/>\n"
       "<cvParam cvRef=\"IMS\" accession=\"IMS:1000080\" name=\"universally unique identifier\" value=\"{uuid}\"/>\n"
-      "<cvParam cvRef=\"IMS\" accession=\"IMS:1000091\" name=\"ibd SHA-1\" value=\"{sha1sum}\"/>\n"
+      "{#sha1sum}<cvParam cvRef=\"IMS\" accession=\"IMS:1000091\" name=\"ibd SHA-1\" value=\"{sha1sum}\"/>\n{/sha1sum}"
       "</fileContent>\n"
       "</fileDescription>\n"
       "<referenceableParamGroupList count=\"3\">\n"
@@ -304,6 +346,9 @@ namespace m2
       "</binaryDataArrayList>\n"
       "</spectrum>\n";
 
+    const std::vector<std::string> IMZML_SPECTRUM_TEMPLATE_KEYS = {
+      "index", "x", "y", "z", "mz_len", "mz_enc_len", "mz_offset", "int_len", "int_enc_len", "int_offset", "tic"};
+
   }; 
 
 } // namespace m2
@@ -0,0 +1,90 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstdint>
+#include <m2ImzMLSpectrumImage.h>
+
+namespace m2
+{
+  /**
+   * @class ImzMLIndexFile
+   * @brief Binary sidecar (<name>.m2idx) of a parsed imzML file.
+   *
+   * The index file holds the spectrum meta data (offsets, lengths, index and world
+   * coordinates) and the parsed property list of an ImzMLSpectrumImage. It is valid
+   * as long as size and modification time (in nanoseconds) of the imzML, size and UUID
+   * of the ibd and the index relevant preferences are unchanged. Reading the index replaces the XML
+   * parsing (ImzMLParser::ReadImageMetaData and ImzMLParser::ReadImageSpectrumMetaData).
+   */
+  class M2AIACORE_EXPORT ImzMLIndexFile
+  {
+  public:
+    static constexpr char Extension[] = ".m2idx";
+    static constexpr unsigned int Version = 2;
+
+    /**
+     * @brief Identity of an imzML/ibd file pair. Sidecar files (index, channel cube)
+     * are valid as long as the identity of their source files is unchanged.
+     */
+    struct FileIdentity
+    {
+      std::uint64_t imzMLSize = 0;
+      std::int64_t imzMLModificationTime = 0; // nanoseconds
+      std::uint64_t ibdSize = 0;
+      std::uint8_t uuid[16] = {};
+
+      bool operator==(const FileIdentity &other) const;
+      bool operator!=(const FileIdentity &other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief Determine the identity of the imzML/ibd files of data.
+     * @return false if one of the files does not exist.
+     */
+    static bool GetFileIdentity(const m2::ImzMLSpectrumImage *data, FileIdentity &identity);
+
+    /**
+     * @brief Path of a sidecar file (index, channel cube, normalization factors) of an imzML file.
+     *
+     * Sidecars are written to a cache directory and named by the imzML file name and a hash
+     * of its absolute path. The directory is the preference "m2aia.imzml.sidecar_directory",
+     * the environment variable M2AIA_CACHE_DIR or the platform cache location (in this order).
+     * If the preference "m2aia.imzml.sidecar_next_to_data" is set, or no cache directory can
+     * be created, they are written next to the imzML file.
+     */
+    static std::string GetSidecarPath(const std::string &imzMLPath, const std::string &extension);
+
+    /**
+     * @brief Path of the index file for a given imzML file path (see GetSidecarPath).
+     */
+    static std::string GetIndexFilePath(const std::string &imzMLPath);
+
+    /**
+     * @brief Load spectra and properties from the index file into data.
+     * @return false if no valid index file exists for the imzML/ibd pair of data.
+     */
+    static bool Read(m2::ImzMLSpectrumImage *data);
+
+    /**
+     * @brief Write the index file for the already parsed data.
+     * @return false if the file could not be written (e.g. read-only location).
+     */
+    static bool Write(const m2::ImzMLSpectrumImage *data);
+  };
+
+} // namespace m2
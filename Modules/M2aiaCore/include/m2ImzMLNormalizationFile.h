@@ -0,0 +1,61 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <string>
+#include <vector>
+
+namespace m2
+{
+  class ImzMLSpectrumImage;
+
+  /**
+   * @class ImzMLNormalizationFile
+   * @brief Per-spectrum normalization factors of an imzML file (<name>.m2norm).
+   *
+   * The factors of all m2::Signal::SpectrumNormalizationStrategyTypeList strategies (TIC, Sum,
+   * Mean, Max, RMS) are computed together in one pass over the binary data and stored as
+   * one float column per strategy. Column t holds the factor of spectrum i at t * N + i.
+   *
+   * The file is only valid for the imzML/ibd pair (see ImzMLIndexFile::FileIdentity)
+   * it was created from.
+   */
+  class M2AIACORE_EXPORT ImzMLNormalizationFile
+  {
+  public:
+    static constexpr char Extension[] = ".m2norm";
+    static constexpr unsigned int Version = 1;
+
+    /**
+     * @brief Path of the normalization file for a given imzML file path (see ImzMLIndexFile::GetSidecarPath).
+     */
+    static std::string GetNormalizationFilePath(const std::string &imzMLPath);
+
+    /**
+     * @brief Load the factors of data.
+     * @return false if no valid normalization file exists for the imzML/ibd pair of data.
+     */
+    static bool Read(const m2::ImzMLSpectrumImage *data, std::vector<float> &factors);
+
+    /**
+     * @brief Write the factors of data.
+     * @return false if the file could not be written (e.g. read-only location).
+     */
+    static bool Write(const m2::ImzMLSpectrumImage *data, const std::vector<float> &factors);
+  };
+
+} // namespace m2
@@ -17,7 +17,9 @@ See LICENSE.txt for details.
 
 #include <M2aiaCoreExports.h>
 #include <m2ISpectrumImageSource.h>
+#include <m2MemoryMappedFile.h>
 #include <m2SpectrumImage.h>
+#include <mutex>
 #include <signal/m2Baseline.h>
 #include <signal/m2Smoothing.h>
 #include <signal/m2Transformer.h>
@@ -70,8 +72,16 @@ namespace m2
 
     void SetBinaryDataPath(std::string binaryDataPath){
       this->SetProperty("path.binary", mitk::StringProperty::New(binaryDataPath));
+      std::lock_guard<std::mutex> lock(m_BinaryDataViewMutex);
+      m_BinaryDataView.reset();
     }
 
+    /**
+     * @brief Shared read-only memory mapping of the binary data file (*.ibd).
+     * The mapping is created on first access and used by all reading threads.
+     */
+    std::shared_ptr<const m2::MemoryMappedFile> GetBinaryDataView() const;
+
     /// @brief Type representing the offset from file start in bytes 
     using BinaryDataOffsetType = unsigned long long;
     
@@ -85,6 +95,9 @@ namespace m2
       BinaryDataOffsetType intOffset;
       BinaryDataLengthType mzLength;
       BinaryDataLengthType intLength;
+      // Length of the (compressed) arrays in the file in bytes [IMS:1000104]
+      BinaryDataLengthType mzEncodedLength = 0;
+      BinaryDataLengthType intEncodedLength = 0;
       // size_t id;
       itk::Index<3> index;
       struct
@@ -104,6 +117,21 @@ namespace m2
 
     void GetImage(double mz, double tol, const mitk::Image *mask, mitk::Image *img) const override;
 
+    /**
+     * @brief Requests are processed one after another; a cancelled request stops after the current
+     * chunk of spectra (see ImzMLSpectrumImageSource::CancellationCheckInterval).
+     */
+    bool TryGetImage(double mz, double tol, const mitk::Image *mask, mitk::Image *img, const std::atomic<bool> &cancelled) const override;
+
+    /**
+     * @brief All ranges are pooled in one pass over the spectra (see ImzMLSpectrumImageSource::GetImagesPrivate).
+     * Falls back to one GetImage call per range if image normalization or image smoothing is selected.
+     */
+    void GetImages(const std::vector<double> &xs,
+                   const std::vector<double> &tols,
+                   const mitk::Image *mask,
+                   std::vector<m2::DisplayImagePixelType> &values) const override;
+
     double GetXMin() const;
     double GetXMax() const;
 
@@ -161,9 +189,32 @@ namespace m2
      */
     void GetIntensities(unsigned int id, std::vector<double> &xs) const override;
 
+    /**
+     * @brief Get the x values of a spectrum as stored in the imzML file.
+     * @param id The spectrum ID.
+     * @param xs The vector to store x values.
+     */
+    void GetXValues(unsigned int id, std::vector<double> &xs) const;
+
+    /**
+     * @brief Get the intensities as stored in the ibd file, without normalization or signal processing.
+     * @param id The spectrum ID.
+     * @param ys The vector to store y values.
+     */
+    void GetRawIntensitiesFloat(unsigned int id, std::vector<float> &ys) const;
+
     std::string GetMzGroupID() const {return m_MzGroupID;}
     std::string GetIntensityGroupID() const {return m_IntensityGroupID;}
 
+    /// @brief True if the m/z arrays are zlib compressed [MS:1000574]
+    bool IsMzZlibCompressed() const {return m_MzZlibCompressed;}
+
+    /// @brief True if the intensity arrays are zlib compressed [MS:1000574]
+    bool IsIntensityZlibCompressed() const {return m_IntensityZlibCompressed;}
+
+    /// @brief True if the intensity arrays are stored as 16-bit float [MS:1000520]
+    bool IsIntensityHalfPrecision() const {return m_IntensityHalfPrecision;}
+
   private:
     /// @brief path to the imzML file
     std::string m_ImzMLDataPath;
@@ -177,6 +228,10 @@ namespace m2
     /// @brief referenceableParameterGroupName
     std::string m_IntensityGroupID;
 
+    bool m_MzZlibCompressed = false;
+    bool m_IntensityZlibCompressed = false;
+    bool m_IntensityHalfPrecision = false;
+
     /// @brief the source object is used to read/process data from the disk
     std::unique_ptr<m2::ISpectrumImageSource> m_SpectrumImageSource;
 
@@ -186,7 +241,12 @@ namespace m2
     /// @brief Transformations are applied if available using elastix transformix
     std::vector<std::string> m_Transformations;
 
-    mutable bool m_IsIonImageGenerated = true;
+    /// @brief serializes ion image generation, the processing functors of the source are shared
+    mutable std::mutex m_IonImageMutex;
+
+    /// @brief read-only mapping of the ibd file, see GetBinaryDataView()
+    mutable std::shared_ptr<const m2::MemoryMappedFile> m_BinaryDataView;
+    mutable std::mutex m_BinaryDataViewMutex;
 
     ImzMLSpectrumImage();
     ~ImzMLSpectrumImage() override;
@@ -21,10 +21,16 @@ See LICENSE.txt for details.
 #include <itkDiscreteGaussianImageFilter.h>
 #include <m2ISpectrumImageSource.h>
 #include <m2ImzMLSpectrumImage.h>
+#include <m2BinaryDataCompression.h>
+#include <m2ImzMLChannelCubeFile.h>
+#include <m2ImzMLNormalizationFile.h>
+#include <m2CompactMzAxes.h>
 #include <m2CoreCommon.h>
+#include <m2HalfFloat.h>
+#include <m2MemoryMappedFile.h>
 #include <m2Process.hpp>
 #include <m2Timer.h>
-#include <mitkImageAccessByItk.h>
+#include <chrono>
 #include <mitkCoreServices.h>
 #include <mitkIPreferences.h>
 #include <mitkIPreferencesService.h>
@@ -35,6 +41,7 @@ See LICENSE.txt for details.
 #include <mitkLabelSetImage.h>
 #include <mitkProperties.h>
 #include <mutex>
+#include <numeric>
 #include <signal/m2Baseline.h>
 #include <signal/m2Morphology.h>
 #include <signal/m2Normalization.h>
@@ -124,6 +131,25 @@ namespace m2
     return offsetHelper;
   }
 
+  /**
+   * @brief Read-only range of values located in the memory mapped binary data file.
+   * Can be passed to all algorithms expecting begin()/end().
+   */
+  template <class DataType>
+  struct BinaryDataRange
+  {
+    const DataType *first = nullptr;
+    const DataType *last = nullptr;
+
+    const DataType *begin() const noexcept { return first; }
+    const DataType *end() const noexcept { return last; }
+    std::size_t size() const noexcept { return std::distance(first, last); }
+    bool empty() const noexcept { return first == last; }
+    const DataType &front() const noexcept { return *first; }
+    const DataType &back() const noexcept { return *(last - 1); }
+    const DataType &operator[](std::size_t i) const noexcept { return first[i]; }
+  };
+
 } // namespace m2
 
 namespace m2
@@ -140,10 +166,44 @@ namespace m2
   {
   private:
     m2::ImzMLSpectrumImage *p;
+    bool m_MzZlibCompressed = false;
+    bool m_IntensityZlibCompressed = false;
+    bool m_IntensityHalfPrecision = false;
+    std::shared_ptr<const m2::ImzMLChannelCubeFile> m_ChannelCube;
+    m2::CompactMzAxes m_CompactMzAxes;
+
+    // factors of m2::Signal::SpectrumNormalizationStrategyTypeList, column-wise per spectrum id
+    std::vector<float> m_NormalizationFactors;
 
   public:
-    explicit ImzMLSpectrumImageSource(m2::ImzMLSpectrumImage *owner) : p(owner) {}
-    virtual void GetImagePrivate(double mz, double tol, const mitk::Image *mask, mitk::Image *image);
+    explicit ImzMLSpectrumImageSource(m2::ImzMLSpectrumImage *owner)
+      : p(owner),
+        m_MzZlibCompressed(owner->IsMzZlibCompressed()),
+        m_IntensityZlibCompressed(owner->IsIntensityZlibCompressed()),
+        m_IntensityHalfPrecision(owner->IsIntensityHalfPrecision())
+    {
+    }
+    /**
+     * @brief Generate the ion image of the range [mz-tol, mz+tol].
+     * If cancelled is set during processing, the workers stop at the next chunk of spectra and false is returned.
+     */
+    bool GetImagePrivate(double mz, double tol, const mitk::Image *mask, mitk::Image *image, const std::atomic<bool> *cancelled) override;
+
+    /// @brief Number of spectra processed between two checks of the cancellation flag
+    static constexpr unsigned int CancellationCheckInterval = 256;
+
+    /**
+     * @brief Pooled values of several ranges in one pass over the spectra.
+     * Each spectrum is read and processed once for all ranges: continuous profile spectra over the
+     * channel span covering all ranges, for other formats the ranges are merged against the m/z array.
+     * Smoothing and baseline correction run on the whole span, not on each padded range as in
+     * GetImagePrivate, so values close to the range borders may differ slightly if these are active.
+     * values: pixel-major matrix (image pixels x xs.size()), see m2::SpectrumImage::GetImages.
+     */
+    void GetImagesPrivate(const std::vector<double> &xs,
+                          const std::vector<double> &tols,
+                          const mitk::Image *mask,
+                          m2::DisplayImagePixelType *values) override;
 
     /**
      * @brief Initialize the geometry of the image.
@@ -160,6 +220,13 @@ namespace m2
 
     virtual void InitializeImageAccessContinuousProfile();
 
+    /**
+     * @brief Open (or create, if enabled by the preference "m2aia.imzml.channel_cube")
+     * the channel-major companion file of continuous profile data.
+     * GetImagePrivate reads ion images as one contiguous slab from the cube if available.
+     */
+    virtual void InitializeChannelCube();
+
     /**
      * @brief Provides optimized access to centroid data.
      * No binning is applied. Normalization factors are provided.
@@ -181,6 +248,8 @@ namespace m2
      * It includes binning for visualization purposes of the overview spectra
      * and invokes the calculation of normalization factors, but no further
      * signal-processing is supported here.
+     * If enabled by the preference "m2aia.imzml.compact_mz_axes" (default), the m/z arrays
+     * are kept in memory (see m2::CompactMzAxes) and ion images only read intensities.
      */
     virtual void InitializeImageAccessProcessedData();
 
@@ -189,24 +258,207 @@ namespace m2
      */
     void InitializeNormalizationImage(m2::NormalizationStrategyType type) override;
 
+    /**
+     * @brief Load the per-spectrum normalization factors from the *.m2norm file or compute the
+     * factors of all strategies in a single pass over the binary data (and write the file).
+     */
+    virtual void InitializeNormalizationFactors();
+
     /**
      * @brief Convert binary data to a vector.
      * @tparam OffsetType Type of the offset.
      * @tparam LengthType Type of the length.
      * @tparam DataType Type of the data.
-     * @param f Input file stream.
+     * @param f Memory mapped binary data file.
      * @param offset The offset to start reading from.
      * @param length The length of data to read.
      * @param vec Pointer to the vector to store the data.
      */
     template <class OffsetType, class LengthType, class DataType>
-    static void binaryDataToVector(std::ifstream &f, OffsetType offset, LengthType length, DataType *vec) noexcept
+    static void binaryDataToVector(const m2::MemoryMappedFile &f, OffsetType offset, LengthType length, DataType *vec)
     {
-      f.seekg(offset);
-      f.read((char *)vec, length * sizeof(DataType));
+      f.Copy(offset, length, vec);
     }
 
+    /**
+     * @brief Access binary data in place.
+     * If the data in the file is not aligned for DataType, it is copied into the buffer.
+     * The returned range is valid as long as the mapping (and the buffer) lives.
+     */
+    template <class OffsetType, class LengthType, class DataType>
+    static BinaryDataRange<DataType> binaryDataToRange(const m2::MemoryMappedFile &f,
+                                                       OffsetType offset,
+                                                       LengthType length,
+                                                       std::vector<DataType> &buffer)
+    {
+      if (const auto *data = f.Pointer<DataType>(offset, length))
+        return {data, data + length};
+      buffer.resize(length);
+      f.Copy(offset, length, buffer.data());
+      return {buffer.data(), buffer.data() + length};
+    }
 
+    /**
+     * @brief Read n values of a binary data array starting at the value index start.
+     * zlib compressed arrays [MS:1000574] can not be accessed at a value offset. They are
+     * inflated from the beginning of the array up to the last requested value.
+     * Throws if the array exceeds the file or can not be inflated.
+     * @param encodedLength Length of the array in the file in bytes [IMS:1000104]
+     */
+    template <class OffsetType, class LengthType, class DataType>
+    static void binaryDataToVector(const m2::MemoryMappedFile &f,
+                                   OffsetType offset,
+                                   LengthType encodedLength,
+                                   bool zlib,
+                                   std::size_t start,
+                                   std::size_t n,
+                                   DataType *vec)
+    {
+      if (!zlib)
+      {
+        f.Copy(offset + start * sizeof(DataType), n, vec);
+        return;
+      }
+
+      if (n == 0)
+        return;
+      if (!f.Contains(offset, 1))
+        mitkThrow() << "Compressed binary data array at offset " << offset << " exceeds the file: " << f.GetPath();
+      std::uint64_t srcBytes = encodedLength;
+      if (srcBytes == 0 || !f.Contains(offset, srcBytes))
+        srcBytes = f.Size() - offset;
+
+      thread_local std::vector<char> inflated;
+      char *target = reinterpret_cast<char *>(vec);
+      if (start != 0)
+      {
+        inflated.resize((start + n) * sizeof(DataType));
+        target = inflated.data();
+      }
+
+      if (!m2::Zlib::Inflate(f.Data() + offset, srcBytes, target, (start + n) * sizeof(DataType)))
+        mitkThrow() << "Compressed binary data array at offset " << offset << " with encoded length " << encodedLength
+                    << " is corrupted or holds less than " << (start + n) << " values: " << f.GetPath();
+
+      if (start != 0)
+        std::memcpy(vec, inflated.data() + start * sizeof(DataType), n * sizeof(DataType));
+    }
+
+    /**
+     * @brief Read n values of a 16-bit float binary data array [MS:1000520] starting at the value index start.
+     * The half precision values are widened on the fly (F16C if available).
+     */
+    template <class OffsetType, class LengthType, class DataType>
+    static void binaryDataToVector(const m2::MemoryMappedFile &f,
+                                   OffsetType offset,
+                                   LengthType encodedLength,
+                                   bool zlib,
+                                   bool half,
+                                   std::size_t start,
+                                   std::size_t n,
+                                   DataType *vec)
+    {
+      if (!half)
+      {
+        binaryDataToVector(f, offset, encodedLength, zlib, start, n, vec);
+        return;
+      }
+
+      thread_local std::vector<std::uint16_t> halfs;
+      halfs.resize(n);
+      binaryDataToVector(f, offset, encodedLength, zlib, start, n, halfs.data());
+      if constexpr (std::is_same<DataType, float>::value)
+      {
+        m2::HalfFloat::ToFloat(halfs.data(), n, vec);
+      }
+      else
+      {
+        thread_local std::vector<float> floats;
+        floats.resize(n);
+        m2::HalfFloat::ToFloat(halfs.data(), n, floats.data());
+        std::copy(floats.begin(), floats.end(), vec);
+      }
+    }
+
+    /// @brief Read n m/z values of the spectrum starting at value index start.
+    template <class SpectrumType>
+    void ReadMzs(const m2::MemoryMappedFile &f,
+                 const SpectrumType &s,
+                 std::size_t start,
+                 std::size_t n,
+                 MassAxisType *vec) const
+    {
+      binaryDataToVector(f, s.mzOffset, s.mzEncodedLength, m_MzZlibCompressed, start, n, vec);
+    }
+
+    /// @brief Read n intensity values of the spectrum starting at value index start.
+    template <class SpectrumType>
+    void ReadIntensities(const m2::MemoryMappedFile &f,
+                         const SpectrumType &s,
+                         std::size_t start,
+                         std::size_t n,
+                         IntensityType *vec) const
+    {
+      binaryDataToVector(
+        f, s.intOffset, s.intEncodedLength, m_IntensityZlibCompressed, m_IntensityHalfPrecision, start, n, vec);
+    }
+
+    /// @brief The complete m/z array of the spectrum, in place if possible.
+    template <class SpectrumType>
+    BinaryDataRange<MassAxisType> MzRange(const m2::MemoryMappedFile &f,
+                                          const SpectrumType &s,
+                                          std::vector<MassAxisType> &buffer) const
+    {
+      if (!m_MzZlibCompressed)
+        return binaryDataToRange(f, s.mzOffset, s.mzLength, buffer);
+      buffer.resize(s.mzLength);
+      ReadMzs(f, s, 0, s.mzLength, buffer.data());
+      return {buffer.data(), buffer.data() + buffer.size()};
+    }
+
+    /// @brief The complete intensity array of the spectrum, in place if possible (not for compressed or 16-bit float arrays).
+    template <class SpectrumType>
+    BinaryDataRange<IntensityType> IntensityRange(const m2::MemoryMappedFile &f,
+                                                  const SpectrumType &s,
+                                                  std::vector<IntensityType> &buffer) const
+    {
+      if (!m_IntensityZlibCompressed && !m_IntensityHalfPrecision)
+        return binaryDataToRange(f, s.intOffset, s.intLength, buffer);
+      buffer.resize(s.intLength);
+      ReadIntensities(f, s, 0, s.intLength, buffer.data());
+      return {buffer.data(), buffer.data() + buffer.size()};
+    }
+
+
+
+    /// @brief Bytes of the m/z and intensity arrays of the spectrum in the file.
+    template <class SpectrumType>
+    std::uint64_t MzBytes(const SpectrumType &s) const noexcept
+    {
+      return s.mzEncodedLength ? s.mzEncodedLength : s.mzLength * sizeof(MassAxisType);
+    }
+
+    template <class SpectrumType>
+    std::uint64_t IntensityBytes(const SpectrumType &s) const noexcept
+    {
+      return s.intEncodedLength ? s.intEncodedLength
+                                : s.intLength * (m_IntensityHalfPrecision ? sizeof(std::uint16_t) : sizeof(IntensityType));
+    }
+
+    /// @brief Number of bytes announced to the OS ahead of the reads of a thread in SequentialPass.
+    static constexpr std::uint64_t PrefetchWindowBytes = 32ull << 20;
+
+    /**
+     * @brief Visit all spectra in the order of their intensity arrays in the ibd file (one full pass).
+     * Each thread streams one contiguous region of the file. Two windows of PrefetchWindowBytes are
+     * announced to the OS (WillNeed) ahead of the reads, so the OS reads large consecutive blocks
+     * instead of the single arrays. The achieved throughput is logged.
+     * @param name Name of the pass (log).
+     * @param withMzs True if the pass reads the m/z array of each spectrum (processed data).
+     * @param worker Called as worker(threadId, ids, n) for consecutive spectra in file order.
+     */
+    template <class WorkerType>
+    void SequentialPass(const std::string &name, bool withMzs, WorkerType worker) const;
 
     using XIteratorType = typename std::vector<MassAxisType>::iterator;
     using YIteratorType = typename std::vector<IntensityType>::iterator;
@@ -218,6 +470,7 @@ namespace m2
     virtual void GetYValues(unsigned int id, std::vector<double> &yd) { GetYValues<double>(id, yd); }
     virtual void GetXValues(unsigned int id, std::vector<float> &yd) { GetXValues<float>(id, yd); }
     virtual void GetXValues(unsigned int id, std::vector<double> &yd) { GetXValues<double>(id, yd); }
+    virtual void GetRawYValues(unsigned int id, std::vector<float> &yd);
 
   private:
     template <class OutputType>
@@ -228,6 +481,78 @@ namespace m2
 
 } // namespace m2
 
+template <class MassAxisType, class IntensityType>
+template <class WorkerType>
+void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::SequentialPass(const std::string &name,
+                                                                               bool withMzs,
+                                                                               WorkerType worker) const
+{
+  const auto &spectra = p->GetSpectra();
+  if (spectra.empty())
+    return;
+
+  std::vector<unsigned int> order(spectra.size());
+  std::iota(std::begin(order), std::end(order), 0);
+  std::sort(std::begin(order),
+            std::end(order),
+            [&spectra](unsigned int a, unsigned int b) { return spectra[a].intOffset < spectra[b].intOffset; });
+
+  // byte range of the binary data of spectrum id
+  const auto spanBegin = [&](unsigned int id)
+  {
+    const auto &s = spectra[id];
+    return withMzs ? std::min<std::uint64_t>(s.mzOffset, s.intOffset) : std::uint64_t(s.intOffset);
+  };
+  const auto spanEnd = [&](unsigned int id)
+  {
+    const auto &s = spectra[id];
+    const std::uint64_t intEnd = s.intOffset + IntensityBytes(s);
+    return withMzs ? std::max<std::uint64_t>(s.mzOffset + MzBytes(s), intEnd) : intEnd;
+  };
+
+  std::uint64_t totalBytes = 0;
+  for (const auto &s : spectra)
+    totalBytes += IntensityBytes(s) + (withMzs ? MzBytes(s) : 0);
+
+  const auto view = p->GetBinaryDataView();
+  const auto start = std::chrono::steady_clock::now();
+
+  m2::Process::Map(order.size(),
+                   p->GetNumberOfThreads(),
+                   [&](unsigned int t, unsigned int a, unsigned int b)
+                   {
+                     // announce [from, k) with at least PrefetchWindowBytes, returns k
+                     const auto advise = [&](unsigned int from)
+                     {
+                       if (from >= b)
+                         return b;
+                       const auto first = spanBegin(order[from]);
+                       auto last = first;
+                       auto k = from;
+                       for (; k < b && last - first < PrefetchWindowBytes; ++k)
+                         last = std::max(last, spanEnd(order[k]));
+                       view->Advise(m2::MemoryMappedFile::AccessHint::WillNeed, first, last - first);
+                       return k;
+                     };
+
+                     auto current = a;
+                     auto next = advise(current);
+                     auto ahead = advise(next);
+                     while (current < b)
+                     {
+                       worker(t, order.data() + current, next - current);
+                       current = next;
+                       next = ahead;
+                       ahead = advise(ahead);
+                     }
+                   });
+
+  const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+  const double megaBytes = totalBytes / (1024.0 * 1024.0);
+  MITK_INFO << name << ": " << megaBytes << " MB in " << seconds.count() << " s ("
+            << (seconds.count() > 0 ? megaBytes / seconds.count() : 0.0) << " MB/s)";
+}
+
 template <class MassAxisType, class IntensityType>
 void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeNormalizationImage(
   m2::NormalizationStrategyType type)
@@ -249,46 +574,89 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeNormal
 
   // get individual spectrum meta data
   auto &spectra = p->GetSpectra();
-  int threads = p->GetNumberOfThreads();
-  using namespace std;
-
-  // split image in individual regions and process in parallel each spectrum
-  Process::Map(spectra.size(),
-               threads,
-               [&](unsigned int /*thread*/, unsigned int a, unsigned int b)
-               {
-                 ifstream f(p->GetBinaryDataPath(), ifstream::binary);
-                 vector<MassAxisType> mzs;
-                 vector<IntensityType> ints;
-
-                 for (unsigned long int i = a; i < b; i++)
-                 {
-                   auto &spectrum = spectra[i];
-
-                   mzs.resize(spectrum.mzLength);
-                   ints.resize(spectrum.intLength);
-                   binaryDataToVector(f, spectrum.mzOffset, spectrum.mzLength, mzs.data());
-                   binaryDataToVector(f, spectrum.intOffset, spectrum.intLength, ints.data());
-
-                   double v;
-                   if (type == NormalizationStrategyType::Internal)
-                     v = spectrum.inFileNormalizationFactor;
-                   else
-                     v = m2::Signal::GetNormalizationFactor(type, begin(mzs), end(mzs), begin(ints), end(ints));
-
-                   accNorm->SetPixelByIndex(spectrum.index, v);
-                 }
-               });
+
+  // the in-file factors are part of the spectrum meta data, no binary data is read
+  if (type == NormalizationStrategyType::Internal)
+  {
+    for (const auto &spectrum : spectra)
+      accNorm->SetPixelByIndex(spectrum.index, spectrum.inFileNormalizationFactor);
+    p->SetNormalizationImageStatus(type, true);
+    return;
+  }
+
+  const auto &types = m2::Signal::SpectrumNormalizationStrategyTypeList;
+  const auto column = std::find(std::begin(types), std::end(types), type);
+  if (column == std::end(types))
+  {
+    // None (and External without an external image)
+    for (const auto &spectrum : spectra)
+      accNorm->SetPixelByIndex(spectrum.index, 1);
+    p->SetNormalizationImageStatus(type, true);
+    return;
+  }
+
+  InitializeNormalizationFactors();
+  const auto *factors = m_NormalizationFactors.data() + std::distance(std::begin(types), column) * spectra.size();
+  for (unsigned int i = 0; i < spectra.size(); ++i)
+    accNorm->SetPixelByIndex(spectra[i].index, factors[i]);
   p->SetNormalizationImageStatus(type, true);
 }
 
 template <class MassAxisType, class IntensityType>
-void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(double xRangeCenter,
+void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeNormalizationFactors()
+{
+  auto &spectra = p->GetSpectra();
+  const auto &types = m2::Signal::SpectrumNormalizationStrategyTypeList;
+  if (m_NormalizationFactors.size() == types.size() * spectra.size())
+    return;
+
+  if (m2::ImzMLNormalizationFile::Read(p, m_NormalizationFactors))
+    return;
+
+  m_NormalizationFactors.assign(types.size() * spectra.size(), 1);
+  const auto n = spectra.size();
+  float *factors = m_NormalizationFactors.data();
+
+  const auto view = p->GetBinaryDataView();
+
+  // process the spectra in parallel, in the order of the binary data
+  // (continuous data shares one m/z array, it is not part of the streamed range)
+  const bool processed =
+    any(p->GetSpectrumType().Format & (m2::SpectrumFormat::ProcessedCentroid | m2::SpectrumFormat::ProcessedProfile));
+  SequentialPass("Normalization factors",
+                 processed,
+                 [&](unsigned int /*thread*/, const unsigned int *ids, unsigned int k)
+                 {
+                   using namespace std;
+                   const auto &f = *view;
+                   vector<MassAxisType> mzsBuffer;
+                   vector<IntensityType> intsBuffer;
+
+                   for (unsigned int j = 0; j < k; j++)
+                   {
+                     const auto id = ids[j];
+                     const auto &spectrum = spectra[id];
+                     const auto mzs = MzRange(f, spectrum, mzsBuffer);
+                     const auto ints = IntensityRange(f, spectrum, intsBuffer);
+                     const auto v = m2::Signal::GetNormalizationFactors(begin(mzs), end(mzs), begin(ints), end(ints));
+                     for (size_t t = 0; t < v.size(); ++t)
+                       factors[t * n + id] = v[t];
+                   }
+                 });
+
+  m2::ImzMLNormalizationFile::Write(p, m_NormalizationFactors);
+}
+
+template <class MassAxisType, class IntensityType>
+bool m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(double xRangeCenter,
                                                                                 double xRangeTol,
                                                                                 const mitk::Image *mask,
-                                                                                mitk::Image *destImage)
+                                                                                mitk::Image *destImage,
+                                                                                const std::atomic<bool> *cancelled)
 {
   using namespace m2;
+  const auto IsCancelled = [cancelled](unsigned int i)
+  { return cancelled && (i % CancellationCheckInterval) == 0 && cancelled->load(std::memory_order_relaxed); };
 
   m_Smoother.Initialize(p->GetSmoothingStrategy(), p->GetSmoothingHalfWindowSize());
   m_BaselineSubtractor.Initialize(p->GetBaselineCorrectionStrategy(), p->GetBaseLineCorrectionHalfWindowSize());
@@ -339,13 +707,24 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
     auto binaryDataAccessHelper = GetBinaryDataAccessHelper<double>(mzs, xRangeCenter, xRangeTol, padding);
 
     const auto &spectra = p->GetSpectra();
+    const auto view = p->GetBinaryDataView();
+
+    // Shifted spectra do not share the channel range, read them from the ibd.
+    const IntensityType *slab = nullptr;
+    if (m_ChannelCube && !accShift)
+    {
+      m_ChannelCube->WillNeed(binaryDataAccessHelper.dataModifiedOffset, binaryDataAccessHelper.dataModifiedLength);
+      slab = m_ChannelCube->Channel<IntensityType>(binaryDataAccessHelper.dataModifiedOffset);
+    }
+    const auto N = spectra.size();
+
     m2::Process::Map(
       spectra.size(),
       threads,
       [&](auto /*id*/, auto a, auto b)
       {
-        // create a input stream for the binary data file
-        std::ifstream f(p->GetBinaryDataPath(), std::iostream::binary);
+        // all threads read from the shared mapping of the binary data file
+        const auto &f = *view;
 
         // prepare data vectors for raw data and processing data
         std::vector<IntensityType> ints(binaryDataAccessHelper.dataModifiedLength);
@@ -364,6 +743,8 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
 
         for (unsigned int i = a; i < b; ++i)
         {
+          if (IsCancelled(i - a))
+            return;
           const auto &spectrum = spectra[i];
 
           // check if outside of mask
@@ -375,15 +756,27 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
           // 6) access the binary data in the file.
           // - use the spectrum.intOffset to find spectrum data in the binary file
           // - add the offset to find the right subrange of the spectrum data
-          auto binaryFileOffset =  spectrum.intOffset + binaryDataAccessHelper.dataModifiedOffset * sizeof(IntensityType);
-            
-          if(accShift) binaryFileOffset += accShift->GetPixelByIndex(spectrum.index)*sizeof(IntensityType);
-          // access the binary data and read a (padded) subrange of the intensities (y values)
-          binaryDataToVector(f, binaryFileOffset, binaryDataAccessHelper.dataModifiedLength, ints.data());
+          if (slab)
+          {
+            // gather the (padded) subrange from the contiguous channel slab
+            for (unsigned int c = 0; c < binaryDataAccessHelper.dataModifiedLength; ++c)
+              ints[c] = slab[c * N + i];
+          }
+          else
+          {
+            long long start = binaryDataAccessHelper.dataModifiedOffset;
+
+            if(accShift) start += accShift->GetPixelByIndex(spectrum.index);
+            // access the binary data and read a (padded) subrange of the intensities (y values)
+            ReadIntensities(f, spectrum, start, binaryDataAccessHelper.dataModifiedLength, ints.data());
+          }
 
           // ----- Normalization
 
           IntensityType norm = normAccess.GetPixelByIndex(spectrum.index);
+          // e.g. the TIC of a spectrum with a single value
+          if (!(norm > 0) || std::isinf(norm))
+            norm = 1;
           std::transform(std::begin(ints), std::end(ints), std::begin(ints), [&norm](auto &v) { return v / norm; });
 
           // ----- Smoothing
@@ -408,15 +801,15 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
                                       m2::SpectrumFormat::ProcessedProfile)))
   {
     const auto &spectra = p->GetSpectra();
+    const auto view = p->GetBinaryDataView();
     m2::Process::Map(
       spectra.size(),
       threads,
       [&](auto /*id*/, auto a, auto b)
       {
-        std::ifstream f(p->GetBinaryDataPath(), std::iostream::binary);
+        const auto &f = *view;
         std::vector<IntensityType> ints;
-        std::vector<MassAxisType> mzs;
-        std::copy(p->GetXAxis().begin(),p->GetXAxis().end(), std::back_inserter(mzs));
+        std::vector<MassAxisType> mzsBuffer;
         // auto binaryDataAccessHelper = GetBinaryDataAccessHelper<MassAxisType>(mzs, xRangeCenter, xRangeTol, 0);
         //MITK_INFO << xRangeCenter << " " << xRangeTol << " " << mzs.front() << " " << mzs.back();
                   
@@ -424,6 +817,8 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
 
         for (unsigned int i = a; i < b; ++i)
         {
+          if (IsCancelled(i - a))
+            return;
           auto &spectrum = spectra[i];
           if (maskAccess && maskAccess->GetPixelByIndex(spectrum.index) == 0)
           {
@@ -431,13 +826,19 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
             continue;
           }
 
-          mzs.resize(spectrum.mzLength);
-          binaryDataToVector(
-            f, spectrum.mzOffset, spectrum.mzLength, mzs.data()); // !! read mass axis for each spectrum
+          // !! mass axis of each spectrum is searched in memory or in place
+          std::pair<unsigned int, unsigned int> range;
+          if (m_CompactMzAxes.Contains(i))
+          {
+            range = m_CompactMzAxes.Subrange(i, xRangeCenter - xRangeTol, xRangeCenter + xRangeTol);
+          }
+          else
+          {
+            const auto mzs = MzRange(f, spectrum, mzsBuffer);
+            range = m2::Signal::Subrange(mzs, xRangeCenter - xRangeTol, xRangeCenter + xRangeTol);
+          }
 
-          //MITK_INFO << (any(spectrumType.Format &                     (m2::SpectrumFormat::ProcessedCentroid | m2::SpectrumFormat::ProcessedProfile)));
-            
-          auto [start, length] = m2::Signal::Subrange(mzs, xRangeCenter - xRangeTol, xRangeCenter + xRangeTol);
+          auto [start, length] = range;
           if(length == 0)
           {
             imageAccess.SetPixelByIndex(spectrum.index, 0);
@@ -445,8 +846,7 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
           }
           
           ints.resize(length);
-          const auto binaryFileOffset = spectrum.intOffset + start * sizeof(IntensityType);
-          binaryDataToVector(f, binaryFileOffset, length, ints.data());
+          ReadIntensities(f, spectrum, start, length, ints.data());
 
           // TODO: Is it useful to normalize centroid data?
           IntensityType norm = normAccess.GetPixelByIndex(spectrum.index);
@@ -465,6 +865,9 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
       });
   }
 
+  if (cancelled && cancelled->load())
+    return false;
+
   // Spatial image normalization
   const auto bufferN = std::accumulate(destImage->GetDimensions(), destImage->GetDimensions() + 3, 1, std::multiplies<>());
   switch(p->GetImageNormalizationStrategy()){
@@ -539,15 +942,211 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagePrivate(
       break;
     }
   }
-  
- 
+
+  return true;
 }
 
 
 
+template <class MassAxisType, class IntensityType>
+void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetImagesPrivate(const std::vector<double> &xs,
+                                                                                 const std::vector<double> &tols,
+                                                                                 const mitk::Image *mask,
+                                                                                 m2::DisplayImagePixelType *values)
+{
+  using namespace m2;
+
+  const std::size_t K = xs.size();
+  if (K == 0)
+    return;
+  if (tols.size() != K)
+    mitkThrow() << "GetImages requires one tolerance per range.";
+
+  m_Smoother.Initialize(p->GetSmoothingStrategy(), p->GetSmoothingHalfWindowSize());
+  m_BaselineSubtractor.Initialize(p->GetBaselineCorrectionStrategy(), p->GetBaseLineCorrectionHalfWindowSize());
+  m_Transformer.Initialize(p->GetIntensityTransformationStrategy());
+
+  std::shared_ptr<mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>> maskAccess;
+  if (mask)
+    maskAccess.reset(new mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>(mask));
+
+  using ShiftImageAccessorType = mitk::ImagePixelReadAccessor<m2::ShiftImageType, 3>;
+  std::shared_ptr<ShiftImageAccessorType> accShift;
+  if (p->GetShiftImage())
+    accShift = std::make_shared<ShiftImageAccessorType>(p->GetShiftImage());
+
+  const auto currentType = p->GetNormalizationStrategy();
+  if (!p->GetNormalizationImageStatus(currentType))
+    InitializeNormalizationImage(currentType);
+  mitk::ImagePixelReadAccessor<NormImagePixelType, 3> normAccess(p->GetNormalizationImage());
+
+  const auto *dims = p->GetDimensions();
+  const std::size_t nx = dims[0], ny = dims[1], nz = p->GetDimension() > 2 ? dims[2] : 1;
+  std::fill(values, values + nx * ny * nz * K, 0);
+  const auto Row = [&](const itk::Index<3> &index)
+  { return values + (std::size_t(index[0]) + nx * (std::size_t(index[1]) + ny * std::size_t(index[2]))) * K; };
+
+  // ranges ordered by their lower bound, the merge below walks each m/z array once
+  std::vector<double> lower(K), upper(K);
+  for (std::size_t k = 0; k < K; ++k)
+  {
+    lower[k] = xs[k] - tols[k];
+    upper[k] = xs[k] + tols[k];
+  }
+  std::vector<unsigned int> order(K);
+  std::iota(std::begin(order), std::end(order), 0);
+  std::sort(std::begin(order), std::end(order), [&](auto a, auto b) { return lower[a] < lower[b]; });
+
+  const auto spectrumType = p->GetSpectrumType();
+  const auto threads = p->GetNumberOfThreads();
+  const auto pooling = p->GetRangePoolingStrategy();
+  const auto &spectra = p->GetSpectra();
+  const auto view = p->GetBinaryDataView();
+
+  if (spectrumType.Format == m2::SpectrumFormat::ContinuousProfile)
+  {
+    // channel ranges on the shared m/z axis and the (padded) span covering all of them
+    const auto &mzs = p->GetXAxis();
+    std::vector<std::pair<unsigned int, unsigned int>> ranges(K);
+    unsigned int spanFirst = mzs.size(), spanLast = 0;
+    for (std::size_t k = 0; k < K; ++k)
+    {
+      ranges[k] = m2::Signal::Subrange(mzs, lower[k], upper[k]);
+      if (ranges[k].second == 0)
+        continue;
+      spanFirst = std::min(spanFirst, ranges[k].first);
+      spanLast = std::max(spanLast, ranges[k].first + ranges[k].second);
+    }
+    if (spanFirst >= spanLast)
+      return;
+
+    unsigned padding = 0;
+    if (p->GetBaselineCorrectionStrategy() != m2::BaselineCorrectionType::None)
+      padding = p->GetBaseLineCorrectionHalfWindowSize();
+    const unsigned int paddingLeft = std::min<unsigned int>(padding, spanFirst);
+    const unsigned int paddingRight = std::min<unsigned int>(padding, mzs.size() - spanLast);
+    const unsigned int offset = spanFirst - paddingLeft;
+    const unsigned int length = spanLast - spanFirst + paddingLeft + paddingRight;
+
+    // Shifted spectra do not share the channel range, read them from the ibd.
+    const IntensityType *slab = nullptr;
+    if (m_ChannelCube && !accShift)
+    {
+      m_ChannelCube->WillNeed(offset, length);
+      slab = m_ChannelCube->Channel<IntensityType>(offset);
+    }
+    const auto N = spectra.size();
+
+    m2::Process::Map(N,
+                     threads,
+                     [&](auto /*id*/, auto a, auto b)
+                     {
+                       const auto &f = *view;
+                       std::vector<IntensityType> ints(length);
+                       std::vector<IntensityType> baseline(length);
+
+                       for (unsigned int i = a; i < b; ++i)
+                       {
+                         const auto &spectrum = spectra[i];
+                         if (maskAccess && maskAccess->GetPixelByIndex(spectrum.index) == 0)
+                           continue;
+
+                         if (slab)
+                         {
+                           for (unsigned int c = 0; c < length; ++c)
+                             ints[c] = slab[c * N + i];
+                         }
+                         else
+                         {
+                           long long start = offset;
+                           if (accShift)
+                             start += accShift->GetPixelByIndex(spectrum.index);
+                           ReadIntensities(f, spectrum, start, length, ints.data());
+                         }
+
+                         IntensityType norm = normAccess.GetPixelByIndex(spectrum.index);
+                         if (!(norm > 0) || std::isinf(norm))
+                           norm = 1;
+                         std::transform(std::begin(ints), std::end(ints), std::begin(ints), [&norm](auto &v) { return v / norm; });
+                         m_Smoother(std::begin(ints), std::end(ints));
+                         m_BaselineSubtractor(std::begin(ints), std::end(ints), std::begin(baseline));
+                         m_Transformer(std::begin(ints), std::end(ints));
+
+                         auto *row = Row(spectrum.index);
+                         for (std::size_t k = 0; k < K; ++k)
+                         {
+                           const auto s = std::next(std::begin(ints), ranges[k].first - offset);
+                           row[k] = Signal::RangePooling<IntensityType>(s, std::next(s, ranges[k].second), pooling);
+                         }
+                       }
+                     });
+  }
+  else if (any(spectrumType.Format & (m2::SpectrumFormat::ContinuousCentroid | m2::SpectrumFormat::ProcessedCentroid |
+                                      m2::SpectrumFormat::ProcessedProfile)))
+  {
+    m2::Process::Map(spectra.size(),
+                     threads,
+                     [&](auto /*id*/, auto a, auto b)
+                     {
+                       const auto &f = *view;
+                       std::vector<IntensityType> intsBuffer, ints;
+                       std::vector<MassAxisType> mzsBuffer;
+                       std::vector<double> decoded;
+
+                       for (unsigned int i = a; i < b; ++i)
+                       {
+                         auto &spectrum = spectra[i];
+                         if (maskAccess && maskAccess->GetPixelByIndex(spectrum.index) == 0)
+                           continue;
+
+                         IntensityType norm = normAccess.GetPixelByIndex(spectrum.index);
+                         if (norm <= 0 || std::isnan(norm) || std::isinf(norm))
+                         {
+                           MITK_ERROR << "Normalization factor is invalid: Nan=" << std::isnan(norm)
+                                      << " inf=" << std::isinf(norm) << " " << norm << " Spectrum-id:" << i;
+                           continue;
+                         }
+
+                         const auto intensities = IntensityRange(f, spectrum, intsBuffer);
+                         auto *row = Row(spectrum.index);
+                         const auto Merge = [&](auto first, auto last)
+                         {
+                           // lower bounds are ascending, the start of each range is searched from the previous one
+                           auto s = first;
+                           for (const auto k : order)
+                           {
+                             s = std::lower_bound(s, last, lower[k]);
+                             const auto e = std::upper_bound(s, last, upper[k]);
+                             if (s == e)
+                               continue;
+                             const auto pos = std::distance(first, s);
+                             ints.assign(std::next(intensities.begin(), pos), std::next(intensities.begin(), pos + std::distance(s, e)));
+                             std::transform(std::begin(ints), std::end(ints), std::begin(ints), [&norm](auto &v) { return v / norm; });
+                             row[k] = Signal::RangePooling<IntensityType>(std::begin(ints), std::end(ints), pooling);
+                           }
+                         };
+
+                         // !! mass axis of each spectrum is decoded from memory or read in place
+                         if (m_CompactMzAxes.Contains(i))
+                         {
+                           m_CompactMzAxes.Get(i, decoded);
+                           Merge(std::cbegin(decoded), std::cend(decoded));
+                         }
+                         else
+                         {
+                           const auto mzs = MzRange(f, spectrum, mzsBuffer);
+                           Merge(mzs.begin(), mzs.end());
+                         }
+                       }
+                     });
+  }
+}
+
 template <class MassAxisType, class IntensityType>
 void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeGeometry()
 {
+  m_NormalizationFactors.clear();
+
   std::array<itk::SizeValueType, 3> imageSize = {
     p->GetPropertyValue<unsigned int>("[IMS:1000042] max count of pixels x"),
     p->GetPropertyValue<unsigned int>("[IMS:1000043] max count of pixels y"),
@@ -628,27 +1227,7 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeGeomet
     image->SetProperty("m2aia.mask.initialization", mitk::StringProperty::New("external"));
   }
 
-  
-  
-  
-  
-  for (auto type :  m2::NormalizationStrategyTypeList){
-    // Create a reference image for normalization images
-    auto normImage = mitk::Image::New();
-    
-    
-    using LocalImageType = itk::Image<m2::NormImagePixelType, 3>;
-    auto caster = itk::CastImageFilter<ImageType, LocalImageType>::New();
-    caster->SetInput(itkIonImage);
-    caster->Update();
-    normImage->InitializeByItk(caster->GetOutput());
-    
-    mitk::ImagePixelWriteAccessor<m2::NormImagePixelType, 3> acc(normImage);
-    std::memset(acc.GetData(), 1.0, imageSize[0] * imageSize[1] * imageSize[2] * sizeof(m2::NormImagePixelType));
-    
-    p->SetNormalizationImage(normImage, type);
-    p->SetNormalizationImageStatus(type, false);
-  }
+  // normalization images are allocated on first access (m2::SpectrumImage::GetNormalizationImage)
 
   // p->SetNormalizationImageStatus(m2::NormalizationStrategyType::None, true);
 
@@ -762,9 +1341,8 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
     maxDownShift = std::max(0,*minMaxElement.second); // (+)
   
     const auto &spectra = p->GetSpectra();
-    std::ifstream f(p->GetBinaryDataPath(), std::ios::binary);
     mzs.resize(spectra[0].mzLength,0);
-    binaryDataToVector(f, spectra[0].mzOffset, spectra[0].mzLength, mzs.data());
+    ReadMzs(*p->GetBinaryDataView(), spectra[0], 0, spectra[0].mzLength, mzs.data());
 
     // **** Prepare Overview mzAxis
     auto &mzAxis = p->GetXAxis();
@@ -790,9 +1368,8 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
 
   }else{ 
     const auto &spectra = p->GetSpectra();
-    std::ifstream f(p->GetBinaryDataPath(), std::ios::binary);
     mzs.resize(spectra[0].mzLength);
-    binaryDataToVector(f, spectra[0].mzOffset, spectra[0].mzLength, mzs.data());
+    ReadMzs(*p->GetBinaryDataView(), spectra[0], 0, spectra[0].mzLength, mzs.data());
    
     mzAxis.clear();
     std::copy(std::begin(mzs), std::end(mzs), std::back_inserter(mzAxis));
@@ -811,23 +1388,24 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
 
   {
     auto &spectra = p->GetSpectra();
+    const auto view = p->GetBinaryDataView();
 
-    m2::Process::Map(
-      spectra.size(),
-      p->GetNumberOfThreads(),
-      [&](unsigned int t, unsigned int a, unsigned int b)
+    SequentialPass(
+      "Continuous profile overview spectra",
+      false,
+      [&](unsigned int t, const unsigned int *ids, unsigned int n)
       {
         std::vector<IntensityType> baseline(mzs.size(), 0);
         std::vector<IntensityType> ints(mzs.size(), 0);
-        std::ifstream f(p->GetBinaryDataPath(), std::ifstream::binary);
+        const auto &f = *view;
 
         double nFac = 1.0;
-        for (unsigned long int i = a; i < b; i++)
+        for (unsigned int k = 0; k < n; k++)
         {
-          auto &spectrum = spectra[i];
+          auto &spectrum = spectra[ids[k]];
           // Read data from file ------------
           ints.resize(spectrum.intLength);
-          binaryDataToVector(f, spectrum.intOffset, spectrum.intLength, ints.data());
+          ReadIntensities(f, spectrum, 0, spectrum.intLength, ints.data());
 
           try
           {
@@ -885,6 +1463,48 @@ MITK_INFO << "mzAxis Size " << mzAxis.size();
     std::transform(sumT[t].begin(), sumT[t].end(), sum.begin(), sum.begin(), plus);
   std::transform(sum.begin(), sum.end(), mean.begin(), [&](auto &a) { return a / double(N); });
 
+  InitializeChannelCube();
+}
+
+template <class MassAxisType, class IntensityType>
+void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeChannelCube()
+{
+  m_ChannelCube.reset();
+
+  const auto &spectra = p->GetSpectra();
+  if (spectra.empty())
+    return;
+
+  const auto numberOfChannels = spectra[0].intLength;
+  m_ChannelCube = m2::ImzMLChannelCubeFile::Open(p, sizeof(IntensityType), numberOfChannels);
+  if (m_ChannelCube)
+    return;
+
+  bool createCube = false;
+  if (auto *preferencesService = mitk::CoreServices::GetPreferencesService())
+    if (auto *preferences = preferencesService->GetSystemPreferences())
+      createCube = preferences->GetBool("m2aia.imzml.channel_cube", false);
+  if (!createCube)
+    return;
+
+  const auto view = p->GetBinaryDataView();
+
+  // Each spectrum is read (and inflated) once, the cube file transposes groups of spectra.
+  const auto reader = [&](std::uint64_t first, std::uint64_t n, char *block)
+  {
+    auto *values = reinterpret_cast<IntensityType *>(block);
+    m2::Process::Map(n,
+                     p->GetNumberOfThreads(),
+                     [&](unsigned int /*t*/, unsigned int a, unsigned int b)
+                     {
+                       const auto &f = *view;
+                       for (unsigned int i = a; i < b; ++i)
+                         ReadIntensities(f, spectra[first + i], 0, numberOfChannels, values + i * numberOfChannels);
+                     });
+  };
+
+  if (m2::ImzMLChannelCubeFile::Write(p, sizeof(IntensityType), numberOfChannels, reader))
+    m_ChannelCube = m2::ImzMLChannelCubeFile::Open(p, sizeof(IntensityType), numberOfChannels);
 }
 
 template <class MassAxisType, class IntensityType>
@@ -895,9 +1515,7 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
   { // load continuous x axis
     const auto &spectra = p->GetSpectra();
     mzs.resize(spectra[0].mzLength);
-
-    std::ifstream f(p->GetBinaryDataPath(), std::ios::binary);
-    binaryDataToVector(f, spectra[0].mzOffset, spectra[0].mzLength, mzs.data());
+    ReadMzs(*p->GetBinaryDataView(), spectra[0], 0, spectra[0].mzLength, mzs.data());
 
     auto &massAxis = p->GetXAxis();
     massAxis.clear();
@@ -918,23 +1536,21 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
   NormImageReadAccess accNorm(p->GetNormalizationImage(currentType));
 
   auto &spectra = p->GetSpectra();
+  const auto view = p->GetBinaryDataView();
 
   m2::Process::Map(spectra.size(),
                    p->GetNumberOfThreads(),
                    [&](unsigned int t, unsigned int a, unsigned int b)
                    {
-                     std::ifstream f;
-                     f.open(p->GetBinaryDataPath(), std::ios::binary);
-
+                     const auto &f = *view;
                      std::vector<IntensityType> ints;
 
                      for (unsigned i = a; i < b; i++)
                      {
-                       auto iO = spectra[i].intOffset;
                        auto iL = spectra[i].intLength;
                        ints.resize(iL);
                        
-                       binaryDataToVector(f, iO, iL, ints.data());
+                       ReadIntensities(f, spectra[i], 0, iL, ints.data());
 
                        auto nFac = accNorm.GetPixelByIndex(spectra[i].index);
                        
@@ -950,8 +1566,6 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
                        }
                       //  out << std::endl;
                      }
-
-                     f.close();
                    });
 
   auto &skyline = p->GetSkylineSpectrum();
@@ -1027,23 +1641,37 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
   std::vector<std::vector<unsigned int>> hT(T, std::vector<unsigned int>(binsN, 0));
   std::vector<std::vector<double>> xT(T, std::vector<double>(binsN, 0));
 
+  const auto view = p->GetBinaryDataView();
+
   // Find min max x values
   m2::Process::Map(spectra.size(),
                    T,
                    [&](unsigned int t, unsigned int a, unsigned int b)
                    {
-                     std::ifstream f(p->GetBinaryDataPath(), std::ios::binary);
-                     std::vector<MassAxisType> mzs;
+                     const auto &f = *view;
+                     std::vector<MassAxisType> mzsBuffer;
+                     MassAxisType first, last;
                      //  std::list<m2::Interval> peaks, tempList;
-                     // find x min/max
+                     // find x min/max, only the first and the last value of each mass axis are touched
                      for (unsigned i = a; i < b; i++)
                      {
                        const auto &mzO = spectra[i].mzOffset;
                        const auto &mzL = spectra[i].mzLength;
-                       mzs.resize(mzL);
-                       binaryDataToVector(f, mzO, mzL, mzs.data());
-                       xMin[t] = std::min(xMin[t], (double)mzs.front());
-                       xMax[t] = std::max(xMax[t], (double)mzs.back());
+                       if (mzL == 0)
+                         continue;
+                       if (m_MzZlibCompressed)
+                       {
+                         const auto mzs = MzRange(f, spectra[i], mzsBuffer);
+                         first = mzs.front();
+                         last = mzs.back();
+                       }
+                       else
+                       {
+                         binaryDataToVector(f, mzO, 1, &first);
+                         binaryDataToVector(f, mzO + (mzL - 1) * sizeof(MassAxisType), 1, &last);
+                       }
+                       xMin[t] = std::min(xMin[t], (double)first);
+                       xMax[t] = std::max(xMax[t], (double)last);
                      }
                    });
 
@@ -1056,27 +1684,32 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
   min = *std::min_element(std::begin(xMin), std::end(xMin));
   binSize = (max - min) / double(binsN);
 
-  
-  m2::Process::Map(spectra.size(),
-                   T,
-                   [&](unsigned int t, unsigned int a, unsigned int b)
+  bool compactMzAxes = true;
+  if (auto *preferencesService = mitk::CoreServices::GetPreferencesService())
+    if (auto *preferences = preferencesService->GetSystemPreferences())
+      compactMzAxes = preferences->GetBool("m2aia.imzml.compact_mz_axes", true);
+  m_CompactMzAxes.Resize(compactMzAxes ? spectra.size() : 0);
+
+  SequentialPass("Processed overview spectra",
+                 true,
+                 [&](unsigned int t, const unsigned int *ids, unsigned int n)
                    {
-                     std::ifstream f(p->GetBinaryDataPath(), std::ios::binary);
-                     std::vector<MassAxisType> mzs;
+                     const auto &f = *view;
+                     std::vector<MassAxisType> mzsBuffer;
                      std::vector<IntensityType> ints;
 
-                     for (unsigned i = a; i < b; i++)
+                     for (unsigned int c = 0; c < n; c++)
                      {
+                       const auto i = ids[c];
                        auto &spectrum = spectra[i];
-                       const auto &mzO = spectrum.mzOffset;
                        const auto &mzL = spectrum.mzLength;
-                       mzs.resize(mzL);
-                       binaryDataToVector(f, mzO, mzL, mzs.data());
+                       const auto mzs = MzRange(f, spectrum, mzsBuffer);
+                       if (compactMzAxes)
+                         m_CompactMzAxes.Set(i, mzs.begin(), mzs.size());
 
-                       const auto &intO = spectrum.intOffset;
                        const auto &intL = spectrum.intLength;
                        ints.resize(intL);
-                       binaryDataToVector(f, intO, intL, ints.data());
+                       ReadIntensities(f, spectrum, 0, intL, ints.data());
 
                        assert(intL > 0);
                        assert(mzL > 0);
@@ -1108,10 +1741,18 @@ void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::InitializeImageA
                        }
                        
                      }
-
-                     f.close();
                    });
 
+  if (compactMzAxes)
+  {
+    m_CompactMzAxes.Finalize();
+    MITK_INFO << "m/z axes held in memory: " << m_CompactMzAxes.GetNumberOfDistinctAxes() << " distinct, "
+              << m_CompactMzAxes.GetMemorySize() / (1024.0 * 1024.0) << " MiB";
+    if (const auto n = m_CompactMzAxes.GetNumberOfSpectraOverBudget())
+      MITK_INFO << "m/z axes of " << n << " spectra exceed the memory budget of "
+                << m_CompactMzAxes.GetMemoryBudget() / (1024.0 * 1024.0) << " MiB, they are read from disk";
+  }
+
   // REDUCE
   for (unsigned int i = 1; i < T; ++i)
   {
@@ -1166,44 +1807,61 @@ template <class MassAxisType, class IntensityType>
 template <class OutputType>
 void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetXValues(unsigned int id, std::vector<OutputType> &xd)
 {
-  std::ifstream f(p->GetBinaryDataPath(), std::ios::binary);
+  const auto view = p->GetBinaryDataView();
+  const auto &f = *view;
 
   const auto &spectrum = p->GetSpectra()[id];
   const auto &length = spectrum.mzLength;
-  const auto &offset = spectrum.mzOffset;
 
-  if (std::is_same<MassAxisType, OutputType>::value)
+  if constexpr (std::is_same<MassAxisType, OutputType>::value)
   {
     xd.resize(length);
-    binaryDataToVector(f, offset, length, xd.data());
+    ReadMzs(f, spectrum, 0, length, xd.data());
   }
   else
   {
-    std::vector<MassAxisType> xs;
-    xs.resize(length);
-    binaryDataToVector(f, offset, length, xs.data());
+    std::vector<MassAxisType> buffer;
+    const auto xs = MzRange(f, spectrum, buffer);
     // copy and convert
     xd.resize(length);
     std::copy(std::begin(xs), std::end(xs), std::begin(xd));
   }
 }
 
+template <class MassAxisType, class IntensityType>
+void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetRawYValues(unsigned int id, std::vector<float> &yd)
+{
+  const auto view = p->GetBinaryDataView();
+  const auto &spectrum = p->GetSpectra()[id];
+  if constexpr (std::is_same<IntensityType, float>::value)
+  {
+    yd.resize(spectrum.intLength);
+    ReadIntensities(*view, spectrum, 0, spectrum.intLength, yd.data());
+  }
+  else
+  {
+    std::vector<IntensityType> ys(spectrum.intLength);
+    ReadIntensities(*view, spectrum, 0, spectrum.intLength, ys.data());
+    yd.assign(std::begin(ys), std::end(ys));
+  }
+}
+
 template <class MassAxisType, class IntensityType>
 template <class OutputType>
 void m2::ImzMLSpectrumImageSource<MassAxisType, IntensityType>::GetYValues(unsigned int id, std::vector<OutputType> &yd)
 {
-  std::ifstream f(p->GetBinaryDataPath(), std::ios::binary);
+  const auto view = p->GetBinaryDataView();
+  const auto &f = *view;
 
   const auto &spectrum = p->GetSpectra()[id];
   const auto &length = spectrum.intLength;
-  const auto &offset = spectrum.intOffset;
 
   mitk::ImagePixelReadAccessor<m2::NormImagePixelType, 3> normAccess(p->GetNormalizationImage());
 
   {
     std::vector<IntensityType> ys;
     ys.resize(length);
-    binaryDataToVector(f, offset, length, ys.data());
+    ReadIntensities(f, spectrum, 0, length, ys.data());
 
     IntensityType norm = normAccess.GetPixelByIndex(spectrum.index);
     std::transform(std::begin(ys), std::end(ys), std::begin(ys), [&norm](auto &v) { return v / norm; });
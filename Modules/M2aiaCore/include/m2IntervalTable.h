@@ -0,0 +1,117 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstdint>
+#include <m2CoreCommon.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace m2
+{
+  struct Interval;
+  class MemoryMappedFile;
+
+  /**
+   * @class IntervalTable
+   * @brief Columnar representation of an interval list and its binary file format (*.m2intervals).
+   *
+   * Each accumulator field (sum, min, max, count of x and y) and the source ids are stored
+   * as separate arrays; descriptions are kept in an optional string table. An interval
+   * occupies 60 bytes instead of a full m2::Interval with its std::string.
+   *
+   * Tables created from a file reference the columns of a read-only memory mapping,
+   * nothing is copied on load.
+   *
+   * File layout (little endian, columns aligned to 8 bytes):
+   * header (64 bytes) | info | xSum xMin xMax xCount | ySum yMin yMax yCount | sourceId |
+   * [description offsets (count + 1) | description bytes]
+   */
+  class M2AIACORE_EXPORT IntervalTable
+  {
+  public:
+    static constexpr char Extension[] = ".m2intervals";
+    static constexpr unsigned int Version = 1;
+
+    IntervalTable() = default;
+    explicit IntervalTable(const std::vector<m2::Interval> &intervals);
+
+    IntervalTable(const IntervalTable &) = delete;
+    IntervalTable &operator=(const IntervalTable &) = delete;
+
+    /// @brief Map a *.m2intervals file.
+    static std::shared_ptr<const IntervalTable> Open(const std::string &path);
+
+    /// @brief Write the table (columns and meta data) to path.
+    void Write(const std::string &path) const;
+
+    /// @brief Write intervals column by column without building a table in memory.
+    static void Write(const std::string &path,
+                      const std::vector<m2::Interval> &intervals,
+                      m2::SpectrumFormat type,
+                      const std::string &info,
+                      unsigned int numberOfSourcePixels);
+
+    std::size_t Size() const { return m_Size; }
+
+    const double *XSum() const { return m_XSum; }
+    const double *XMin() const { return m_XMin; }
+    const double *XMax() const { return m_XMax; }
+    const std::uint32_t *XCount() const { return m_XCount; }
+    const double *YSum() const { return m_YSum; }
+    const double *YMin() const { return m_YMin; }
+    const double *YMax() const { return m_YMax; }
+    const std::uint32_t *YCount() const { return m_YCount; }
+    const std::uint32_t *SourceId() const { return m_SourceId; }
+
+    bool HasDescriptions() const { return m_DescriptionOffsets != nullptr; }
+    std::string GetDescription(std::size_t i) const;
+
+    m2::Interval GetInterval(std::size_t i) const;
+    void GetIntervals(std::vector<m2::Interval> &intervals) const;
+
+    m2::SpectrumFormat GetType() const { return m_Type; }
+    void SetType(m2::SpectrumFormat type) { m_Type = type; }
+    const std::string &GetInfo() const { return m_Info; }
+    void SetInfo(const std::string &info) { m_Info = info; }
+    unsigned int GetNumberOfSourcePixels() const { return m_NumberOfSourcePixels; }
+    void SetNumberOfSourcePixels(unsigned int n) { m_NumberOfSourcePixels = n; }
+
+  private:
+    std::size_t m_Size = 0;
+    m2::SpectrumFormat m_Type = m2::SpectrumFormat::Centroid;
+    std::string m_Info;
+    unsigned int m_NumberOfSourcePixels = 0;
+
+    const double *m_XSum = nullptr, *m_XMin = nullptr, *m_XMax = nullptr;
+    const double *m_YSum = nullptr, *m_YMin = nullptr, *m_YMax = nullptr;
+    const std::uint32_t *m_XCount = nullptr, *m_YCount = nullptr, *m_SourceId = nullptr;
+    const std::uint64_t *m_DescriptionOffsets = nullptr;
+    const char *m_Descriptions = nullptr;
+
+    // storage of tables created in memory
+    std::vector<double> m_Doubles;
+    std::vector<std::uint32_t> m_Integers;
+    std::vector<std::uint64_t> m_Offsets;
+    std::string m_Strings;
+
+    // storage of tables created from a file
+    std::shared_ptr<m2::MemoryMappedFile> m_File;
+  };
+
+} // namespace m2
@@ -15,6 +15,8 @@ See LICENSE.txt for details.
 #pragma once
 #include <M2aiaCoreExports.h>
 #include <m2CoreCommon.h>
+#include <memory>
+#include <mutex>
 #include <mitkBaseData.h>
 #include <mitkDataNode.h>
 #include <mitkProperties.h>
@@ -113,6 +115,8 @@ namespace m2
   };
   
   
+  class IntervalTable;
+
   /**
    * DataNode properties:
    * - spectrum.plot.color: color of plot lines in spectrum view's
@@ -153,8 +157,26 @@ namespace m2
     // std::vector<double> GetIndexMin() const;
     // std::vector<unsigned int> GetIndexCount() const;
 
-    std::vector<Interval> &GetIntervals() { return m_Data; }
-    const std::vector<Interval> &GetIntervals() const { return m_Data; }
+    /**
+     * @brief Intervals as objects. A compact table (see SetTable) is expanded on first access
+     * and discarded: the vector then holds a full m2::Interval (with its std::string) per entry.
+     * Prefer the column getters (GetXMean, ...) and GetNumberOfIntervals for read-only access.
+     * The expansion is thread-safe, modifying the intervals is not.
+     */
+    std::vector<Interval> &GetIntervals();
+    const std::vector<Interval> &GetIntervals() const;
+
+    /**
+     * @brief Use a columnar table (e.g. mapped from a *.m2intervals file) as data.
+     * The x/y getters (GetXMean, ...) read the columns directly, the intervals are
+     * only materialized by GetIntervals(). Type, info and pixel count are taken from the table.
+     */
+    void SetTable(std::shared_ptr<const IntervalTable> table);
+
+    /// @brief Compact table or nullptr if the intervals are held as objects.
+    std::shared_ptr<const IntervalTable> GetTable() const;
+
+    std::size_t GetNumberOfIntervals() const;
     void SetType(SpectrumFormat type)
     {
       m_Type = type;
@@ -208,11 +230,13 @@ namespace m2
     //## compatibility reasons. Override in sub-classes that
     //## support distinction between empty/non-empty state.
     virtual bool IsEmpty() const{
-      return m_Data.empty();
+      return GetNumberOfIntervals() == 0;
     }
 
   private:
-    std::vector<Interval> m_Data;
+    mutable std::vector<Interval> m_Data;
+    mutable std::shared_ptr<const IntervalTable> m_Table;
+    mutable std::mutex m_TableMutex;
     std::string m_Info = "Not Set!";
     SpectrumFormat m_Type = SpectrumFormat::Centroid;
 
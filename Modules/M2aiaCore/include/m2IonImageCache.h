@@ -0,0 +1,125 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstdint>
+#include <list>
+#include <m2CoreCommon.h>
+#include <map>
+#include <mutex>
+#include <signal/m2SignalCommon.h>
+#include <vector>
+
+namespace mitk
+{
+  class Image;
+}
+
+namespace m2
+{
+  class SpectrumImage;
+
+  /**
+   * @class IonImageCache
+   * @brief Bounded LRU cache of generated ion images.
+   *
+   * Entries are keyed by the spectrum image, the queried range and all settings of the image
+   * that change the pixel values (spectral and image processing, pooling, normalization image,
+   * shift image and mask). If the capacity (in bytes) is exceeded, the least recently used
+   * images are dropped.
+   *
+   * All spectrum images share one cache (see GetInstance), the capacity bounds the memory of
+   * all cached ion images, e.g. of the many slices of an image stack. The cache is thread safe.
+   * It does not observe the spectrum images, owners have to call Clear(image) if the underlying
+   * data changes (e.g. on InitializeImageAccess) and when they are destroyed.
+   */
+  class M2AIACORE_EXPORT IonImageCache
+  {
+  public:
+    static constexpr std::size_t DefaultCapacity = std::size_t(256) << 20;
+
+    /// @brief The cache shared by all spectrum images.
+    static IonImageCache &GetInstance();
+
+    struct Key
+    {
+      std::uintptr_t image = 0;
+      double x = 0;
+      double tol = 0;
+      m2::NormalizationStrategyType normalization = m2::NormalizationStrategyType::None;
+      m2::IntensityTransformationType intensityTransformation = m2::IntensityTransformationType::None;
+      m2::SmoothingType smoothing = m2::SmoothingType::None;
+      unsigned int smoothingHalfWindowSize = 0;
+      m2::BaselineCorrectionType baselineCorrection = m2::BaselineCorrectionType::None;
+      unsigned int baselineCorrectionHalfWindowSize = 0;
+      m2::RangePoolingStrategyType pooling = m2::RangePoolingStrategyType::None;
+      m2::ImageNormalizationStrategyType imageNormalization = m2::ImageNormalizationStrategyType::None;
+      m2::ImageSmoothingStrategyType imageSmoothing = m2::ImageSmoothingStrategyType::None;
+      unsigned long normalizationImageMTime = 0;
+      unsigned long shiftImageMTime = 0;
+      std::uintptr_t mask = 0;
+      unsigned long maskMTime = 0;
+
+      bool operator<(const Key &other) const;
+    };
+
+    /// @brief Key of an ion image of image in the range [x-tol, x+tol] with the current settings of image.
+    /// Images (normalization, shift and mask) are identified by their MTime, so this is cheap enough for every query.
+    static Key MakeKey(const m2::SpectrumImage *image, double x, double tol, const mitk::Image *mask);
+
+    explicit IonImageCache(std::size_t capacity = DefaultCapacity) : m_Capacity(capacity) {}
+
+    IonImageCache(const IonImageCache &) = delete;
+    IonImageCache &operator=(const IonImageCache &) = delete;
+
+    /// @brief Copy the cached image into target. Returns false on a miss (target is not modified then).
+    bool Get(const Key &key, mitk::Image *target);
+
+    /// @brief Store a copy of the pixel values of image.
+    void Put(const Key &key, const mitk::Image *image);
+
+    void Clear();
+
+    /// @brief Remove all ion images of image.
+    void Clear(const m2::SpectrumImage *image);
+
+    void SetCapacity(std::size_t bytes);
+    std::size_t GetCapacity() const;
+
+    /// @brief Memory used by the cached images in bytes.
+    std::size_t GetSize() const;
+    std::size_t GetNumberOfEntries() const;
+
+    std::size_t GetHits() const;
+    std::size_t GetMisses() const;
+
+  private:
+    using ValuesType = std::vector<m2::DisplayImagePixelType>;
+    using EntryList = std::list<std::pair<Key, ValuesType>>;
+
+    void Evict();
+
+    mutable std::mutex m_Mutex;
+    EntryList m_Entries; // most recently used first
+    std::map<Key, EntryList::iterator> m_Index;
+    std::size_t m_Capacity;
+    std::size_t m_Size = 0;
+    std::size_t m_Hits = 0;
+    std::size_t m_Misses = 0;
+  };
+
+} // namespace m2
@@ -0,0 +1,88 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mitkImage.h>
+#include <mutex>
+#include <thread>
+
+namespace m2
+{
+  class SpectrumImage;
+
+  /**
+   * @class IonImageScheduler
+   * @brief Runs ion image requests (SpectrumImage::TryGetImage) one after another on a worker thread.
+   *
+   * At most one request per spectrum image is pending. A new request for an image supersedes
+   * its pending request and cancels the one in progress, which stops after its current chunk
+   * of spectra. Scrubbing through the spectrum thus only computes the latest requested image.
+   * Requests equal to the pending or running one (same image, range, mask and target) are
+   * coalesced and share its future.
+   *
+   * Requests render into a scratch image that is copied to the target if the image was generated.
+   * Futures resolve to true if the image was generated and to false if the request was
+   * superseded, cancelled or failed; the target is unchanged in that case.
+   */
+  class M2AIACORE_EXPORT IonImageScheduler
+  {
+  public:
+    /// @brief Called when a request is done (on the worker thread) or superseded/cancelled (on the calling thread).
+    using CallbackType = std::function<void(bool generated)>;
+
+    IonImageScheduler();
+    ~IonImageScheduler();
+
+    IonImageScheduler(const IonImageScheduler &) = delete;
+    IonImageScheduler &operator=(const IonImageScheduler &) = delete;
+
+    std::shared_future<bool> Submit(const m2::SpectrumImage *image,
+                                     double x,
+                                     double tol,
+                                     const mitk::Image *mask,
+                                     mitk::Image *target,
+                                     CallbackType onFinished = nullptr);
+
+    /// @brief Cancel the running and drop all pending requests.
+    void CancelAll();
+
+    /// @brief Block until all requests are finished.
+    void Wait();
+
+  private:
+    struct Request;
+    using RequestPointer = std::shared_ptr<Request>;
+
+    static void Finish(Request &request, bool generated);
+    void Run();
+
+    std::mutex m_Mutex;
+    std::condition_variable m_RequestAvailable;
+    std::condition_variable m_Idle;
+    std::deque<RequestPointer> m_Pending;
+    RequestPointer m_Running;
+    unsigned int m_Active = 0;
+    bool m_Stop = false;
+    std::thread m_Worker;
+  };
+
+} // namespace m2
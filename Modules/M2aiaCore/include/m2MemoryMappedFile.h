@@ -0,0 +1,151 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace m2
+{
+  /**
+   * @class MemoryMappedFile
+   * @brief Read-only memory mapping of a file (e.g. the *.ibd of an imzML data set).
+   *
+   * One mapping is shared by all worker threads. Readers access the binary data
+   * in place or copy it out with memcpy, no per-call file stream is required.
+   * Access pattern hints are forwarded to the operating system (madvise, posix_fadvise).
+   */
+  class M2AIACORE_EXPORT MemoryMappedFile
+  {
+  public:
+    enum class AccessHint
+    {
+      Normal,
+      Sequential,
+      Random,
+      WillNeed
+    };
+
+    explicit MemoryMappedFile(const std::string &path);
+    ~MemoryMappedFile();
+
+    MemoryMappedFile(const MemoryMappedFile &) = delete;
+    MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+    const char *Data() const { return m_Data; }
+    std::uint64_t Size() const { return m_Size; }
+    const std::string &GetPath() const { return m_Path; }
+
+    /**
+     * @brief Forward an access pattern hint to the OS for the byte range [offset, offset + length).
+     * The mapping is shared by all readers, hints are given for the range a reader is about to
+     * access and never for the whole file (a length of 0 is ignored).
+     */
+    void Advise(AccessHint hint, std::uint64_t offset, std::uint64_t length) const;
+
+    /**
+     * @brief Returns a typed pointer to n elements starting at the byte offset or nullptr if the
+     * offset is not suitably aligned for DataType (or n is 0). Use Copy() as fallback.
+     * Throws if the range exceeds the mapping.
+     */
+    template <class DataType>
+    const DataType *Pointer(std::uint64_t offset, std::uint64_t n) const
+    {
+      if (n == 0)
+        return nullptr;
+      if (!Contains(offset, n * sizeof(DataType)))
+        ThrowOutOfRange(offset, n * sizeof(DataType));
+      const char *ptr = m_Data + offset;
+      if (reinterpret_cast<std::uintptr_t>(ptr) % alignof(DataType) != 0)
+        return nullptr;
+      return reinterpret_cast<const DataType *>(ptr);
+    }
+
+    /**
+     * @brief Copy n elements starting at the byte offset into dest.
+     * Throws if the range exceeds the mapping.
+     */
+    template <class DataType>
+    void Copy(std::uint64_t offset, std::uint64_t n, DataType *dest) const
+    {
+      if (n == 0)
+        return;
+      if (!Contains(offset, n * sizeof(DataType)))
+        ThrowOutOfRange(offset, n * sizeof(DataType));
+      std::memcpy(dest, m_Data + offset, n * sizeof(DataType));
+    }
+
+    /**
+     * @brief Check that [offset, offset + bytes) is inside of the mapping.
+     */
+    bool Contains(std::uint64_t offset, std::uint64_t bytes) const noexcept
+    {
+      return offset <= m_Size && bytes <= m_Size - offset;
+    }
+
+  private:
+    [[noreturn]] void ThrowOutOfRange(std::uint64_t offset, std::uint64_t bytes) const;
+
+    std::string m_Path;
+    const char *m_Data = nullptr;
+    std::uint64_t m_Size = 0;
+#ifdef _WIN32
+    void *m_FileHandle = nullptr;
+    void *m_MappingHandle = nullptr;
+#else
+    int m_FileDescriptor = -1;
+#endif
+  };
+
+  /**
+   * @class MemoryMappedOutputFile
+   * @brief Writable memory mapping of a newly created file of fixed size.
+   *
+   * Worker threads fill disjoint byte ranges in place, no write buffers or file
+   * streams are involved. Dirty pages are written back by Flush() and on destruction.
+   */
+  class M2AIACORE_EXPORT MemoryMappedOutputFile
+  {
+  public:
+    /// @brief Create (or truncate) the file at path and map size bytes of it.
+    MemoryMappedOutputFile(const std::string &path, std::uint64_t size);
+    ~MemoryMappedOutputFile();
+
+    MemoryMappedOutputFile(const MemoryMappedOutputFile &) = delete;
+    MemoryMappedOutputFile &operator=(const MemoryMappedOutputFile &) = delete;
+
+    char *Data() { return m_Data; }
+    std::uint64_t Size() const { return m_Size; }
+    const std::string &GetPath() const { return m_Path; }
+
+    /// @brief Write modified pages back to the file (blocking).
+    void Flush();
+
+  private:
+    std::string m_Path;
+    char *m_Data = nullptr;
+    std::uint64_t m_Size = 0;
+#ifdef _WIN32
+    void *m_FileHandle = nullptr;
+    void *m_MappingHandle = nullptr;
+#else
+    int m_FileDescriptor = -1;
+#endif
+  };
+
+} // namespace m2
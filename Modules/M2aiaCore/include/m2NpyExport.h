@@ -0,0 +1,49 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <string>
+
+namespace m2
+{
+  class SpectrumImage;
+  class IntervalVector;
+
+  /**
+   * @class NpyExport
+   * @brief Dense export of a spectrum image as NumPy arrays (*.npy).
+   *
+   * For the output path <name>.npy the following arrays are written:
+   * - <name>.npy: float32 matrix (pixels x features). Row r holds the pooled intensities
+   *   of all features (interval centers +/- image tolerance) of the r-th valid pixel.
+   * - <name>_coordinates.npy: int32 matrix (pixels x 3), pixel index (x, y, z) of each row.
+   * - <name>_mask.npy: uint16 mask labels of the image, shape (z, y, x).
+   * - <name>_features.npy: float64 interval centers (columns of the matrix).
+   *
+   * The matrix is filled by parallel row ranges directly in a memory mapped output file
+   * and can be opened without copying, e.g. np.load(path, mmap_mode='r').
+   * Intensities are taken from GetSpectrumFloat, i.e. with the current signal processing
+   * and normalization settings of the image. An empty mask or a failing spectrum read
+   * raises an exception.
+   */
+  class M2AIACORE_EXPORT NpyExport
+  {
+  public:
+    static void Write(const std::string &path, const m2::SpectrumImage *image, const m2::IntervalVector *features);
+  };
+
+} // namespace m2
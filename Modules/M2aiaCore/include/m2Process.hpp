@@ -17,7 +17,9 @@ See LICENSE.txt for details.
 
 #pragma once
 #include <cassert>
+#include <exception>
 #include <functional>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -43,21 +45,43 @@ namespace m2
       if (n == 0)
       { // recursively reduce threads to get non-zero n
         Map(N, T / 2, worker);
+        return;
       }
 
+      // an exception thrown by a worker is rethrown after all threads are joined
+      // (the first one if several workers fail)
+      std::exception_ptr error;
+      std::mutex errorMutex;
+      const auto guarded = [&](unsigned int t, unsigned int a, unsigned int b)
+      {
+        try
+        {
+          worker(t, a, b);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          if (!error)
+            error = std::current_exception();
+        }
+      };
+
       // start the workers
       unsigned int r = N % T;
       for (unsigned int t = 0; t < T; ++t)
       {
         if (t != (T - 1))
-          threads.emplace_back(std::thread(worker, t, t * n, (t + 1) * n));
+          threads.emplace_back(std::thread(guarded, t, t * n, (t + 1) * n));
         else
-          threads.emplace_back(std::thread(worker, t, t * n, (t + 1) * n + r));
+          threads.emplace_back(std::thread(guarded, t, t * n, (t + 1) * n + r));
       }
 
       // wait until the work is done
       for (auto &t : threads)
         t.join();
+
+      if (error)
+        std::rethrow_exception(error);
     }
 
     template <class ElementType, class BinaryReduceOperationFunctionType, class UnaryFinalizeOperationFunctionType>
@@ -18,6 +18,7 @@ See LICENSE.txt for details.
 #include <M2aiaCoreExports.h>
 #include <algorithm>
 #include <array>
+#include <m2AlignedAllocator.h>
 #include <m2SpectrumImage.h>
 #include <m2ISpectrumImageSource.h>
 #include <mitkDataNode.h>
@@ -26,6 +27,8 @@ See LICENSE.txt for details.
 #include <mitkImageAccessByItk.h>
 #include <mitkStringProperty.h>
 #include <mitkVectorProperty.h>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
 #include <thread>
@@ -57,14 +60,20 @@ namespace m2
     itkSetEnumMacro(ImageAccessInitialized, bool);
     itkGetEnumMacro(ImageAccessInitialized, bool);
 
+    /// @brief Pixels outside of the mask (if given) are 0.
     void GetImage(double mz, double tol, const mitk::Image *mask, mitk::Image *img) const override;
+
+    /// @brief Each spectrum row of the pixel-major matrix is visited once for all ranges.
+    void GetImages(const std::vector<double> &xs,
+                   const std::vector<double> &tols,
+                   const mitk::Image *mask,
+                   std::vector<m2::DisplayImagePixelType> &values) const override;
     
 
     struct SpectrumData
     {
       uint32_t id;
       itk::Index<3> index;
-      std::vector<float> data;
       struct
       {
         float x, y, z;
@@ -76,6 +85,46 @@ namespace m2
     itkGetMacro(Spectra, SpectrumVectorType &);
     itkGetConstReferenceMacro(Spectra, SpectrumVectorType);
 
+    /**
+     * @brief Memory layout used by GetImage.
+     * The pixel-major matrix (one row per spectrum) is always kept, spectra are read from it.
+     * ChannelMajor additionally keeps a wavenumber-major copy (one row per channel) that is
+     * built on the first band image; range sums then stream contiguous rows over all pixels.
+     */
+    enum class SpectralDataLayout
+    {
+      PixelMajor,
+      ChannelMajor
+    };
+
+    /// @brief Switching to PixelMajor releases the wavenumber-major copy.
+    void SetImageLayout(SpectralDataLayout layout);
+    SpectralDataLayout GetImageLayout() const { return m_ImageLayout; }
+
+    /**
+     * @brief Intensities of channel c of all spectra (ordered by id). Builds the wavenumber-major copy if required.
+     * The pointer keeps the copy alive if it is released meanwhile. Null if there are no channels.
+     */
+    std::shared_ptr<const float> GetChannelData(std::size_t c) const;
+
+    /// @brief Drop the wavenumber-major copy (e.g. after the pixel-major matrix was modified).
+    void ReleaseChannelMajorData();
+
+    /**
+     * @brief Allocate the intensities of all spectra as one contiguous, cache line aligned matrix
+     * (numberOfSpectra x numberOfChannels, pixel-major). Readers write into GetSpectrumData(id).
+     */
+    void AllocateSpectralData(std::size_t numberOfSpectra, std::size_t numberOfChannels);
+
+    /// @brief Drop spectra at the end of the matrix (e.g. if a file contains less spectra than announced).
+    void ResizeSpectralData(std::size_t numberOfSpectra);
+
+    std::size_t GetNumberOfChannels() const { return m_NumberOfChannels; }
+
+    /// @brief Intensities of spectrum id (GetNumberOfChannels() values).
+    float *GetSpectrumData(unsigned int id) { return m_SpectralData.data() + id * m_NumberOfChannels; }
+    const float *GetSpectrumData(unsigned int id) const { return m_SpectralData.data() + id * m_NumberOfChannels; }
+
     void InitializeImageAccess() override;
     void InitializeGeometry() override;
     void InitializeProcessor() override;
@@ -87,6 +136,11 @@ namespace m2
 
   private:
     SpectrumVectorType m_Spectra;
+    m2::AlignedVector<float> m_SpectralData;
+    std::size_t m_NumberOfChannels = 0;
+    SpectralDataLayout m_ImageLayout = SpectralDataLayout::PixelMajor;
+    mutable std::shared_ptr<const m2::AlignedVector<float>> m_ChannelMajorData;
+    mutable std::mutex m_ChannelMajorMutex;
     m2::SpectrumFormat m_ImportMode = m2::SpectrumFormat::ContinuousProfile;
     using m2::SpectrumImage::InternalClone;
     bool m_ImageAccessInitialized = false;
@@ -95,17 +149,20 @@ namespace m2
     SpectrumContainerImage();
     ~SpectrumContainerImage() override;
 
+    /// @brief Wavenumber-major copy of the matrix (numberOfChannels x numberOfSpectra), built on first use.
+    std::shared_ptr<const m2::AlignedVector<float>> GetChannelMajorData() const;
+
 
     void GetYValues(unsigned int id, std::vector<float> & data) const
     {
-      data = m_Spectra[id].data;
+      const auto *d = GetSpectrumData(id);
+      data.assign(d, d + m_NumberOfChannels);
     }
     
     void GetYValues(unsigned int id, std::vector<double> & data) const
     {
-      const auto & d = m_Spectra[id].data;
-      data.resize(d.size());
-      std::copy(std::begin(d), std::end(d), std::begin(data));
+      const auto *d = GetSpectrumData(id);
+      data.assign(d, d + m_NumberOfChannels);
     }
     
     void GetXValues(unsigned int /*id*/, std::vector<float> & data) const
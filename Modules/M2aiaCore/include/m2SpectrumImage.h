@@ -20,9 +20,13 @@ See LICENSE.txt for details.
 #include <m2CoreCommon.h>
 #include <m2ElxRegistrationHelper.h>
 #include <m2ISpectrumImageDataAccess.h>
+#include <m2IonImageCache.h>
 #include <m2SpectrumInfo.h>
 #include <mitkImage.h>
 #include <mitkProperties.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <random>
 #include <signal/m2SignalCommon.h>
 
@@ -51,6 +55,9 @@ namespace m2
     using NormalizationImageMapType = std::map<m2::NormalizationStrategyType, NormalizationImageData>;
     using TransformParameterVectorType = std::vector<std::string>;
 
+    /// @brief Loads an associated image (e.g. a *.nrrd next to the imzML) on demand; may return nullptr.
+    using DeferredImageLoader = std::function<mitk::Image::Pointer()>;
+
     mitkClassMacro(SpectrumImage, mitk::Image);
 
     itkSetEnumMacro(NormalizationStrategy, NormalizationStrategyType);
@@ -107,13 +114,27 @@ namespace m2
     itkGetMacro(NormalizationImages, NormalizationImageMapType &);
     itkGetConstReferenceMacro(NormalizationImages, NormalizationImageMapType);
 
-    itkGetMacro(MaskImage, mitk::Image::Pointer);
-    itkGetConstMacro(MaskImage, mitk::Image::Pointer);
-    itkSetMacro(MaskImage, mitk::Image::Pointer);
+    mitk::Image::Pointer GetMaskImage();
+    mitk::Image::Pointer GetMaskImage() const;
+    void SetMaskImage(mitk::Image::Pointer image);
+
+    mitk::Image::Pointer GetShiftImage();
+    mitk::Image::Pointer GetShiftImage() const;
+    void SetShiftImage(mitk::Image::Pointer image);
+
+    /// @brief Register a loader that provides the mask image on first access.
+    /// If the loader returns nullptr, the current mask image is kept.
+    void SetDeferredMaskImage(DeferredImageLoader loader);
+
+    /// @brief Register a loader that provides the shift image on first access.
+    void SetDeferredShiftImage(DeferredImageLoader loader);
+
+    /// @brief Register a loader that provides an initialized normalization image of the given type
+    /// on first access. The image must be of m2::NormImagePixelType and match the image geometry.
+    void SetDeferredNormalizationImage(m2::NormalizationStrategyType type, DeferredImageLoader loader);
 
-    itkGetMacro(ShiftImage, mitk::Image::Pointer);
-    itkGetConstMacro(ShiftImage, mitk::Image::Pointer);
-    itkSetMacro(ShiftImage, mitk::Image::Pointer);
+    /// @brief Create an image of m2::NormImagePixelType with the geometry of this image, filled with 1.
+    mitk::Image::Pointer CreateNormalizationImage() const;
 
 
     itkGetMacro(IndexImage, mitk::Image::Pointer);
@@ -143,7 +164,12 @@ namespace m2
     // /// @brief Return the normalization image for the *currently* selected normalization method
     // virtual mitk::Image::Pointer GetNormalizationImage() const;
 
-    /// @brief Return and if necessary prepare the normalization image
+    /// @brief MTime of the normalization image for the *currently* selected normalization method, 0 if there is none yet.
+    /// Neither loads deferred images nor allocates a missing one.
+    unsigned long GetNormalizationImageMTime() const;
+
+    /// @brief Return and if necessary prepare the normalization image.
+    /// Pending deferred images are loaded, missing images are allocated on first access.
     virtual mitk::Image::Pointer GetNormalizationImage(m2::NormalizationStrategyType type);
 
     // /// @brief Return the normalization image
@@ -164,6 +190,27 @@ namespace m2
     /// @brief Override GetImage of the interface ISpectrumImageDataAccess
     void GetImage(double x, double tol, const mitk::Image *mask, mitk::Image *img) const override;
 
+    /// @brief GetImage that can be stopped early by setting cancelled (e.g. by m2::IonImageScheduler).
+    // Returns true if the image was generated, false if the request was cancelled or failed;
+    // img is incomplete in that case. The default implementation is not interruptible.
+    virtual bool TryGetImage(double x, double tol, const mitk::Image *mask, mitk::Image *img, const std::atomic<bool> &cancelled) const;
+
+    /// @brief Reduces spectral data to the gray values of several images at once.
+    // xs: center positions on the x axis
+    // tols: interval range around each center (xs[k]+/-tols[k])
+    // mask: region where image data is generated (if null the whole image region is queried)
+    // values: pixel-major matrix (number of image pixels x K) in image buffer order, i.e. values[pixel * K + k];
+    // this is the buffer layout of a K component vector image
+    // Results match K calls of GetImage (up to border effects of spectral smoothing/baseline correction).
+    // The default implementation does exactly that, derived classes read each spectrum only once.
+    virtual void GetImages(const std::vector<double> &xs,
+                           const std::vector<double> &tols,
+                           const mitk::Image *mask,
+                           std::vector<m2::DisplayImagePixelType> &values) const;
+
+    /// @brief Vector image with one component per center (tolerance as for single ion images, see ApplyTolerance)
+    mitk::Image::Pointer GetVectorImage(const std::vector<double> &xs, const mitk::Image *mask = nullptr) const;
+
     /// @brief Initialize the SpectrumImage's geometry
     // - Set the origin
     // - Set the image dimensions in x,y,z
@@ -200,6 +247,10 @@ namespace m2
     inline void SaveModeOff() const { this->m_InSaveMode = false; }
     double ApplyTolerance(double xValue) const;
 
+    /// @brief Cache of recently generated ion images (see m2::IonImageCache), e.g. for hit/miss statistics.
+    /// The cache is shared by all spectrum images.
+    m2::IonImageCache &GetIonImageCache() const { return m2::IonImageCache::GetInstance(); }
+
     void SetElxRegistrationHelper(const std::shared_ptr<m2::ElxRegistrationHelper> &d) { m_ElxRegistrationHelper = d; }
 
     const SpectrumInfo &GetSpectrumType() const { return m_SpectrumType; }
@@ -234,12 +285,23 @@ namespace m2
 
     SpectrumArtifactMapType m_SpectraArtifacts;
 
-    mitk::Image::Pointer m_MaskImage;
-    mitk::Image::Pointer m_ShiftImage;
+    // loaded on first access, also by the const getters (see ResolveDeferredMaskImage)
+    mutable mitk::Image::Pointer m_MaskImage;
+    mutable mitk::Image::Pointer m_ShiftImage;
     mitk::Image::Pointer m_IndexImage;
     mitk::PointSet::Pointer m_Points;
     NormalizationImageMapType m_NormalizationImages;
 
+    // associated images registered by the I/O, loaded on first access
+    mutable DeferredImageLoader m_DeferredMaskImage;
+    mutable DeferredImageLoader m_DeferredShiftImage;
+    std::map<m2::NormalizationStrategyType, DeferredImageLoader> m_DeferredNormalizationImages;
+    mutable std::mutex m_DeferredImagesMutex;
+
+    void ResolveDeferredMaskImage() const;
+    void ResolveDeferredShiftImage() const;
+    void ResolveDeferredNormalizationImage(m2::NormalizationStrategyType type);
+
     SpectrumInfo m_SpectrumType;
     SpectrumInfo m_ExportSpectrumType;
 
@@ -17,7 +17,9 @@ See LICENSE.txt for details.
 #include <M2aiaCoreExports.h>
 #include <m2SpectrumImage.h>
 #include <m2ElxRegistrationHelper.h>
+#include <map>
 #include <memory>
+#include <mutex>
 
 namespace m2
 {
@@ -65,6 +67,15 @@ namespace m2
     /// @param sliceIndex Index where the warped image will be added along the z-axis of the the 3D volume
     void CopyWarpedImageToStackImage(mitk::Image *warped, mitk::Image *stack, unsigned sliceIndex) const;
 
+    /// @brief Pass the processing parameters of the stack to a slice image
+    void ApplyProcessingSettings(m2::SpectrumImage *sliceImage) const;
+
+    /// @brief Slice images of the stack (one per slice index), prepared before they are accessed in parallel.
+    /// The processing parameters are applied once per distinct image and a mutex is added for each of them,
+    /// since an image may be referenced by several slices.
+    /// Throws if a slice is not a spectrum image or an untransformed slice does not match the stack dimensions.
+    std::vector<m2::SpectrumImage *> PrepareSliceImages(std::map<m2::SpectrumImage *, std::mutex> &sliceMutexes) const;
+
 
     unsigned int m_StackSize;
     double m_SpacingZ;
@@ -83,6 +94,12 @@ namespace m2
     void InitializeNormalizationImage(m2::NormalizationStrategyType /*type*/) override{}
 
     virtual void GetImage(double mz, double tol, const mitk::Image *mask, mitk::Image *img) const override;
+
+    /// @brief Each slice pools all ranges in one pass (SpectrumImage::GetImages), channels are warped one by one.
+    void GetImages(const std::vector<double> &xs,
+                   const std::vector<double> &tols,
+                   const mitk::Image *mask,
+                   std::vector<m2::DisplayImagePixelType> &values) const override;
     virtual void GetSpectrumFloat(unsigned int, std::vector<float> &, std::vector<float> &) const override{}
     virtual void GetIntensitiesFloat(unsigned int, std::vector<float> &) const override{}
 
@@ -0,0 +1,78 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <m2SpectrumImage.h>
+#include <m2TiledSpectrumStore.h>
+#include <memory>
+
+namespace m2
+{
+  /**
+   * @class TiledSpectrumImage
+   * @brief Spectrum image backed by a TiledSpectrumStore (*.m2tiles).
+   *
+   * Spectra are decoded from the chunks of their tile, ion images from the chunks of
+   * the channel blocks overlapping the queried range. No spectral data is held in memory.
+   * The store holds raw intensities, normalization and signal processing are applied on read.
+   */
+  class M2AIACORE_EXPORT TiledSpectrumImage final : public SpectrumImage
+  {
+  public:
+    typedef TiledSpectrumImage Self;
+    typedef SpectrumImage Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+    virtual std::vector<std::string> GetClassHierarchy() const override { return mitk::GetClassHierarchy<Self>(); }
+
+    // Overwrite those methods to make MITK recognize this as default mitk::Image
+    static const char *GetStaticNameOfClass() { return "Image"; }
+    const char *GetNameOfClass() const override { return "Image"; }
+
+    itkNewMacro(Self);
+
+    void SetStore(std::shared_ptr<const m2::TiledSpectrumStore> store) { m_Store = store; }
+    std::shared_ptr<const m2::TiledSpectrumStore> GetStore() const { return m_Store; }
+
+    void GetImage(double x, double tol, const mitk::Image *mask, mitk::Image *img) const override;
+
+    void InitializeImageAccess() override;
+    void InitializeGeometry() override;
+    void InitializeProcessor() override;
+    void InitializeNormalizationImage(m2::NormalizationStrategyType type) override;
+
+    void GetSpectrumFloat(unsigned int id, std::vector<float> &xs, std::vector<float> &ys) const override;
+    void GetSpectrum(unsigned int id, std::vector<double> &xs, std::vector<double> &ys) const override;
+    void GetIntensitiesFloat(unsigned int id, std::vector<float> &ys) const override;
+    void GetIntensities(unsigned int id, std::vector<double> &ys) const override;
+
+  private:
+    std::shared_ptr<const m2::TiledSpectrumStore> m_Store;
+
+    /// @brief Raw intensities of spectrum id. xs (optional) receives the x values of processed data,
+    /// the x axis of the store otherwise.
+    void ReadSpectrum(unsigned int id, std::vector<double> *xs, std::vector<float> &ys) const;
+
+    /// @brief Normalized and processed intensities of spectrum id (see ReadSpectrum).
+    void GetYValues(unsigned int id, std::vector<double> *xs, std::vector<float> &ys) const;
+
+    TiledSpectrumImage();
+    ~TiledSpectrumImage() override;
+    using m2::SpectrumImage::InternalClone;
+  };
+
+} // namespace m2
@@ -0,0 +1,64 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+
+#include <mitkAbstractFileIO.h>
+#include <mitkIOMimeTypes.h>
+#include <mitkImage.h>
+
+#include <m2TiledSpectrumStore.h>
+
+namespace m2
+{
+  /**
+   * Reads m2::TiledSpectrumImage from *.m2tiles files and converts m2::ImzMLSpectrumImage to *.m2tiles.
+   * @ingroup Process
+   */
+  class M2AIACORE_EXPORT TiledSpectrumImageIO : public mitk::AbstractFileIO
+  {
+  public:
+    TiledSpectrumImageIO();
+
+    std::string M2TILES_MIMETYPE_NAME()
+    {
+      static std::string name = mitk::IOMimeTypes::DEFAULT_BASE_NAME() + ".image.m2tiles";
+      return name;
+    }
+
+    mitk::CustomMimeType M2TILES_MIMETYPE()
+    {
+      mitk::CustomMimeType mimeType(M2TILES_MIMETYPE_NAME());
+      mimeType.AddExtension("m2tiles");
+      mimeType.SetCategory("Images");
+      mimeType.SetComment("M2aia tiled spectrum store");
+      return mimeType;
+    }
+
+    std::vector<mitk::BaseData::Pointer> DoRead() override;
+    ConfidenceLevel GetReaderConfidenceLevel() const override;
+
+    void Write() override;
+    ConfidenceLevel GetWriterConfidenceLevel() const override;
+
+    void SetOptions(const m2::TiledSpectrumStore::Options &options) { m_Options = options; }
+
+  private:
+    m2::TiledSpectrumStore::Options m_Options;
+    TiledSpectrumImageIO *IOClone() const override;
+  };
+} // namespace m2
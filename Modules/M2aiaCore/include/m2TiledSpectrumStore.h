@@ -0,0 +1,224 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+#pragma once
+
+#include <M2aiaCoreExports.h>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <m2CoreCommon.h>
+#include <m2MemoryMappedFile.h>
+#include <string>
+#include <vector>
+
+namespace m2
+{
+  class ImzMLSpectrumImage;
+
+  /// @brief Layout and compression of a TiledSpectrumStore (at namespace scope, used as default argument).
+  struct TiledSpectrumStoreOptions
+  {
+    unsigned int TileSize = 16;
+    unsigned int ChannelsPerBlock = 256;
+    bool UseZlibCompression = true;
+    int CompressionLevel = 1;
+  };
+
+  /**
+   * @class TiledSpectrumStore
+   * @brief Native M2aia storage of spectral data (*.m2tiles) chunked in pixel tiles and channel blocks.
+   *
+   * The store holds the raw intensities (no normalization or signal processing), the
+   * processing settings of the spectrum image are applied on read.
+   *
+   * Continuous data: all spectra share one x axis (channels). The image plane is split
+   * into tiles of TileSize x TileSize pixels, the x axis into blocks of ChannelsPerBlock
+   * channels. Each (tile, block) chunk holds the intensities of all spectra of the tile
+   * for the channels of the block (channel-major).
+   *
+   * Processed data: each spectrum keeps its own x axis. The x axis of the store is the
+   * overview axis of the image, there is one chunk per tile holding the x values and
+   * intensities of all spectra of the tile (see ReadProcessedTile).
+   *
+   * Chunks are zlib compressed individually if this reduces their size. A single
+   * spectrum touches the chunks of one tile, an ion image of continuous data touches the
+   * chunks of one (or a few) blocks.
+   */
+  class M2AIACORE_EXPORT TiledSpectrumStore
+  {
+  public:
+    static constexpr char Extension[] = ".m2tiles";
+    static constexpr unsigned int Version = 2;
+
+    using Options = TiledSpectrumStoreOptions;
+
+    struct Geometry
+    {
+      std::array<std::uint32_t, 3> Dimensions = {0, 0, 0};
+      std::array<double, 3> Spacing = {1, 1, 1};
+      std::array<double, 3> Origin = {0, 0, 0};
+    };
+
+    struct Spectrum
+    {
+      std::int64_t index[3];
+      float world[3];
+      std::uint32_t tile;
+      std::uint32_t slot;
+    };
+
+    /**
+     * @brief Provide the intensities of spectrum id on the shared x axis (numberOfChannels values).
+     */
+    using SpectrumReader = std::function<void(unsigned int id, float *ys)>;
+
+    /**
+     * @brief Provide the x values and intensities of spectrum id (processed data).
+     */
+    using ProcessedSpectrumReader = std::function<void(unsigned int id, std::vector<double> &xs, std::vector<float> &ys)>;
+
+    /**
+     * @brief Create a store file from continuous spectra on a shared x axis.
+     * Spectrum ids are preserved, spectra[i].tile and spectra[i].slot are assigned.
+     */
+    static void Write(const std::string &path,
+                      const Geometry &geometry,
+                      const std::string &xAxisLabel,
+                      m2::SpectrumFormat format,
+                      const std::vector<double> &xAxis,
+                      std::vector<Spectrum> spectra,
+                      const SpectrumReader &reader,
+                      const Options &options = Options());
+
+    /**
+     * @brief Create a store file from processed spectra, each on its own x axis.
+     * overviewAxis is stored as x axis of the store. maxSpectrumLength is an upper bound of
+     * the number of values of a spectrum (used to limit the memory while writing).
+     */
+    static void WriteProcessed(const std::string &path,
+                               const Geometry &geometry,
+                               const std::string &xAxisLabel,
+                               m2::SpectrumFormat format,
+                               const std::vector<double> &overviewAxis,
+                               std::vector<Spectrum> spectra,
+                               std::uint64_t maxSpectrumLength,
+                               const ProcessedSpectrumReader &reader,
+                               const Options &options = Options());
+
+    /**
+     * @brief Convert an imzML spectrum image with initialized image access.
+     * The raw intensities are stored on the native x axes of the spectra, continuous data
+     * on its shared axis and processed data per spectrum.
+     */
+    static void Write(const std::string &path, const m2::ImzMLSpectrumImage *image, const Options &options = Options());
+
+    explicit TiledSpectrumStore(const std::string &path);
+
+    TiledSpectrumStore(const TiledSpectrumStore &) = delete;
+    TiledSpectrumStore &operator=(const TiledSpectrumStore &) = delete;
+
+    const Geometry &GetGeometry() const { return m_Geometry; }
+    const std::string &GetXAxisLabel() const { return m_XAxisLabel; }
+    m2::SpectrumFormat GetFormat() const { return m_Format; }
+    const std::vector<double> &GetXAxis() const { return m_XAxis; }
+    const std::vector<Spectrum> &GetSpectra() const { return m_Spectra; }
+
+    /// @brief True if each spectrum has its own x axis (see ReadProcessedTile).
+    bool IsProcessed() const { return any(m_Format & m2::SpectrumFormat::Processed); }
+
+    std::uint64_t GetNumberOfChannels() const { return m_XAxis.size(); }
+    std::uint64_t GetChannelsPerBlock() const { return m_ChannelsPerBlock; }
+    std::uint64_t GetNumberOfBlocks() const { return m_NumberOfBlocks; }
+    std::uint64_t GetNumberOfTiles() const { return m_TileOffsets.size() - 1; }
+
+    /// @brief First channel and number of channels of block b.
+    std::uint64_t GetBlockBegin(std::uint64_t b) const { return b * m_ChannelsPerBlock; }
+    std::uint64_t GetBlockLength(std::uint64_t b) const;
+
+    /// @brief Number of spectra in tile t.
+    std::uint32_t GetTileLength(std::uint64_t t) const { return m_TileOffsets[t + 1] - m_TileOffsets[t]; }
+
+    /// @brief Spectrum ids of tile t (ordered by slot).
+    const std::uint32_t *GetTileSpectra(std::uint64_t t) const { return m_TileSpectra.data() + m_TileOffsets[t]; }
+
+    /**
+     * @brief Decode chunk (t, b). Returns GetBlockLength(b) x GetTileLength(t) values (channel-major).
+     * Uncompressed chunks are accessed in place, otherwise the buffer is used.
+     */
+    const float *ReadChunk(std::uint64_t t, std::uint64_t b, std::vector<float> &buffer) const;
+
+    /**
+     * @brief Spectra of a tile of processed data. The spectrum in slot s has the
+     * values [offsets[s], offsets[s + 1]) of xs and ys.
+     */
+    struct ProcessedTile
+    {
+      const std::uint64_t *offsets = nullptr;
+      const double *xs = nullptr;
+      const float *ys = nullptr;
+    };
+
+    /**
+     * @brief Decode the chunk of tile t of processed data.
+     * Uncompressed chunks are accessed in place, otherwise the buffer is used.
+     */
+    ProcessedTile ReadProcessedTile(std::uint64_t t, std::vector<char> &buffer) const;
+
+  private:
+    struct ChunkEntry
+    {
+      std::uint64_t offset;
+      std::uint64_t encodedBytes;
+      std::uint64_t rawBytes;
+    };
+
+    struct EncodedChunk
+    {
+      std::vector<char> bytes;
+      std::uint64_t rawBytes = 0;
+    };
+
+    /// @brief Encode the chunks (one per block) of a tile with the spectrum ids [ids, ids + m).
+    using TileEncoder = std::function<void(const std::uint32_t *ids, std::uint64_t m, std::vector<EncodedChunk> &chunks)>;
+
+    static void WriteFile(const std::string &path,
+                          const Geometry &geometry,
+                          const std::string &xAxisLabel,
+                          m2::SpectrumFormat format,
+                          const std::vector<double> &xAxis,
+                          std::vector<Spectrum> spectra,
+                          std::uint64_t channelsPerBlock,
+                          std::uint64_t bytesPerSpectrum,
+                          const TileEncoder &encoder,
+                          const Options &options);
+
+    /// @brief Decoded bytes of a chunk, in place or in buffer.
+    const char *ReadChunkBytes(const ChunkEntry &chunk, char *buffer) const;
+
+    m2::MemoryMappedFile m_File;
+    Geometry m_Geometry;
+    std::string m_XAxisLabel;
+    m2::SpectrumFormat m_Format = m2::SpectrumFormat::None;
+    std::vector<double> m_XAxis;
+    std::vector<Spectrum> m_Spectra;
+    std::vector<std::uint32_t> m_TileOffsets;
+    std::vector<std::uint32_t> m_TileSpectra;
+    std::vector<ChunkEntry> m_Chunks;
+    std::uint64_t m_ChannelsPerBlock = 0;
+    std::uint64_t m_NumberOfBlocks = 0;
+  };
+
+} // namespace m2
@@ -17,8 +17,10 @@ See LICENSE.txt for details.
 
 #include <M2aiaCoreExports.h>
 #include <algorithm>
+#include <array>
 #include <functional>
 #include <cmath>
+#include <iterator>
 #include <mitkExceptionMacro.h>
 #include <numeric>
 #include <vector>
@@ -91,6 +93,9 @@ namespace m2
       m2::NormalizationStrategyType strategy, ItXFirst xFirst, ItXLast xLast, ItYFirst yFirst, ItYLast yLast)
     {
       using namespace std;
+      // empty spectra are not scaled
+      if (yFirst == yLast)
+        return 1;
       switch (strategy)
       {
         case m2::NormalizationStrategyType::TIC:
@@ -111,5 +116,46 @@ namespace m2
       }
     }
 
+    /// Strategies with factors computed from the spectrum data, in the order of GetNormalizationFactors.
+    const std::array<m2::NormalizationStrategyType, 5> SpectrumNormalizationStrategyTypeList = {
+      m2::NormalizationStrategyType::TIC,
+      m2::NormalizationStrategyType::Sum,
+      m2::NormalizationStrategyType::Mean,
+      m2::NormalizationStrategyType::Max,
+      m2::NormalizationStrategyType::RMS};
+
+    /*!
+     * GetNormalizationFactors: The factors of all SpectrumNormalizationStrategyTypeList strategies in a
+     * single pass over the spectrum (x and y of equal length). Each factor is identical to the result of
+     * GetNormalizationFactor, all factors of an empty spectrum are 1.
+     */
+    template <class ItXFirst, class ItXLast, class ItYFirst, class ItYLast>
+    inline std::array<double, 5> GetNormalizationFactors(ItXFirst xFirst, ItXLast xLast, ItYFirst yFirst, ItYLast yLast)
+    {
+      using XType = typename std::iterator_traits<ItXFirst>::value_type;
+      using YType = typename std::iterator_traits<ItYFirst>::value_type;
+      const double n = std::distance(yFirst, yLast);
+      if (xFirst == xLast || yFirst == yLast)
+        return {1, 1, 1, 1, 1};
+
+      XType xPrev = *xFirst;
+      YType yPrev = *yFirst;
+      YType max = yPrev;
+      double tic = 0, sum = yPrev, squares = yPrev * yPrev;
+      auto x = std::next(xFirst);
+      for (auto y = std::next(yFirst); y != yLast; ++x, ++y)
+      {
+        const YType v = *y;
+        tic += (yPrev + v) * 0.5 * ((*x) - xPrev);
+        sum += v;
+        squares += v * v;
+        if (max < v)
+          max = v;
+        xPrev = *x;
+        yPrev = v;
+      }
+      return {tic, sum, sum / n, double(max), std::sqrt(squares / n)};
+    }
+
   }; // namespace Signal
 } // namespace m2
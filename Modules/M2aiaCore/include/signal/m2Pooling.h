@@ -44,7 +44,7 @@ namespace m2
           val = *std::max_element(first, last);
           break;
         case RangePoolingStrategyType::Median:
-          std::vector<typename ItFirst::value_type> v(first, last);
+          std::vector<typename std::iterator_traits<ItFirst>::value_type> v(first, last);
           val = m2::Signal::Median(v.begin(),v.end());
           break;
       }
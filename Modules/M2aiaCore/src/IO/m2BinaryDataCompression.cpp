@@ -0,0 +1,102 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <itk_zlib.h>
+#include <limits>
+#include <m2BinaryDataCompression.h>
+#include <mitkExceptionMacro.h>
+
+namespace
+{
+  // z_stream counts bytes in uInt, larger buffers are passed in slices of this size
+  constexpr std::size_t MaxSliceBytes = std::numeric_limits<uInt>::max();
+
+  // upper bound of the deflated size (see deflateBound), without the uLong argument of compressBound
+  std::size_t DeflateBound(std::size_t srcBytes)
+  {
+    return srcBytes + (srcBytes >> 12) + (srcBytes >> 14) + (srcBytes >> 25) + 13 + 6;
+  }
+} // namespace
+
+bool m2::Zlib::Inflate(const char *src, std::size_t srcBytes, char *dest, std::size_t destBytes) noexcept
+{
+  z_stream zs{};
+  if (inflateInit(&zs) != Z_OK)
+    return false;
+
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src));
+  zs.next_out = reinterpret_cast<Bytef *>(dest);
+  std::size_t srcLeft = srcBytes;
+  std::size_t destLeft = destBytes;
+
+  int status = Z_OK;
+  while (status == Z_OK)
+  {
+    if (zs.avail_in == 0)
+    {
+      zs.avail_in = static_cast<uInt>(std::min(srcLeft, MaxSliceBytes));
+      srcLeft -= zs.avail_in;
+    }
+    if (zs.avail_out == 0)
+    {
+      if (destLeft == 0)
+        break;
+      zs.avail_out = static_cast<uInt>(std::min(destLeft, MaxSliceBytes));
+      destLeft -= zs.avail_out;
+    }
+    status = inflate(&zs, Z_SYNC_FLUSH);
+  }
+
+  inflateEnd(&zs);
+  return destLeft == 0 && zs.avail_out == 0 && (status == Z_OK || status == Z_STREAM_END);
+}
+
+std::size_t m2::Zlib::Deflate(const char *src, std::size_t srcBytes, std::vector<char> &dest, int level)
+{
+  z_stream zs{};
+  const auto init = deflateInit(&zs, level);
+  if (init != Z_OK)
+    mitkThrow() << "zlib compression failed (" << init << ")";
+
+  dest.resize(DeflateBound(srcBytes));
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src));
+  std::size_t srcLeft = srcBytes;
+  std::size_t written = 0;
+
+  int status = Z_OK;
+  while (status == Z_OK)
+  {
+    if (zs.avail_in == 0)
+    {
+      zs.avail_in = static_cast<uInt>(std::min(srcLeft, MaxSliceBytes));
+      srcLeft -= zs.avail_in;
+    }
+    if (written == dest.size())
+      dest.resize(2 * dest.size());
+    zs.next_out = reinterpret_cast<Bytef *>(dest.data() + written);
+    zs.avail_out = static_cast<uInt>(std::min(dest.size() - written, MaxSliceBytes));
+    const auto available = zs.avail_out;
+    status = deflate(&zs, srcLeft == 0 ? Z_FINISH : Z_NO_FLUSH);
+    written += available - zs.avail_out;
+  }
+
+  deflateEnd(&zs);
+  if (status != Z_STREAM_END)
+    mitkThrow() << "zlib compression failed (" << status << ")";
+  dest.resize(written);
+  return written;
+}
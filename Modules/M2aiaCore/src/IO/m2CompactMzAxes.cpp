@@ -0,0 +1,206 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <cstring>
+#include <m2CompactMzAxes.h>
+#include <functional>
+#include <string_view>
+
+namespace
+{
+  // block table entry: absolute key (8 bytes) and offset of the block's deltas (4 bytes)
+  constexpr std::size_t TableEntryBytes = sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+  inline void PutVarint(std::vector<std::uint8_t> &out, std::uint64_t v)
+  {
+    while (v >= 0x80)
+    {
+      out.push_back(static_cast<std::uint8_t>(v) | 0x80);
+      v >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(v));
+  }
+
+  inline std::uint64_t GetVarint(const std::uint8_t *&p)
+  {
+    std::uint64_t v = 0;
+    unsigned int shift = 0;
+    while (*p & 0x80)
+    {
+      v |= std::uint64_t(*p++ & 0x7f) << shift;
+      shift += 7;
+    }
+    v |= std::uint64_t(*p++) << shift;
+    return v;
+  }
+
+  inline std::uint64_t BlockKey(const std::uint8_t *base, std::size_t b)
+  {
+    std::uint64_t k;
+    std::memcpy(&k, base + b * TableEntryBytes, sizeof(k));
+    return k;
+  }
+
+  inline std::uint32_t BlockOffset(const std::uint8_t *base, std::size_t b)
+  {
+    std::uint32_t o;
+    std::memcpy(&o, base + b * TableEntryBytes + sizeof(std::uint64_t), sizeof(o));
+    return o;
+  }
+
+  inline std::size_t NumberOfBlocks(std::size_t n)
+  {
+    return (n + m2::CompactMzAxes::BlockSize - 1) / m2::CompactMzAxes::BlockSize;
+  }
+} // namespace
+
+void m2::CompactMzAxes::Resize(std::size_t numberOfSpectra)
+{
+  m_Entries.assign(numberOfSpectra, Entry());
+  m_Data.clear();
+  m_Offsets.clear();
+  m_NumberOfDistinctAxes = 0;
+  m_NumberOfSpectraOverBudget = 0;
+}
+
+void m2::CompactMzAxes::Encode(std::size_t id, const std::uint64_t *keys, std::size_t n)
+{
+  const auto nBlocks = NumberOfBlocks(n);
+  thread_local std::vector<std::uint8_t> out, deltas;
+  out.assign(nBlocks * TableEntryBytes, 0);
+
+  deltas.clear();
+  for (std::size_t b = 0; b < nBlocks; ++b)
+  {
+    const auto first = b * BlockSize;
+    const auto last = std::min(n, first + BlockSize);
+    const std::uint32_t offset = static_cast<std::uint32_t>(deltas.size());
+    std::memcpy(out.data() + b * TableEntryBytes, keys + first, sizeof(std::uint64_t));
+    std::memcpy(out.data() + b * TableEntryBytes + sizeof(std::uint64_t), &offset, sizeof(offset));
+    for (auto i = first + 1; i < last; ++i)
+      PutVarint(deltas, keys[i] - keys[i - 1]);
+  }
+  out.insert(out.end(), deltas.begin(), deltas.end());
+
+  // the encoding is copied into m_Data directly, only distinct encodings are held
+  const std::string_view bytes(reinterpret_cast<const char *>(out.data()), out.size());
+  const auto hash = std::hash<std::string_view>()(bytes);
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const auto range = m_Offsets.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    const auto [offset, size] = it->second;
+    if (size == out.size() && std::memcmp(m_Data.data() + offset, out.data(), size) == 0)
+    {
+      m_Entries[id].offset = offset;
+      m_Entries[id].length = static_cast<std::uint32_t>(n);
+      return;
+    }
+  }
+
+  const auto required = m_Data.size() + out.size();
+  if (required > m_MemoryBudget)
+  {
+    m_Entries[id].length = NotEncoded;
+    ++m_NumberOfSpectraOverBudget;
+    return;
+  }
+  // grow geometrically, but never beyond the budget
+  if (required > m_Data.capacity())
+    m_Data.reserve(std::min(m_MemoryBudget, std::max(required, 2 * m_Data.capacity())));
+
+  m_Offsets.emplace(hash, std::make_pair(std::uint64_t(m_Data.size()), out.size()));
+  m_Entries[id].offset = m_Data.size();
+  m_Entries[id].length = static_cast<std::uint32_t>(n);
+  m_Data.insert(m_Data.end(), out.begin(), out.end());
+}
+
+void m2::CompactMzAxes::Finalize()
+{
+  m_NumberOfDistinctAxes = m_Offsets.size();
+  m_Offsets = {};
+  m_Data.shrink_to_fit();
+}
+
+void m2::CompactMzAxes::Get(std::size_t id, std::vector<double> &mzs) const
+{
+  const auto &e = m_Entries[id];
+  mzs.resize(e.length);
+  const auto nBlocks = NumberOfBlocks(e.length);
+  const auto *base = m_Data.data() + e.offset;
+  const auto *p = base + nBlocks * TableEntryBytes;
+  std::uint64_t key = 0;
+  for (std::size_t i = 0; i < e.length; ++i)
+  {
+    key = (i % BlockSize == 0) ? BlockKey(base, i / BlockSize) : key + GetVarint(p);
+    mzs[i] = key * GridSpacing;
+  }
+}
+
+std::size_t m2::CompactMzAxes::Bound(const Entry &e, double x, bool strict) const
+{
+  const auto pred = [x, strict](std::uint64_t key)
+  {
+    const double v = key * GridSpacing;
+    return strict ? v > x : v >= x;
+  };
+
+  const std::size_t nBlocks = NumberOfBlocks(e.length);
+  const auto *base = m_Data.data() + e.offset;
+
+  // first block whose first value satisfies pred
+  std::size_t lo = 0, hi = nBlocks;
+  while (lo < hi)
+  {
+    const auto mid = lo + (hi - lo) / 2;
+    if (pred(BlockKey(base, mid)))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  if (lo == 0)
+    return 0;
+
+  // the bound is inside the previous block or at the start of block lo
+  const auto b = lo - 1;
+  const auto *p = base + nBlocks * TableEntryBytes + BlockOffset(base, b);
+  const std::size_t last = std::min<std::size_t>(e.length, (b + 1) * BlockSize);
+  auto key = BlockKey(base, b);
+  for (std::size_t i = b * BlockSize + 1; i < last; ++i)
+  {
+    key += GetVarint(p);
+    if (pred(key))
+      return i;
+  }
+  return last;
+}
+
+std::pair<unsigned int, unsigned int> m2::CompactMzAxes::Subrange(std::size_t id, double lower, double upper) const
+{
+  const auto &e = m_Entries[id];
+  const auto start = Bound(e, lower, false);
+  const auto end = Bound(e, upper, true);
+  if (start >= end)
+    return {0, 0};
+  return {static_cast<unsigned int>(start), static_cast<unsigned int>(end - start)};
+}
+
+std::size_t m2::CompactMzAxes::GetMemorySize() const
+{
+  return m_Data.capacity() + m_Entries.capacity() * sizeof(Entry);
+}
@@ -0,0 +1,143 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+
+#include <cstring>
+#include <m2HalfFloat.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define M2_HALF_FLOAT_F16C
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  inline std::uint32_t FloatBits(float f)
+  {
+    std::uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+  }
+
+  inline float BitsFloat(std::uint32_t u)
+  {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+
+#ifdef M2_HALF_FLOAT_F16C
+  __attribute__((target("avx,f16c"))) void ToFloatF16C(const std::uint16_t *src, std::size_t n, float *dest)
+  {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const auto h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(h));
+    }
+    for (; i < n; ++i)
+      dest[i] = m2::HalfFloat::ToFloat(src[i]);
+  }
+
+  __attribute__((target("avx,f16c"))) void FromFloatF16C(const float *src, std::size_t n, std::uint16_t *dest)
+  {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const auto f = _mm256_loadu_ps(src + i);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+    for (; i < n; ++i)
+      dest[i] = m2::HalfFloat::FromFloat(src[i]);
+  }
+
+  bool HasF16C()
+  {
+    static const bool supported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+    return supported;
+  }
+#endif
+
+} // namespace
+
+float m2::HalfFloat::ToFloat(std::uint16_t h) noexcept
+{
+  const std::uint32_t sign = std::uint32_t(h & 0x8000) << 16;
+  const std::uint32_t exponent = (h >> 10) & 0x1f;
+  const std::uint32_t mantissa = h & 0x3ff;
+
+  if (exponent == 0x1f) // inf, nan
+    return BitsFloat(sign | 0x7f800000 | (mantissa << 13));
+  if (exponent != 0) // normal
+    return BitsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+  // zero and subnormal: mantissa * 2^-24
+  const float v = float(mantissa) * 5.9604644775390625e-8f;
+  return sign ? -v : v;
+}
+
+std::uint16_t m2::HalfFloat::FromFloat(float f) noexcept
+{
+  const std::uint32_t u = FloatBits(f);
+  const std::uint16_t sign = (u >> 16) & 0x8000;
+  const std::uint32_t abs = u & 0x7fffffff;
+
+  if (abs >= 0x7f800000) // inf, nan
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  if (abs >= 0x477ff000) // rounds to a value >= 65520: overflow
+    return sign | 0x7c00;
+  if (abs < 0x38800000) // subnormal or zero in half precision
+  {
+    // exact multiple of 2^-24 after rounding to nearest even
+    const float v = BitsFloat(abs) * 16777216.0f;
+    auto m = static_cast<std::uint32_t>(v);
+    const float r = v - float(m);
+    if (r > 0.5f || (r == 0.5f && (m & 1)))
+      ++m;
+    return sign | static_cast<std::uint16_t>(m);
+  }
+
+  // normal: rebias exponent, round mantissa to nearest even
+  std::uint32_t h = ((abs >> 13) - (112 << 10));
+  const std::uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+    ++h;
+  return sign | static_cast<std::uint16_t>(h);
+}
+
+void m2::HalfFloat::ToFloat(const std::uint16_t *src, std::size_t n, float *dest) noexcept
+{
+#ifdef M2_HALF_FLOAT_F16C
+  if (HasF16C())
+  {
+    ToFloatF16C(src, n, dest);
+    return;
+  }
+#endif
+  for (std::size_t i = 0; i < n; ++i)
+    dest[i] = ToFloat(src[i]);
+}
+
+void m2::HalfFloat::FromFloat(const float *src, std::size_t n, std::uint16_t *dest) noexcept
+{
+#ifdef M2_HALF_FLOAT_F16C
+  if (HasF16C())
+  {
+    FromFloatF16C(src, n, dest);
+    return;
+  }
+#endif
+  for (std::size_t i = 0; i < n; ++i)
+    dest[i] = FromFloat(src[i]);
+}
@@ -0,0 +1,144 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+
+#include <Poco/SHA1Engine.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <m2ImzMLBinaryDataWriter.h>
+#include <m2Process.hpp>
+#include <mitkExceptionMacro.h>
+#include <mutex>
+
+namespace
+{
+  // upper bound of the encoded bytes held by one batch
+  constexpr unsigned long long MaxBatchBytes = 256ull << 20;
+  constexpr unsigned long long MaxBatchSize = 8192;
+} // namespace
+
+m2::ImzMLBinaryDataWriter::ImzMLBinaryDataWriter(const std::string &path,
+                                                 bool computeSHA1,
+                                                 unsigned long long bufferSize)
+  : m_Buffer(bufferSize)
+{
+  m_Stream.rdbuf()->pubsetbuf(m_Buffer.data(), m_Buffer.size());
+  m_Stream.open(path, std::ofstream::binary | std::ofstream::trunc);
+  if (!m_Stream)
+    mitkThrow() << "Can not open " << path << " for writing.";
+  if (computeSHA1)
+    m_SHA1 = std::make_unique<Poco::SHA1Engine>();
+}
+
+m2::ImzMLBinaryDataWriter::~ImzMLBinaryDataWriter() = default;
+
+unsigned long long m2::ImzMLBinaryDataWriter::Append(const char *data, unsigned long long n)
+{
+  const auto offset = m_Offset;
+  m_Stream.write(data, n);
+  if (m_SHA1)
+    m_SHA1->update(data, n);
+  if (!m_Stream)
+    mitkThrow() << "Writing binary data failed at offset " << offset << ".";
+  m_Offset += n;
+  return offset;
+}
+
+void m2::ImzMLBinaryDataWriter::WriteOrdered(const std::vector<unsigned int> &ids,
+                                             unsigned int threads,
+                                             unsigned long long bytesPerSpectrum,
+                                             const EncodeFunction &encode,
+                                             const WrittenFunction &written)
+{
+  if (ids.empty())
+    return;
+
+  threads = std::max(1u, threads);
+  const unsigned long long batchSize =
+    std::min<unsigned long long>(ids.size(),
+                                 std::clamp<unsigned long long>(
+                                   MaxBatchBytes / std::max(1ull, bytesPerSpectrum), threads, MaxBatchSize));
+
+  // encoded while the pending batch is written
+  std::vector<std::vector<char>> current(batchSize), pending(batchSize);
+  std::future<void> writing;
+
+  // the first exception thrown by encode, the remaining workers stop early
+  std::exception_ptr encodeError;
+  std::mutex encodeErrorMutex;
+  std::atomic<bool> failed{false};
+
+  for (size_t first = 0; first < ids.size(); first += batchSize)
+  {
+    const auto n = std::min<unsigned long long>(batchSize, ids.size() - first);
+    m2::Process::Map(n,
+                     threads,
+                     [&](unsigned int, unsigned int a, unsigned int b)
+                     {
+                       for (unsigned int i = a; i < b && !failed; ++i)
+                       {
+                         try
+                         {
+                           encode(ids[first + i], current[i]);
+                         }
+                         catch (...)
+                         {
+                           std::lock_guard<std::mutex> lock(encodeErrorMutex);
+                           if (!encodeError)
+                             encodeError = std::current_exception();
+                           failed = true;
+                         }
+                       }
+                     });
+
+    // the writer only touches pending, wait for it before the batch is dropped or swapped
+    if (writing.valid())
+      writing.get();
+    if (encodeError)
+      std::rethrow_exception(encodeError);
+    std::swap(current, pending);
+
+    writing = std::async(std::launch::async,
+                         [this, &pending, &ids, &written, first, n]()
+                         {
+                           for (unsigned long long i = 0; i < n; ++i)
+                           {
+                             const auto &bytes = pending[i];
+                             const auto offset = Append(bytes.data(), bytes.size());
+                             written(ids[first + i], offset, bytes.size());
+                           }
+                         });
+  }
+
+  if (writing.valid())
+    writing.get();
+}
+
+void m2::ImzMLBinaryDataWriter::Flush()
+{
+  m_Stream.flush();
+}
+
+std::string m2::ImzMLBinaryDataWriter::GetSHA1()
+{
+  if (!m_SHA1)
+    return {};
+  // finalize once, digest() resets the engine
+  if (m_Digest.empty())
+    m_Digest = Poco::SHA1Engine::digestToHex(m_SHA1->digest());
+  return m_Digest;
+}
@@ -0,0 +1,279 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <m2ImzMLChannelCubeFile.h>
+#include <m2ImzMLIndexFile.h>
+#include <m2ImzMLSpectrumImage.h>
+#include <m2Timer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <itksys/SystemTools.hxx>
+#include <mitkExceptionMacro.h>
+#include <mitkLogMacros.h>
+#include <vector>
+
+namespace
+{
+  constexpr char CubeFileMagic[8] = {'M', '2', 'A', 'I', 'A', 'C', 'U', 'B'};
+
+  // data starts page aligned, channel slabs are accessed in place
+  constexpr uint64_t CubeFileDataOffset = 4096;
+
+  // upper bound of the memory used while writing (two buffers of half the size)
+  constexpr uint64_t CubeFileBlockBytes = uint64_t(256) << 20;
+
+  struct CubeFileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t valueBytes;
+    uint64_t imzMLSize;
+    int64_t imzMLModificationTime;
+    uint64_t ibdSize;
+    uint8_t uuid[16];
+    uint64_t numberOfSpectra;
+    uint64_t numberOfChannels;
+    uint64_t dataOffset;
+  };
+
+  static_assert(sizeof(CubeFileHeader) <= CubeFileDataOffset, "CubeFileHeader exceeds the data offset");
+
+  bool FillHeader(const m2::ImzMLSpectrumImage *data,
+                  unsigned int valueBytes,
+                  uint64_t numberOfChannels,
+                  CubeFileHeader &header)
+  {
+    m2::ImzMLIndexFile::FileIdentity identity;
+    if (!m2::ImzMLIndexFile::GetFileIdentity(data, identity))
+      return false;
+
+    std::memcpy(header.magic, CubeFileMagic, sizeof(CubeFileMagic));
+    header.version = m2::ImzMLChannelCubeFile::Version;
+    header.valueBytes = valueBytes;
+    header.imzMLSize = identity.imzMLSize;
+    header.imzMLModificationTime = identity.imzMLModificationTime;
+    header.ibdSize = identity.ibdSize;
+    std::memcpy(header.uuid, identity.uuid, sizeof(header.uuid));
+    header.numberOfSpectra = data->GetSpectra().size();
+    header.numberOfChannels = numberOfChannels;
+    header.dataOffset = CubeFileDataOffset;
+    return true;
+  }
+
+  template <class T>
+  void Transpose(const char *src, uint64_t rows, uint64_t cols, char *dest)
+  {
+    const auto *s = reinterpret_cast<const T *>(src);
+    auto *d = reinterpret_cast<T *>(dest);
+    for (uint64_t r = 0; r < rows; ++r)
+      for (uint64_t c = 0; c < cols; ++c)
+        d[c * rows + r] = s[r * cols + c];
+  }
+
+  /// Row-major rows x cols matrix of valueBytes elements to column-major.
+  void Transpose(const char *src, uint64_t rows, uint64_t cols, unsigned int valueBytes, char *dest)
+  {
+    switch (valueBytes)
+    {
+      case 2:
+        return Transpose<uint16_t>(src, rows, cols, dest);
+      case 4:
+        return Transpose<uint32_t>(src, rows, cols, dest);
+      case 8:
+        return Transpose<uint64_t>(src, rows, cols, dest);
+      default:
+        for (uint64_t r = 0; r < rows; ++r)
+          for (uint64_t c = 0; c < cols; ++c)
+            std::memcpy(dest + (c * rows + r) * valueBytes, src + (r * cols + c) * valueBytes, valueBytes);
+    }
+  }
+
+} // namespace
+
+m2::ImzMLChannelCubeFile::ImzMLChannelCubeFile(const std::string &path) : m_File(path)
+{
+  CubeFileHeader header;
+  if (!m_File.Contains(0, sizeof(header)))
+    mitkThrow() << "Channel cube file is truncated: " << path;
+  m_File.Copy(0, 1, &header);
+
+  m_NumberOfSpectra = header.numberOfSpectra;
+  m_NumberOfChannels = header.numberOfChannels;
+  m_ValueBytes = header.valueBytes;
+  m_DataOffset = header.dataOffset;
+
+  if (!m_File.Contains(m_DataOffset, m_NumberOfSpectra * m_NumberOfChannels * m_ValueBytes))
+    mitkThrow() << "Channel cube file is truncated: " << path;
+}
+
+std::string m2::ImzMLChannelCubeFile::GetCubeFilePath(const std::string &imzMLPath)
+{
+  return m2::ImzMLIndexFile::GetSidecarPath(imzMLPath, Extension);
+}
+
+std::shared_ptr<const m2::ImzMLChannelCubeFile> m2::ImzMLChannelCubeFile::Open(const m2::ImzMLSpectrumImage *data,
+                                                                              unsigned int valueBytes,
+                                                                              std::uint64_t numberOfChannels)
+{
+  const auto cubePath = GetCubeFilePath(data->GetImzMLDataPath());
+  if (!itksys::SystemTools::FileExists(cubePath))
+    return nullptr;
+
+  CubeFileHeader expected{};
+  if (!FillHeader(data, valueBytes, numberOfChannels, expected))
+    return nullptr;
+
+  try
+  {
+    auto cube = std::make_shared<m2::ImzMLChannelCubeFile>(cubePath);
+
+    CubeFileHeader header;
+    cube->m_File.Copy(0, 1, &header);
+    if (std::memcmp(header.magic, CubeFileMagic, sizeof(CubeFileMagic)) != 0 || header.version != expected.version ||
+        header.valueBytes != expected.valueBytes || header.imzMLSize != expected.imzMLSize ||
+        header.imzMLModificationTime != expected.imzMLModificationTime || header.ibdSize != expected.ibdSize ||
+        std::memcmp(header.uuid, expected.uuid, sizeof(header.uuid)) != 0 ||
+        header.numberOfSpectra != expected.numberOfSpectra || header.numberOfChannels != expected.numberOfChannels ||
+        header.dataOffset != expected.dataOffset)
+    {
+      MITK_INFO << "Channel cube file is outdated: " << cubePath;
+      return nullptr;
+    }
+    cube->m_File.Advise(m2::MemoryMappedFile::AccessHint::Random, 0, cube->m_File.Size());
+    return cube;
+  }
+  catch (std::exception &e)
+  {
+    MITK_WARN << "Channel cube file could not be read: " << cubePath << "\n" << e.what();
+  }
+  return nullptr;
+}
+
+bool m2::ImzMLChannelCubeFile::Write(const m2::ImzMLSpectrumImage *data,
+                                     unsigned int valueBytes,
+                                     std::uint64_t numberOfChannels,
+                                     const SpectrumReader &reader)
+{
+  const auto cubePath = GetCubeFilePath(data->GetImzMLDataPath());
+
+  CubeFileHeader header{};
+  if (!FillHeader(data, valueBytes, numberOfChannels, header) || header.numberOfSpectra == 0 || numberOfChannels == 0)
+    return false;
+
+  const uint64_t N = header.numberOfSpectra;
+  const uint64_t spectrumBytes = numberOfChannels * valueBytes;
+  const uint64_t channelBytes = N * valueBytes;
+  const uint64_t spectraPerGroup = std::max<uint64_t>(1, (CubeFileBlockBytes / 2) / spectrumBytes);
+  const uint64_t channelsPerBlock = std::max<uint64_t>(1, (CubeFileBlockBytes / 2) / channelBytes);
+
+  m2::Timer t("Write channel cube file " + cubePath);
+
+  // write to a temporary file first, a cube file is either complete or not existent
+  const auto tmpPath = cubePath + ".tmp";
+  const auto groupsPath = cubePath + ".groups.tmp";
+  const auto fail = [&](const char *reason)
+  {
+    std::remove(groupsPath.c_str());
+    std::remove(tmpPath.c_str());
+    MITK_WARN << "Channel cube file could not be " << reason << ": " << cubePath;
+    return false;
+  };
+
+  try
+  {
+    // 1st pass: each group of spectra [s0, s0 + S) is read once from the ibd and stored channel-major
+    // at s0 * spectrumBytes, i.e. the channels [c, c + n) of a group are n * S consecutive values.
+    {
+      std::ofstream groups(groupsPath, std::ios::binary | std::ios::trunc);
+      if (!groups)
+        return fail("created");
+
+      std::vector<char> rows(std::min(spectraPerGroup, N) * spectrumBytes);
+      std::vector<char> columns(rows.size());
+      for (uint64_t s0 = 0; s0 < N && groups; s0 += spectraPerGroup)
+      {
+        const auto S = std::min(spectraPerGroup, N - s0);
+        reader(s0, S, rows.data());
+        Transpose(rows.data(), S, numberOfChannels, valueBytes, columns.data());
+        groups.write(columns.data(), S * spectrumBytes);
+      }
+      if (!groups)
+      {
+        groups.close();
+        return fail("written");
+      }
+    }
+
+    // 2nd pass: gather the blocks of channels from all groups and append them to the cube
+    std::ifstream groups(groupsPath, std::ios::binary);
+    std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!groups || !f)
+      return fail("created");
+
+    std::vector<char> block(header.dataOffset, 0);
+    std::memcpy(block.data(), &header, sizeof(header));
+    f.write(block.data(), header.dataOffset);
+
+    const auto blockChannels = std::min(channelsPerBlock, numberOfChannels);
+    block.resize(blockChannels * channelBytes);
+    std::vector<char> buffer(blockChannels * std::min(spectraPerGroup, N) * valueBytes);
+    for (uint64_t first = 0; first < numberOfChannels && f && groups; first += channelsPerBlock)
+    {
+      const auto n = std::min(channelsPerBlock, numberOfChannels - first);
+      for (uint64_t s0 = 0; s0 < N && groups; s0 += spectraPerGroup)
+      {
+        const auto S = std::min(spectraPerGroup, N - s0);
+        const auto groupChannelBytes = S * valueBytes;
+        groups.seekg(s0 * spectrumBytes + first * groupChannelBytes);
+        groups.read(buffer.data(), n * groupChannelBytes);
+        for (uint64_t c = 0; c < n; ++c)
+          std::memcpy(block.data() + c * channelBytes + s0 * valueBytes,
+                      buffer.data() + c * groupChannelBytes,
+                      groupChannelBytes);
+      }
+      f.write(block.data(), n * channelBytes);
+    }
+
+    if (!f || !groups)
+    {
+      f.close();
+      groups.close();
+      return fail("written");
+    }
+  }
+  catch (...)
+  {
+    fail("written");
+    throw;
+  }
+
+  std::remove(groupsPath.c_str());
+  std::remove(cubePath.c_str());
+  if (std::rename(tmpPath.c_str(), cubePath.c_str()) != 0)
+    return fail("written");
+  return true;
+}
+
+void m2::ImzMLChannelCubeFile::WillNeed(std::uint64_t first, std::uint64_t n) const
+{
+  if (n == 0)
+    return;
+  const auto channelBytes = m_NumberOfSpectra * m_ValueBytes;
+  m_File.Advise(m2::MemoryMappedFile::AccessHint::WillNeed, m_DataOffset + first * channelBytes, n * channelBytes);
+}
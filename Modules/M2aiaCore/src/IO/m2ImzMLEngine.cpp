@@ -15,7 +15,10 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 ===================================================================*/
 
 
+#include <algorithm>
+#include <charconv>
 #include <m2ImzMLEngine.h>
+#include <mitkExceptionMacro.h>
 
 std::string m2::TemplateEngine::render(const std::string & view, std::map<std::string, std::string> & map, char from, char to) {
 
@@ -80,3 +83,89 @@ std::string m2::TemplateEngine::render(const std::string & view, std::map<std::s
 	return copy;
 
 }
+
+m2::CompiledTemplate::CompiledTemplate(const std::string &view,
+                                       const std::vector<std::string> &keys,
+                                       char from,
+                                       char to)
+  : m_View(view)
+{
+  const auto keyIndex = [&keys](const std::string &key)
+  {
+    auto it = std::find(std::begin(keys), std::end(keys), key);
+    if (it == std::end(keys))
+      mitkThrow() << "Template key {" << key << "} is not part of the key list.";
+    return std::size_t(std::distance(std::begin(keys), it));
+  };
+
+  std::vector<std::size_t> openSections;
+  std::size_t o = 0;
+  while (o < m_View.size())
+  {
+    const auto b = m_View.find(from, o);
+    const auto c = b == std::string::npos ? std::string::npos : m_View.find(to, b + 1);
+    if (c == std::string::npos)
+    {
+      m_Ops.push_back({Op::Type::Literal, o, m_View.size() - o});
+      break;
+    }
+    if (b > o)
+      m_Ops.push_back({Op::Type::Literal, o, b - o});
+
+    const auto key = m_View.substr(b + 1, c - (b + 1));
+    if (!key.empty() && key[0] == '#')
+    {
+      openSections.push_back(m_Ops.size());
+      m_Ops.push_back({Op::Type::Section, keyIndex(key.substr(1)), 0});
+    }
+    else if (!key.empty() && key[0] == '/')
+    {
+      if (openSections.empty())
+        mitkThrow() << "Template section {" << key << "} was not opened.";
+      auto &section = m_Ops[openSections.back()];
+      section.length = m_Ops.size() - (openSections.back() + 1);
+      openSections.pop_back();
+    }
+    else
+    {
+      m_Ops.push_back({Op::Type::Slot, keyIndex(key), 0});
+    }
+    o = c + 1;
+  }
+
+  if (!openSections.empty())
+    mitkThrow() << "Template section is not closed.";
+}
+
+void m2::CompiledTemplate::Render(const Value *values, std::string &out) const
+{
+  char digits[24];
+  for (std::size_t i = 0; i < m_Ops.size(); ++i)
+  {
+    const auto &op = m_Ops[i];
+    switch (op.type)
+    {
+      case Op::Type::Literal:
+        out.append(m_View, op.first, op.length);
+        break;
+      case Op::Type::Section:
+        if (values[op.first].m_Type == Value::Type::None)
+          i += op.length; // skip the enclosed ops
+        break;
+      case Op::Type::Slot:
+      {
+        const auto &v = values[op.first];
+        if (v.m_Type == Value::Type::Integer)
+        {
+          const auto r = std::to_chars(digits, digits + sizeof(digits), v.m_Integer);
+          out.append(digits, r.ptr);
+        }
+        else if (v.m_Type == Value::Type::String)
+        {
+          out.append(v.m_String);
+        }
+        break;
+      }
+    }
+  }
+}
@@ -14,37 +14,242 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 
 ===================================================================*/
 #define BOOST_TIMER_ENABLE_DEPRECATED
-#include <Poco/SHA1Engine.h>
 #include <boost/progress.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <itkMath.h>
 #include <itksys/SystemTools.hxx>
+#include <m2BinaryDataCompression.h>
+#include <m2ImzMLBinaryDataWriter.h>
 #include <m2CoreCommon.h>
+#include <m2HalfFloat.h>
 #include <m2ImzMLEngine.h>
 #include <m2ImzMLImageIO.h>
+#include <m2ImzMLIndexFile.h>
 #include <m2ImzMLParser.h>
+#include <m2Process.hpp>
 #include <m2Timer.h>
 #include <mitkIOUtil.h>
 #include <mitkImagePixelReadAccessor.h>
 #include <mitkImagePixelWriteAccessor.h>
 #include <mitkLocaleSwitch.h>
+#include <mitkImageAccessByItk.h>
 #include <mitkImageCast.h>
 #include <signal/m2PeakDetection.h>
 #include <signal/m2Pooling.h>
 
-template <class ConversionType, class ItFirst, class ItLast, class OStreamType>
-void writeData(ItFirst itFirst, ItLast itLast, OStreamType &os)
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+
+/**
+ * Converts the values to ConversionType and encodes them as one block, zlib compressed if requested.
+ * The size of bytes is the encoded length [IMS:1000104].
+ */
+template <class ConversionType, class ItFirst, class ItLast>
+void encodeArray(ItFirst itFirst, ItLast itLast, std::vector<char> &bytes, bool zlib)
 {
-  std::for_each(itFirst,
-                itLast,
-                [&os](const auto &v)
-                {
-                  const ConversionType c(v);
-                  os.write((char *)(&c), sizeof(ConversionType));
-                });
+  thread_local std::vector<ConversionType> converted;
+  converted.assign(itFirst, itLast);
+  const auto n = converted.size() * sizeof(ConversionType);
+  if (!zlib)
+  {
+    bytes.resize(n);
+    std::memcpy(bytes.data(), converted.data(), n);
+    return;
+  }
+  bytes.resize(m2::Zlib::Deflate(reinterpret_cast<const char *>(converted.data()), n, bytes));
+}
+
+/**
+ * Encodes the values as 16-bit float [MS:1000520], zlib compressed if requested.
+ */
+template <class ItFirst, class ItLast>
+void encodeHalfArray(ItFirst itFirst, ItLast itLast, std::vector<char> &bytes, bool zlib)
+{
+  thread_local std::vector<float> floats;
+  thread_local std::vector<std::uint16_t> halfs;
+  floats.assign(itFirst, itLast);
+  halfs.resize(floats.size());
+  m2::HalfFloat::FromFloat(floats.data(), floats.size(), halfs.data());
+  const auto n = halfs.size() * sizeof(std::uint16_t);
+  if (!zlib)
+  {
+    bytes.resize(n);
+    std::memcpy(bytes.data(), halfs.data(), n);
+    return;
+  }
+  bytes.resize(m2::Zlib::Deflate(reinterpret_cast<const char *>(halfs.data()), n, bytes));
+}
+
+template <class ItFirst, class ItLast>
+void encodeArray(m2::NumericType type, ItFirst itFirst, ItLast itLast, std::vector<char> &bytes, bool zlib)
+{
+  switch (type)
+  {
+    case m2::NumericType::Float:
+      encodeArray<float>(itFirst, itLast, bytes, zlib);
+      break;
+    case m2::NumericType::Double:
+      encodeArray<double>(itFirst, itLast, bytes, zlib);
+      break;
+    case m2::NumericType::Half:
+      encodeHalfArray(itFirst, itLast, bytes, zlib);
+      break;
+    case m2::NumericType::None:
+      mitkThrow() << "m2::NumericType of output not set";
+  }
 }
 
+/**
+ * Ids of the spectra inside the mask of the image.
+ */
+template <class SpectraType>
+std::vector<unsigned int> maskedSpectrumIds(const m2::SpectrumImage *input, const SpectraType &spectra)
+{
+  std::vector<unsigned int> ids;
+  mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType> macc(input->GetMaskImage());
+  for (size_t id = 0; id < spectra.size(); ++id)
+    if (macc.GetPixelByIndex(spectra[id].index) > 0)
+      ids.push_back(id);
+  return ids;
+}
+
+/**
+ * Ids of the spectra inside the region of interest (pixel > 0, or == label if label > 0) and
+ * the bounding box of these spectra.
+ */
+template <class SpectraType>
+std::vector<unsigned int> regionOfInterestIds(const mitk::Image *roi,
+                                              unsigned int label,
+                                              const SpectraType &spectra,
+                                              itk::Index<3> &first,
+                                              itk::Size<3> &size)
+{
+  std::vector<unsigned int> ids;
+  mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3> acc(roi);
+  first.Fill(std::numeric_limits<itk::IndexValueType>::max());
+  itk::Index<3> last;
+  last.Fill(std::numeric_limits<itk::IndexValueType>::lowest());
+  for (size_t id = 0; id < spectra.size(); ++id)
+  {
+    const auto v = acc.GetPixelByIndex(spectra[id].index);
+    if (label ? v != label : v == 0)
+      continue;
+    ids.push_back(id);
+    for (unsigned int d = 0; d < 3; ++d)
+    {
+      first[d] = std::min(first[d], spectra[id].index[d]);
+      last[d] = std::max(last[d], spectra[id].index[d]);
+    }
+  }
+  if (ids.empty())
+    mitkThrow() << "The region of interest contains no spectra!";
+  for (unsigned int d = 0; d < 3; ++d)
+    size[d] = last[d] - first[d] + 1;
+  return ids;
+}
+
+/**
+ * Writes one m/z and one intensity array per spectrum (processed mode). The arrays of
+ * spectrum id are provided by produce(id, xs, ys), called concurrently.
+ */
+template <class SpectraType, class ProduceFunction>
+void writeProcessedSpectra(SpectraType &spectra,
+                           const std::vector<unsigned int> &ids,
+                           m2::ImzMLBinaryDataWriter &writer,
+                           unsigned int threads,
+                           m2::NumericType xType,
+                           m2::NumericType yType,
+                           bool zlib,
+                           unsigned long long bytesPerSpectrum,
+                           ProduceFunction produce)
+{
+  if (xType == m2::NumericType::None || yType == m2::NumericType::None)
+    mitkThrow() << "m2::NumericType of output not set";
+
+  boost::progress_display show_progress(ids.size());
+  writer.WriteOrdered(
+    ids,
+    threads,
+    bytesPerSpectrum,
+    [&](unsigned int id, std::vector<char> &bytes)
+    {
+      thread_local std::vector<double> xs, ys;
+      thread_local std::vector<char> intBytes;
+      produce(id, xs, ys);
+      encodeArray(xType, std::begin(xs), std::end(xs), bytes, zlib);
+      encodeArray(yType, std::begin(ys), std::end(ys), intBytes, zlib);
+
+      // spectrum id is only accessed by this worker until the batch is written
+      auto &s = spectra[id];
+      s.mzLength = xs.size();
+      s.mzEncodedLength = bytes.size();
+      s.intLength = ys.size();
+      s.intEncodedLength = intBytes.size();
+      bytes.insert(std::end(bytes), std::begin(intBytes), std::end(intBytes));
+    },
+    [&](unsigned int id, unsigned long long offset, unsigned long long)
+    {
+      auto &s = spectra[id];
+      s.mzOffset = offset;
+      s.intOffset = offset + s.mzEncodedLength;
+      ++show_progress;
+    });
+}
+
+/**
+ * Restores the spectrum processing settings of an image on destruction, so an export can
+ * temporarily apply the settings of another image (e.g. of an image stack to its slices).
+ */
+class ProcessingSettingsGuard
+{
+public:
+  explicit ProcessingSettingsGuard(m2::SpectrumImage *image)
+    : m_Image(image),
+      m_BaselineCorrection(image->GetBaselineCorrectionStrategy()),
+      m_BaselineCorrectionHalfWindowSize(image->GetBaseLineCorrectionHalfWindowSize()),
+      m_Normalization(image->GetNormalizationStrategy()),
+      m_Smoothing(image->GetSmoothingStrategy()),
+      m_SmoothingHalfWindowSize(image->GetSmoothingHalfWindowSize()),
+      m_IntensityTransformation(image->GetIntensityTransformationStrategy()),
+      m_ImageSmoothing(image->GetImageSmoothingStrategy()),
+      m_ImageNormalization(image->GetImageNormalizationStrategy())
+  {
+  }
+
+  ~ProcessingSettingsGuard()
+  {
+    m_Image->SetBaselineCorrectionStrategy(m_BaselineCorrection);
+    m_Image->SetBaseLineCorrectionHalfWindowSize(m_BaselineCorrectionHalfWindowSize);
+    m_Image->SetNormalizationStrategy(m_Normalization);
+    m_Image->SetSmoothingStrategy(m_Smoothing);
+    m_Image->SetSmoothingHalfWindowSize(m_SmoothingHalfWindowSize);
+    m_Image->SetIntensityTransformationStrategy(m_IntensityTransformation);
+    m_Image->SetImageSmoothingStrategy(m_ImageSmoothing);
+    m_Image->SetImageNormalizationStrategy(m_ImageNormalization);
+  }
+
+  ProcessingSettingsGuard(const ProcessingSettingsGuard &) = delete;
+  ProcessingSettingsGuard &operator=(const ProcessingSettingsGuard &) = delete;
+
+private:
+  m2::SpectrumImage *m_Image;
+  m2::BaselineCorrectionType m_BaselineCorrection;
+  unsigned int m_BaselineCorrectionHalfWindowSize;
+  m2::NormalizationStrategyType m_Normalization;
+  m2::SmoothingType m_Smoothing;
+  unsigned int m_SmoothingHalfWindowSize;
+  m2::IntensityTransformationType m_IntensityTransformation;
+  m2::ImageSmoothingStrategyType m_ImageSmoothing;
+  m2::ImageNormalizationStrategyType m_ImageNormalization;
+};
+
 namespace m2
 {
   ImzMLImageIO::ImzMLImageIO() : AbstractFileIO(mitk::Image::GetStaticNameOfClass(), IMZML_MIMETYPE(), "imzML Image")
@@ -138,219 +343,464 @@ namespace m2
   }
   */
 
-  void ImzMLImageIO::WriteContinuousProfile(m2::ImzMLSpectrumImage::SpectrumVectorType &spectra) const
+  void ImzMLImageIO::WriteContinuousProfile(m2::ImzMLSpectrumImage::SpectrumVectorType &spectra,
+                                            m2::ImzMLBinaryDataWriter &writer) const
   {
     const auto *input = static_cast<const m2::ImzMLSpectrumImage *>(this->GetInput());
-
-    std::vector<float> mzs;
-    std::vector<float> ints;
-
-    std::ifstream ibd(input->GetBinaryDataPath(), std::ofstream::binary);
-    std::ofstream b(GetIBDOutputPath(), std::ofstream::binary | std::ofstream::app);
-
-    unsigned sourceId = 0;
-    unsigned long long offset = 16;
-    unsigned long long offsetDelta = 0;
+    if (m_DataTypeXAxis == m2::NumericType::None || m_DataTypeYAxis == m2::NumericType::None)
+      mitkThrow() << "m2::NumericType of output not set";
 
     boost::progress_display show_progress(spectra.size() + 1);
 
     // write mzs
     {
+      std::vector<float> mzs, ints;
+      std::vector<char> bytes;
       input->GetSpectrumFloat(0, mzs, ints); // get x axis
+      encodeArray(m_DataTypeXAxis, std::begin(mzs), std::end(mzs), bytes, m_UseZlibCompression);
 
-      spectra[0].mzOffset = 16;
+      spectra[0].mzOffset = writer.Append(bytes.data(), bytes.size());
       spectra[0].mzLength = mzs.size();
-
-      auto start = std::begin(mzs);
-      auto end = std::end(mzs);
-      switch (m_DataTypeXAxis)
-      {
-        case m2::NumericType::Float:
-          // input->GetProcessor()
-          writeData<float>(start, end, b);
-          offsetDelta = mzs.size() * sizeof(float);
-          break;
-        case m2::NumericType::Double:
-          writeData<double>(start, end, b);
-          offsetDelta = mzs.size() * sizeof(double);
-          break;
-        case m2::NumericType::None:
-          mitkThrow() << "m2::NumericType of yAxisOutput not set";
-      }
-      offset += offsetDelta;
+      spectra[0].mzEncodedLength = bytes.size();
       ++show_progress;
     }
 
     MITK_INFO("ImzMLImageIO::WriteContinuousProfile") << "Write x axis done!";
 
-    for (size_t id = 0; id < spectra.size(); ++id)
-    {
-      auto &s = spectra[id];
-      // update mz axis info
-      s.mzLength = spectra[0].mzLength;
-      s.mzOffset = spectra[0].mzOffset;
+    std::vector<unsigned int> ids(spectra.size());
+    std::iota(std::begin(ids), std::end(ids), 0);
+    const auto valueBytes = m2::to_bytes(m_DataTypeYAxis);
 
-      // write ints
+    const auto mzAxis = spectra[0];
+    writer.WriteOrdered(
+      ids,
+      input->GetNumberOfThreads(),
+      mzAxis.mzLength * valueBytes,
+      [&](unsigned int id, std::vector<char> &bytes)
       {
-        input->GetSpectrumFloat(id, mzs, ints);
+        thread_local std::vector<float> ints;
+        input->GetIntensitiesFloat(id, ints);
+        encodeArray(m_DataTypeYAxis, std::begin(ints), std::end(ints), bytes, m_UseZlibCompression);
+      },
+      [&](unsigned int id, unsigned long long offset, unsigned long long numberOfBytes)
+      {
+        auto &s = spectra[id];
+        // update mz axis info
+        s.mzLength = mzAxis.mzLength;
+        s.mzOffset = mzAxis.mzOffset;
+        s.mzEncodedLength = mzAxis.mzEncodedLength;
 
         s.intOffset = offset;
-        s.intLength = ints.size();
+        s.intLength = mzAxis.mzLength;
+        s.intEncodedLength = numberOfBytes;
+        ++show_progress;
+      });
+  }
 
-        auto start = std::begin(ints);
-        auto end = std::end(ints);
+  void ImzMLImageIO::SetIntervalVector(m2::IntervalVector::Pointer intervals)
+  {
+    m_Intervals = intervals;
+  }
 
-        switch (m_DataTypeYAxis)
+  void ImzMLImageIO::WriteContinuousCentroid3DStack(const m2::SpectrumImageStack *stack,
+                                                    m2::ImzMLSpectrumImage::SpectrumVectorType &spectra,
+                                                    m2::ImzMLBinaryDataWriter &writer) const
+  {
+    if (m_Intervals.IsNull() || m_Intervals->GetIntervals().empty())
+      mitkThrow() << "No intervals provided!";
+    if (m_DataTypeXAxis == m2::NumericType::None || m_DataTypeYAxis == m2::NumericType::None)
+      mitkThrow() << "m2::NumericType of output not set";
+
+    const auto &intervals = m_Intervals->GetIntervals();
+    const auto &transformers = stack->GetSliceTransformers();
+    const auto dims = stack->GetDimensions();
+    const std::size_t sliceN = std::size_t(dims[0]) * dims[1];
+    const std::size_t K = intervals.size();
+    if (sliceN == 0 || dims[2] == 0)
+      mitkThrow() << "The image stack is empty!";
+    if (transformers.size() < dims[2])
+      mitkThrow() << "The image stack has " << transformers.size() << " slices, its z dimension is " << dims[2];
+
+    // one spectrum per pixel of the stack mask, ordered by z, y, x
+    spectra.clear();
+    std::vector<std::size_t> sliceFirst(dims[2] + 1, 0);
+    {
+      mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3> macc(stack->GetMaskImage());
+      const auto *m = macc.GetData();
+      for (unsigned int z = 0; z < dims[2]; ++z)
+      {
+        sliceFirst[z] = spectra.size();
+        for (std::size_t i = 0; i < sliceN; ++i)
         {
-          case m2::NumericType::Float:
-            writeData<float>(start, end, b);
-            offsetDelta = ints.size() * sizeof(float);
-            break;
-          case m2::NumericType::Double:
-            writeData<double>(start, end, b);
-            offsetDelta = ints.size() * sizeof(double);
-            break;
-          case m2::NumericType::None:
-            mitkThrow() << "m2::NumericType of yAxisOutput not set";
+          if (m[z * sliceN + i] == 0)
+            continue;
+          m2::ImzMLSpectrumImage::BinarySpectrumMetaData s{};
+          s.index = {{itk::IndexValueType(i % dims[0]), itk::IndexValueType(i / dims[0]), itk::IndexValueType(z)}};
+          s.world = {float(s.index[0]), float(s.index[1]), float(z)};
+          spectra.push_back(s);
         }
-
-        offset += offsetDelta;
       }
-      b.flush();
-      ++show_progress;
+      sliceFirst[dims[2]] = spectra.size();
     }
-    ++sourceId;
-  }
+    if (spectra.empty())
+      mitkThrow() << "The mask of the image stack is empty!";
 
-  void ImzMLImageIO::SetIntervalVector(m2::IntervalVector::Pointer intervals)
-  {
-    m_Intervals = intervals;
-  }
+    // write mzs
+    m2::ImzMLSpectrumImage::BinarySpectrumMetaData mzAxis{};
+    {
+      const auto &xs = m_Intervals->GetXMean();
+      std::vector<char> bytes;
+      encodeArray(m_DataTypeXAxis, std::begin(xs), std::end(xs), bytes, m_UseZlibCompression);
+      mzAxis.mzOffset = writer.Append(bytes.data(), bytes.size());
+      mzAxis.mzLength = xs.size();
+      mzAxis.mzEncodedLength = bytes.size();
+    }
 
-  void ImzMLImageIO::WriteContinuousCentroid3DStack(const m2::SpectrumImageStack * ) const {
+    // the slice images use the processing settings of the stack (see SpectrumImageStack::GetImage),
+    // they are applied once before the slices are computed in parallel and restored after the export
+    std::vector<m2::SpectrumImage *> sliceImages(dims[2], nullptr);
+    std::map<m2::SpectrumImage *, std::mutex> sliceMutexes;
+    std::vector<std::unique_ptr<ProcessingSettingsGuard>> sliceSettings;
+    for (unsigned int z = 0; z < dims[2]; ++z)
+    {
+      auto sliceImage = dynamic_cast<m2::SpectrumImage *>(transformers[z]->GetMovingImage().GetPointer());
+      if (!sliceImage)
+        mitkThrow() << "The slice with index " << z << " is not a spectrum image!";
+      if (transformers[z]->GetTransformation().empty() &&
+          std::size_t(sliceImage->GetDimension(0)) * sliceImage->GetDimension(1) != sliceN)
+        mitkThrow() << "Slice dimensions are not equal for target slice with index " << z;
+      sliceImages[z] = sliceImage;
+      if (sliceMutexes.count(sliceImage))
+        continue;
+      sliceMutexes[sliceImage];
+      sliceSettings.push_back(std::make_unique<ProcessingSettingsGuard>(sliceImage));
+      sliceImage->SetBaselineCorrectionStrategy(stack->GetBaselineCorrectionStrategy());
+      sliceImage->SetBaseLineCorrectionHalfWindowSize(stack->GetBaseLineCorrectionHalfWindowSize());
+      sliceImage->SetNormalizationStrategy(stack->GetNormalizationStrategy());
+      sliceImage->SetSmoothingStrategy(stack->GetSmoothingStrategy());
+      sliceImage->SetSmoothingHalfWindowSize(stack->GetSmoothingHalfWindowSize());
+      sliceImage->SetIntensityTransformationStrategy(stack->GetIntensityTransformationStrategy());
+      sliceImage->SetImageSmoothingStrategy(stack->GetImageSmoothingStrategy());
+      sliceImage->SetImageNormalizationStrategy(stack->GetImageNormalizationStrategy());
+    }
 
-    // 
+    // warped ion images of slice z, values[k * sliceN + i]
+    const auto computeSlice = [&](unsigned int z, std::vector<float> &values)
+    {
+      values.assign(K * sliceN, 0);
+      const auto &transformer = transformers[z];
+      auto sliceImage = sliceImages[z];
+      // a slice image may be referenced by several slices of the stack
+      std::lock_guard<std::mutex> lock(sliceMutexes.at(sliceImage));
+      for (std::size_t k = 0; k < K; ++k)
+      {
+        const auto x = intervals[k].x.mean();
+        mitk::Image::Pointer ionImage = mitk::Image::New();
+        ionImage->Initialize(sliceImage);
+        sliceImage->GetImage(x, stack->ApplyTolerance(x), sliceImage->GetMaskImage(), ionImage);
+        if (!transformer->GetTransformation().empty())
+          ionImage = transformer->WarpImage(ionImage);
+
+        if (std::size_t(ionImage->GetDimension(0)) * ionImage->GetDimension(1) != sliceN)
+          mitkThrow() << "Slice dimensions are not equal for target slice with index " << z;
+        AccessFixedDimensionByItk(ionImage,
+                                  ([&](auto itkImage) {
+                                    const auto *data = itkImage->GetBufferPointer();
+                                    std::copy(data, data + sliceN, values.data() + k * sliceN);
+                                  }),
+                                  3);
+      }
+    };
 
+    // slices are computed in parallel, bounded to 1 GiB of ion image data
+    const unsigned int threads = stack->GetNumberOfThreads();
+    const unsigned int parallelSlices = std::max<unsigned long long>(
+      1, std::min<unsigned long long>({threads, dims[2], (1ull << 30) / std::max<std::size_t>(1, K * sliceN * sizeof(float))}));
+    std::vector<std::vector<float>> sliceValues(parallelSlices);
 
+    const auto valueBytes = m2::to_bytes(m_DataTypeYAxis);
+    boost::progress_display show_progress(dims[2]);
+    for (unsigned int z0 = 0; z0 < dims[2]; z0 += parallelSlices)
+    {
+      const unsigned int n = std::min(parallelSlices, dims[2] - z0);
+      // the first failing slice is reported after all workers joined
+      std::exception_ptr sliceError;
+      std::mutex sliceErrorMutex;
+      m2::Process::Map(n,
+                       n,
+                       [&](unsigned int, unsigned int a, unsigned int b)
+                       {
+                         for (unsigned int j = a; j < b; ++j)
+                         {
+                           try
+                           {
+                             computeSlice(z0 + j, sliceValues[j]);
+                           }
+                           catch (...)
+                           {
+                             std::lock_guard<std::mutex> lock(sliceErrorMutex);
+                             if (!sliceError)
+                               sliceError = std::current_exception();
+                           }
+                         }
+                       });
+      if (sliceError)
+        std::rethrow_exception(sliceError);
+
+      std::vector<unsigned int> ids(sliceFirst[z0 + n] - sliceFirst[z0]);
+      std::iota(std::begin(ids), std::end(ids), sliceFirst[z0]);
+      writer.WriteOrdered(
+        ids,
+        threads,
+        K * valueBytes,
+        [&](unsigned int id, std::vector<char> &bytes)
+        {
+          thread_local std::vector<float> ints;
+          const auto &s = spectra[id];
+          const auto &values = sliceValues[s.index[2] - z0];
+          const auto i = s.index[1] * dims[0] + s.index[0];
+          ints.resize(K);
+          for (std::size_t k = 0; k < K; ++k)
+            ints[k] = values[k * sliceN + i];
+          encodeArray(m_DataTypeYAxis, std::begin(ints), std::end(ints), bytes, m_UseZlibCompression);
+        },
+        [&](unsigned int id, unsigned long long offset, unsigned long long numberOfBytes)
+        {
+          auto &s = spectra[id];
+          s.mzOffset = mzAxis.mzOffset;
+          s.mzLength = mzAxis.mzLength;
+          s.mzEncodedLength = mzAxis.mzEncodedLength;
+          s.intOffset = offset;
+          s.intLength = K;
+          s.intEncodedLength = numberOfBytes;
+        });
+      show_progress += n;
+    }
   }
 
-  void ImzMLImageIO::WriteContinuousCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType &spectra) const
+  void ImzMLImageIO::WriteContinuousCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType &spectra,
+                                             m2::ImzMLBinaryDataWriter &writer) const
   {
     if (m_Intervals.IsNull() || m_Intervals->GetIntervals().empty())
       mitkThrow() << "No intervals provided!";
+    if (m_DataTypeXAxis == m2::NumericType::None || m_DataTypeYAxis == m2::NumericType::None)
+      mitkThrow() << "m2::NumericType of output not set";
 
-    std::vector<float> mzs, mzsMasked;
-    std::vector<float> ints, intsMasked;
-
-    // Output file stream for ibd
     const auto *input = static_cast<const m2::SpectrumImage *>(this->GetInput());
-    // auto nonConst_input = const_cast<m2::ImzMLSpectrumImage *>(input);
-    mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType> macc(input->GetMaskImage());
+    const auto ids = maskedSpectrumIds(input, spectra);
 
-    auto numPixels =
-      std::accumulate(input->GetDimensions(), input->GetDimensions() + 3, 1, std::multiplies<unsigned int>());
-    auto numMaskedPixel = 0;
-    for (auto it = macc.GetData(); it <= macc.GetData() + numPixels; ++it)
-    {
-      if (*it > 0)
-        numMaskedPixel++;
-    }
-
-    std::ofstream b(GetIBDOutputPath(), std::ofstream::binary | std::ofstream::app);
-
-    unsigned long long offset = 16;
-    unsigned long long offsetDelta = 0;
-    b.seekp(offset);
+    boost::progress_display show_progress(ids.size() + 1);
 
-    boost::progress_display show_progress(numMaskedPixel + 1);
     // write mzs
     {
-      // convert to float
       const auto &xs = m_Intervals->GetXMean();
-      std::copy(std::begin(xs), std::end(xs), std::back_inserter(mzsMasked));
+      std::vector<char> bytes;
+      encodeArray(m_DataTypeXAxis, std::begin(xs), std::end(xs), bytes, m_UseZlibCompression);
 
       // update source spectra meta data to its actual values
-      spectra[0].mzOffset = 16;
-      spectra[0].mzLength = mzsMasked.size();
-
-      switch (m_DataTypeXAxis)
-      {
-        case NumericType::Float:
-          writeData<float>(std::begin(mzsMasked), std::end(mzsMasked), b);
-          offsetDelta = spectra[0].mzLength * sizeof(float);
-          break;
-        case NumericType::Double:
-          writeData<double>(std::begin(mzsMasked), std::end(mzsMasked), b);
-          offsetDelta = spectra[0].mzLength * sizeof(double);
-          break;
-        case NumericType::None:
-          mitkThrow() << "m2::NumericType of xAxisOutput not set";
-      }
-      offset += offsetDelta;
+      spectra[0].mzOffset = writer.Append(bytes.data(), bytes.size());
+      spectra[0].mzLength = xs.size();
+      spectra[0].mzEncodedLength = bytes.size();
       ++show_progress;
     }
 
-    for (size_t id = 0; id < spectra.size(); ++id)
-    {
-      auto &s = spectra[id];
+    const auto &intervals = m_Intervals->GetIntervals();
+    const auto valueBytes = m2::to_bytes(m_DataTypeYAxis);
 
-      if (macc.GetPixelByIndex(s.index) > 0)
+    const auto mzAxis = spectra[0];
+    writer.WriteOrdered(
+      ids,
+      input->GetNumberOfThreads(),
+      intervals.size() * valueBytes,
+      [&](unsigned int id, std::vector<char> &bytes)
       {
-        // update mz axis info
-        s.mzLength = spectra[0].mzLength;
-        s.mzOffset = spectra[0].mzOffset;
+        thread_local std::vector<float> mzs, ints, intsMasked;
+        input->GetSpectrumFloat(id, mzs, ints);
+        intsMasked.clear();
 
-        // write ints
+        for (const Interval &I : intervals)
         {
-          input->GetSpectrumFloat(id, mzs, ints);
-          intsMasked.clear();
+          const auto tol = input->ApplyTolerance(I.x.mean());
+          const auto [startIndex, rangeLength] = m2::Signal::Subrange(mzs, I.x.mean() - tol, I.x.mean() + tol);
+          const auto s = std::next(std::begin(ints), startIndex);
+          const auto e = std::next(s, rangeLength);
+          intsMasked.push_back(Signal::RangePooling<double>(s, e, input->GetRangePoolingStrategy()));
+        }
+        encodeArray(m_DataTypeYAxis, std::begin(intsMasked), std::end(intsMasked), bytes, m_UseZlibCompression);
+      },
+      [&](unsigned int id, unsigned long long offset, unsigned long long numberOfBytes)
+      {
+        auto &s = spectra[id];
+        // update mz axis info
+        s.mzLength = mzAxis.mzLength;
+        s.mzOffset = mzAxis.mzOffset;
+        s.mzEncodedLength = mzAxis.mzEncodedLength;
 
-          for (const Interval &I : m_Intervals->GetIntervals())
-          {
-            double val = 0;
-            const auto tol = input->ApplyTolerance(I.x.mean());
-            // MITK_INFO << "Tolerance: " << tol;
-            const auto [startIndex, rangeLength] = m2::Signal::Subrange(mzs, I.x.mean() - tol, I.x.mean() + tol);
-            const auto s = std::next(std::begin(ints), startIndex);
-            const auto e = std::next(s, rangeLength);
-            val = Signal::RangePooling<double>(s, e, input->GetRangePoolingStrategy());
-
-            intsMasked.push_back(val);
-          }
+        s.intOffset = offset;
+        s.intLength = intervals.size();
+        s.intEncodedLength = numberOfBytes;
+        ++show_progress;
+      });
+  }
 
-          s.intOffset = offset;
-          s.intLength = intsMasked.size();
+  void ImzMLImageIO::WriteProcessedProfile(m2::ImzMLSpectrumImage::SpectrumVectorType &spectra,
+                                           m2::ImzMLBinaryDataWriter &writer) const
+  {
+    const auto *input = static_cast<const m2::SpectrumImage *>(this->GetInput());
+    const auto ids = maskedSpectrumIds(input, spectra);
+    const auto valueBytes = m2::to_bytes(m_DataTypeXAxis) + m2::to_bytes(m_DataTypeYAxis);
+
+    writeProcessedSpectra(spectra,
+                          ids,
+                          writer,
+                          input->GetNumberOfThreads(),
+                          m_DataTypeXAxis,
+                          m_DataTypeYAxis,
+                          m_UseZlibCompression,
+                          spectra[0].mzLength * valueBytes,
+                          [input](unsigned int id, std::vector<double> &xs, std::vector<double> &ys)
+                          { input->GetSpectrum(id, xs, ys); });
+  }
+
+  void ImzMLImageIO::WriteProcessedCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType &spectra,
+                                            m2::ImzMLBinaryDataWriter &writer) const
+  {
+    const auto *input = static_cast<const m2::SpectrumImage *>(this->GetInput());
+    const bool hasIntervals = m_Intervals.IsNotNull() && m_Intervals->GetNumberOfIntervals() > 0;
+    if (!hasIntervals && !any(input->GetSpectrumType().Format & m2::SpectrumFormat::Centroid))
+      mitkThrow() << "No intervals provided!";
+
+    const auto ids = maskedSpectrumIds(input, spectra);
+    const auto valueBytes = m2::to_bytes(m_DataTypeXAxis) + m2::to_bytes(m_DataTypeYAxis);
+    // read once from the columns, the intervals are not expanded to objects
+    const auto centers = hasIntervals ? m_Intervals->GetXMean() : std::vector<double>{};
+
+    // peaks of a pixel are the intervals with a non-zero value, or the non-zero values of centroid input
+    writeProcessedSpectra(
+      spectra,
+      ids,
+      writer,
+      input->GetNumberOfThreads(),
+      m_DataTypeXAxis,
+      m_DataTypeYAxis,
+      m_UseZlibCompression,
+      (hasIntervals ? centers.size() : spectra[0].mzLength) * valueBytes,
+      [&](unsigned int id, std::vector<double> &xs, std::vector<double> &ys)
+      {
+        thread_local std::vector<double> mzs, ints;
+        input->GetSpectrum(id, mzs, ints);
+        xs.clear();
+        ys.clear();
+        if (!hasIntervals)
+        {
+          for (size_t i = 0; i < mzs.size(); ++i)
+            if (ints[i] != 0)
+            {
+              xs.push_back(mzs[i]);
+              ys.push_back(ints[i]);
+            }
+          return;
+        }
 
-          switch (m_DataTypeYAxis)
+        for (const auto center : centers)
+        {
+          const auto tol = input->ApplyTolerance(center);
+          const auto [startIndex, rangeLength] = m2::Signal::Subrange(mzs, center - tol, center + tol);
+          if (rangeLength == 0)
+            continue;
+          const auto s = std::next(std::begin(ints), startIndex);
+          const auto e = std::next(s, rangeLength);
+          const auto v = Signal::RangePooling<double>(s, e, input->GetRangePoolingStrategy());
+          if (v != 0)
           {
-            case m2::NumericType::Float:
-              writeData<float>(std::begin(intsMasked), std::end(intsMasked), b);
-              offsetDelta = s.intLength * sizeof(float);
-              break;
-            case m2::NumericType::Double:
-              writeData<double>(std::begin(intsMasked), std::end(intsMasked), b);
-              offsetDelta = s.intLength * sizeof(double);
-              break;
-            case m2::NumericType::None:
-              mitkThrow() << "m2::NumericType of yAxisOutput not set";
+            xs.push_back(center);
+            ys.push_back(v);
           }
-
-          offset += offsetDelta;
         }
-        b.flush();
-        ++show_progress;
-      }
-    }
+      });
   }
 
-  void ImzMLImageIO::WriteProcessedProfile(m2::ImzMLSpectrumImage::SpectrumVectorType & /*spectra*/) const
+  void ImzMLImageIO::WriteRegionOfInterest(const m2::ImzMLSpectrumImage *input,
+                                           const std::vector<unsigned int> &ids,
+                                           m2::ImzMLSpectrumImage::SpectrumVectorType &spectra,
+                                           m2::ImzMLBinaryDataWriter &writer) const
   {
-    mitkThrow() << "Not implemented";
-  }
+    const auto view = input->GetBinaryDataView();
+    const auto bytesOf = [&input](const std::string &groupID, unsigned long long encodedLength, unsigned long long n)
+    {
+      if (encodedLength)
+        return encodedLength;
+      const auto type = input->GetPropertyValue<std::string>("m2aia.imzml." + groupID + ".value_type");
+      return n * (type == "64-bit float" ? 8ull : type == "16-bit float" ? 2ull : 4ull);
+    };
+
+    // all arrays to copy; arrays shared by several spectra (e.g. the m/z axis
+    // of continuous data) are copied once
+    struct Extent
+    {
+      unsigned long long offset, bytes;
+    };
+    std::vector<Extent> extents;
+    extents.reserve(ids.size() * 2);
+    for (const auto id : ids)
+    {
+      auto &s = spectra[id];
+      s.mzEncodedLength = bytesOf(input->GetMzGroupID(), s.mzEncodedLength, s.mzLength);
+      s.intEncodedLength = bytesOf(input->GetIntensityGroupID(), s.intEncodedLength, s.intLength);
+      extents.push_back({s.mzOffset, s.mzEncodedLength});
+      extents.push_back({s.intOffset, s.intEncodedLength});
+    }
+    std::sort(std::begin(extents),
+              std::end(extents),
+              [](const Extent &a, const Extent &b) { return a.offset < b.offset; });
+    extents.erase(std::unique(std::begin(extents),
+                              std::end(extents),
+                              [](const Extent &a, const Extent &b) { return a.offset == b.offset; }),
+                  std::end(extents));
+
+    for (const auto &e : extents)
+      if (!view->Contains(e.offset, e.bytes))
+        mitkThrow() << "Binary data array at offset " << e.offset << " exceeds the ibd file.";
+
+    // consecutive arrays are copied as one block; new offset of each array by its source offset
+    std::map<unsigned long long, unsigned long long> offsets;
+    const unsigned long long pieceBytes = 64ull << 20;
+    unsigned long long copied = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t a = 0; a < extents.size();)
+    {
+      auto end = extents[a].offset + extents[a].bytes;
+      size_t b = a + 1;
+      for (; b < extents.size() && extents[b].offset <= end; ++b)
+        end = std::max(end, extents[b].offset + extents[b].bytes);
+
+      const auto begin = extents[a].offset;
+      view->Advise(m2::MemoryMappedFile::AccessHint::Sequential, begin, end - begin);
+      unsigned long long target = writer.GetOffset();
+      for (auto o = begin; o < end; o += pieceBytes)
+      {
+        const auto n = std::min(pieceBytes, end - o);
+        if (o + n < end)
+          view->Advise(m2::MemoryMappedFile::AccessHint::WillNeed, o + n, std::min(pieceBytes, end - o - n));
+        writer.Append(view->Data() + o, n);
+      }
+      view->Advise(m2::MemoryMappedFile::AccessHint::Normal, begin, end - begin);
+      for (auto k = a; k < b; ++k)
+        offsets[extents[k].offset] = target + (extents[k].offset - begin);
+      copied += end - begin;
+      a = b;
+    }
 
-  void ImzMLImageIO::WriteProcessedCentroid(m2::ImzMLSpectrumImage::SpectrumVectorType & /*spectra*/) const
-  {
-    mitkThrow() << "Not implemented";
+    for (const auto id : ids)
+    {
+      auto &s = spectra[id];
+      s.mzOffset = offsets[s.mzOffset];
+      s.intOffset = offsets[s.intOffset];
+    }
+
+    const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    MITK_INFO << "Region of interest: " << ids.size() << " spectra, " << copied / (1024.0 * 1024.0) << " MB copied in "
+              << seconds.count() << " s";
   }
 
   void ImzMLImageIO::Write()
@@ -361,24 +811,16 @@ namespace m2
     
 
     std::string uuidString;
+    m2::ImzMLBinaryDataWriter writer(GetIBDOutputPath(), m_ComputeSHA1);
     {
       // Write UUID string to ibd
-      std::ofstream b(GetIBDOutputPath(), std::ofstream::binary);
       boost::uuids::basic_random_generator<boost::mt19937> gen;
       boost::uuids::uuid u = gen();
       uuidString = boost::uuids::to_string(u);
-      b.seekp(0);
-      b.write((char *)(u.data), u.static_size());
-      b.flush();
-      MITK_INFO << u.data;
+      writer.Append((char *)(u.data), u.static_size());
     }
 
-    if (const auto input = dynamic_cast<const m2::SpectrumImageStack *>(this->GetInput()))
-    {
-      WriteContinuousCentroid3DStack(input);
-      return;
-    }
-    else if (const auto input = static_cast<const m2::ImzMLSpectrumImage *>(this->GetInput()))
+    if (const auto input = dynamic_cast<const m2::SpectrumImage *>(this->GetInput()))
     {
       input->SaveModeOn();
       try
@@ -389,44 +831,67 @@ namespace m2
         // updated based on the save mode.
         // mz and ints meta data is manipulated to write a correct imzML xml structure
         // copy of sources is discared after writing
-        m2::ImzMLSpectrumImage::SpectrumVectorType spectraCopy(input->GetSpectra());
+        m2::ImzMLSpectrumImage::SpectrumVectorType spectraCopy;
+        const auto stack = dynamic_cast<const m2::SpectrumImageStack *>(input);
+        const auto imzML = dynamic_cast<const m2::ImzMLSpectrumImage *>(input);
+
+        // spectra written to the imzML (the mask, or the region of interest) and their bounding box
+        std::vector<unsigned int> ids;
+        itk::Index<3> regionIndex;
+        regionIndex.Fill(0);
+        itk::Size<3> regionSize = {{input->GetDimensions()[0], input->GetDimensions()[1], input->GetDimensions()[2]}};
+        const bool copyRegion = m_RegionOfInterest.IsNotNull();
+        auto format = m_SpectrumFormat;
+
+        if (copyRegion)
+        {
+          if (!imzML)
+            mitkThrow() << "A region of interest can only be exported from imzML spectrum images!";
+          if (!CheckDimensions(const_cast<m2::SpectrumImage *>(input), m_RegionOfInterest))
+            mitkThrow() << "The region of interest does not match the image dimensions!";
+          spectraCopy = imzML->GetSpectra();
+          ids = regionOfInterestIds(m_RegionOfInterest, m_RegionOfInterestLabel, spectraCopy, regionIndex, regionSize);
+          this->WriteRegionOfInterest(imzML, ids, spectraCopy, writer);
+          for (const auto id : ids)
+            for (unsigned int d = 0; d < 3; ++d)
+              spectraCopy[id].index[d] -= regionIndex[d];
+          format = input->GetSpectrumType().Format;
+        }
+        else if (stack)
+        {
+          if (m_SpectrumFormat != SpectrumFormat::ContinuousCentroid)
+            mitkThrow() << "Image stacks can only be exported as ContinuousCentroid!";
+          this->WriteContinuousCentroid3DStack(stack, spectraCopy, writer);
+        }
+        else
+        {
+          spectraCopy = imzML->GetSpectra();
+        }
 
-        std::string sha1;
-        switch (m_SpectrumFormat)
+        switch (stack || copyRegion ? SpectrumFormat::None : m_SpectrumFormat)
         {
           case SpectrumFormat::ContinuousProfile:
-            this->WriteContinuousProfile(spectraCopy);
+            this->WriteContinuousProfile(spectraCopy, writer);
             break;
           case SpectrumFormat::ProcessedCentroid:
-            mitkThrow() << "ProcessedCentroid export type is not supported!";
-            // this->WriteProcessedCentroid(spectraCopy);
+            this->WriteProcessedCentroid(spectraCopy, writer);
             break;
           case SpectrumFormat::ContinuousCentroid:
-            this->WriteContinuousCentroid(spectraCopy);
+            this->WriteContinuousCentroid(spectraCopy, writer);
             break;
           case SpectrumFormat::ProcessedProfile:
-            mitkThrow() << "ProcessedProfile export type is not supported!";
+            this->WriteProcessedProfile(spectraCopy, writer);
             break;
           default:
             break;
         }
 
-        Poco::SHA1Engine generator;
-        std::ifstream bf(GetIBDOutputPath(), std::fstream::binary);
-        char *c = new char[2048];
-        unsigned long long l = 0;
-        while (bf)
-        {
-          bf.read(c, 2048);
-          generator.update(c, bf.gcount());
-          l += bf.gcount();
-        }
-
-        MITK_INFO << "bytes " << l;
+        writer.Flush();
+        MITK_INFO << "bytes " << writer.GetOffset();
 
         std::map<std::string, std::string> context;
 
-        switch (m_SpectrumFormat)
+        switch (format)
         {
           case SpectrumFormat::None:
             mitkThrow() << "SpectrumFormatType::None type is not supported!";
@@ -451,12 +916,15 @@ namespace m2
           default:
             break;
         }
-        std::string sha1string = Poco::SHA1Engine::digestToHex(generator.digest());
-        MITK_INFO << "[ibd SHA1] " << sha1string << "\n";
         MITK_INFO << "[uuid] " << uuidString << "\n";
         // context["mode"] = "[IMS:1000030] continuous";
         context["uuid"] = uuidString;
-        context["sha1sum"] = sha1string;
+        if (m_ComputeSHA1)
+        {
+          std::string sha1string = writer.GetSHA1();
+          MITK_INFO << "[ibd SHA1] " << sha1string << "\n";
+          context["sha1sum"] = sha1string;
+        }
         unsigned mzBytes = 0;
         unsigned intBytes = 0;
 
@@ -470,6 +938,8 @@ namespace m2
             context["mz_data_type"] = "32-bit float";
             mzBytes = 4;
             break;
+          case m2::NumericType::Half:
+            mitkThrow() << "16-bit float is supported for intensities only";
           case m2::NumericType::None:
             mitkThrow() << "m2::NumericType of xAxisOutput not set";
         }
@@ -484,40 +954,52 @@ namespace m2
             context["int_data_type"] = "32-bit float";
             intBytes = 4;
             break;
+          case m2::NumericType::Half:
+            context["int_data_type"] = "16-bit float";
+            intBytes = 2;
+            break;
           case m2::NumericType::None:
             mitkThrow() << "m2::NumericType of yAxisOutput not set";
         }
 
-        auto nonConst_input = const_cast<m2::ImzMLSpectrumImage *>(input);
-        mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType> macc(nonConst_input->GetMaskImage());
+        if (copyRegion)
+        {
+          // the copied arrays keep the data types and compression of the source
+          const auto valueType = [imzML](const std::string &groupID)
+          { return imzML->GetPropertyValue<std::string>("m2aia.imzml." + groupID + ".value_type"); };
+          context["mz_data_type"] = valueType(imzML->GetMzGroupID());
+          context["int_data_type"] = valueType(imzML->GetIntensityGroupID());
+        }
+        const bool mzZlib = copyRegion ? imzML->IsMzZlibCompressed() : m_UseZlibCompression;
+        const bool intZlib = copyRegion ? imzML->IsIntensityZlibCompressed() : m_UseZlibCompression;
 
         context["mz_data_type_code"] = TextToCodeMap[context["mz_data_type"]];
         context["int_data_type_code"] = TextToCodeMap[context["int_data_type"]];
-        context["mz_compression"] = "no compression";
-        context["int_compression"] = "no compression";
+        context["mz_compression"] = mzZlib ? "zlib compression" : "no compression";
+        context["int_compression"] = intZlib ? "zlib compression" : "no compression";
 
         context["mode_code"] = TextToCodeMap[context["mode"]];
         context["spectrumtype_code"] = TextToCodeMap[context["spectrumtype"]];
 
-        context["size_x"] = std::to_string(input->GetDimensions()[0]);
-        context["size_y"] = std::to_string(input->GetDimensions()[1]);
-        context["size_z"] = std::to_string(input->GetDimensions()[2]);
+        context["size_x"] = std::to_string(regionSize[0]);
+        context["size_y"] = std::to_string(regionSize[1]);
+        context["size_z"] = std::to_string(regionSize[2]);
 
         auto xs = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetSpacing()[0]);
         auto ys = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetSpacing()[1]);
         auto zs = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetSpacing()[2]);
 
-        context["max dimension x"] = std::to_string(unsigned(input->GetDimensions()[0] * xs));
-        context["max dimension y"] = std::to_string(unsigned(input->GetDimensions()[1] * ys));
-        context["max dimension z"] = std::to_string(unsigned(input->GetDimensions()[2] * zs));
+        context["max dimension x"] = std::to_string(unsigned(regionSize[0] * xs));
+        context["max dimension y"] = std::to_string(unsigned(regionSize[1] * ys));
+        context["max dimension z"] = std::to_string(unsigned(regionSize[2] * zs));
 
         context["pixel size x"] = std::to_string(xs);
         context["pixel size y"] = std::to_string(ys);
         context["pixel size z"] = std::to_string(zs);
 
-        auto xo = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetOrigin()[0]);
-        auto yo = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetOrigin()[1]);
-        auto zo = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetOrigin()[2]);
+        auto xo = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetOrigin()[0]) + regionIndex[0] * xs;
+        auto yo = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetOrigin()[1]) + regionIndex[1] * ys;
+        auto zo = m2::MilliMeterToMicroMeter(input->GetGeometry()->GetOrigin()[2]) + regionIndex[2] * zs;
 
         context["origin x"] = std::to_string(xo);
         context["origin y"] = std::to_string(yo);
@@ -525,14 +1007,15 @@ namespace m2
 
         context["run_id"] = std::to_string(0);
 
-        auto numPixels =
-          std::accumulate(input->GetDimensions(), input->GetDimensions() + 3, 1, std::multiplies<unsigned int>());
-        auto numMaskedPixel = 0;
-        for (auto it = macc.GetData(); it <= macc.GetData() + numPixels; ++it)
+        if (!copyRegion)
         {
-          if (*it > 0)
-            numMaskedPixel++;
+          auto nonConst_input = const_cast<m2::SpectrumImage *>(input);
+          mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType> macc(nonConst_input->GetMaskImage());
+          for (unsigned int i = 0; i < spectraCopy.size(); ++i)
+            if (macc.GetPixelByIndex(spectraCopy[i].index) > 0)
+              ids.push_back(i);
         }
+        const auto numMaskedPixel = ids.size();
         MITK_INFO << "numMaskedPixel: " << numMaskedPixel;
         // auto N = spectraCopy.size();
         context["num_spectra"] = std::to_string(numMaskedPixel);
@@ -546,43 +1029,54 @@ namespace m2
         std::string view = IMZML_TEMPLATE_START;
         f << m2::TemplateEngine::render(view, context);
 
-        view = IMZML_SPECTRUM_TEMPLATE;
-        unsigned long id = 1;
+        // the spectrum template is parsed once, spectrum elements are rendered
+        // in parallel chunks and written in order
+        const m2::CompiledTemplate spectrumTemplate(IMZML_SPECTRUM_TEMPLATE, IMZML_SPECTRUM_TEMPLATE_KEYS);
 
         MITK_INFO << "Write imzML data ...";
         boost::progress_display show_progress(numMaskedPixel);
-        mitk::ImagePixelReadAccessor<m2::NormImagePixelType> nacc(nonConst_input->GetNormalizationImage());
 
-        for (auto &s : spectraCopy)
+        const unsigned int threads = input->GetNumberOfThreads();
+        const std::size_t chunkSize = 4096;
+        std::vector<std::string> chunks(threads);
+        for (std::size_t first = 0; first < ids.size(); first += chunkSize * threads)
         {
-          if (macc.GetPixelByIndex(s.index) > 0)
-          {
-            auto x = s.index[0] + 1; // start by 1
-            auto y = s.index[1] + 1; // start by 1
-            auto z = s.index[2] + 1; // start by 1
-
-            context = {{"index", std::to_string(id++)},
-                       {"x", std::to_string(x)},
-                       {"y", std::to_string(y)},
-                       {"z", std::to_string(z)},
-                       {"mz_len", std::to_string(s.mzLength)},
-                       {"mz_enc_len", std::to_string(s.mzLength * mzBytes)},
-                       {"mz_offset", std::to_string(s.mzOffset)},
-                       {"int_len", std::to_string(s.intLength)},
-                       {"int_enc_len", std::to_string(s.intLength * intBytes)},
-                       {"int_offset", std::to_string(s.intOffset)}};
-
-            // if (nacc.GetPixelByIndex(s.index) != 1)
-            // {
-            //   context["tic"] = std::to_string(nacc.GetPixelByIndex(s.index));
-            // }
-            f << m2::TemplateEngine::render(view, context);
-            f.flush();
-            ++show_progress;
-          }
+          const auto n = std::min(chunkSize * threads, ids.size() - first);
+          const auto numberOfChunks = (n + chunkSize - 1) / chunkSize;
+          m2::Process::Map(numberOfChunks,
+                           threads,
+                           [&](unsigned int, unsigned int a, unsigned int b)
+                           {
+                             std::vector<m2::CompiledTemplate::Value> values(IMZML_SPECTRUM_TEMPLATE_KEYS.size());
+                             for (unsigned int c = a; c < b; ++c)
+                             {
+                               auto &out = chunks[c];
+                               out.clear();
+                               const auto last = std::min(first + (c + 1) * chunkSize, first + n);
+                               for (auto k = first + c * chunkSize; k < last; ++k)
+                               {
+                                 const auto &s = spectraCopy[ids[k]];
+                                 values[0] = k + 1;
+                                 values[1] = s.index[0] + 1; // start by 1
+                                 values[2] = s.index[1] + 1; // start by 1
+                                 values[3] = s.index[2] + 1; // start by 1
+                                 values[4] = s.mzLength;
+                                 values[5] = s.mzEncodedLength ? s.mzEncodedLength : s.mzLength * mzBytes;
+                                 values[6] = s.mzOffset;
+                                 values[7] = s.intLength;
+                                 values[8] = s.intEncodedLength ? s.intEncodedLength : s.intLength * intBytes;
+                                 values[9] = s.intOffset;
+                                 spectrumTemplate.Render(values.data(), out);
+                               }
+                             }
+                           });
+
+          for (std::size_t c = 0; c < numberOfChunks; ++c)
+            f.write(chunks[c].data(), chunks[c].size());
+          show_progress += n;
         }
 
-        MITK_INFO << "numMaskedPixel: " << numMaskedPixel << " id: " << id;
+        MITK_INFO << "numMaskedPixel: " << numMaskedPixel;
 
         f << IMZML_TEMPLATE_END;
         f.close();
@@ -639,9 +1133,12 @@ namespace m2
     object->GetSpectrumType().XAxisLabel = "m/z";
     object->GetSpectrumType().YAxisLabel = "Intensity";
 
+    // the binary index file (<name>.m2idx) replaces the XML parsing if it is still valid
+    if (!m2::ImzMLIndexFile::Read(object))
     {
       m2::ImzMLParser::ReadImageMetaData(object);
       m2::ImzMLParser::ReadImageSpectrumMetaData(object);
+      m2::ImzMLIndexFile::Write(object);
     }
     {
       object->InitializeGeometry();
@@ -756,74 +1253,89 @@ namespace m2
     auto pathWithoutExtension = itksys::SystemTools::GetParentDirectory(GetInputLocation()) + "/" +
                              itksys::SystemTools::GetFilenameWithoutExtension(GetInputLocation());
 
+    // mask, shift and normalization images are registered as deferred images and read on first access
     auto maskPath = pathWithoutExtension + ".mask.nrrd";
     if (itksys::SystemTools::FileExists(maskPath))
     {
-      auto maskData = mitk::IOUtil::Load(maskPath).at(0);
-      if (auto maskImage = dynamic_cast<mitk::Image *>(maskData.GetPointer())){
-        if(ValidateChildImage(object, maskImage)){
-          if (auto lsImage = dynamic_cast<mitk::LabelSetImage *>(maskData.GetPointer()))
-          {
-            object->SetMaskImage(lsImage);
-          }
-          else
+      object->SetDeferredMaskImage(
+        [object, maskPath]() -> mitk::Image::Pointer
+        {
+          auto maskData = mitk::IOUtil::Load(maskPath).at(0);
+          auto maskImage = dynamic_cast<mitk::Image *>(maskData.GetPointer());
+          if (!maskImage || !ValidateChildImage(object, maskImage))
+            return nullptr;
+
+          mitk::LabelSetImage::Pointer lsImage = dynamic_cast<mitk::LabelSetImage *>(maskData.GetPointer());
+          if (lsImage.IsNull())
           {
-            auto newLsImage = mitk::LabelSetImage::New();
-            newLsImage->InitializeByLabeledImage(maskImage);
-            object->SetMaskImage(newLsImage);
+            lsImage = mitk::LabelSetImage::New();
+            lsImage->InitializeByLabeledImage(maskImage);
           }
-        } 
-      }
+          lsImage->SetProperty("m2aia.mask.initialization", mitk::StringProperty::New("external"));
+          return lsImage.GetPointer();
+        });
     }
 
     auto shiftImagePath = pathWithoutExtension + ".shift.nrrd";
     if (itksys::SystemTools::FileExists(shiftImagePath))
     {
-      auto data = mitk::IOUtil::Load(shiftImagePath).at(0);
-      object->SetShiftImage(dynamic_cast<mitk::Image *>(data.GetPointer()));
-      data->GetGeometry()->SetOrigin(object->GetGeometry()->GetOrigin());
-      data->GetGeometry()->SetSpacing(object->GetGeometry()->GetSpacing());
+      object->SetDeferredShiftImage(
+        [object, shiftImagePath]() -> mitk::Image::Pointer
+        {
+          auto data = mitk::IOUtil::Load(shiftImagePath).at(0);
+          data->GetGeometry()->SetOrigin(object->GetGeometry()->GetOrigin());
+          data->GetGeometry()->SetSpacing(object->GetGeometry()->GetSpacing());
+          return dynamic_cast<mitk::Image *>(data.GetPointer());
+        });
     }
 
     for (auto type : m2::NormalizationStrategyTypeList)
     {
       auto typeName = m2::NormalizationStrategyTypeNames[to_underlying(type)];
       auto fileName = pathWithoutExtension + "." + typeName + ".nrrd";
-      
-      if(itksys::SystemTools::FileExists(fileName)){ 
-        auto dataVector = mitk::IOUtil::Load(fileName);
-        auto externalImage = dynamic_cast<mitk::Image *>(dataVector[0].GetPointer());
-
-        
-        auto numPixels = std::accumulate(object->GetDimensions(), object->GetDimensions() + externalImage->GetDimension(), 1, std::multiplies<unsigned int>());
-        auto numPixelsExternal = std::accumulate(externalImage->GetDimensions(), externalImage->GetDimensions() + externalImage->GetDimension(), 1, std::multiplies<unsigned int>());
-
-        if(numPixels != numPixelsExternal){
-          MITK_ERROR << "Normalization image size does not match the data size! Skip loading the normalization image: " << fileName;
-          continue;
-        }
+      if (!itksys::SystemTools::FileExists(fileName))
+        continue;
 
-    
-        // m2::NormImagePixelType is either double or float 
-        // TODO: add cmake variable to select the pixel type
-        if (externalImage->GetPixelType().GetComponentType() == mitk::MakeScalarPixelType<m2::NormImagePixelType>().GetComponentType() &&
-        externalImage->GetDimension() == 3)
+      object->SetDeferredNormalizationImage(
+        type,
+        [object, fileName]() -> mitk::Image::Pointer
         {
-          object->SetNormalizationImage(externalImage, type);
-          object->SetNormalizationImageStatus(type, true);
-        }
-        else {
+          auto dataVector = mitk::IOUtil::Load(fileName);
+          mitk::Image::Pointer externalImage = dynamic_cast<mitk::Image *>(dataVector[0].GetPointer());
+          if (externalImage.IsNull())
+            return nullptr;
+
+          auto numPixels = std::accumulate(object->GetDimensions(), object->GetDimensions() + externalImage->GetDimension(), 1, std::multiplies<unsigned int>());
+          auto numPixelsExternal = std::accumulate(externalImage->GetDimensions(), externalImage->GetDimensions() + externalImage->GetDimension(), 1, std::multiplies<unsigned int>());
+
+          if (numPixels != numPixelsExternal)
+          {
+            MITK_ERROR << "Normalization image size does not match the data size! Skip loading the normalization image: " << fileName;
+            return nullptr;
+          }
+
+          // m2::NormImagePixelType is either double or float
+          // TODO: add cmake variable to select the pixel type
+          if (externalImage->GetPixelType().GetComponentType() == mitk::MakeScalarPixelType<m2::NormImagePixelType>().GetComponentType() &&
+              externalImage->GetDimension() == 3)
+          {
+            externalImage->GetGeometry()->SetOrigin(object->GetGeometry()->GetOrigin());
+            return externalImage;
+          }
+
+          auto normImage = object->CreateNormalizationImage();
           mitk::ImageReadAccessor racc(externalImage);
-          mitk::ImagePixelWriteAccessor<m2::NormImagePixelType, 3> wacc(object->GetNormalizationImage(type));
+          mitk::ImagePixelWriteAccessor<m2::NormImagePixelType, 3> wacc(normImage);
           if (externalImage->GetPixelType().GetComponentType() == mitk::MakeScalarPixelType<double>().GetComponentType())
           {
             std::copy(static_cast<const double *>(racc.GetData()), static_cast<const double *>(racc.GetData()) + numPixelsExternal, wacc.GetData());
-          }else if(externalImage->GetPixelType().GetComponentType() == mitk::MakeScalarPixelType<float>().GetComponentType())
+          }
+          else if (externalImage->GetPixelType().GetComponentType() == mitk::MakeScalarPixelType<float>().GetComponentType())
           {
             std::copy(static_cast<const float *>(racc.GetData()), static_cast<const float *>(racc.GetData()) + numPixelsExternal, wacc.GetData());
           }
-        }
-      }
+          return normImage;
+        });
     }
 
     // auto normPath = pathWithoutExtension + ".norm.nrrd";
@@ -0,0 +1,482 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <m2ImzMLIndexFile.h>
+#include <m2MemoryMappedFile.h>
+#include <m2Timer.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <itksys/SystemTools.hxx>
+#include <mitkCoreServices.h>
+#include <mitkGenericProperty.h>
+#include <mitkIPreferences.h>
+#include <mitkIPreferencesService.h>
+#include <mitkProperties.h>
+#include <sstream>
+
+namespace
+{
+  // All values are stored in little endian byte order (as the binary data in the ibd file).
+  constexpr char IndexFileMagic[8] = {'M', '2', 'A', 'I', 'A', 'I', 'D', 'X'};
+
+  enum IndexFileFlags : uint32_t
+  {
+    MinimalArea = 1u << 0
+  };
+
+  struct IndexFileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t imzMLSize;
+    int64_t imzMLModificationTime;
+    uint64_t ibdSize;
+    uint8_t uuid[16];
+    uint64_t numberOfSpectra;
+    uint64_t numberOfProperties;
+    uint64_t propertiesOffset;
+    uint64_t propertiesSize;
+    uint64_t spectraOffset;
+  };
+
+  struct IndexFileSpectrum
+  {
+    uint64_t mzOffset;
+    uint64_t intOffset;
+    uint64_t mzLength;
+    uint64_t intLength;
+    uint64_t mzEncodedLength;
+    uint64_t intEncodedLength;
+    int64_t index[3];
+    float world[3];
+    float inFileNormalizationFactor;
+  };
+
+  static_assert(sizeof(IndexFileSpectrum) == 88, "Unexpected padding in IndexFileSpectrum");
+
+  enum class PropertyTag : uint8_t
+  {
+    String = 0,
+    UInt = 1,
+    Int = 2,
+    Double = 3,
+    Float = 4,
+    Bool = 5
+  };
+
+  uint32_t GetFlags()
+  {
+    uint32_t flags = 0;
+    bool minimalArea = true;
+    if (auto *preferencesService = mitk::CoreServices::GetPreferencesService())
+      if (auto *preferences = preferencesService->GetSystemPreferences())
+        minimalArea = preferences->GetBool("m2aia.view.image.minimal_area", true);
+    if (minimalArea)
+      flags |= IndexFileFlags::MinimalArea;
+    return flags;
+  }
+
+  mitk::IPreferences *GetPreferences()
+  {
+    if (auto *preferencesService = mitk::CoreServices::GetPreferencesService())
+      return preferencesService->GetSystemPreferences();
+    return nullptr;
+  }
+
+  std::string GetCacheDirectory()
+  {
+    std::string dir;
+    if (auto *preferences = GetPreferences())
+      dir = preferences->Get("m2aia.imzml.sidecar_directory", "");
+    if (dir.empty())
+      if (const char *env = std::getenv("M2AIA_CACHE_DIR"))
+        dir = env;
+#ifdef _WIN32
+    if (dir.empty())
+      if (const char *localAppData = std::getenv("LOCALAPPDATA"))
+        dir = std::string(localAppData) + "/m2aia/cache";
+#else
+    if (dir.empty())
+    {
+      const char *xdg = std::getenv("XDG_CACHE_HOME");
+      const char *home = std::getenv("HOME");
+      if (xdg && *xdg)
+        dir = std::string(xdg) + "/m2aia";
+      else if (home && *home)
+        dir = std::string(home) + "/.cache/m2aia";
+    }
+#endif
+    return dir;
+  }
+
+  // 64-bit FNV-1a
+  uint64_t Hash(const std::string &value)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (const unsigned char c : value)
+    {
+      hash ^= c;
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  bool ReadBinaryDataUUID(const std::string &ibdPath, uint8_t (&uuid)[16])
+  {
+    std::ifstream ibd(ibdPath, std::ios::binary);
+    return static_cast<bool>(ibd.read(reinterpret_cast<char *>(uuid), 16));
+  }
+
+  bool FillIdentity(const m2::ImzMLSpectrumImage *data, IndexFileHeader &header)
+  {
+    m2::ImzMLIndexFile::FileIdentity identity;
+    if (!m2::ImzMLIndexFile::GetFileIdentity(data, identity))
+      return false;
+
+    std::memcpy(header.magic, IndexFileMagic, sizeof(IndexFileMagic));
+    header.version = m2::ImzMLIndexFile::Version;
+    header.flags = GetFlags();
+    header.imzMLSize = identity.imzMLSize;
+    header.imzMLModificationTime = identity.imzMLModificationTime;
+    header.ibdSize = identity.ibdSize;
+    std::memcpy(header.uuid, identity.uuid, sizeof(header.uuid));
+    return true;
+  }
+
+  template <class T>
+  void Append(std::string &buffer, const T &value)
+  {
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void AppendString(std::string &buffer, const std::string &value)
+  {
+    Append(buffer, uint32_t(value.size()));
+    buffer.append(value);
+  }
+
+  template <class T>
+  bool TryAppendProperty(std::string &buffer, PropertyTag tag, const std::string &key, const mitk::BaseProperty *prop)
+  {
+    auto entry = dynamic_cast<const mitk::GenericProperty<T> *>(prop);
+    if (!entry)
+      return false;
+    Append(buffer, tag);
+    AppendString(buffer, key);
+    if constexpr (std::is_same<T, std::string>::value)
+      AppendString(buffer, entry->GetValue());
+    else
+      Append(buffer, entry->GetValue());
+    return true;
+  }
+
+  class Cursor
+  {
+  public:
+    Cursor(const char *first, const char *last) : m_Pos(first), m_End(last) {}
+
+    template <class T>
+    bool Read(T &value)
+    {
+      if (std::size_t(m_End - m_Pos) < sizeof(T))
+        return false;
+      std::memcpy(&value, m_Pos, sizeof(T));
+      m_Pos += sizeof(T);
+      return true;
+    }
+
+    bool ReadString(std::string &value)
+    {
+      uint32_t n;
+      if (!Read(n) || std::size_t(m_End - m_Pos) < n)
+        return false;
+      value.assign(m_Pos, n);
+      m_Pos += n;
+      return true;
+    }
+
+  private:
+    const char *m_Pos;
+    const char *m_End;
+  };
+
+  template <class T>
+  bool ReadProperty(Cursor &cursor, const std::string &key, m2::ImzMLSpectrumImage *data)
+  {
+    T value;
+    if (!cursor.Read(value))
+      return false;
+    data->SetPropertyValue<T>(key, value);
+    return true;
+  }
+
+} // namespace
+
+bool m2::ImzMLIndexFile::FileIdentity::operator==(const FileIdentity &other) const
+{
+  return imzMLSize == other.imzMLSize && imzMLModificationTime == other.imzMLModificationTime &&
+         ibdSize == other.ibdSize && std::memcmp(uuid, other.uuid, sizeof(uuid)) == 0;
+}
+
+bool m2::ImzMLIndexFile::GetFileIdentity(const m2::ImzMLSpectrumImage *data, FileIdentity &identity)
+{
+  using itksys::SystemTools;
+  const auto imzMLPath = data->GetImzMLDataPath();
+  const auto ibdPath = data->GetBinaryDataPath();
+  if (!SystemTools::FileExists(imzMLPath) || !SystemTools::FileExists(ibdPath))
+    return false;
+
+  identity.imzMLSize = SystemTools::FileLength(imzMLPath);
+  // second resolution does not detect files rewritten within the same second
+  std::error_code error;
+  const auto modified = std::filesystem::last_write_time(std::filesystem::u8path(imzMLPath), error);
+  if (error)
+    return false;
+  identity.imzMLModificationTime =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count();
+  identity.ibdSize = SystemTools::FileLength(ibdPath);
+  return ReadBinaryDataUUID(ibdPath, identity.uuid);
+}
+
+std::string m2::ImzMLIndexFile::GetSidecarPath(const std::string &imzMLPath, const std::string &extension)
+{
+  using itksys::SystemTools;
+  const auto filename = SystemTools::GetFilenameWithoutLastExtension(imzMLPath);
+
+  bool nextToData = false;
+  if (auto *preferences = GetPreferences())
+    nextToData = preferences->GetBool("m2aia.imzml.sidecar_next_to_data", false);
+
+  const auto cacheDir = nextToData ? std::string() : GetCacheDirectory();
+  if (cacheDir.empty() || !SystemTools::MakeDirectory(cacheDir))
+    return SystemTools::GetParentDirectory(imzMLPath) + "/" + filename + extension;
+
+  // data sets in different directories may share a file name
+  std::ostringstream path;
+  path << cacheDir << "/" << filename << "-" << std::hex << std::setw(16) << std::setfill('0')
+       << Hash(SystemTools::CollapseFullPath(imzMLPath)) << extension;
+  return path.str();
+}
+
+std::string m2::ImzMLIndexFile::GetIndexFilePath(const std::string &imzMLPath)
+{
+  return GetSidecarPath(imzMLPath, Extension);
+}
+
+bool m2::ImzMLIndexFile::Read(m2::ImzMLSpectrumImage *data)
+{
+  const auto indexPath = GetIndexFilePath(data->GetImzMLDataPath());
+  if (!itksys::SystemTools::FileExists(indexPath))
+    return false;
+
+  IndexFileHeader expected{};
+  if (!FillIdentity(data, expected))
+    return false;
+
+  try
+  {
+    m2::Timer t("Read imzML index file " + indexPath);
+    m2::MemoryMappedFile file(indexPath);
+    file.Advise(m2::MemoryMappedFile::AccessHint::Sequential, 0, file.Size());
+
+    IndexFileHeader header;
+    if (!file.Contains(0, sizeof(header)))
+      return false;
+    file.Copy(0, 1, &header);
+
+    if (std::memcmp(header.magic, IndexFileMagic, sizeof(IndexFileMagic)) != 0 || header.version != expected.version ||
+        header.flags != expected.flags || header.imzMLSize != expected.imzMLSize ||
+        header.imzMLModificationTime != expected.imzMLModificationTime || header.ibdSize != expected.ibdSize ||
+        std::memcmp(header.uuid, expected.uuid, sizeof(header.uuid)) != 0)
+    {
+      MITK_INFO << "Index file is outdated and will be recreated: " << indexPath;
+      return false;
+    }
+
+    if (!file.Contains(header.propertiesOffset, header.propertiesSize) ||
+        !file.Contains(header.spectraOffset, header.numberOfSpectra * sizeof(IndexFileSpectrum)))
+    {
+      MITK_WARN << "Index file is truncated: " << indexPath;
+      return false;
+    }
+
+    // properties
+    Cursor cursor(file.Data() + header.propertiesOffset,
+                  file.Data() + header.propertiesOffset + header.propertiesSize);
+    std::string key, value;
+    for (uint64_t i = 0; i < header.numberOfProperties; ++i)
+    {
+      PropertyTag tag;
+      if (!cursor.Read(tag) || !cursor.ReadString(key))
+        return false;
+
+      bool status = false;
+      switch (tag)
+      {
+        case PropertyTag::String:
+          status = cursor.ReadString(value);
+          if (status)
+            data->SetPropertyValue<std::string>(key, value);
+          break;
+        case PropertyTag::UInt:
+          status = ReadProperty<unsigned int>(cursor, key, data);
+          break;
+        case PropertyTag::Int:
+          status = ReadProperty<int>(cursor, key, data);
+          break;
+        case PropertyTag::Double:
+          status = ReadProperty<double>(cursor, key, data);
+          break;
+        case PropertyTag::Float:
+          status = ReadProperty<float>(cursor, key, data);
+          break;
+        case PropertyTag::Bool:
+          status = ReadProperty<bool>(cursor, key, data);
+          break;
+      }
+      if (!status)
+      {
+        MITK_WARN << "Index file is corrupted: " << indexPath;
+        return false;
+      }
+    }
+
+    // spectra
+    auto &spectra = data->GetSpectra();
+    spectra.resize(header.numberOfSpectra);
+    const char *first = file.Data() + header.spectraOffset;
+    IndexFileSpectrum entry;
+    for (uint64_t i = 0; i < header.numberOfSpectra; ++i)
+    {
+      std::memcpy(&entry, first + i * sizeof(IndexFileSpectrum), sizeof(IndexFileSpectrum));
+      auto &s = spectra[i];
+      s.mzOffset = entry.mzOffset;
+      s.intOffset = entry.intOffset;
+      s.mzLength = entry.mzLength;
+      s.intLength = entry.intLength;
+      s.mzEncodedLength = entry.mzEncodedLength;
+      s.intEncodedLength = entry.intEncodedLength;
+      s.index[0] = entry.index[0];
+      s.index[1] = entry.index[1];
+      s.index[2] = entry.index[2];
+      s.world.x = entry.world[0];
+      s.world.y = entry.world[1];
+      s.world.z = entry.world[2];
+      s.inFileNormalizationFactor = entry.inFileNormalizationFactor;
+    }
+  }
+  catch (std::exception &e)
+  {
+    MITK_WARN << "Index file could not be read: " << indexPath << "\n" << e.what();
+    data->GetSpectra().clear();
+    return false;
+  }
+
+  return true;
+}
+
+bool m2::ImzMLIndexFile::Write(const m2::ImzMLSpectrumImage *data)
+{
+  const auto indexPath = GetIndexFilePath(data->GetImzMLDataPath());
+
+  IndexFileHeader header{};
+  if (!FillIdentity(data, header))
+    return false;
+
+  // Only GenericProperty values created by the parser are stored. The file paths
+  // (mitk::StringProperty) are set by the reader and are not part of the index.
+  std::string properties;
+  uint64_t numberOfProperties = 0;
+  for (const auto &kv : *data->GetPropertyList()->GetMap())
+  {
+    const auto &key = kv.first;
+    const auto *prop = kv.second.GetPointer();
+    if (TryAppendProperty<std::string>(properties, PropertyTag::String, key, prop) ||
+        TryAppendProperty<unsigned int>(properties, PropertyTag::UInt, key, prop) ||
+        TryAppendProperty<int>(properties, PropertyTag::Int, key, prop) ||
+        TryAppendProperty<double>(properties, PropertyTag::Double, key, prop) ||
+        TryAppendProperty<float>(properties, PropertyTag::Float, key, prop) ||
+        TryAppendProperty<bool>(properties, PropertyTag::Bool, key, prop))
+      ++numberOfProperties;
+  }
+
+  const auto &spectra = data->GetSpectra();
+  header.numberOfSpectra = spectra.size();
+  header.numberOfProperties = numberOfProperties;
+  header.propertiesOffset = sizeof(IndexFileHeader);
+  header.propertiesSize = properties.size();
+  // keep the spectrum records 8 byte aligned
+  header.spectraOffset = (header.propertiesOffset + header.propertiesSize + 7) & ~uint64_t(7);
+
+  std::vector<IndexFileSpectrum> records(spectra.size());
+  for (size_t i = 0; i < spectra.size(); ++i)
+  {
+    const auto &s = spectra[i];
+    auto &r = records[i];
+    r.mzOffset = s.mzOffset;
+    r.intOffset = s.intOffset;
+    r.mzLength = s.mzLength;
+    r.intLength = s.intLength;
+    r.mzEncodedLength = s.mzEncodedLength;
+    r.intEncodedLength = s.intEncodedLength;
+    r.index[0] = s.index[0];
+    r.index[1] = s.index[1];
+    r.index[2] = s.index[2];
+    r.world[0] = s.world.x;
+    r.world[1] = s.world.y;
+    r.world[2] = s.world.z;
+    r.inFileNormalizationFactor = s.inFileNormalizationFactor;
+  }
+
+  // write to a temporary file first, an index file is either complete or not existent
+  const auto tmpPath = indexPath + ".tmp";
+  {
+    std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!f)
+    {
+      MITK_WARN << "Index file could not be created: " << indexPath;
+      return false;
+    }
+    const char zeros[8] = {};
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.write(properties.data(), properties.size());
+    f.write(zeros, header.spectraOffset - (header.propertiesOffset + header.propertiesSize));
+    f.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(IndexFileSpectrum));
+    if (!f)
+    {
+      f.close();
+      std::remove(tmpPath.c_str());
+      MITK_WARN << "Index file could not be written: " << indexPath;
+      return false;
+    }
+  }
+
+  std::remove(indexPath.c_str());
+  if (std::rename(tmpPath.c_str(), indexPath.c_str()) != 0)
+  {
+    std::remove(tmpPath.c_str());
+    MITK_WARN << "Index file could not be written: " << indexPath;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,142 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+
+#include <m2ImzMLIndexFile.h>
+#include <m2ImzMLNormalizationFile.h>
+#include <m2ImzMLSpectrumImage.h>
+#include <signal/m2Normalization.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <itksys/SystemTools.hxx>
+#include <mitkLogMacros.h>
+
+namespace
+{
+  constexpr char NormalizationFileMagic[8] = {'M', '2', 'A', 'I', 'A', 'N', 'R', 'M'};
+
+  struct NormalizationFileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t numberOfTypes;
+    uint64_t imzMLSize;
+    int64_t imzMLModificationTime;
+    uint64_t ibdSize;
+    uint8_t uuid[16];
+    uint64_t numberOfSpectra;
+    uint32_t types[8];
+  };
+
+  static_assert(sizeof(NormalizationFileHeader) == 96, "Unexpected padding in NormalizationFileHeader");
+
+  bool FillHeader(const m2::ImzMLSpectrumImage *data, NormalizationFileHeader &header)
+  {
+    m2::ImzMLIndexFile::FileIdentity identity;
+    if (!m2::ImzMLIndexFile::GetFileIdentity(data, identity))
+      return false;
+
+    const auto &types = m2::Signal::SpectrumNormalizationStrategyTypeList;
+    static_assert(m2::Signal::SpectrumNormalizationStrategyTypeList.size() <= sizeof(header.types) / sizeof(uint32_t),
+                  "Too many normalization types for the file header");
+
+    std::memcpy(header.magic, NormalizationFileMagic, sizeof(NormalizationFileMagic));
+    header.version = m2::ImzMLNormalizationFile::Version;
+    header.numberOfTypes = types.size();
+    header.imzMLSize = identity.imzMLSize;
+    header.imzMLModificationTime = identity.imzMLModificationTime;
+    header.ibdSize = identity.ibdSize;
+    std::memcpy(header.uuid, identity.uuid, sizeof(header.uuid));
+    header.numberOfSpectra = data->GetSpectra().size();
+    for (size_t t = 0; t < types.size(); ++t)
+      header.types[t] = static_cast<uint32_t>(types[t]);
+    return true;
+  }
+
+} // namespace
+
+std::string m2::ImzMLNormalizationFile::GetNormalizationFilePath(const std::string &imzMLPath)
+{
+  return m2::ImzMLIndexFile::GetSidecarPath(imzMLPath, Extension);
+}
+
+bool m2::ImzMLNormalizationFile::Read(const m2::ImzMLSpectrumImage *data, std::vector<float> &factors)
+{
+  const auto path = GetNormalizationFilePath(data->GetImzMLDataPath());
+  if (!itksys::SystemTools::FileExists(path))
+    return false;
+
+  NormalizationFileHeader expected{};
+  if (!FillHeader(data, expected))
+    return false;
+
+  std::ifstream f(path, std::ios::binary);
+  NormalizationFileHeader header{};
+  if (!f.read(reinterpret_cast<char *>(&header), sizeof(header)) || std::memcmp(&header, &expected, sizeof(header)) != 0)
+  {
+    MITK_INFO << "Normalization file is outdated and will be recreated: " << path;
+    return false;
+  }
+
+  factors.resize(header.numberOfTypes * header.numberOfSpectra);
+  if (!f.read(reinterpret_cast<char *>(factors.data()), factors.size() * sizeof(float)))
+  {
+    MITK_WARN << "Normalization file is truncated: " << path;
+    factors.clear();
+    return false;
+  }
+  return true;
+}
+
+bool m2::ImzMLNormalizationFile::Write(const m2::ImzMLSpectrumImage *data, const std::vector<float> &factors)
+{
+  const auto path = GetNormalizationFilePath(data->GetImzMLDataPath());
+
+  NormalizationFileHeader header{};
+  if (!FillHeader(data, header) || factors.size() != header.numberOfTypes * header.numberOfSpectra)
+    return false;
+
+  // write to a temporary file first, a normalization file is either complete or not existent
+  const auto tmpPath = path + ".tmp";
+  {
+    std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!f)
+    {
+      MITK_WARN << "Normalization file could not be created: " << path;
+      return false;
+    }
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char *>(factors.data()), factors.size() * sizeof(float));
+    if (!f)
+    {
+      f.close();
+      std::remove(tmpPath.c_str());
+      MITK_WARN << "Normalization file could not be written: " << path;
+      return false;
+    }
+  }
+
+  std::remove(path.c_str());
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    std::remove(tmpPath.c_str());
+    MITK_WARN << "Normalization file could not be written: " << path;
+    return false;
+  }
+  return true;
+}
@@ -13,15 +13,23 @@ A PARTICULAR PURPOSE.
 See LICENSE.txt for details.
 
 ===================================================================*/
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
 #include <future>
 #include <iterator>
 #include <m2ImzMLParser.h>
+#include <m2MemoryMappedFile.h>
+#include <m2Process.hpp>
 #include <m2Timer.h>
 #include <math.h>
 #include <mitkCoreServices.h>
 #include <mitkIPreferences.h>
 #include <mitkIPreferencesService.h>
 #include <numeric>
+#include <optional>
+#include <string_view>
 #include <unordered_map>
 
 auto m2::ImzMLParser::findLine(std::ifstream &f, std::string name, std::string start_tag, bool eol)
@@ -179,6 +187,12 @@ void m2::ImzMLParser::ReadImageMetaData(m2::ImzMLSpectrumImage::Pointer data)
           dataType = name;
            }
         
+        if(line.find("MS:1000574") != npos ||
+           line.find("MS:1000576") != npos){
+          // zlib compression | no compression
+          data->SetPropertyValue<std::string>("m2aia.imzml." + id + ".compression", name);
+        }
+
         if(line.find("MS:1000127") != npos || 
            line.find("MS:1000128") != npos){
           spectrumType = name;
@@ -461,139 +475,288 @@ void m2::ImzMLParser::ReadImageMetaData(m2::ImzMLSpectrumImage::Pointer data)
   }
 }
 
-void m2::ImzMLParser::ReadImageSpectrumMetaData(m2::ImzMLSpectrumImage::Pointer data)
+namespace
 {
-  std::ifstream f;
-  std::vector<std::string> stack, context_stack;
-  std::string line, context, tag, name, value, accession;
-  tag.reserve(60);
-  name.reserve(60);
-  value.reserve(60);
-  context.reserve(60);
-  accession.reserve(60);
+  /// Text range in the memory mapped imzML file [first, last)
+  struct TextRange
+  {
+    const char *first;
+    const char *last;
+  };
 
-  std::unordered_map<std::string, std::function<void(const std::string &)>> accession_map;
-  std::unordered_map<std::string, std::function<void(const std::string &)>> context_map;
+  /// Search pattern with its skip table, built once per needle and shared by all threads.
+  class Needle
+  {
+  public:
+    explicit Needle(std::string_view pattern) : m_Size(pattern.size()), m_Searcher(pattern.begin(), pattern.end()) {}
 
-  f.open((data->GetImzMLDataPath()), std::ios_base::binary);
+    /// Position of the first occurrence in [first, last) or last
+    const char *Find(const char *first, const char *last) const { return std::search(first, last, m_Searcher); }
+    std::size_t size() const { return m_Size; }
 
-  std::map<std::string, unsigned> precisionDict = {{"32-bit float", sizeof(float)},
-                                                   {"64-bit float", sizeof(double)},
-                                                   {"32-bit integer", sizeof(int32_t)},
-                                                   {"64-bit integer", sizeof(int64_t)}};
+  private:
+    std::size_t m_Size;
+    std::boyer_moore_horspool_searcher<std::string_view::const_iterator> m_Searcher;
+  };
 
-  {
-    accession_map.clear();
-    context_map.clear();
+  // patterns are string literals, the searchers refer to them
+  const Needle SpectrumStartTag("<spectrum");
+  const Needle SpectrumListStartTag("<spectrumList");
+  const Needle SpectrumListEndTag("</spectrumList>");
+  const Needle CountAttribute("count");
+  const Needle RefAttribute("ref");
+  const Needle ValueAttribute("value");
+  const Needle AccessionAttribute("accession");
+  const Needle NameAttribute("name");
 
-    auto &spectra = data->GetSpectra();
+  bool IsTagNameEnd(char c) { return c == ' ' || c == '>' || c == '/' || c == '\n' || c == '\r' || c == '\t'; }
 
-    context_map["spectrumList"] = [&](auto line)
+  /// Find the next "<spectrum" start-tag (but not "<spectrumList")
+  const char *FindSpectrumStart(const char *first, const char *last)
+  {
+    const auto &tag = SpectrumStartTag;
+    while ((first = tag.Find(first, last)) != last)
     {
-      unsigned count = std::stoul(attributeValue(line, "count", value));
-      data->SetPropertyValue<unsigned>("number of measurements", count);
-      spectra.resize(count);
-    };
-
-    size_t spectrumIndexReference = 0;
+      if (first + tag.size() < last && IsTagNameEnd(first[tag.size()]))
+        return first;
+      first += tag.size();
+    }
+    return last;
+  }
 
-    context_map["spectrum"] = [&](auto line)
+  /// Get the value of an attribute of the element [first, last) without copying it
+  bool FindAttributeValue(const char *first, const char *last, const Needle &attribute, std::string_view &value)
+  {
+    const char *p = first;
+    while ((p = attribute.Find(p, last)) != last)
     {
-      attributeValue(line, "index", value);
-      spectra[spectrumIndexReference].index.SetElement(2, 0);
-      // TODO: Backtracability to spectrum in file may be lost.
-      //  Maybe we can add the id string to the BinarySpectrumMetaData definition.
-      //  e.g. spectrum.tag = attributValue(line, "id", value);
-    };
-
-    // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L196
-    accession_map["IMS:1000050"] = [&](auto line)
-    { spectra[spectrumIndexReference].index.SetElement(0, std::stol(attributeValue(line, "value", value)) - 1); };
+      const char *q = p + attribute.size();
+      if (p > first && std::isspace(static_cast<unsigned char>(p[-1])) && q + 1 < last && q[0] == '=' && q[1] == '"')
+      {
+        q += 2;
+        const char *e = std::find(q, last, '"');
+        value = std::string_view(q, e - q);
+        return true;
+      }
+      p = q;
+    }
+    value = std::string_view();
+    return false;
+  }
 
-    // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L204
-    accession_map["IMS:1000051"] = [&](auto line)
-    { spectra[spectrumIndexReference].index.SetElement(1, std::stol(attributeValue(line, "value", value)) - 1); };
+  /// The value is terminated by '"', which stops the number conversion.
+  double ToDouble(std::string_view v) { return v.empty() ? 0.0 : std::strtod(v.data(), nullptr); }
+  long ToLong(std::string_view v) { return v.empty() ? 0 : std::strtol(v.data(), nullptr, 10); }
+  unsigned long long ToULongLong(std::string_view v) { return v.empty() ? 0 : std::strtoull(v.data(), nullptr, 10); }
 
-    // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L213
-    accession_map["IMS:1000052"] = [&](auto line)
-    { spectra[spectrumIndexReference].index.SetElement(2, std::stol(attributeValue(line, "value", value)) - 1); };
+  struct SpectrumListScanContext
+  {
+    std::string_view mzGroupID;
+    std::string_view intensityGroupID;
+  };
 
-    // Foreign user tags
-    accession_map["3DPositionX"] = [&](auto line)
-    { spectra[spectrumIndexReference].world.x = std::stod(attributeValue(line, "value", value)); };
-    accession_map["3DPositionY"] = [&](auto line)
-    { spectra[spectrumIndexReference].world.y = std::stod(attributeValue(line, "value", value)); };
-    accession_map["3DPositionZ"] = [&](auto line)
-    { spectra[spectrumIndexReference].world.z = std::stod(attributeValue(line, "value", value)); };
+  /// The binary data array refers to the group id (an empty or missing reference matches no group).
+  bool IsGroup(const std::optional<std::string_view> &group, std::string_view id)
+  {
+    return group && !id.empty() && *group == id;
+  }
 
-    accession_map["MS:1000285"] = [&](auto line)
-    { spectra[spectrumIndexReference].inFileNormalizationFactor = std::stod(attributeValue(line, "value", value)); };
+  /**
+   * Parse all spectra in the range. The range starts with a spectrum start-tag and contains only complete spectra.
+   * Spectrum meta data is written to spectra[startIndex], spectra[startIndex+1], ...
+   * Returns true if the SciLs 3DPositionZ tag was found.
+   */
+  bool ParseSpectra(TextRange range,
+                    size_t startIndex,
+                    const SpectrumListScanContext &ctx,
+                    m2::ImzMLSpectrumImage::SpectrumVectorType &spectra)
+  {
+    using namespace std::string_view_literals;
+    bool scilsTag3DCoordinateUsed = false;
+    std::optional<std::string_view> group; // referenceableParamGroupRef of the current binary data array
+    std::string_view reference, accession, name, value;
+    size_t i = startIndex;
+    bool inSpectrum = false;
+
+    const char *p = range.first;
+    while ((p = std::find(p, range.last, '<')) != range.last)
+    {
+      const char *e = std::find(p, range.last, '>');
+      const char *n = p + 1;
+      if (n < e && *n == '/')
+        ++n;
+      while (n < e && !IsTagNameEnd(*n))
+        ++n;
+      const std::string_view tag(p + 1, n - (p + 1));
+      p = e;
+
+      if (tag == "/spectrum"sv)
+      {
+        inSpectrum = false;
+        group.reset();
+        ++i;
+        continue;
+      }
 
-    context_map["referenceableParamGroupRef"] = [&](auto line) { attributeValue(line, "ref", context); };
+      if (tag == "/binaryDataArray"sv)
+      {
+        group.reset();
+        continue;
+      }
 
-    auto mzArrayRefName = data->GetPropertyValue<std::string>("m2aia.imzml.mzGroupID");
-    // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L303
-    accession_map[mzArrayRefName + ".IMS:1000102"] = [&](auto line)
-    { spectra[spectrumIndexReference].mzOffset = std::stoull(attributeValue(line, "value", value)); };
+      if (tag == "spectrum"sv)
+      {
+        if (i >= spectra.size())
+          break;
+        inSpectrum = true;
+        spectra[i].index.SetElement(2, 0);
+        continue;
+      }
 
-    // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L311
-    accession_map[mzArrayRefName + ".IMS:1000103"] = [&](auto line)
-    { spectra[spectrumIndexReference].mzLength = std::stoull(attributeValue(line, "value", value)); };
+      if (!inSpectrum)
+        continue;
 
-    auto intensityArrayRefName = data->GetPropertyValue<std::string>("m2aia.imzml.intensityGroupID");
-    // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L303
-    accession_map[intensityArrayRefName + ".IMS:1000102"] = [&](auto line)
-    { spectra[spectrumIndexReference].intOffset = std::stoull(attributeValue(line, "value", value)); };
+      if (tag == "referenceableParamGroupRef"sv)
+      {
+        if (FindAttributeValue(n, e, RefAttribute, reference) && !reference.empty())
+          group = reference;
+        else
+          group.reset();
+        continue;
+      }
 
-    // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L311
-    accession_map[intensityArrayRefName + ".IMS:1000103"] = [&](auto line)
-    { spectra[spectrumIndexReference].intLength = std::stoull(attributeValue(line, "value", value)); };
+      if (tag != "cvParam"sv && tag != "userParam"sv)
+        continue;
 
-    std::vector<char> buff;
-    std::list<std::thread> threads;
-    bool _ScilsTag3DCoordinateUsed = false;
-    {
-      while (!f.eof())
+      auto &spectrum = spectra[i];
+      FindAttributeValue(n, e, ValueAttribute, value);
+      if (FindAttributeValue(n, e, AccessionAttribute, accession) && !accession.empty())
       {
-        std::getline(f, line); // read the next line from the file
-        if (line.find("</") != std::string::npos)
+        if (accession == "IMS:1000102"sv)
         {
-          if (line.find("spectrum") != std::string::npos)
-            ++spectrumIndexReference;
-          continue;
+          if (IsGroup(group, ctx.mzGroupID))
+            spectrum.mzOffset = ToULongLong(value);
+          else if (IsGroup(group, ctx.intensityGroupID))
+            spectrum.intOffset = ToULongLong(value);
         }
-        if (line.rfind("/>") != std::string::npos) // check for end-tag
-        {                                          // check for empty element-tag
-          attributeValue(line, "accession", accession);
-          if (!accession.empty())
-          {
-            // if a context is given
-            if (!context.empty())
-            {
-              // call context specific accession
-              if (evaluateAccession(line, context + "." + accession, accession_map))
-                continue;
-            }
-            // fall back to context-less accession
-            if (evaluateAccession(line, accession, accession_map))
-              continue;
-          }
-          else
-          {
-            // e.g. support old 3D imzML Data (SciLs specific tags)
-            attributeValue(line, "name", name);
-            if (name.compare("3DPositionZ") == 0)
-            {
-              evaluateAccession(line, name, accession_map);
-              _ScilsTag3DCoordinateUsed = true;
-            }
-          }
+        else if (accession == "IMS:1000103"sv)
+        {
+          if (IsGroup(group, ctx.mzGroupID))
+            spectrum.mzLength = ToULongLong(value);
+          else if (IsGroup(group, ctx.intensityGroupID))
+            spectrum.intLength = ToULongLong(value);
+        }
+        // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L319
+        else if (accession == "IMS:1000104"sv)
+        {
+          if (IsGroup(group, ctx.mzGroupID))
+            spectrum.mzEncodedLength = ToULongLong(value);
+          else if (IsGroup(group, ctx.intensityGroupID))
+            spectrum.intEncodedLength = ToULongLong(value);
+        }
+        // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L196
+        else if (accession == "IMS:1000050"sv)
+          spectrum.index.SetElement(0, ToLong(value) - 1);
+        // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L204
+        else if (accession == "IMS:1000051"sv)
+          spectrum.index.SetElement(1, ToLong(value) - 1);
+        // https://github.com/m2aia/imzML/blob/master/imagingMS.obo#L213
+        else if (accession == "IMS:1000052"sv)
+          spectrum.index.SetElement(2, ToLong(value) - 1);
+        else if (accession == "MS:1000285"sv)
+          spectrum.inFileNormalizationFactor = ToDouble(value);
+      }
+      else if (FindAttributeValue(n, e, NameAttribute, name))
+      {
+        // e.g. support old 3D imzML Data (SciLs specific tags)
+        if (name == "3DPositionX"sv)
+          spectrum.world.x = ToDouble(value);
+        else if (name == "3DPositionY"sv)
+          spectrum.world.y = ToDouble(value);
+        else if (name == "3DPositionZ"sv)
+        {
+          spectrum.world.z = ToDouble(value);
+          scilsTag3DCoordinateUsed = true;
         }
-
-        GetElementName(line, tag);
-        EvaluateContext(line, tag, context_map);
       }
     }
+    return scilsTag3DCoordinateUsed;
+  }
+
+} // namespace
+
+void m2::ImzMLParser::ReadImageSpectrumMetaData(m2::ImzMLSpectrumImage::Pointer data)
+{
+  {
+    auto &spectra = data->GetSpectra();
+
+    // The spectrumList is scanned in place in the memory mapped imzML file.
+    // It is split at spectrum start-tags into chunks that are parsed in parallel.
+    m2::MemoryMappedFile file(data->GetImzMLDataPath());
+    file.Advise(m2::MemoryMappedFile::AccessHint::Sequential, 0, file.Size());
+    const char *fileBegin = file.Data();
+    const char *fileEnd = file.Data() + file.Size();
+
+    const char *listBegin = SpectrumListStartTag.Find(fileBegin, fileEnd);
+    if (listBegin == fileEnd)
+      mitkThrow() << "No spectrumList element found in " << data->GetImzMLDataPath();
+    const char *listTagEnd = std::find(listBegin, fileEnd, '>');
+
+    std::string_view countValue;
+    unsigned count = 0;
+    if (FindAttributeValue(listBegin, listTagEnd, CountAttribute, countValue))
+      count = ToULongLong(countValue);
+    data->SetPropertyValue<unsigned>("number of measurements", count);
+    spectra.resize(count);
+
+    const char *listEnd = SpectrumListEndTag.Find(listTagEnd, fileEnd);
+
+    const std::string mzGroupID = data->GetPropertyValue<std::string>("m2aia.imzml.mzGroupID");
+    const std::string intensityGroupID = data->GetPropertyValue<std::string>("m2aia.imzml.intensityGroupID");
+    const SpectrumListScanContext ctx{mzGroupID, intensityGroupID};
+
+    // chunk boundaries are aligned to spectrum start-tags
+    const unsigned int T = std::max(1u, data->GetNumberOfThreads());
+    const auto listSize = static_cast<size_t>(listEnd - listTagEnd);
+    std::vector<const char *> bounds(T + 1, listEnd);
+    bounds[0] = FindSpectrumStart(listTagEnd, listEnd);
+    for (unsigned int t = 1; t < T; ++t)
+      bounds[t] = std::max(bounds[t - 1], FindSpectrumStart(listTagEnd + (listSize * t) / T, listEnd));
+
+    // count the spectra per chunk to find the index of the first spectrum in each chunk
+    std::vector<size_t> chunkCount(T, 0);
+    m2::Process::Map(T,
+                     T,
+                     [&](unsigned int, unsigned int a, unsigned int b)
+                     {
+                       for (unsigned int t = a; t < b; ++t)
+                         for (const char *s = FindSpectrumStart(bounds[t], bounds[t + 1]); s != bounds[t + 1];
+                              s = FindSpectrumStart(s + 1, bounds[t + 1]))
+                           ++chunkCount[t];
+                     });
+
+    std::vector<size_t> chunkStart(T, 0);
+    std::partial_sum(chunkCount.begin(), std::prev(chunkCount.end()), std::next(chunkStart.begin()));
+    const size_t numberOfSpectra = chunkStart.back() + chunkCount.back();
+    if (numberOfSpectra != spectra.size())
+    {
+      MITK_WARN << "The spectrumList count attribute (" << count << ") differs from the number of spectra found ("
+                << numberOfSpectra << ").";
+      spectra.resize(numberOfSpectra);
+      data->SetPropertyValue<unsigned>("number of measurements", numberOfSpectra);
+    }
+
+    std::vector<char> scilsTagUsedT(T, false);
+    m2::Process::Map(T,
+                     T,
+                     [&](unsigned int, unsigned int a, unsigned int b)
+                     {
+                       for (unsigned int t = a; t < b; ++t)
+                         scilsTagUsedT[t] = ParseSpectra({bounds[t], bounds[t + 1]}, chunkStart[t], ctx, spectra);
+                     });
+
+    const bool _ScilsTag3DCoordinateUsed =
+      std::any_of(scilsTagUsedT.begin(), scilsTagUsedT.end(), [](char v) { return v; });
 
     data->SetPropertyValue<double>("pixel size z", m2::MicroMeterToMilliMeter(10));
 
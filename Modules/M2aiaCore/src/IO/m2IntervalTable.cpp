@@ -0,0 +1,348 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <m2IntervalTable.h>
+#include <m2IntervalVector.h>
+#include <m2MemoryMappedFile.h>
+#include <mitkExceptionMacro.h>
+
+namespace
+{
+  constexpr char Magic[8] = {'M', '2', 'I', 'N', 'T', 'V', 'L', '\0'};
+  constexpr std::uint32_t HasDescriptionsFlag = 1;
+
+  struct FileHeader
+  {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t type;
+    std::uint64_t count;
+    std::uint32_t numberOfSourcePixels;
+    std::uint32_t flags;
+    std::uint64_t infoBytes;
+    std::uint64_t descriptionBytes;
+    char reserved[16];
+  };
+  static_assert(sizeof(FileHeader) == 64, "m2intervals header must be 64 bytes");
+
+  std::uint64_t Padded(std::uint64_t bytes) { return (bytes + 7) & ~std::uint64_t(7); }
+
+  /// Byte offsets of all columns in a file with n intervals.
+  struct Layout
+  {
+    std::uint64_t xSum, xMin, xMax, xCount, ySum, yMin, yMax, yCount, sourceId, descriptionOffsets, descriptions, end;
+
+    Layout(std::uint64_t n, std::uint64_t infoBytes, bool hasDescriptions, std::uint64_t descriptionBytes)
+    {
+      // less than 16 columns of n doubles, the offsets below can not overflow
+      if (n > std::numeric_limits<std::uint64_t>::max() / (16 * sizeof(double)))
+        mitkThrow() << "Too many intervals for an interval file: " << n;
+      const auto d = n * sizeof(double);
+      const auto u = Padded(n * sizeof(std::uint32_t));
+      xSum = Padded(sizeof(FileHeader) + infoBytes);
+      xMin = xSum + d;
+      xMax = xMin + d;
+      xCount = xMax + d;
+      ySum = xCount + u;
+      yMin = ySum + d;
+      yMax = yMin + d;
+      yCount = yMax + d;
+      sourceId = yCount + u;
+      descriptionOffsets = sourceId + u;
+      descriptions = descriptionOffsets + (hasDescriptions ? (n + 1) * sizeof(std::uint64_t) : 0);
+      end = descriptions + (hasDescriptions ? descriptionBytes : 0);
+    }
+  };
+
+  void Pad(std::ostream &os)
+  {
+    static const char zeros[8] = {};
+    const auto pos = static_cast<std::uint64_t>(os.tellp());
+    os.write(zeros, Padded(pos) - pos);
+  }
+
+  /// Write value(0) ... value(n - 1) in buffered chunks, followed by padding to 8 bytes.
+  template <class F>
+  void WriteColumn(std::ostream &os, std::size_t n, F value)
+  {
+    using T = decltype(value(std::size_t(0)));
+    std::vector<T> buffer;
+    buffer.reserve(std::min<std::size_t>(n, 1 << 16));
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      buffer.push_back(value(i));
+      if (buffer.size() == buffer.capacity())
+      {
+        os.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(T));
+        buffer.clear();
+      }
+    }
+    os.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(T));
+    Pad(os);
+  }
+
+  /**
+   * Write a file from a source providing the columns per interval
+   * (xSum(i), ..., sourceId(i), description(i)).
+   */
+  template <class Source>
+  void WriteFile(const std::string &path,
+                 const Source &src,
+                 std::size_t n,
+                 m2::SpectrumFormat type,
+                 const std::string &info,
+                 unsigned int numberOfSourcePixels,
+                 bool hasDescriptions)
+  {
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os)
+      mitkThrow() << "Could not open interval file for writing: " << path;
+
+    std::uint64_t descriptionBytes = 0;
+    if (hasDescriptions)
+      for (std::size_t i = 0; i < n; ++i)
+        descriptionBytes += src.description(i).size();
+
+    FileHeader header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = m2::IntervalTable::Version;
+    header.type = static_cast<std::uint32_t>(type);
+    header.count = n;
+    header.numberOfSourcePixels = numberOfSourcePixels;
+    header.flags = hasDescriptions ? HasDescriptionsFlag : 0;
+    header.infoBytes = info.size();
+    header.descriptionBytes = descriptionBytes;
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os.write(info.data(), info.size());
+    Pad(os);
+
+    WriteColumn(os, n, [&](std::size_t i) { return src.xSum(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.xMin(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.xMax(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.xCount(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.ySum(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.yMin(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.yMax(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.yCount(i); });
+    WriteColumn(os, n, [&](std::size_t i) { return src.sourceId(i); });
+
+    if (hasDescriptions)
+    {
+      std::uint64_t offset = 0;
+      WriteColumn(os,
+                  n + 1,
+                  [&](std::size_t i)
+                  {
+                    const auto o = offset;
+                    if (i < n)
+                      offset += src.description(i).size();
+                    return o;
+                  });
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        const auto &s = src.description(i);
+        os.write(s.data(), s.size());
+      }
+    }
+
+    if (!os)
+      mitkThrow() << "Could not write interval file: " << path;
+  }
+
+  struct IntervalSource
+  {
+    const std::vector<m2::Interval> &v;
+    double xSum(std::size_t i) const { return v[i].x.m_sum; }
+    double xMin(std::size_t i) const { return v[i].x.m_min; }
+    double xMax(std::size_t i) const { return v[i].x.m_max; }
+    std::uint32_t xCount(std::size_t i) const { return v[i].x.m_count; }
+    double ySum(std::size_t i) const { return v[i].y.m_sum; }
+    double yMin(std::size_t i) const { return v[i].y.m_min; }
+    double yMax(std::size_t i) const { return v[i].y.m_max; }
+    std::uint32_t yCount(std::size_t i) const { return v[i].y.m_count; }
+    std::uint32_t sourceId(std::size_t i) const { return v[i].sourceId; }
+    const std::string &description(std::size_t i) const { return v[i].description; }
+  };
+
+  struct TableSource
+  {
+    const m2::IntervalTable &t;
+    double xSum(std::size_t i) const { return t.XSum()[i]; }
+    double xMin(std::size_t i) const { return t.XMin()[i]; }
+    double xMax(std::size_t i) const { return t.XMax()[i]; }
+    std::uint32_t xCount(std::size_t i) const { return t.XCount()[i]; }
+    double ySum(std::size_t i) const { return t.YSum()[i]; }
+    double yMin(std::size_t i) const { return t.YMin()[i]; }
+    double yMax(std::size_t i) const { return t.YMax()[i]; }
+    std::uint32_t yCount(std::size_t i) const { return t.YCount()[i]; }
+    std::uint32_t sourceId(std::size_t i) const { return t.SourceId()[i]; }
+    std::string description(std::size_t i) const { return t.GetDescription(i); }
+  };
+
+  bool AnyDescription(const std::vector<m2::Interval> &intervals)
+  {
+    return std::any_of(intervals.begin(), intervals.end(), [](const m2::Interval &I) { return !I.description.empty(); });
+  }
+} // namespace
+
+m2::IntervalTable::IntervalTable(const std::vector<m2::Interval> &intervals) : m_Size(intervals.size())
+{
+  const auto n = m_Size;
+  m_Doubles.resize(6 * n);
+  m_Integers.resize(3 * n);
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    const auto &I = intervals[i];
+    m_Doubles[i] = I.x.m_sum;
+    m_Doubles[n + i] = I.x.m_min;
+    m_Doubles[2 * n + i] = I.x.m_max;
+    m_Doubles[3 * n + i] = I.y.m_sum;
+    m_Doubles[4 * n + i] = I.y.m_min;
+    m_Doubles[5 * n + i] = I.y.m_max;
+    m_Integers[i] = I.x.m_count;
+    m_Integers[n + i] = I.y.m_count;
+    m_Integers[2 * n + i] = I.sourceId;
+  }
+
+  m_XSum = m_Doubles.data();
+  m_XMin = m_XSum + n;
+  m_XMax = m_XMin + n;
+  m_YSum = m_XMax + n;
+  m_YMin = m_YSum + n;
+  m_YMax = m_YMin + n;
+  m_XCount = m_Integers.data();
+  m_YCount = m_XCount + n;
+  m_SourceId = m_YCount + n;
+
+  if (AnyDescription(intervals))
+  {
+    m_Offsets.reserve(n + 1);
+    for (const auto &I : intervals)
+    {
+      m_Offsets.push_back(m_Strings.size());
+      m_Strings += I.description;
+    }
+    m_Offsets.push_back(m_Strings.size());
+    m_DescriptionOffsets = m_Offsets.data();
+    m_Descriptions = m_Strings.data();
+  }
+}
+
+std::shared_ptr<const m2::IntervalTable> m2::IntervalTable::Open(const std::string &path)
+{
+  auto file = std::make_shared<m2::MemoryMappedFile>(path);
+  if (!file->Contains(0, sizeof(FileHeader)))
+    mitkThrow() << "Not an interval file (too small): " << path;
+
+  FileHeader header;
+  file->Copy(0, 1, &header);
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+    mitkThrow() << "Not an interval file: " << path;
+  if (header.version > Version)
+    mitkThrow() << "Unsupported interval file version " << header.version << ": " << path;
+
+  // no section is larger than the file
+  if (header.infoBytes > file->Size() || header.descriptionBytes > file->Size())
+    mitkThrow() << "Interval file is truncated: " << path;
+
+  const bool hasDescriptions = header.flags & HasDescriptionsFlag;
+  const Layout layout(header.count, header.infoBytes, hasDescriptions, header.descriptionBytes);
+  if (!file->Contains(0, layout.end))
+    mitkThrow() << "Interval file is truncated: " << path;
+
+  auto table = std::make_shared<IntervalTable>();
+  table->m_Size = header.count;
+  table->m_Type = static_cast<m2::SpectrumFormat>(header.type);
+  table->m_Info.assign(file->Data() + sizeof(FileHeader), header.infoBytes);
+  table->m_NumberOfSourcePixels = header.numberOfSourcePixels;
+
+  table->m_XSum = file->Pointer<double>(layout.xSum, header.count);
+  table->m_XMin = file->Pointer<double>(layout.xMin, header.count);
+  table->m_XMax = file->Pointer<double>(layout.xMax, header.count);
+  table->m_XCount = file->Pointer<std::uint32_t>(layout.xCount, header.count);
+  table->m_YSum = file->Pointer<double>(layout.ySum, header.count);
+  table->m_YMin = file->Pointer<double>(layout.yMin, header.count);
+  table->m_YMax = file->Pointer<double>(layout.yMax, header.count);
+  table->m_YCount = file->Pointer<std::uint32_t>(layout.yCount, header.count);
+  table->m_SourceId = file->Pointer<std::uint32_t>(layout.sourceId, header.count);
+  if (hasDescriptions)
+  {
+    table->m_DescriptionOffsets = file->Pointer<std::uint64_t>(layout.descriptionOffsets, header.count + 1);
+    table->m_Descriptions = file->Data() + layout.descriptions;
+  }
+  if (header.count > 0 && (!table->m_XSum || !table->m_SourceId || (hasDescriptions && !table->m_DescriptionOffsets)))
+    mitkThrow() << "Interval file columns are not aligned: " << path;
+
+  // descriptions are read as [offsets[i], offsets[i + 1]) of the description bytes
+  if (hasDescriptions)
+  {
+    const auto *offsets = table->m_DescriptionOffsets;
+    if (!offsets || offsets[0] != 0 || offsets[header.count] != header.descriptionBytes ||
+        !std::is_sorted(offsets, offsets + header.count + 1))
+      mitkThrow() << "Interval file descriptions are corrupted: " << path;
+  }
+
+  table->m_File = file;
+  return table;
+}
+
+void m2::IntervalTable::Write(const std::string &path) const
+{
+  WriteFile(path, TableSource{*this}, m_Size, m_Type, m_Info, m_NumberOfSourcePixels, HasDescriptions());
+}
+
+void m2::IntervalTable::Write(const std::string &path,
+                              const std::vector<m2::Interval> &intervals,
+                              m2::SpectrumFormat type,
+                              const std::string &info,
+                              unsigned int numberOfSourcePixels)
+{
+  WriteFile(path, IntervalSource{intervals}, intervals.size(), type, info, numberOfSourcePixels, AnyDescription(intervals));
+}
+
+std::string m2::IntervalTable::GetDescription(std::size_t i) const
+{
+  if (!m_DescriptionOffsets)
+    return {};
+  return std::string(m_Descriptions + m_DescriptionOffsets[i], m_DescriptionOffsets[i + 1] - m_DescriptionOffsets[i]);
+}
+
+m2::Interval m2::IntervalTable::GetInterval(std::size_t i) const
+{
+  m2::Interval I(m_SourceId[i]);
+  I.x.m_sum = m_XSum[i];
+  I.x.m_min = m_XMin[i];
+  I.x.m_max = m_XMax[i];
+  I.x.m_count = m_XCount[i];
+  I.y.m_sum = m_YSum[i];
+  I.y.m_min = m_YMin[i];
+  I.y.m_max = m_YMax[i];
+  I.y.m_count = m_YCount[i];
+  I.description = GetDescription(i);
+  return I;
+}
+
+void m2::IntervalTable::GetIntervals(std::vector<m2::Interval> &intervals) const
+{
+  intervals.clear();
+  intervals.reserve(m_Size);
+  for (std::size_t i = 0; i < m_Size; ++i)
+    intervals.push_back(GetInterval(i));
+}
@@ -0,0 +1,267 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <m2MemoryMappedFile.h>
+#include <mitkExceptionMacro.h>
+#include <mitkLogMacros.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+m2::MemoryMappedFile::MemoryMappedFile(const std::string &path) : m_Path(path)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(
+    path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    mitkThrow() << "Could not open file for memory mapping: " << path;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+  {
+    CloseHandle(file);
+    mitkThrow() << "Could not determine the file size: " << path;
+  }
+  m_FileHandle = file;
+  m_Size = static_cast<std::uint64_t>(size.QuadPart);
+  if (m_Size == 0)
+    return;
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    m_FileHandle = nullptr;
+    mitkThrow() << "Could not create a file mapping: " << path;
+  }
+  m_MappingHandle = mapping;
+
+  m_Data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!m_Data)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    m_MappingHandle = m_FileHandle = nullptr;
+    mitkThrow() << "Could not map view of file: " << path;
+  }
+#else
+  m_FileDescriptor = ::open(path.c_str(), O_RDONLY);
+  if (m_FileDescriptor < 0)
+    mitkThrow() << "Could not open file for memory mapping: " << path;
+
+  struct stat st;
+  if (::fstat(m_FileDescriptor, &st) != 0)
+  {
+    ::close(m_FileDescriptor);
+    m_FileDescriptor = -1;
+    mitkThrow() << "Could not determine the file size: " << path;
+  }
+
+  m_Size = static_cast<std::uint64_t>(st.st_size);
+  if (m_Size == 0)
+    return;
+
+  void *data = ::mmap(nullptr, m_Size, PROT_READ, MAP_SHARED, m_FileDescriptor, 0);
+  if (data == MAP_FAILED)
+  {
+    ::close(m_FileDescriptor);
+    m_FileDescriptor = -1;
+    mitkThrow() << "Could not memory map file: " << path;
+  }
+  m_Data = static_cast<const char *>(data);
+#endif
+}
+
+m2::MemoryMappedFile::~MemoryMappedFile()
+{
+#ifdef _WIN32
+  if (m_Data)
+    UnmapViewOfFile(m_Data);
+  if (m_MappingHandle)
+    CloseHandle(m_MappingHandle);
+  if (m_FileHandle)
+    CloseHandle(m_FileHandle);
+#else
+  if (m_Data)
+    ::munmap(const_cast<char *>(m_Data), m_Size);
+  if (m_FileDescriptor >= 0)
+    ::close(m_FileDescriptor);
+#endif
+}
+
+void m2::MemoryMappedFile::ThrowOutOfRange(std::uint64_t offset, std::uint64_t bytes) const
+{
+  mitkThrow() << "Access of " << bytes << " bytes at offset " << offset << " exceeds the file size (" << m_Size
+              << " bytes): " << m_Path;
+}
+
+void m2::MemoryMappedFile::Advise(AccessHint hint, std::uint64_t offset, std::uint64_t length) const
+{
+  if (!m_Data || offset >= m_Size || length == 0)
+    return;
+  if (length > m_Size - offset)
+    length = m_Size - offset;
+
+#ifdef _WIN32
+  if (hint == AccessHint::WillNeed || hint == AccessHint::Sequential)
+  {
+    WIN32_MEMORY_RANGE_ENTRY entry;
+    entry.VirtualAddress = const_cast<char *>(m_Data + offset);
+    entry.NumberOfBytes = static_cast<SIZE_T>(length);
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+  }
+#else
+  // madvise requires a page aligned start address
+  static const std::uint64_t pageSize = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+  const auto alignedOffset = offset - (offset % pageSize);
+  length += offset - alignedOffset;
+
+  int advice = MADV_NORMAL;
+  switch (hint)
+  {
+    case AccessHint::Sequential:
+      advice = MADV_SEQUENTIAL;
+      break;
+    case AccessHint::Random:
+      advice = MADV_RANDOM;
+      break;
+    case AccessHint::WillNeed:
+      advice = MADV_WILLNEED;
+      break;
+    case AccessHint::Normal:
+    default:
+      break;
+  }
+
+  if (::madvise(const_cast<char *>(m_Data + alignedOffset), length, advice) != 0)
+    MITK_WARN << "madvise failed for " << m_Path;
+
+#ifdef POSIX_FADV_WILLNEED
+  // also hint the page cache of the file (readahead on network file systems)
+  int fileAdvice = POSIX_FADV_NORMAL;
+  switch (hint)
+  {
+    case AccessHint::Sequential:
+      fileAdvice = POSIX_FADV_SEQUENTIAL;
+      break;
+    case AccessHint::Random:
+      fileAdvice = POSIX_FADV_RANDOM;
+      break;
+    case AccessHint::WillNeed:
+      fileAdvice = POSIX_FADV_WILLNEED;
+      break;
+    case AccessHint::Normal:
+    default:
+      break;
+  }
+  ::posix_fadvise(m_FileDescriptor, static_cast<off_t>(alignedOffset), static_cast<off_t>(length), fileAdvice);
+#endif
+#endif
+}
+
+m2::MemoryMappedOutputFile::MemoryMappedOutputFile(const std::string &path, std::uint64_t size)
+  : m_Path(path), m_Size(size)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(
+    path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    mitkThrow() << "Could not create file for memory mapping: " << path;
+  m_FileHandle = file;
+  if (m_Size == 0)
+    return;
+
+  HANDLE mapping = CreateFileMappingA(
+    file, nullptr, PAGE_READWRITE, static_cast<DWORD>(m_Size >> 32), static_cast<DWORD>(m_Size & 0xFFFFFFFF), nullptr);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    m_FileHandle = nullptr;
+    mitkThrow() << "Could not create a file mapping: " << path;
+  }
+  m_MappingHandle = mapping;
+
+  m_Data = static_cast<char *>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+  if (!m_Data)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    m_MappingHandle = m_FileHandle = nullptr;
+    mitkThrow() << "Could not map view of file: " << path;
+  }
+#else
+  m_FileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (m_FileDescriptor < 0)
+    mitkThrow() << "Could not create file for memory mapping: " << path;
+  if (m_Size == 0)
+    return;
+
+  if (::ftruncate(m_FileDescriptor, static_cast<off_t>(m_Size)) != 0)
+  {
+    ::close(m_FileDescriptor);
+    m_FileDescriptor = -1;
+    mitkThrow() << "Could not resize file to " << m_Size << " bytes: " << path;
+  }
+
+  void *data = ::mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_SHARED, m_FileDescriptor, 0);
+  if (data == MAP_FAILED)
+  {
+    ::close(m_FileDescriptor);
+    m_FileDescriptor = -1;
+    mitkThrow() << "Could not memory map file: " << path;
+  }
+  m_Data = static_cast<char *>(data);
+#endif
+}
+
+m2::MemoryMappedOutputFile::~MemoryMappedOutputFile()
+{
+#ifdef _WIN32
+  if (m_Data)
+    UnmapViewOfFile(m_Data);
+  if (m_MappingHandle)
+    CloseHandle(m_MappingHandle);
+  if (m_FileHandle)
+    CloseHandle(m_FileHandle);
+#else
+  if (m_Data)
+    ::munmap(m_Data, m_Size);
+  if (m_FileDescriptor >= 0)
+    ::close(m_FileDescriptor);
+#endif
+}
+
+void m2::MemoryMappedOutputFile::Flush()
+{
+  if (!m_Data)
+    return;
+#ifdef _WIN32
+  if (!FlushViewOfFile(m_Data, 0) || !FlushFileBuffers(m_FileHandle))
+    mitkThrow() << "Could not flush memory mapped file: " << m_Path;
+#else
+  if (::msync(m_Data, m_Size, MS_SYNC) != 0)
+    mitkThrow() << "Could not flush memory mapped file: " << m_Path;
+#endif
+}
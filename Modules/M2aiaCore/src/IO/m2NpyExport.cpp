@@ -0,0 +1,179 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <m2IntervalVector.h>
+#include <m2MemoryMappedFile.h>
+#include <m2NpyExport.h>
+#include <m2Process.hpp>
+#include <m2SpectrumImage.h>
+#include <mitkExceptionMacro.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkLabelSetImage.h>
+#include <mitkLogMacros.h>
+#include <mutex>
+#include <npy/npy.hpp>
+#include <signal/m2Pooling.h>
+#include <sstream>
+
+namespace
+{
+  std::string BaseName(const std::string &path)
+  {
+    const std::string ext = ".npy";
+    if (path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0)
+      return path.substr(0, path.size() - ext.size());
+    return path;
+  }
+
+  std::vector<npy::ndarray_len_t> Shape(std::initializer_list<std::size_t> dims)
+  {
+    return std::vector<npy::ndarray_len_t>(dims.begin(), dims.end());
+  }
+
+  /// NumPy header of a C-ordered array (magic, version, header dict and padding).
+  template <class T>
+  std::string Header(std::initializer_list<std::size_t> dims)
+  {
+    std::ostringstream os;
+    npy::write_header(os, npy::header_t{npy::dtype_map.at(std::type_index(typeid(T))), false, Shape(dims)});
+    return os.str();
+  }
+
+  template <class T>
+  void Save(const std::string &path, std::initializer_list<std::size_t> dims, const T *data)
+  {
+    const auto shape = Shape(dims);
+    try
+    {
+      npy::SaveArrayAsNumpy(path, false, shape.size(), shape.data(), data);
+    }
+    catch (std::exception &e)
+    {
+      mitkThrow() << "Could not write " << path << ": " << e.what();
+    }
+  }
+} // namespace
+
+void m2::NpyExport::Write(const std::string &path, const m2::SpectrumImage *image, const m2::IntervalVector *features)
+{
+  if (!image || !features)
+    mitkThrow() << "Npy export requires a spectrum image and an interval vector.";
+  if (!image->GetMaskImage() || !image->GetIndexImage())
+    mitkThrow() << "Npy export requires an initialized spectrum image.";
+
+  const auto base = BaseName(path);
+  const auto centers = features->GetXMean();
+  const std::size_t numberOfFeatures = centers.size();
+  if (numberOfFeatures == 0)
+    mitkThrow() << "Npy export: the interval vector is empty.";
+
+  // feature ranges as used for ion images
+  std::vector<double> lower(numberOfFeatures), upper(numberOfFeatures);
+  for (std::size_t j = 0; j < numberOfFeatures; ++j)
+  {
+    const auto tol = image->ApplyTolerance(centers[j]);
+    lower[j] = centers[j] - tol;
+    upper[j] = centers[j] + tol;
+  }
+
+  auto pooling = image->GetRangePoolingStrategy();
+  if (pooling == m2::RangePoolingStrategyType::None)
+    pooling = m2::RangePoolingStrategyType::Maximum;
+
+  // rows: valid pixels in image order (x fastest)
+  const auto *dims = image->GetDimensions();
+  const std::size_t nx = dims[0], ny = dims[1], nz = image->GetDimension() > 2 ? dims[2] : 1;
+  const std::size_t numberOfPixels = nx * ny * nz;
+
+  mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3> maskAccess(image->GetMaskImage());
+  mitk::ImagePixelReadAccessor<m2::IndexImagePixelType, 3> indexAccess(image->GetIndexImage());
+  const auto *mask = maskAccess.GetData();
+  const auto *index = indexAccess.GetData();
+
+  std::vector<m2::IndexImagePixelType> ids;
+  std::vector<int> coordinates;
+  for (std::size_t p = 0; p < numberOfPixels; ++p)
+  {
+    if (mask[p] == 0)
+      continue;
+    ids.push_back(index[p]);
+    coordinates.push_back(int(p % nx));
+    coordinates.push_back(int((p / nx) % ny));
+    coordinates.push_back(int(p / (nx * ny)));
+  }
+  const std::size_t numberOfRows = ids.size();
+  if (numberOfRows == 0)
+    mitkThrow() << "Npy export: the mask of the image is empty.";
+
+  // dense matrix, filled in place
+  {
+    const auto header = Header<float>({numberOfRows, numberOfFeatures});
+    const std::uint64_t dataBytes = std::uint64_t(numberOfRows) * numberOfFeatures * sizeof(float);
+    m2::MemoryMappedOutputFile out(base + ".npy", header.size() + dataBytes);
+    std::memcpy(out.Data(), header.data(), header.size());
+    auto *matrix = reinterpret_cast<float *>(out.Data() + header.size());
+
+    // the first failing spectrum is reported after all workers joined
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    std::atomic<bool> failed{false};
+
+    const auto start = std::chrono::steady_clock::now();
+    m2::Process::Map(numberOfRows,
+                     image->GetNumberOfThreads(),
+                     [&](unsigned int /*t*/, unsigned int a, unsigned int b)
+                     {
+                       try
+                       {
+                         std::vector<float> xs, ys;
+                         for (unsigned int r = a; r < b && !failed; ++r)
+                         {
+                           image->GetSpectrumFloat(ids[r], xs, ys);
+                           float *row = matrix + std::size_t(r) * numberOfFeatures;
+                           for (std::size_t j = 0; j < numberOfFeatures; ++j)
+                           {
+                             const auto s = std::lower_bound(std::begin(xs), std::end(xs), lower[j]) - std::begin(xs);
+                             const auto e = std::upper_bound(std::begin(xs) + s, std::end(xs), upper[j]) - std::begin(xs);
+                             row[j] = m2::Signal::RangePooling<float>(std::begin(ys) + s, std::begin(ys) + e, pooling);
+                           }
+                         }
+                       }
+                       catch (...)
+                       {
+                         std::lock_guard<std::mutex> lock(errorMutex);
+                         if (!error)
+                           error = std::current_exception();
+                         failed = true;
+                       }
+                     });
+    if (error)
+      std::rethrow_exception(error);
+    out.Flush();
+
+    const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    MITK_INFO << "Npy export " << numberOfRows << " x " << numberOfFeatures << " to " << out.GetPath() << ": "
+              << seconds.count() << "s (" << (dataBytes / 1048576.0) / std::max(seconds.count(), 1e-9) << " MB/s)";
+  }
+
+  Save(base + "_coordinates.npy", {numberOfRows, 3}, coordinates.data());
+  Save(base + "_mask.npy", {nz, ny, nx}, mask);
+  Save(base + "_features.npy", {numberOfFeatures}, centers.data());
+}
@@ -0,0 +1,69 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes.
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
+
+===================================================================*/
+
+#include <m2ImzMLSpectrumImage.h>
+#include <m2TiledSpectrumImage.h>
+#include <m2TiledSpectrumImageIO.h>
+
+namespace m2
+{
+  TiledSpectrumImageIO::TiledSpectrumImageIO()
+    : AbstractFileIO(mitk::Image::GetStaticNameOfClass(), M2TILES_MIMETYPE(), "M2aia Tiled Spectrum Image")
+  {
+    // below ImzMLImageIO (10), imzML stays the default format to save spectrum images
+    AbstractFileWriter::SetRanking(5);
+    AbstractFileReader::SetRanking(10);
+    this->RegisterService();
+  }
+
+  mitk::IFileIO::ConfidenceLevel TiledSpectrumImageIO::GetWriterConfidenceLevel() const
+  {
+    if (AbstractFileIO::GetWriterConfidenceLevel() == Unsupported)
+      return Unsupported;
+
+    auto input = dynamic_cast<const m2::ImzMLSpectrumImage *>(this->GetInput());
+    if (input && input->GetImageAccessInitialized())
+      return Supported;
+    return Unsupported;
+  }
+
+  void TiledSpectrumImageIO::Write()
+  {
+    ValidateOutputLocation();
+    auto input = dynamic_cast<const m2::ImzMLSpectrumImage *>(this->GetInput());
+    if (!input)
+      mitkThrow() << "Only imzML spectrum images can be converted to " << m2::TiledSpectrumStore::Extension;
+    m2::TiledSpectrumStore::Write(GetOutputLocation(), input, m_Options);
+  }
+
+  mitk::IFileIO::ConfidenceLevel TiledSpectrumImageIO::GetReaderConfidenceLevel() const
+  {
+    if (AbstractFileIO::GetReaderConfidenceLevel() == Unsupported)
+      return Unsupported;
+    return Supported;
+  }
+
+  std::vector<mitk::BaseData::Pointer> TiledSpectrumImageIO::DoRead()
+  {
+    auto store = std::make_shared<const m2::TiledSpectrumStore>(GetInputLocation());
+    auto object = m2::TiledSpectrumImage::New();
+    object->SetStore(store);
+    object->InitializeGeometry();
+    return {object.GetPointer()};
+  }
+
+  TiledSpectrumImageIO *TiledSpectrumImageIO::IOClone() const { return new TiledSpectrumImageIO(*this); }
+} // namespace m2
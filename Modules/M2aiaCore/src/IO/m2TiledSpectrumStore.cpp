@@ -0,0 +1,531 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <m2BinaryDataCompression.h>
+#include <m2ImzMLSpectrumImage.h>
+#include <m2Process.hpp>
+#include <m2Timer.h>
+#include <m2TiledSpectrumStore.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mitkExceptionMacro.h>
+#include <numeric>
+
+namespace
+{
+  // All values are stored in little endian byte order.
+  constexpr char StoreFileMagic[8] = {'M', '2', 'A', 'I', 'A', 'T', 'I', 'L'};
+
+  // upper bound of the memory used for the tiles processed in parallel while writing
+  constexpr uint64_t StoreFileBatchBytes = uint64_t(512) << 20;
+
+  struct StoreFileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t dimensions[3];
+    uint32_t tileSize;
+    double spacing[3];
+    double origin[3];
+    uint64_t numberOfSpectra;
+    uint64_t numberOfChannels;
+    uint64_t channelsPerBlock;
+    uint64_t numberOfTiles;
+    uint64_t xAxisOffset;
+    uint64_t spectraOffset;
+    uint64_t tileOffsetsOffset;
+    uint64_t tileSpectraOffset;
+    uint64_t chunkTableOffset;
+    char xAxisLabel[64];
+  };
+
+  static_assert(sizeof(m2::TiledSpectrumStore::Spectrum) == 48, "Unexpected padding in TiledSpectrumStore::Spectrum");
+
+  uint64_t Align8(uint64_t v) { return (v + 7) & ~uint64_t(7); }
+
+  void Encode(const char *src, uint64_t rawBytes, const m2::TiledSpectrumStore::Options &options, std::vector<char> &dest)
+  {
+    if (options.UseZlibCompression && m2::Zlib::Deflate(src, rawBytes, dest, options.CompressionLevel) < rawBytes)
+      return;
+    dest.assign(src, src + rawBytes);
+  }
+
+  template <class T>
+  void CopySection(const m2::MemoryMappedFile &file, uint64_t offset, uint64_t n, std::vector<T> &dest)
+  {
+    if (!file.Contains(offset, n * sizeof(T)))
+      mitkThrow() << "Tiled spectrum store is truncated: " << file.GetPath();
+    dest.resize(n);
+    file.Copy(offset, n, dest.data());
+  }
+
+} // namespace
+
+m2::TiledSpectrumStore::TiledSpectrumStore(const std::string &path) : m_File(path)
+{
+  StoreFileHeader header;
+  if (!m_File.Contains(0, sizeof(header)))
+    mitkThrow() << "Not a tiled spectrum store: " << path;
+  m_File.Copy(0, 1, &header);
+
+  if (std::memcmp(header.magic, StoreFileMagic, sizeof(StoreFileMagic)) != 0)
+    mitkThrow() << "Not a tiled spectrum store: " << path;
+  if (header.version != Version)
+    mitkThrow() << "Unsupported tiled spectrum store version " << header.version << ": " << path;
+  if (header.channelsPerBlock == 0)
+    mitkThrow() << "Tiled spectrum store is corrupted: " << path;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    m_Geometry.Dimensions[i] = header.dimensions[i];
+    m_Geometry.Spacing[i] = header.spacing[i];
+    m_Geometry.Origin[i] = header.origin[i];
+  }
+  m_Format = static_cast<m2::SpectrumFormat>(header.format);
+  m_XAxisLabel.assign(header.xAxisLabel, strnlen(header.xAxisLabel, sizeof(header.xAxisLabel)));
+  m_ChannelsPerBlock = header.channelsPerBlock;
+  m_NumberOfBlocks = (header.numberOfChannels + m_ChannelsPerBlock - 1) / m_ChannelsPerBlock;
+  if (IsProcessed() && m_NumberOfBlocks != 1)
+    mitkThrow() << "Tiled spectrum store is corrupted: " << path;
+
+  CopySection(m_File, header.xAxisOffset, header.numberOfChannels, m_XAxis);
+  CopySection(m_File, header.spectraOffset, header.numberOfSpectra, m_Spectra);
+  CopySection(m_File, header.tileOffsetsOffset, header.numberOfTiles + 1, m_TileOffsets);
+  CopySection(m_File, header.tileSpectraOffset, header.numberOfSpectra, m_TileSpectra);
+  CopySection(m_File, header.chunkTableOffset, header.numberOfTiles * m_NumberOfBlocks, m_Chunks);
+
+  for (std::uint64_t t = 0; t < GetNumberOfTiles(); ++t)
+    for (std::uint64_t b = 0; b < m_NumberOfBlocks; ++b)
+    {
+      const auto &c = m_Chunks[t * m_NumberOfBlocks + b];
+      const bool validSize = IsProcessed() ? c.rawBytes >= (GetTileLength(t) + 1) * sizeof(std::uint64_t)
+                                           : c.rawBytes == GetBlockLength(b) * GetTileLength(t) * sizeof(float);
+      if (!validSize || !m_File.Contains(c.offset, c.encodedBytes))
+        mitkThrow() << "Tiled spectrum store is truncated: " << path;
+    }
+
+  m_File.Advise(m2::MemoryMappedFile::AccessHint::Random, 0, m_File.Size());
+}
+
+std::uint64_t m2::TiledSpectrumStore::GetBlockLength(std::uint64_t b) const
+{
+  const auto first = GetBlockBegin(b);
+  return std::min<std::uint64_t>(m_ChannelsPerBlock, m_XAxis.size() - first);
+}
+
+const char *m2::TiledSpectrumStore::ReadChunkBytes(const ChunkEntry &chunk, char *buffer) const
+{
+  if (chunk.encodedBytes == chunk.rawBytes)
+  {
+    if (const auto *data = m_File.Pointer<char>(chunk.offset, chunk.rawBytes))
+      return data;
+    m_File.Copy(chunk.offset, chunk.rawBytes, buffer);
+    return buffer;
+  }
+
+  if (!m_File.Contains(chunk.offset, chunk.encodedBytes))
+    mitkThrow() << "Tiled spectrum store is truncated: " << m_File.GetPath();
+  if (!m2::Zlib::Inflate(m_File.Data() + chunk.offset, chunk.encodedBytes, buffer, chunk.rawBytes))
+    mitkThrow() << "Corrupted chunk at offset " << chunk.offset << " (" << chunk.encodedBytes
+                << " bytes): " << m_File.GetPath();
+  return buffer;
+}
+
+const float *m2::TiledSpectrumStore::ReadChunk(std::uint64_t t, std::uint64_t b, std::vector<float> &buffer) const
+{
+  const auto &chunk = m_Chunks[t * m_NumberOfBlocks + b];
+  buffer.resize(chunk.rawBytes / sizeof(float));
+  return reinterpret_cast<const float *>(ReadChunkBytes(chunk, reinterpret_cast<char *>(buffer.data())));
+}
+
+m2::TiledSpectrumStore::ProcessedTile m2::TiledSpectrumStore::ReadProcessedTile(std::uint64_t t,
+                                                                                std::vector<char> &buffer) const
+{
+  const auto &chunk = m_Chunks[t];
+  buffer.resize(chunk.rawBytes);
+  const auto *data = ReadChunkBytes(chunk, buffer.data());
+
+  // offsets[m + 1], xs[n], ys[n]
+  ProcessedTile tile;
+  const auto m = GetTileLength(t);
+  tile.offsets = reinterpret_cast<const std::uint64_t *>(data);
+  const auto headerBytes = (m + 1) * sizeof(std::uint64_t);
+  const auto n = tile.offsets[m];
+  // the offsets come from the file; n is bounded before it enters the size computation
+  if (n > (chunk.rawBytes - headerBytes) / (sizeof(double) + sizeof(float)) ||
+      headerBytes + n * (sizeof(double) + sizeof(float)) != chunk.rawBytes || tile.offsets[0] != 0 ||
+      !std::is_sorted(tile.offsets, tile.offsets + m + 1))
+    mitkThrow() << "Tiled spectrum store is corrupted: " << m_File.GetPath();
+  tile.xs = reinterpret_cast<const double *>(data + (m + 1) * sizeof(std::uint64_t));
+  tile.ys = reinterpret_cast<const float *>(tile.xs + n);
+  return tile;
+}
+
+void m2::TiledSpectrumStore::Write(const std::string &path,
+                                   const Geometry &geometry,
+                                   const std::string &xAxisLabel,
+                                   m2::SpectrumFormat format,
+                                   const std::vector<double> &xAxis,
+                                   std::vector<Spectrum> spectra,
+                                   const SpectrumReader &reader,
+                                   const Options &options)
+{
+  if (any(format & m2::SpectrumFormat::Processed))
+    mitkThrow() << "Processed spectra have to be written by WriteProcessed.";
+  if (options.ChannelsPerBlock == 0)
+    mitkThrow() << "Tile size and channels per block have to be > 0.";
+
+  const uint64_t C = xAxis.size();
+  const uint64_t B = options.ChannelsPerBlock;
+  const auto encoder = [&](const std::uint32_t *ids, std::uint64_t m, std::vector<EncodedChunk> &chunks)
+  {
+    thread_local std::vector<float> ys, values;
+    ys.resize(C);
+
+    // channel-major tile: values[c * m + slot], block b starts at b * B * m
+    values.resize(C * m);
+    for (uint64_t slot = 0; slot < m; ++slot)
+    {
+      reader(ids[slot], ys.data());
+      for (uint64_t c = 0; c < C; ++c)
+        values[c * m + slot] = ys[c];
+    }
+
+    for (uint64_t block = 0; block < chunks.size(); ++block)
+    {
+      const auto first = block * B;
+      const auto length = std::min(B, C - first);
+      auto &chunk = chunks[block];
+      chunk.rawBytes = length * m * sizeof(float);
+      Encode(reinterpret_cast<const char *>(values.data() + first * m), chunk.rawBytes, options, chunk.bytes);
+    }
+  };
+
+  WriteFile(path, geometry, xAxisLabel, format, xAxis, std::move(spectra), B, C * sizeof(float), encoder, options);
+}
+
+void m2::TiledSpectrumStore::WriteProcessed(const std::string &path,
+                                            const Geometry &geometry,
+                                            const std::string &xAxisLabel,
+                                            m2::SpectrumFormat format,
+                                            const std::vector<double> &overviewAxis,
+                                            std::vector<Spectrum> spectra,
+                                            std::uint64_t maxSpectrumLength,
+                                            const ProcessedSpectrumReader &reader,
+                                            const Options &options)
+{
+  if (!any(format & m2::SpectrumFormat::Processed))
+    mitkThrow() << "Continuous spectra have to be written by Write.";
+
+  const auto encoder = [&](const std::uint32_t *ids, std::uint64_t m, std::vector<EncodedChunk> &chunks)
+  {
+    thread_local std::vector<double> xs;
+    thread_local std::vector<float> ys;
+    thread_local std::vector<std::uint64_t> offsets;
+    thread_local std::vector<double> tileXs;
+    thread_local std::vector<float> tileYs;
+
+    offsets.assign(1, 0);
+    tileXs.clear();
+    tileYs.clear();
+    for (uint64_t slot = 0; slot < m; ++slot)
+    {
+      reader(ids[slot], xs, ys);
+      if (xs.size() != ys.size())
+        mitkThrow() << "Spectrum " << ids[slot] << " has " << xs.size() << " x values and " << ys.size()
+                    << " intensities.";
+      tileXs.insert(tileXs.end(), xs.begin(), xs.end());
+      tileYs.insert(tileYs.end(), ys.begin(), ys.end());
+      offsets.push_back(tileXs.size());
+    }
+
+    // offsets[m + 1], xs[n], ys[n]
+    const auto offsetsBytes = offsets.size() * sizeof(std::uint64_t);
+    const auto xsBytes = tileXs.size() * sizeof(double);
+    const auto ysBytes = tileYs.size() * sizeof(float);
+    std::vector<char> raw(offsetsBytes + xsBytes + ysBytes);
+    std::memcpy(raw.data(), offsets.data(), offsetsBytes);
+    std::memcpy(raw.data() + offsetsBytes, tileXs.data(), xsBytes);
+    std::memcpy(raw.data() + offsetsBytes + xsBytes, tileYs.data(), ysBytes);
+
+    auto &chunk = chunks[0];
+    chunk.rawBytes = raw.size();
+    Encode(raw.data(), raw.size(), options, chunk.bytes);
+  };
+
+  // one block of all channels, i.e. one chunk per tile
+  WriteFile(path,
+            geometry,
+            xAxisLabel,
+            format,
+            overviewAxis,
+            std::move(spectra),
+            std::max<std::uint64_t>(1, overviewAxis.size()),
+            sizeof(std::uint64_t) + maxSpectrumLength * (sizeof(double) + sizeof(float)) * 2,
+            encoder,
+            options);
+}
+
+void m2::TiledSpectrumStore::WriteFile(const std::string &path,
+                                       const Geometry &geometry,
+                                       const std::string &xAxisLabel,
+                                       m2::SpectrumFormat format,
+                                       const std::vector<double> &xAxis,
+                                       std::vector<Spectrum> spectra,
+                                       std::uint64_t channelsPerBlock,
+                                       std::uint64_t bytesPerSpectrum,
+                                       const TileEncoder &encoder,
+                                       const Options &options)
+{
+  m2::Timer timer("Write tiled spectrum store " + path);
+
+  if (xAxis.empty() || spectra.empty())
+    mitkThrow() << "No spectra to write.";
+  if (options.TileSize == 0 || channelsPerBlock == 0)
+    mitkThrow() << "Tile size and channels per block have to be > 0.";
+
+  const uint64_t N = spectra.size();
+  const uint64_t C = xAxis.size();
+  const uint64_t B = channelsPerBlock;
+  const uint64_t numberOfBlocks = (C + B - 1) / B;
+  const uint64_t ts = options.TileSize;
+
+  // ----- assign spectra to tiles (counting sort by tile id)
+  const uint64_t tilesX = (std::max<uint64_t>(1, geometry.Dimensions[0]) + ts - 1) / ts;
+  const uint64_t tilesY = (std::max<uint64_t>(1, geometry.Dimensions[1]) + ts - 1) / ts;
+  const uint64_t tilesZ = std::max<uint64_t>(1, geometry.Dimensions[2]);
+  const uint64_t numberOfTiles = tilesX * tilesY * tilesZ;
+
+  std::vector<uint32_t> tileOffsets(numberOfTiles + 1, 0);
+  for (auto &s : spectra)
+  {
+    const uint64_t tx = uint64_t(std::max<int64_t>(0, s.index[0])) / ts;
+    const uint64_t ty = uint64_t(std::max<int64_t>(0, s.index[1])) / ts;
+    const uint64_t tz = uint64_t(std::max<int64_t>(0, s.index[2]));
+    if (tx >= tilesX || ty >= tilesY || tz >= tilesZ)
+      mitkThrow() << "Spectrum index [" << s.index[0] << ", " << s.index[1] << ", " << s.index[2]
+                  << "] is outside of the image region.";
+    s.tile = static_cast<uint32_t>((tz * tilesY + ty) * tilesX + tx);
+    s.slot = tileOffsets[s.tile + 1]++;
+  }
+  std::partial_sum(tileOffsets.begin(), tileOffsets.end(), tileOffsets.begin());
+
+  std::vector<uint32_t> tileSpectra(N);
+  for (uint64_t i = 0; i < N; ++i)
+    tileSpectra[tileOffsets[spectra[i].tile] + spectra[i].slot] = static_cast<uint32_t>(i);
+
+  // ----- header and tables
+  StoreFileHeader header{};
+  std::memcpy(header.magic, StoreFileMagic, sizeof(StoreFileMagic));
+  header.version = Version;
+  header.format = static_cast<uint32_t>(format);
+  header.tileSize = options.TileSize;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    header.dimensions[i] = geometry.Dimensions[i];
+    header.spacing[i] = geometry.Spacing[i];
+    header.origin[i] = geometry.Origin[i];
+  }
+  header.numberOfSpectra = N;
+  header.numberOfChannels = C;
+  header.channelsPerBlock = B;
+  header.numberOfTiles = numberOfTiles;
+  std::strncpy(header.xAxisLabel, xAxisLabel.c_str(), sizeof(header.xAxisLabel) - 1);
+
+  header.xAxisOffset = Align8(sizeof(StoreFileHeader));
+  header.spectraOffset = Align8(header.xAxisOffset + C * sizeof(double));
+  header.tileOffsetsOffset = Align8(header.spectraOffset + N * sizeof(Spectrum));
+  header.tileSpectraOffset = Align8(header.tileOffsetsOffset + (numberOfTiles + 1) * sizeof(uint32_t));
+  header.chunkTableOffset = Align8(header.tileSpectraOffset + N * sizeof(uint32_t));
+  const uint64_t dataOffset = Align8(header.chunkTableOffset + numberOfTiles * numberOfBlocks * sizeof(ChunkEntry));
+
+  // write to a temporary file first, a store file is either complete or not existent
+  const auto tmpPath = path + ".tmp";
+  std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+  if (!f)
+    mitkThrow() << "Tiled spectrum store could not be created: " << path;
+
+  const char zeros[8] = {};
+  const auto writeSection = [&](uint64_t offset, const void *data, uint64_t bytes)
+  {
+    f.write(zeros, offset - uint64_t(f.tellp()));
+    f.write(reinterpret_cast<const char *>(data), bytes);
+  };
+
+  f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  writeSection(header.xAxisOffset, xAxis.data(), C * sizeof(double));
+  writeSection(header.spectraOffset, spectra.data(), N * sizeof(Spectrum));
+  writeSection(header.tileOffsetsOffset, tileOffsets.data(), tileOffsets.size() * sizeof(uint32_t));
+  writeSection(header.tileSpectraOffset, tileSpectra.data(), N * sizeof(uint32_t));
+  std::vector<ChunkEntry> chunks(numberOfTiles * numberOfBlocks, ChunkEntry{0, 0, 0});
+  writeSection(header.chunkTableOffset, chunks.data(), chunks.size() * sizeof(ChunkEntry));
+  f.write(zeros, dataOffset - uint64_t(f.tellp()));
+
+  // ----- chunks
+  // Tiles are read and encoded in parallel batches and appended in tile order.
+  uint64_t maxTileLength = 1;
+  for (uint64_t t = 0; t < numberOfTiles; ++t)
+    maxTileLength = std::max<uint64_t>(maxTileLength, tileOffsets[t + 1] - tileOffsets[t]);
+
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  const uint64_t batchSize = std::max<uint64_t>(
+    1, std::min<uint64_t>(threads, StoreFileBatchBytes / std::max<uint64_t>(1, maxTileLength * bytesPerSpectrum)));
+
+  // encoded chunks of the current batch [tile in batch][block]
+  std::vector<std::vector<EncodedChunk>> encoded(batchSize, std::vector<EncodedChunk>(numberOfBlocks));
+  uint64_t offset = dataOffset;
+
+  try
+  {
+    for (uint64_t firstTile = 0; firstTile < numberOfTiles; firstTile += batchSize)
+    {
+      const uint64_t n = std::min(batchSize, numberOfTiles - firstTile);
+      m2::Process::Map(n,
+                       std::min<uint64_t>(threads, n),
+                       [&](unsigned int /*t*/, unsigned int a, unsigned int b)
+                       {
+                         for (unsigned int k = a; k < b; ++k)
+                         {
+                           const auto tile = firstTile + k;
+                           const uint64_t m = tileOffsets[tile + 1] - tileOffsets[tile];
+                           if (m == 0)
+                           {
+                             for (auto &e : encoded[k])
+                             {
+                               e.bytes.clear();
+                               e.rawBytes = 0;
+                             }
+                             continue;
+                           }
+                           encoder(tileSpectra.data() + tileOffsets[tile], m, encoded[k]);
+                         }
+                       });
+
+      for (uint64_t k = 0; k < n; ++k)
+      {
+        for (uint64_t block = 0; block < numberOfBlocks; ++block)
+        {
+          const auto &e = encoded[k][block];
+          auto &entry = chunks[(firstTile + k) * numberOfBlocks + block];
+          entry.offset = offset;
+          entry.encodedBytes = e.bytes.size();
+          entry.rawBytes = e.rawBytes;
+          f.write(e.bytes.data(), e.bytes.size());
+          // keep uncompressed chunks aligned for in place access
+          const auto padding = Align8(e.bytes.size()) - e.bytes.size();
+          f.write(zeros, padding);
+          offset += e.bytes.size() + padding;
+        }
+      }
+      if (!f)
+        break;
+    }
+  }
+  catch (...)
+  {
+    f.close();
+    std::remove(tmpPath.c_str());
+    throw;
+  }
+
+  f.seekp(header.chunkTableOffset);
+  f.write(reinterpret_cast<const char *>(chunks.data()), chunks.size() * sizeof(ChunkEntry));
+
+  if (!f)
+  {
+    f.close();
+    std::remove(tmpPath.c_str());
+    mitkThrow() << "Tiled spectrum store could not be written: " << path;
+  }
+  f.close();
+
+  std::remove(path.c_str());
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    std::remove(tmpPath.c_str());
+    mitkThrow() << "Tiled spectrum store could not be written: " << path;
+  }
+}
+
+void m2::TiledSpectrumStore::Write(const std::string &path,
+                                   const m2::ImzMLSpectrumImage *image,
+                                   const Options &options)
+{
+  if (!image->GetImageAccessInitialized())
+    mitkThrow() << "Image access of the spectrum image has to be initialized.";
+
+  const auto &source = image->GetSpectra();
+  if (source.empty())
+    mitkThrow() << "No spectra to write.";
+
+  Geometry geometry;
+  const auto spacing = image->GetGeometry()->GetSpacing();
+  const auto origin = image->GetGeometry()->GetOrigin();
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    geometry.Dimensions[i] = image->GetDimension(i);
+    geometry.Spacing[i] = spacing[i];
+    geometry.Origin[i] = origin[i];
+  }
+
+  std::vector<Spectrum> spectra(source.size());
+  std::uint64_t maxSpectrumLength = 0;
+  for (size_t i = 0; i < source.size(); ++i)
+  {
+    const auto &s = source[i];
+    auto &r = spectra[i];
+    r.index[0] = s.index[0];
+    r.index[1] = s.index[1];
+    r.index[2] = s.index[2];
+    r.world[0] = s.world.x;
+    r.world[1] = s.world.y;
+    r.world[2] = s.world.z;
+    r.tile = r.slot = 0;
+    maxSpectrumLength = std::max<std::uint64_t>(maxSpectrumLength, s.intLength);
+  }
+
+  const auto &info = image->GetSpectrumType();
+  if (any(info.Format & m2::SpectrumFormat::Processed))
+  {
+    // raw values on the x axis of each spectrum, the overview axis is kept for the overview spectra
+    const auto reader = [&](unsigned int id, std::vector<double> &xs, std::vector<float> &ys)
+    {
+      image->GetXValues(id, xs);
+      image->GetRawIntensitiesFloat(id, ys);
+    };
+    WriteProcessed(
+      path, geometry, info.XAxisLabel, info.Format, image->GetXAxis(), std::move(spectra), maxSpectrumLength, reader, options);
+    return;
+  }
+
+  std::vector<double> xAxis;
+  image->GetXValues(0, xAxis);
+
+  const auto reader = [&](unsigned int id, float *ys)
+  {
+    thread_local std::vector<float> ysBuffer;
+    image->GetRawIntensitiesFloat(id, ysBuffer);
+    const auto n = std::min(xAxis.size(), ysBuffer.size());
+    std::copy(ysBuffer.begin(), ysBuffer.begin() + n, ys);
+    std::fill(ys + n, ys + xAxis.size(), 0.0f);
+  };
+
+  Write(path, geometry, info.XAxisLabel, info.Format, xAxis, std::move(spectra), reader, options);
+}
@@ -34,6 +34,17 @@ See LICENSE.txt for details.
 #include <signal/m2Smoothing.h>
 #include <signal/m2Transformer.h>
 
+std::shared_ptr<const m2::MemoryMappedFile> m2::ImzMLSpectrumImage::GetBinaryDataView() const
+{
+  std::lock_guard<std::mutex> lock(m_BinaryDataViewMutex);
+  if (!m_BinaryDataView)
+  {
+    // shared by all readers, access hints are given per byte range
+    m_BinaryDataView = std::make_shared<m2::MemoryMappedFile>(GetBinaryDataPath());
+  }
+  return m_BinaryDataView;
+}
+
 double m2::ImzMLSpectrumImage::GetXMin() const{
   return GetXAxis().front();
 }
@@ -44,16 +55,64 @@ double m2::ImzMLSpectrumImage::GetXMax() const{
 
 
 void m2::ImzMLSpectrumImage::GetImage(double mz, double tol, const mitk::Image *mask, mitk::Image *img) const
+{
+  const std::atomic<bool> notCancelled{false};
+  TryGetImage(mz, tol, mask, img, notCancelled);
+}
+
+bool m2::ImzMLSpectrumImage::TryGetImage(
+  double mz, double tol, const mitk::Image *mask, mitk::Image *img, const std::atomic<bool> &cancelled) const
 {
   try{
-    while(!m_IsIonImageGenerated);
-    m_IsIonImageGenerated = false;
-    m_SpectrumImageSource->GetImagePrivate(mz, tol, mask, img);
-    m_IsIonImageGenerated = true;
+    std::lock_guard<std::mutex> lock(m_IonImageMutex);
+    if (cancelled)
+      return false;
+    const auto key = m2::IonImageCache::MakeKey(this, mz, tol, mask);
+    if (GetIonImageCache().Get(key, img))
+    {
+      // as set by GetImagePrivate
+      auto self = const_cast<ImzMLSpectrumImage *>(this);
+      self->SetProperty("m2aia.xs.selection.center", mitk::DoubleProperty::New(mz));
+      self->SetProperty("m2aia.xs.selection.tolerance", mitk::DoubleProperty::New(tol));
+    }
+    else
+    {
+      if (!m_SpectrumImageSource->GetImagePrivate(mz, tol, mask, img, &cancelled))
+        return false;
+      // generating may have created or initialized the normalization image
+      GetIonImageCache().Put(m2::IonImageCache::MakeKey(this, mz, tol, mask), img);
+    }
     m_CurrentX = mz;
+    return true;
   }catch(std::exception & e){
     MITK_ERROR << "Ion image could not be generated! Queried range is [" << mz-tol << ", " <<mz+tol << "]\n" << e.what();
-    m_IsIonImageGenerated = false;
+  }
+  return false;
+}
+
+void m2::ImzMLSpectrumImage::GetImages(const std::vector<double> &xs,
+                                       const std::vector<double> &tols,
+                                       const mitk::Image *mask,
+                                       std::vector<m2::DisplayImagePixelType> &values) const
+{
+  // image normalization and smoothing operate on complete single channel images
+  if (GetImageNormalizationStrategy() != m2::ImageNormalizationStrategyType::None ||
+      GetImageSmoothingStrategy() != m2::ImageSmoothingStrategyType::None)
+  {
+    Superclass::GetImages(xs, tols, mask, values);
+    return;
+  }
+
+  if (xs.size() != tols.size())
+    mitkThrow() << "GetImages requires one tolerance per center.";
+
+  const auto n = std::accumulate(GetDimensions(), GetDimensions() + GetDimension(), size_t(1), std::multiplies<size_t>());
+  values.resize(n * xs.size());
+  try{
+    std::lock_guard<std::mutex> lock(m_IonImageMutex);
+    m_SpectrumImageSource->GetImagesPrivate(xs, tols, mask, values.data());
+  }catch(std::exception & e){
+    MITK_ERROR << "Ion images could not be generated for " << xs.size() << " ranges!\n" << e.what();
   }
 }
 
@@ -61,8 +120,19 @@ void m2::ImzMLSpectrumImage::InitializeProcessor()
 {
   m_MzGroupID = GetPropertyValue<std::string>("m2aia.imzml.mzGroupID");
   m_IntensityGroupID = GetPropertyValue<std::string>("m2aia.imzml.intensityGroupID");
+
+  const auto IsZlibCompressed = [this](const std::string &groupID)
+  {
+    auto prop = GetProperty(("m2aia.imzml." + groupID + ".compression").c_str());
+    return prop && prop->GetValueAsString() == "zlib compression";
+  };
+  m_MzZlibCompressed = IsZlibCompressed(m_MzGroupID);
+  m_IntensityZlibCompressed = IsZlibCompressed(m_IntensityGroupID);
+  if (m_MzZlibCompressed || m_IntensityZlibCompressed)
+    MITK_INFO(GetStaticNameOfClass()) << "zlib compressed binary data arrays are decompressed on access.";
   
   auto intensitiesDataTypeString = GetPropertyValue<std::string>("m2aia.imzml." + m_IntensityGroupID + ".value_type");
+  m_IntensityHalfPrecision = intensitiesDataTypeString.compare("16-bit float") == 0;
   auto mzValueTypeString = GetPropertyValue<std::string>("m2aia.imzml." + m_MzGroupID + ".value_type");
 
   if (mzValueTypeString.compare("32-bit float") == 0)
@@ -78,6 +148,12 @@ void m2::ImzMLSpectrumImage::InitializeProcessor()
       m_SpectrumType.YAxisType = m2::NumericType::Double;
       this->m_SpectrumImageSource.reset((ISpectrumImageSource *)new ImzMLSpectrumImageSource<float, double>(this));
     }
+    else if (intensitiesDataTypeString.compare("16-bit float") == 0)
+    {
+      // half precision intensities are widened to float on access
+      m_SpectrumType.YAxisType = m2::NumericType::Float;
+      this->m_SpectrumImageSource.reset((ISpectrumImageSource *)new ImzMLSpectrumImageSource<float, float>(this));
+    }
     else if (intensitiesDataTypeString.compare("32-bit integer") == 0)
     {
       MITK_ERROR(GetStaticNameOfClass()) << "Using 32-bit integer. Not implemented!";
@@ -104,6 +180,12 @@ void m2::ImzMLSpectrumImage::InitializeProcessor()
       m_SpectrumType.YAxisType = m2::NumericType::Double;
       this->m_SpectrumImageSource.reset((ISpectrumImageSource *)new ImzMLSpectrumImageSource<double, double>(this));
     }
+    else if (intensitiesDataTypeString.compare("16-bit float") == 0)
+    {
+      // half precision intensities are widened to float on access
+      m_SpectrumType.YAxisType = m2::NumericType::Float;
+      this->m_SpectrumImageSource.reset((ISpectrumImageSource *)new ImzMLSpectrumImageSource<double, float>(this));
+    }
     else if (intensitiesDataTypeString.compare("32-bit integer") == 0)
     {
       MITK_ERROR(GetStaticNameOfClass()) << "Using 32-bit integer. Not implemented!";
@@ -136,7 +218,7 @@ void m2::ImzMLSpectrumImage::InitializeImageAccess()
 {
 
   // Reset Normalization strategy type if set to external but no external image was found
-  if(GetNormalizationStrategy() == m2::NormalizationStrategyType::External && GetNormalizationImage(m2::NormalizationStrategyType::External).IsNull()){
+  if(GetNormalizationStrategy() == m2::NormalizationStrategyType::External && !GetNormalizationImageStatus(m2::NormalizationStrategyType::External)){
     SetNormalizationStrategy(m2::NormalizationStrategyType::None);
     MITK_ERROR << "'External' Normalization strategy chosen but no External image exist.\n"
     "To use external normalization provide an image in the NRRD file format.\n"
@@ -144,7 +226,7 @@ void m2::ImzMLSpectrumImage::InitializeImageAccess()
   }
 
   this->SetImageAccessInitialized(false); 
-
+  GetIonImageCache().Clear(this);
   
 
   this->m_SpectrumImageSource->InitializeImageAccess();
@@ -342,6 +424,16 @@ void m2::ImzMLSpectrumImage::GetIntensities(unsigned int id, std::vector<double>
   m_SpectrumImageSource->GetYValues(id, ys);
 }
 
+void m2::ImzMLSpectrumImage::GetXValues(unsigned int id, std::vector<double> &xs) const
+{
+  m_SpectrumImageSource->GetXValues(id, xs);
+}
+
+void m2::ImzMLSpectrumImage::GetRawIntensitiesFloat(unsigned int id, std::vector<float> &ys) const
+{
+  m_SpectrumImageSource->GetRawYValues(id, ys);
+}
+
 // void m2::ImzMLSpectrumImage::GetIntensities(unsigned int id,
 //                                             std::vector<m2::Interval> &I,
 //                                             std::vector<float> &pys,
@@ -13,58 +13,139 @@ See LICENSE.txt for details.
 
 ===================================================================*/
 
+#include <m2IntervalTable.h>
 #include <m2IntervalVector.h>
 
 using namespace std;
 namespace m2
 {
+  std::vector<Interval> &IntervalVector::GetIntervals()
+  {
+    return const_cast<std::vector<Interval> &>(static_cast<const IntervalVector *>(this)->GetIntervals());
+  }
+
+  const std::vector<Interval> &IntervalVector::GetIntervals() const
+  {
+    // the objects are complete before the table is dropped, readers that find no table can use them
+    std::lock_guard<std::mutex> lock(m_TableMutex);
+    if (m_Table)
+    {
+      m_Table->GetIntervals(m_Data);
+      m_Table.reset();
+    }
+    return m_Data;
+  }
+
+  std::shared_ptr<const IntervalTable> IntervalVector::GetTable() const
+  {
+    std::lock_guard<std::mutex> lock(m_TableMutex);
+    return m_Table;
+  }
+
+  void IntervalVector::SetTable(std::shared_ptr<const IntervalTable> table)
+  {
+    std::lock_guard<std::mutex> lock(m_TableMutex);
+    m_Data.clear();
+    m_Data.shrink_to_fit();
+    m_Table = table;
+    if (table)
+    {
+      SetType(table->GetType());
+      SetInfo(table->GetInfo());
+      SetNumberOfSourcePixels(table->GetNumberOfSourcePixels());
+    }
+    Modified();
+  }
+
+  std::size_t IntervalVector::GetNumberOfIntervals() const
+  {
+    std::lock_guard<std::mutex> lock(m_TableMutex);
+    return m_Table ? m_Table->Size() : m_Data.size();
+  }
+
   std::vector<double> IntervalVector::GetXMean() const {
+    if (const auto table = GetTable())
+    {
+      const auto n = table->Size();
+      const auto *sum = table->XSum();
+      const auto *count = table->XCount();
+      vector<double> data(n);
+      for (size_t i = 0; i < n; ++i)
+        data[i] = sum[i] / double(count[i]);
+      return data;
+    }
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.x.mean();});
     return data;
   }
   std::vector<double> IntervalVector::GetXSum() const {
+    if (const auto table = GetTable())
+      return vector<double>(table->XSum(), table->XSum() + table->Size());
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.x.sum();});
     return data;
   }
   std::vector<double> IntervalVector::GetXMax() const {
+    if (const auto table = GetTable())
+      return vector<double>(table->XMax(), table->XMax() + table->Size());
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.x.max();});
     return data;
   }
   std::vector<double> IntervalVector::GetXMin() const {
+    if (const auto table = GetTable())
+      return vector<double>(table->XMin(), table->XMin() + table->Size());
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.x.min();});
     return data;
   }
   std::vector<unsigned int> IntervalVector::GetXCount() const {
+    if (const auto table = GetTable())
+      return vector<unsigned int>(table->XCount(), table->XCount() + table->Size());
     vector<unsigned int> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.x.count();});
     return data;
   }
 
   std::vector<double> IntervalVector::GetYMean() const {
+    if (const auto table = GetTable())
+    {
+      const auto n = table->Size();
+      const auto *sum = table->YSum();
+      const auto *count = table->YCount();
+      vector<double> data(n);
+      for (size_t i = 0; i < n; ++i)
+        data[i] = sum[i] / double(count[i]);
+      return data;
+    }
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.y.mean();});
     return data;
   }
   std::vector<double> IntervalVector::GetYSum() const {
+    if (const auto table = GetTable())
+      return vector<double>(table->YSum(), table->YSum() + table->Size());
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.y.sum();});
     return data;
   }
   std::vector<double> IntervalVector::GetYMax() const {
+    if (const auto table = GetTable())
+      return vector<double>(table->YMax(), table->YMax() + table->Size());
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.y.max();});
     return data;
   }
   std::vector<double> IntervalVector::GetYMin() const {
+    if (const auto table = GetTable())
+      return vector<double>(table->YMin(), table->YMin() + table->Size());
     vector<double> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.y.min();});
     return data;
   }
   std::vector<unsigned int> IntervalVector::GetYCount() const {
+    if (const auto table = GetTable())
+      return vector<unsigned int>(table->YCount(), table->YCount() + table->Size());
     vector<unsigned int> data;
     transform(m_Data.begin(),m_Data.end(),back_inserter(data), [](const Interval & I){return I.y.count();});
     return data;
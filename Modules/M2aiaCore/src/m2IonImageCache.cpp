@@ -0,0 +1,214 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <functional>
+#include <m2IonImageCache.h>
+#include <m2SpectrumImage.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkImagePixelWriteAccessor.h>
+#include <numeric>
+#include <tuple>
+
+namespace
+{
+  std::size_t NumberOfPixels(const mitk::Image *image)
+  {
+    const auto d = image->GetDimensions();
+    return std::accumulate(d, d + image->GetDimension(), std::size_t(1), std::multiplies<std::size_t>());
+  }
+} // namespace
+
+m2::IonImageCache &m2::IonImageCache::GetInstance()
+{
+  // never destroyed, spectrum images remove their entries on destruction (also during static deinitialization)
+  static auto *instance = new IonImageCache();
+  return *instance;
+}
+
+bool m2::IonImageCache::Key::operator<(const Key &other) const
+{
+  const auto tie = [](const Key &k)
+  {
+    return std::tie(k.image,
+                    k.x,
+                    k.tol,
+                    k.normalization,
+                    k.intensityTransformation,
+                    k.smoothing,
+                    k.smoothingHalfWindowSize,
+                    k.baselineCorrection,
+                    k.baselineCorrectionHalfWindowSize,
+                    k.pooling,
+                    k.imageNormalization,
+                    k.imageSmoothing,
+                    k.normalizationImageMTime,
+                    k.shiftImageMTime,
+                    k.mask,
+                    k.maskMTime);
+  };
+  return tie(*this) < tie(other);
+}
+
+m2::IonImageCache::Key m2::IonImageCache::MakeKey(const m2::SpectrumImage *image,
+                                                  double x,
+                                                  double tol,
+                                                  const mitk::Image *mask)
+{
+  Key key;
+  key.image = reinterpret_cast<std::uintptr_t>(image);
+  key.x = x;
+  key.tol = tol;
+  key.normalization = image->GetNormalizationStrategy();
+  key.intensityTransformation = image->GetIntensityTransformationStrategy();
+  key.smoothing = image->GetSmoothingStrategy();
+  key.baselineCorrection = image->GetBaselineCorrectionStrategy();
+  // window sizes are irrelevant if the corresponding method is not used
+  if (key.smoothing != m2::SmoothingType::None)
+    key.smoothingHalfWindowSize = image->GetSmoothingHalfWindowSize();
+  if (key.baselineCorrection != m2::BaselineCorrectionType::None)
+    key.baselineCorrectionHalfWindowSize = image->GetBaseLineCorrectionHalfWindowSize();
+  key.pooling = image->GetRangePoolingStrategy();
+  key.imageNormalization = image->GetImageNormalizationStrategy();
+  key.imageSmoothing = image->GetImageSmoothingStrategy();
+  key.normalizationImageMTime = image->GetNormalizationImageMTime();
+  if (auto shift = image->GetShiftImage())
+    key.shiftImageMTime = shift->GetMTime();
+  if (mask)
+  {
+    key.mask = reinterpret_cast<std::uintptr_t>(mask);
+    key.maskMTime = mask->GetMTime();
+  }
+  return key;
+}
+
+bool m2::IonImageCache::Get(const Key &key, mitk::Image *target)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Index.find(key);
+  if (it == m_Index.end() || !target || it->second->second.size() != NumberOfPixels(target))
+  {
+    ++m_Misses;
+    return false;
+  }
+
+  m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+  const auto &values = it->second->second;
+  mitk::ImagePixelWriteAccessor<m2::DisplayImagePixelType, 3> access(target);
+  std::copy(values.begin(), values.end(), access.GetData());
+  ++m_Hits;
+  return true;
+}
+
+void m2::IonImageCache::Put(const Key &key, const mitk::Image *image)
+{
+  const auto n = NumberOfPixels(image);
+  if (n * sizeof(m2::DisplayImagePixelType) > GetCapacity())
+    return;
+
+  ValuesType values(n);
+  {
+    mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> access(image);
+    std::copy(access.GetData(), access.GetData() + n, values.begin());
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Index.find(key);
+  if (it != m_Index.end())
+  {
+    m_Size -= it->second->second.size() * sizeof(m2::DisplayImagePixelType);
+    m_Entries.erase(it->second);
+    m_Index.erase(it);
+  }
+
+  m_Entries.emplace_front(key, std::move(values));
+  m_Index.emplace(key, m_Entries.begin());
+  m_Size += n * sizeof(m2::DisplayImagePixelType);
+  Evict();
+}
+
+void m2::IonImageCache::Evict()
+{
+  while (m_Size > m_Capacity && !m_Entries.empty())
+  {
+    const auto &last = m_Entries.back();
+    m_Size -= last.second.size() * sizeof(m2::DisplayImagePixelType);
+    m_Index.erase(last.first);
+    m_Entries.pop_back();
+  }
+}
+
+void m2::IonImageCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Entries.clear();
+  m_Index.clear();
+  m_Size = 0;
+}
+
+void m2::IonImageCache::Clear(const m2::SpectrumImage *image)
+{
+  const auto id = reinterpret_cast<std::uintptr_t>(image);
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (auto it = m_Entries.begin(); it != m_Entries.end();)
+  {
+    if (it->first.image != id)
+    {
+      ++it;
+      continue;
+    }
+    m_Size -= it->second.size() * sizeof(m2::DisplayImagePixelType);
+    m_Index.erase(it->first);
+    it = m_Entries.erase(it);
+  }
+}
+
+void m2::IonImageCache::SetCapacity(std::size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Capacity = bytes;
+  Evict();
+}
+
+std::size_t m2::IonImageCache::GetCapacity() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Capacity;
+}
+
+std::size_t m2::IonImageCache::GetSize() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Size;
+}
+
+std::size_t m2::IonImageCache::GetNumberOfEntries() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Entries.size();
+}
+
+std::size_t m2::IonImageCache::GetHits() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Hits;
+}
+
+std::size_t m2::IonImageCache::GetMisses() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Misses;
+}
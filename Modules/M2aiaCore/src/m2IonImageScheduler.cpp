@@ -0,0 +1,224 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <m2IonImageScheduler.h>
+#include <m2SpectrumImage.h>
+#include <mitkExceptionMacro.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+#include <mitkLogMacros.h>
+#include <numeric>
+#include <vector>
+
+struct m2::IonImageScheduler::Request
+{
+  itk::SmartPointer<const m2::SpectrumImage> image;
+  mitk::Image::ConstPointer mask;
+  mitk::Image::Pointer target;
+  double x = 0;
+  double tol = 0;
+
+  std::atomic<bool> cancelled{false};
+  std::promise<bool> promise;
+  std::shared_future<bool> future;
+  std::vector<CallbackType> callbacks;
+
+  bool Matches(const m2::SpectrumImage *i, double c, double t, const mitk::Image *m, const mitk::Image *d) const
+  {
+    return image.GetPointer() == i && x == c && tol == t && mask.GetPointer() == m && target.GetPointer() == d;
+  }
+};
+
+m2::IonImageScheduler::IonImageScheduler() : m_Worker([this]() { Run(); }) {}
+
+m2::IonImageScheduler::~IonImageScheduler()
+{
+  std::deque<RequestPointer> dropped;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+    if (m_Running)
+      m_Running->cancelled = true;
+    dropped.swap(m_Pending);
+  }
+  m_RequestAvailable.notify_all();
+  if (m_Worker.joinable())
+    m_Worker.join();
+  for (auto &r : dropped)
+    Finish(*r, false);
+}
+
+std::shared_future<bool> m2::IonImageScheduler::Submit(const m2::SpectrumImage *image,
+                                                       double x,
+                                                       double tol,
+                                                       const mitk::Image *mask,
+                                                       mitk::Image *target,
+                                                       CallbackType onFinished)
+{
+  if (!image || !target)
+    mitkThrow() << "An ion image request requires a spectrum image and a target image.";
+
+  RequestPointer superseded;
+  RequestPointer request;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    // coalesce with the running request
+    if (m_Running && !m_Running->cancelled && m_Running->Matches(image, x, tol, mask, target))
+    {
+      if (onFinished)
+        m_Running->callbacks.push_back(onFinished);
+      return m_Running->future;
+    }
+
+    auto pending = std::find_if(
+      std::begin(m_Pending), std::end(m_Pending), [image](const RequestPointer &r) { return r->image.GetPointer() == image; });
+
+    // coalesce with the pending request
+    if (pending != std::end(m_Pending) && (*pending)->Matches(image, x, tol, mask, target))
+    {
+      if (onFinished)
+        (*pending)->callbacks.push_back(onFinished);
+      return (*pending)->future;
+    }
+
+    request = std::make_shared<Request>();
+    request->image = image;
+    request->mask = mask;
+    request->target = target;
+    request->x = x;
+    request->tol = tol;
+    request->future = request->promise.get_future().share();
+    if (onFinished)
+      request->callbacks.push_back(onFinished);
+
+    // supersede the pending request (keeping its position in the queue) ...
+    if (pending != std::end(m_Pending))
+    {
+      superseded = *pending;
+      *pending = request;
+    }
+    else
+    {
+      m_Pending.push_back(request);
+    }
+
+    // ... and cancel the running request of the same image
+    if (m_Running && m_Running->image.GetPointer() == image)
+      m_Running->cancelled = true;
+  }
+  m_RequestAvailable.notify_one();
+
+  if (superseded)
+    Finish(*superseded, false);
+  return request->future;
+}
+
+void m2::IonImageScheduler::CancelAll()
+{
+  std::deque<RequestPointer> dropped;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Running)
+      m_Running->cancelled = true;
+    dropped.swap(m_Pending);
+  }
+  for (auto &r : dropped)
+    Finish(*r, false);
+  m_Idle.notify_all();
+}
+
+void m2::IonImageScheduler::Wait()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_Idle.wait(lock, [this]() { return m_Pending.empty() && m_Active == 0; });
+}
+
+void m2::IonImageScheduler::Finish(Request &request, bool generated)
+{
+  request.promise.set_value(generated);
+  for (auto &callback : request.callbacks)
+  {
+    try
+    {
+      callback(generated);
+    }
+    catch (std::exception &e)
+    {
+      MITK_ERROR("IonImageScheduler") << e.what();
+    }
+  }
+}
+
+void m2::IonImageScheduler::Run()
+{
+  for (;;)
+  {
+    RequestPointer request;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_RequestAvailable.wait(lock, [this]() { return m_Stop || !m_Pending.empty(); });
+      if (m_Stop)
+        return;
+      request = m_Pending.front();
+      m_Pending.pop_front();
+      m_Running = request;
+      ++m_Active;
+    }
+
+    bool generated = false;
+    try
+    {
+      // render into a scratch image, a cancelled or failed request leaves the target untouched
+      auto scratch = mitk::Image::New();
+      scratch->Initialize(request->target);
+      generated = request->image->TryGetImage(request->x, request->tol, request->mask, scratch, request->cancelled);
+      if (generated)
+      {
+        const auto *dims = scratch->GetDimensions();
+        const auto n = std::accumulate(dims, dims + scratch->GetDimension(), std::size_t(1), std::multiplies<std::size_t>());
+        {
+          mitk::ImageReadAccessor source(scratch);
+          mitk::ImageWriteAccessor destination(request->target);
+          std::memcpy(destination.GetData(), source.GetData(), n * scratch->GetPixelType().GetSize());
+        }
+        request->target->Modified();
+      }
+    }
+    catch (std::exception &e)
+    {
+      MITK_ERROR("IonImageScheduler") << "Ion image request [" << request->x - request->tol << ", "
+                                      << request->x + request->tol << "] failed: " << e.what();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Running.reset();
+    }
+    // callbacks may submit new requests
+    Finish(*request, generated);
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      --m_Active;
+    }
+    m_Idle.notify_all();
+  }
+}
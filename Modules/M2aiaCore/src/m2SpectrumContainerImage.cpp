@@ -55,34 +55,77 @@ void m2::SpectrumContainerImage::GetImage(double x, double tol, const mitk::Imag
   // map all spectra to several threads for processing
   const unsigned int t = m2::SpectrumImage::GetNumberOfThreads();
   
-
-  m2::Process::Map(n,
-                   t,
-                   [&](auto /*id*/, auto a, auto b)
-                   {
-                     for (unsigned int i = a; i < b; ++i)
+  if (m_ImageLayout == SpectralDataLayout::ChannelMajor && subRes.second > 0)
+  {
+    // band image on the wavenumber-major copy: each thread streams its pixel range
+    // of the channel rows, the inner loops run over contiguous memory
+    const auto channelMajor = GetChannelMajorData();
+    const float *cm = channelMajor->data();
+    const std::size_t first = subRes.first;
+    const std::size_t len = subRes.second;
+    std::vector<double> values(n, 0);
+
+    m2::Process::Map(n,
+                     t,
+                     [&](auto /*id*/, auto a, auto b)
+                     {
+                       if (len >= 2)
+                       {
+                         // mean derivative
+                         for (std::size_t c = first; c + 1 < first + len; ++c)
+                         {
+                           const float *lo = cm + c * n;
+                           const float *hi = lo + n;
+                           for (unsigned long i = a; i < b; ++i)
+                             values[i] += hi[i] - lo[i];
+                         }
+                         for (unsigned long i = a; i < b; ++i)
+                           values[i] /= double(len - 1);
+                       }
+                       else
+                       {
+                         const float *row = cm + first * n;
+                         for (unsigned long i = a; i < b; ++i)
+                           values[i] = Signal::RangePooling<float>(row + i, row + i + 1, GetRangePoolingStrategy());
+                       }
+
+                       // pixels outside of the mask stay 0, as in GetImages
+                       for (unsigned long i = a; i < b; ++i)
+                         if (!maskAccess || maskAccess->GetPixelByIndex(m_Spectra[i].index) != 0)
+                           imageAccess.SetPixelByIndex(m_Spectra[i].index, values[i]);
+                     });
+  }
+  else
+  {
+    m2::Process::Map(n,
+                     t,
+                     [&](auto /*id*/, auto a, auto b)
                      {
-                       auto &spectrum = m_Spectra[i];
-                       auto &ys = spectrum.data;
-                       auto s = std::next(std::begin(ys), subRes.first);
-                       auto e = std::next(std::begin(ys), subRes.first + subRes.second);
+                       for (unsigned int i = a; i < b; ++i)
+                       {
+                         auto &spectrum = m_Spectra[i];
+                         if (maskAccess && maskAccess->GetPixelByIndex(spectrum.index) == 0)
+                           continue;
+                         const auto *ys = GetSpectrumData(i);
+                         auto s = ys + subRes.first;
+                         auto e = ys + subRes.first + subRes.second;
 
 
-                      if(std::distance(s,e)>=2){
+                        if(std::distance(s,e)>=2){
                         
 
-                        auto mean_derivative = std::inner_product(
-                          std::next(s, 1), e, s,
-                          0.0,
-                          std::plus<>(),
-                          [](auto a, auto b) { return a - b; }
-                        ) / double(std::distance(s, e) - 1);
-                        imageAccess.SetPixelByIndex(spectrum.index, mean_derivative);
-                      }else
-                        imageAccess.SetPixelByIndex(spectrum.index, Signal::RangePooling<float>(s, e, GetRangePoolingStrategy()));
-                     }
-                   });
-
+                          auto mean_derivative = std::inner_product(
+                            std::next(s, 1), e, s,
+                            0.0,
+                            std::plus<>(),
+                            [](auto a, auto b) { return a - b; }
+                          ) / double(std::distance(s, e) - 1);
+                          imageAccess.SetPixelByIndex(spectrum.index, mean_derivative);
+                        }else
+                          imageAccess.SetPixelByIndex(spectrum.index, Signal::RangePooling<float>(s, e, GetRangePoolingStrategy()));
+                       }
+                     });
+  }
 
     // Spatial image normalization
     const auto bufferN = std::accumulate(destImage->GetDimensions(), destImage->GetDimensions() + 3, 1, std::multiplies<>());
@@ -116,6 +159,63 @@ void m2::SpectrumContainerImage::GetImage(double x, double tol, const mitk::Imag
     }
 }
 
+void m2::SpectrumContainerImage::GetImages(const std::vector<double> &xs,
+                                           const std::vector<double> &tols,
+                                           const mitk::Image *mask,
+                                           std::vector<m2::DisplayImagePixelType> &values) const
+{
+  // image normalization is applied on complete single channel images
+  if (GetImageNormalizationStrategy() != m2::ImageNormalizationStrategyType::None)
+  {
+    Superclass::GetImages(xs, tols, mask, values);
+    return;
+  }
+  if (xs.size() != tols.size())
+    mitkThrow() << "GetImages requires one tolerance per center.";
+
+  using namespace m2;
+  const std::size_t K = xs.size();
+  const auto *dims = GetDimensions();
+  const std::size_t nx = dims[0], ny = dims[1], nz = GetDimension() > 2 ? dims[2] : 1;
+  values.assign(nx * ny * nz * K, 0);
+
+  std::shared_ptr<mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>> maskAccess;
+  if (mask)
+    maskAccess.reset(new mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>(mask));
+
+  const auto &x = GetXAxis();
+  std::vector<std::pair<unsigned int, unsigned int>> ranges(K);
+  for (std::size_t k = 0; k < K; ++k)
+    ranges[k] = m2::Signal::Subrange(x, xs[k] - tols[k], xs[k] + tols[k]);
+
+  const auto pooling = GetRangePoolingStrategy();
+  m2::Process::Map(m_Spectra.size(),
+                   m2::SpectrumImage::GetNumberOfThreads(),
+                   [&](auto /*id*/, auto a, auto b)
+                   {
+                     for (unsigned int i = a; i < b; ++i)
+                     {
+                       const auto &spectrum = m_Spectra[i];
+                       if (maskAccess && maskAccess->GetPixelByIndex(spectrum.index) == 0)
+                         continue;
+
+                       const auto *ys = GetSpectrumData(i);
+                       auto *row = values.data() + (spectrum.index[0] + nx * (spectrum.index[1] + ny * spectrum.index[2])) * K;
+                       for (std::size_t k = 0; k < K; ++k)
+                       {
+                         auto s = ys + ranges[k].first;
+                         auto e = s + ranges[k].second;
+                         // same reduction as GetImage: mean derivative of the band, pooling for single channels
+                         if (std::distance(s, e) >= 2)
+                           row[k] = std::inner_product(std::next(s, 1), e, s, 0.0, std::plus<>(), [](auto hi, auto lo) { return hi - lo; }) /
+                                    double(std::distance(s, e) - 1);
+                         else
+                           row[k] = Signal::RangePooling<float>(s, e, pooling);
+                       }
+                     }
+                   });
+}
+
 void m2::SpectrumContainerImage::InitializeProcessor()
 {
   // this->m_Processor.reset((m2::ISpectrumImageSource *)new FsmProcessor(this));
@@ -264,12 +364,13 @@ void m2::SpectrumContainerImage::InitializeNormalizationImage(m2::NormalizationS
                  for (unsigned long int i = a; i < b; i++)
                  {
                    auto &spectrum = spectra[i];
+                   const auto *ys = GetSpectrumData(i);
 
                    double v;
                    if (type == NormalizationStrategyType::Internal)
                      v = 1;
                    else
-                     v = m2::Signal::GetNormalizationFactor(type, begin(mzs), end(mzs), begin(spectrum.data), end(spectrum.data));
+                     v = m2::Signal::GetNormalizationFactor(type, begin(mzs), end(mzs), ys, ys + m_NumberOfChannels);
 
                    accNorm->SetPixelByIndex(spectrum.index, v);
                  }
@@ -293,6 +394,9 @@ void m2::SpectrumContainerImage::InitializeImageAccess()
 
   auto &xs = GetXAxis();
 
+  // the stored intensities are replaced by the processed ones
+  ReleaseChannelMajorData();
+
   // ----- PreProcess -----
 
   // if the data are available as continuous data with equivalent mz axis for all
@@ -321,6 +425,7 @@ void m2::SpectrumContainerImage::InitializeImageAccess()
       BaselineSubtractor.Initialize(GetBaselineCorrectionStrategy(), GetBaseLineCorrectionHalfWindowSize());
 
       std::vector<float> baseline(xs.size());
+      std::vector<float> ys;
 
       auto &spectra = GetSpectra();
 
@@ -331,7 +436,8 @@ void m2::SpectrumContainerImage::InitializeImageAccess()
       for (unsigned long int i = a; i < b; i++)
       {
         auto &spectrum = spectra[i];
-        auto &ys = spectrum.data;
+        auto *data = GetSpectrumData(i);
+        ys.assign(data, data + m_NumberOfChannels);
         
         std::transform(std::begin(ys), std::end(ys), std::begin(ys), [](double absorbance) {
           return std::pow(10.0, -absorbance) * 100.0;
@@ -353,6 +459,9 @@ void m2::SpectrumContainerImage::InitializeImageAccess()
         std::transform(std::begin(ys), std::end(ys), sumT.at(t).begin(), sumT.at(t).begin(), plus);
         std::transform(std::begin(ys), std::end(ys), skylineT.at(t).begin(), skylineT.at(t).begin(), maximum);
 
+        // the processed intensities replace the stored ones
+        std::copy(std::begin(ys), std::end(ys), data);
+
 
 
       }
@@ -371,8 +480,9 @@ void m2::SpectrumContainerImage::InitializeImageAccess()
                      }
                    });
 
+  // the overview spectra are recomputed, e.g. the reader provides the sum of the raw spectra
   auto &skyline = GetSkylineSpectrum();
-  skyline.resize(xs.size(), 0);
+  skyline.assign(xs.size(), 0);
   for (unsigned int t = 0; t < GetNumberOfThreads(); ++t)
     std::transform(skylineT[t].begin(),
                    skylineT[t].end(),
@@ -383,8 +493,8 @@ void m2::SpectrumContainerImage::InitializeImageAccess()
   auto &mean = GetMeanSpectrum();
   auto &sum = GetSumSpectrum();
 
-  mean.resize(xs.size(), 0);
-  sum.resize(xs.size(), 0);
+  mean.assign(xs.size(), 0);
+  sum.assign(xs.size(), 0);
 
   // accumulate valid spectra defined by mask image
   auto N = std::accumulate(accMask->GetData(),
@@ -402,6 +512,79 @@ void m2::SpectrumContainerImage::InitializeImageAccess()
 }
 
 
+void m2::SpectrumContainerImage::SetImageLayout(SpectralDataLayout layout)
+{
+  m_ImageLayout = layout;
+  if (layout == SpectralDataLayout::PixelMajor)
+    ReleaseChannelMajorData();
+}
+
+std::shared_ptr<const float> m2::SpectrumContainerImage::GetChannelData(std::size_t c) const
+{
+  if (m_NumberOfChannels == 0 || c >= m_NumberOfChannels)
+    return nullptr;
+  const auto data = GetChannelMajorData();
+  return std::shared_ptr<const float>(data, data->data() + c * (data->size() / m_NumberOfChannels));
+}
+
+std::shared_ptr<const m2::AlignedVector<float>> m2::SpectrumContainerImage::GetChannelMajorData() const
+{
+  std::lock_guard<std::mutex> lock(m_ChannelMajorMutex);
+  if (m_ChannelMajorData && m_ChannelMajorData->size() == m_SpectralData.size())
+    return m_ChannelMajorData;
+
+  m2::Timer timer("Wavenumber-major copy of the spectral data");
+  auto channelMajor = std::make_shared<m2::AlignedVector<float>>(m_SpectralData.size());
+  const std::size_t channels = m_NumberOfChannels;
+  if (channels == 0 || m_SpectralData.empty())
+    return m_ChannelMajorData = channelMajor;
+  const std::size_t n = m_SpectralData.size() / channels;
+
+  // blocked transpose, blocks of channels are distributed over the threads
+  constexpr std::size_t B = 64;
+  const float *src = m_SpectralData.data();
+  float *dst = channelMajor->data();
+  m2::Process::Map((channels + B - 1) / B,
+                   GetNumberOfThreads(),
+                   [&](unsigned int /*t*/, unsigned int a, unsigned int b)
+                   {
+                     for (std::size_t c0 = a * B; c0 < std::min(channels, b * B); c0 += B)
+                     {
+                       const auto c1 = std::min(channels, c0 + B);
+                       for (std::size_t p0 = 0; p0 < n; p0 += B)
+                       {
+                         const auto p1 = std::min(n, p0 + B);
+                         for (std::size_t p = p0; p < p1; ++p)
+                           for (std::size_t c = c0; c < c1; ++c)
+                             dst[c * n + p] = src[p * channels + c];
+                       }
+                     }
+                   });
+
+  return m_ChannelMajorData = channelMajor;
+}
+
+void m2::SpectrumContainerImage::ReleaseChannelMajorData()
+{
+  std::lock_guard<std::mutex> lock(m_ChannelMajorMutex);
+  m_ChannelMajorData = nullptr;
+}
+
+void m2::SpectrumContainerImage::AllocateSpectralData(std::size_t numberOfSpectra, std::size_t numberOfChannels)
+{
+  ReleaseChannelMajorData();
+  m_NumberOfChannels = numberOfChannels;
+  m_SpectralData.clear();
+  m_SpectralData.shrink_to_fit();
+  m_SpectralData.resize(numberOfSpectra * numberOfChannels);
+}
+
+void m2::SpectrumContainerImage::ResizeSpectralData(std::size_t numberOfSpectra)
+{
+  ReleaseChannelMajorData();
+  m_SpectralData.resize(numberOfSpectra * m_NumberOfChannels);
+}
+
 m2::SpectrumContainerImage::~SpectrumContainerImage()
 {
   MITK_INFO << GetStaticNameOfClass() << " destroyed!";
@@ -13,12 +13,18 @@ A PARTICULAR PURPOSE.
 See LICENSE.txt for details.
 
 ===================================================================*/
+#include <algorithm>
+#include <functional>
+#include <itkVectorImage.h>
 #include <m2SpectrumImage.h>
 #include <mitkDataNode.h>
+#include <mitkImageCast.h>
 #include <mitkImagePixelReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
 #include <mitkLevelWindowProperty.h>
 #include <mitkLookupTableProperty.h>
 #include <mitkOperation.h>
+#include <numeric>
 #include <signal/m2PeakDetection.h>
 
 namespace m2
@@ -41,14 +47,29 @@ mitk::Image::Pointer m2::SpectrumImage::GetNormalizationImage()
 
 mitk::Image::Pointer m2::SpectrumImage::GetNormalizationImage(m2::NormalizationStrategyType type)
 {
-  if (m_NormalizationImages.find(type) != m_NormalizationImages.end()){
-      return m_NormalizationImages.at(type).image;
+  ResolveDeferredNormalizationImage(type);
+  auto &data = m_NormalizationImages[type];
+  if (data.image.IsNull() && IsInitialized())
+  {
+    data.image = CreateNormalizationImage();
+    data.isInitialized = false;
   }
-  return nullptr;
+  return data.image;
+}
+
+unsigned long m2::SpectrumImage::GetNormalizationImageMTime() const
+{
+  // deferred images are resolved into the map under this lock
+  std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+  auto it = m_NormalizationImages.find(m_NormalizationStrategy);
+  if (it == m_NormalizationImages.end() || it->second.image.IsNull())
+    return 0;
+  return it->second.image->GetMTime();
 }
 
 bool m2::SpectrumImage::GetNormalizationImageStatus(m2::NormalizationStrategyType type)
 {
+  ResolveDeferredNormalizationImage(type);
   return m_NormalizationImages[type].isInitialized;
 };
 
@@ -58,9 +79,141 @@ void m2::SpectrumImage::SetNormalizationImageStatus(m2::NormalizationStrategyTyp
 
 void m2::SpectrumImage::SetNormalizationImage(mitk::Image::Pointer image, m2::NormalizationStrategyType type)
 {
+  {
+    std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+    m_DeferredNormalizationImages.erase(type);
+  }
   m_NormalizationImages[type].image = image;
 }
 
+mitk::Image::Pointer m2::SpectrumImage::CreateNormalizationImage() const
+{
+  auto image = mitk::Image::New();
+  image->Initialize(mitk::MakeScalarPixelType<m2::NormImagePixelType>(), GetDimension(), GetDimensions());
+  image->SetClonedGeometry(GetGeometry());
+
+  const auto n = std::accumulate(GetDimensions(), GetDimensions() + GetDimension(), size_t(1), std::multiplies<size_t>());
+  mitk::ImageWriteAccessor acc(image);
+  std::fill_n(static_cast<m2::NormImagePixelType *>(acc.GetData()), n, m2::NormImagePixelType(1));
+  return image;
+}
+
+mitk::Image::Pointer m2::SpectrumImage::GetMaskImage()
+{
+  ResolveDeferredMaskImage();
+  return m_MaskImage;
+}
+
+mitk::Image::Pointer m2::SpectrumImage::GetMaskImage() const
+{
+  ResolveDeferredMaskImage();
+  return m_MaskImage;
+}
+
+void m2::SpectrumImage::SetMaskImage(mitk::Image::Pointer image)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+    m_DeferredMaskImage = nullptr;
+  }
+  if (m_MaskImage != image)
+  {
+    m_MaskImage = image;
+    Modified();
+  }
+}
+
+mitk::Image::Pointer m2::SpectrumImage::GetShiftImage()
+{
+  ResolveDeferredShiftImage();
+  return m_ShiftImage;
+}
+
+mitk::Image::Pointer m2::SpectrumImage::GetShiftImage() const
+{
+  ResolveDeferredShiftImage();
+  return m_ShiftImage;
+}
+
+void m2::SpectrumImage::SetShiftImage(mitk::Image::Pointer image)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+    m_DeferredShiftImage = nullptr;
+  }
+  if (m_ShiftImage != image)
+  {
+    m_ShiftImage = image;
+    Modified();
+  }
+}
+
+void m2::SpectrumImage::SetDeferredMaskImage(DeferredImageLoader loader)
+{
+  std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+  m_DeferredMaskImage = std::move(loader);
+}
+
+void m2::SpectrumImage::SetDeferredShiftImage(DeferredImageLoader loader)
+{
+  std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+  m_DeferredShiftImage = std::move(loader);
+}
+
+void m2::SpectrumImage::SetDeferredNormalizationImage(m2::NormalizationStrategyType type, DeferredImageLoader loader)
+{
+  std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+  m_DeferredNormalizationImages[type] = std::move(loader);
+}
+
+// The lock is held while loading: concurrent callers wait for the image instead of loading it twice.
+// Observers of Modified() may access the image again, it is called after the lock was released.
+void m2::SpectrumImage::ResolveDeferredMaskImage() const
+{
+  {
+    std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+    if (!m_DeferredMaskImage)
+      return;
+    auto loader = std::move(m_DeferredMaskImage);
+    m_DeferredMaskImage = nullptr;
+    auto image = loader();
+    if (!image)
+      return;
+    m_MaskImage = image;
+  }
+  Modified();
+}
+
+void m2::SpectrumImage::ResolveDeferredShiftImage() const
+{
+  {
+    std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+    if (!m_DeferredShiftImage)
+      return;
+    auto loader = std::move(m_DeferredShiftImage);
+    m_DeferredShiftImage = nullptr;
+    auto image = loader();
+    if (!image)
+      return;
+    m_ShiftImage = image;
+  }
+  Modified();
+}
+
+void m2::SpectrumImage::ResolveDeferredNormalizationImage(m2::NormalizationStrategyType type)
+{
+  std::lock_guard<std::mutex> lock(m_DeferredImagesMutex);
+  auto it = m_DeferredNormalizationImages.find(type);
+  if (it == m_DeferredNormalizationImages.end())
+    return;
+  auto loader = std::move(it->second);
+  m_DeferredNormalizationImages.erase(it);
+  if (auto image = loader())
+  {
+    m_NormalizationImages[type].image = image;
+    m_NormalizationImages[type].isInitialized = true;
+  }
+}
 
 std::vector<double> &m2::SpectrumImage::GetSkylineSpectrum()
 {
@@ -92,5 +245,64 @@ void m2::SpectrumImage::GetImage(double, double, const mitk::Image *, mitk::Imag
   MITK_WARN("SpectrumImage") << "Get image is not implemented in derived class!";
 }
 
-m2::SpectrumImage::~SpectrumImage() {}
+bool m2::SpectrumImage::TryGetImage(
+  double x, double tol, const mitk::Image *mask, mitk::Image *img, const std::atomic<bool> &cancelled) const
+{
+  if (cancelled)
+    return false;
+  GetImage(x, tol, mask, img);
+  return true;
+}
+
+void m2::SpectrumImage::GetImages(const std::vector<double> &xs,
+                                  const std::vector<double> &tols,
+                                  const mitk::Image *mask,
+                                  std::vector<m2::DisplayImagePixelType> &values) const
+{
+  if (xs.size() != tols.size())
+    mitkThrow() << "GetImages requires one tolerance per center.";
+
+  const std::size_t K = xs.size();
+  const auto n = std::accumulate(GetDimensions(), GetDimensions() + GetDimension(), size_t(1), std::multiplies<size_t>());
+  values.assign(n * K, 0);
+
+  mitk::Image::Pointer ionImage = mitk::Image::Clone();
+  for (std::size_t k = 0; k < K; ++k)
+  {
+    GetImage(xs[k], tols[k], mask, ionImage);
+    mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(ionImage);
+    const auto *data = acc.GetData();
+    for (std::size_t i = 0; i < n; ++i)
+      values[i * K + k] = data[i];
+  }
+}
+
+mitk::Image::Pointer m2::SpectrumImage::GetVectorImage(const std::vector<double> &xs, const mitk::Image *mask) const
+{
+  std::vector<double> tols(xs.size());
+  std::transform(std::begin(xs), std::end(xs), std::begin(tols), [this](double x) { return ApplyTolerance(x); });
+
+  std::vector<m2::DisplayImagePixelType> values;
+  GetImages(xs, tols, mask, values);
+
+  using VectorImageType = itk::VectorImage<m2::DisplayImagePixelType, 3>;
+  auto vectorImage = VectorImageType::New();
+  vectorImage->SetVectorLength(xs.size());
+  VectorImageType::SizeType size;
+  for (unsigned int d = 0; d < 3; ++d)
+    size[d] = d < GetDimension() ? GetDimensions()[d] : 1;
+  vectorImage->SetRegions(size);
+  vectorImage->Allocate();
+  std::copy(std::begin(values), std::end(values), vectorImage->GetBufferPointer());
+
+  mitk::Image::Pointer result;
+  mitk::CastToMitkImage(vectorImage, result);
+  result->SetClonedGeometry(GetGeometry());
+  return result;
+}
+
+m2::SpectrumImage::~SpectrumImage()
+{
+  m2::IonImageCache::GetInstance().Clear(this);
+}
 m2::SpectrumImage::SpectrumImage() : mitk::Image() {}
@@ -13,6 +13,7 @@ See LICENSE.txt for details.
 
 ===================================================================*/
 
+#include <algorithm>
 #include <m2SpectrumImageHelper.h>
 #include <mitkImagePixelReadAccessor.h>
 #include <m2CoreCommon.h>
@@ -90,20 +91,32 @@ std::vector<float> m2::SpectrumImageHelper::GetIntensityData(
   unsigned int N = accumulate(image->GetDimensions(), image->GetDimensions() + 3, 1, multiplies<unsigned int>());
   auto maskImage = image->GetMaskImage();
 
-  auto tmpImage = mitk::Image::New();
-  tmpImage->Initialize(image);
-  mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> tAcc(tmpImage);
-
-  vector<float> values;
-  values.reserve(N * intervals.size());
-  auto inserter = back_inserter(values);
   MITK_INFO << "Generate intensity values for #intervals (" << intervals.size()
             << ") using interval centers and a tolerance of " << image->GetTolerance()
             << " isUsingPPM=" << (image->GetUseToleranceInPPM() ? "True" : "False");
-  for (const auto &p : intervals)
+
+  // ion images are generated for blocks of intervals in one pass each and transposed to one row per interval,
+  // the block size keeps the pixel-major buffer at about 256 MB
+  const size_t K = intervals.size();
+  const size_t blockSize = std::max<size_t>(1, (size_t(256) << 20) / (std::max(N, 1u) * sizeof(m2::DisplayImagePixelType)));
+  vector<float> values(N * K);
+  vector<double> xs, tols;
+  vector<m2::DisplayImagePixelType> pixelMajor;
+  for (size_t k0 = 0; k0 < K; k0 += blockSize)
   {
-    image->GetImage(p.x.mean(), image->ApplyTolerance(p.x.mean()), maskImage, tmpImage);
-    copy(tAcc.GetData(), tAcc.GetData() + N, inserter);
+    const size_t Kb = std::min(blockSize, K - k0);
+    xs.clear();
+    tols.clear();
+    for (size_t k = k0; k < k0 + Kb; ++k)
+    {
+      xs.push_back(intervals[k].x.mean());
+      tols.push_back(image->ApplyTolerance(intervals[k].x.mean()));
+    }
+    image->GetImages(xs, tols, maskImage, pixelMajor);
+
+    for (size_t i = 0; i < N; ++i)
+      for (size_t k = 0; k < Kb; ++k)
+        values[(k0 + k) * N + i] = pixelMajor[i * Kb + k];
   }
   return values;
 }
\ No newline at end of file
@@ -13,8 +13,10 @@ See LICENSE.txt for details.
 
 ===================================================================*/
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
+#include <exception>
 #include <itkSignedMaurerDistanceMapImageFilter.h>
 #include <itksys/SystemTools.hxx>
 #include <m2ImzMLSpectrumImage.h>
@@ -24,6 +26,7 @@ See LICENSE.txt for details.
 #include <mitkIOUtil.h>
 #include <mitkITKImageImport.h>
 #include <mitkImageAccessByItk.h>
+#include <mitkImagePixelWriteAccessor.h>
 #include <mitkImageReadAccessor.h>
 #include <mitkImageWriteAccessor.h>
 #include <mitkLabel.h>
@@ -267,6 +270,116 @@ namespace m2
 
   }
 
+  void SpectrumImageStack::ApplyProcessingSettings(m2::SpectrumImage *spectrumImage) const
+  {
+    spectrumImage->SetBaselineCorrectionStrategy(this->GetBaselineCorrectionStrategy());
+    spectrumImage->SetBaseLineCorrectionHalfWindowSize(this->GetBaseLineCorrectionHalfWindowSize());
+    spectrumImage->SetNormalizationStrategy(this->GetNormalizationStrategy());
+    spectrumImage->SetSmoothingStrategy(this->GetSmoothingStrategy());
+    spectrumImage->SetSmoothingHalfWindowSize(this->GetSmoothingHalfWindowSize());
+    spectrumImage->SetIntensityTransformationStrategy(this->GetIntensityTransformationStrategy());
+    spectrumImage->SetImageSmoothingStrategy(this->GetImageSmoothingStrategy());
+    spectrumImage->SetImageNormalizationStrategy(this->GetImageNormalizationStrategy());
+  }
+
+  std::vector<m2::SpectrumImage *> SpectrumImageStack::PrepareSliceImages(
+    std::map<m2::SpectrumImage *, std::mutex> &sliceMutexes) const
+  {
+    const auto *dims = GetDimensions();
+    if (m_SliceTransformers.size() > dims[2])
+      mitkThrow() << "Stack index is invalid! Z dim is " << dims[2];
+
+    const std::size_t stackN = std::size_t(dims[0]) * dims[1];
+    std::vector<m2::SpectrumImage *> sliceImages(m_SliceTransformers.size(), nullptr);
+    for (unsigned int i = 0; i < m_SliceTransformers.size(); ++i)
+    {
+      const auto &transformer = m_SliceTransformers[i];
+      auto spectrumImage = dynamic_cast<m2::SpectrumImage *>(transformer->GetMovingImage().GetPointer());
+      if (!spectrumImage)
+        mitkThrow() << "Spectrum image base object expected for slice with index " << i;
+      if (transformer->GetTransformation().empty() &&
+          std::size_t(spectrumImage->GetDimension(0)) * spectrumImage->GetDimension(1) != stackN)
+        mitkThrow() << "Slice dimensions are not equal for target slice with index !" << i;
+
+      sliceImages[i] = spectrumImage;
+      if (sliceMutexes.count(spectrumImage))
+        continue;
+      sliceMutexes[spectrumImage];
+      ApplyProcessingSettings(spectrumImage);
+    }
+    return sliceImages;
+  }
+
+  void SpectrumImageStack::GetImages(const std::vector<double> &xs,
+                                     const std::vector<double> &tols,
+                                     const mitk::Image * /*mask*/,
+                                     std::vector<m2::DisplayImagePixelType> &values) const
+  {
+    const std::size_t K = xs.size();
+    const auto *dims = GetDimensions();
+    const std::size_t stackN = std::size_t(dims[0]) * dims[1];
+    values.assign(stackN * dims[2] * K, 0);
+
+    std::map<m2::SpectrumImage *, std::mutex> sliceMutexes;
+    const auto sliceImages = PrepareSliceImages(sliceMutexes);
+
+    // the first failing slice is reported after all workers joined
+    std::exception_ptr sliceError;
+    std::mutex sliceErrorMutex;
+    m2::Process::Map(m_SliceTransformers.size(), 8, [&](auto /*tId*/, auto a, auto b)
+      {
+        std::vector<m2::DisplayImagePixelType> sliceValues;
+        for (unsigned int i = a; i < b; ++i)
+        {
+          try
+          {
+            const auto &transformer = m_SliceTransformers[i];
+            auto spectrumImage = sliceImages[i];
+            auto *target = values.data() + i * stackN * K;
+
+            std::lock_guard<std::mutex> lock(sliceMutexes.at(spectrumImage));
+            spectrumImage->GetImages(xs, tols, spectrumImage->GetMaskImage(), sliceValues);
+
+            if (transformer->GetTransformation().empty())
+            {
+              std::copy(std::begin(sliceValues), std::end(sliceValues), target);
+              continue;
+            }
+
+            // the transformation is applied on each channel image
+            auto imageTemp = mitk::Image::New();
+            imageTemp->Initialize(spectrumImage);
+            const std::size_t sliceN = sliceValues.size() / std::max<std::size_t>(K, 1);
+            for (std::size_t k = 0; k < K; ++k)
+            {
+              {
+                mitk::ImagePixelWriteAccessor<m2::DisplayImagePixelType, 3> acc(imageTemp);
+                auto *data = acc.GetData();
+                for (std::size_t p = 0; p < sliceN; ++p)
+                  data[p] = sliceValues[p * K + k];
+              }
+              mitk::Image::Pointer warped = transformer->WarpImage(imageTemp);
+              if (std::size_t(warped->GetDimensions()[0]) * warped->GetDimensions()[1] != stackN)
+                mitkThrow() << "Slice dimensions are not equal for target slice with index !" << i;
+              AccessFixedDimensionByItk(warped, ([&](auto warpedItk) {
+                const auto *warpedItkData = warpedItk->GetBufferPointer();
+                for (std::size_t p = 0; p < stackN; ++p)
+                  target[p * K + k] = warpedItkData[p];
+              }), 3);
+            }
+          }
+          catch (...)
+          {
+            std::lock_guard<std::mutex> lock(sliceErrorMutex);
+            if (!sliceError)
+              sliceError = std::current_exception();
+          }
+        }
+      });
+    if (sliceError)
+      std::rethrow_exception(sliceError);
+  }
+
   void SpectrumImageStack::GetImage(double center, double tol, const mitk::Image * /*mask*/, mitk::Image *img) const
   {
 
@@ -274,54 +387,46 @@ namespace m2
       img = const_cast<mitk::Image *>(static_cast<const mitk::Image *>(this));
     }
 
-    // if (!mask){
-    //   mask = const_cast<mitk::Image *>(static_cast<const mitk::Image *>(this->GetMaskImage()));
-    // }
+    std::map<m2::SpectrumImage *, std::mutex> sliceMutexes;
+    const auto sliceImages = PrepareSliceImages(sliceMutexes);
 
-    // mitk::ProgressBar::GetInstance()->AddStepsToDo(m_SliceTransformers.size());
-    // std::vector<mitk::Image::Pointer> images;
-    // m2::Process::Map(m_SliceTransformers.size(), 2, [&](auto /*tId*/, auto a, auto b)
-    // {
-    // for (unsigned int i = a; i < b; ++i)
-    // unsigned int i = 0;
-    // for(auto transformer : m_SliceTransformers)
-
-      // mutex
+    // the first failing slice is reported after all workers joined
+    std::exception_ptr sliceError;
     std::mutex mutex;
-
-
-      m2::Process::Map(m_SliceTransformers.size(),8,[&](auto /*tId*/, auto a, auto b)
+    m2::Process::Map(m_SliceTransformers.size(), 8, [&](auto /*tId*/, auto a, auto b)
+      {
+        for (unsigned int i = a; i < b; ++i)
         {
-          for (unsigned int i = a; i < b; ++i)
+          try
           {
-            auto transformer = m_SliceTransformers[i];
-            if (auto spectrumImage = dynamic_cast<m2::SpectrumImage *>(transformer->GetMovingImage().GetPointer()))
+            const auto &transformer = m_SliceTransformers[i];
+            auto spectrumImage = sliceImages[i];
+
+            // create temp image and copy requested image range to the stack
+            auto imageTemp = mitk::Image::New();
+            imageTemp->Initialize(spectrumImage);
             {
-              // create temp image and copy requested image range to the stack
-              auto imageTemp = mitk::Image::New();
-              imageTemp->Initialize(spectrumImage);
-
-              spectrumImage->SetBaselineCorrectionStrategy(this->GetBaselineCorrectionStrategy());
-              spectrumImage->SetBaseLineCorrectionHalfWindowSize(this->GetBaseLineCorrectionHalfWindowSize());
-              spectrumImage->SetNormalizationStrategy(this->GetNormalizationStrategy());
-              spectrumImage->SetSmoothingStrategy(this->GetSmoothingStrategy());
-              spectrumImage->SetSmoothingHalfWindowSize(this->GetSmoothingHalfWindowSize());
-              spectrumImage->SetIntensityTransformationStrategy(this->GetIntensityTransformationStrategy());
-              spectrumImage->SetImageSmoothingStrategy(this->GetImageSmoothingStrategy());
-              spectrumImage->SetImageNormalizationStrategy(this->GetImageNormalizationStrategy());
+              std::lock_guard<std::mutex> lock(sliceMutexes.at(spectrumImage));
               spectrumImage->GetImage(center, tol, spectrumImage->GetMaskImage(), imageTemp);
-
-              if (!transformer->GetTransformation().empty())
-                imageTemp = transformer->WarpImage(imageTemp);
-              // images.push_back(imageTemp);
-              {
-                // lockguard
-                std::lock_guard<std::mutex> lock(mutex);
-                CopyWarpedImageToStackImage(imageTemp, img, i);
-              }
             }
+
+            if (!transformer->GetTransformation().empty())
+              imageTemp = transformer->WarpImage(imageTemp);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            CopyWarpedImageToStackImage(imageTemp, img, i);
+          }
+          catch (...)
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!sliceError)
+              sliceError = std::current_exception();
           }
-        });
+        }
+      });
+    if (sliceError)
+      std::rethrow_exception(sliceError);
+
     img->Modified();
     // });
     // unsigned int i = 0;
@@ -0,0 +1,573 @@
+/*===================================================================
+
+MSI applications for interactive analysis in MITK (M2aia)
+
+Copyright (c) Jonas Cordes
+
+All rights reserved.
+
+This software is distributed WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.
+
+See LICENSE.txt for details.
+
+===================================================================*/
+
+#include <itkCastImageFilter.h>
+#include <m2Process.hpp>
+#include <m2TiledSpectrumImage.h>
+#include <mitkImagePixelReadAccessor.h>
+#include <mitkImagePixelWriteAccessor.h>
+#include <mitkLabelSetImage.h>
+#include <mitkProperties.h>
+#include <signal/m2Baseline.h>
+#include <signal/m2Normalization.h>
+#include <signal/m2PeakDetection.h>
+#include <signal/m2Pooling.h>
+#include <signal/m2Smoothing.h>
+#include <signal/m2SpatialNormalization.h>
+#include <signal/m2Transformer.h>
+
+namespace
+{
+  /**
+   * Decode the channels [first, first + length) of all spectra of tile t into values (channel-major).
+   */
+  void ReadTile(const m2::TiledSpectrumStore &store,
+                std::uint64_t t,
+                std::uint64_t first,
+                std::uint64_t length,
+                std::vector<float> &values,
+                std::vector<float> &buffer)
+  {
+    const std::uint64_t m = store.GetTileLength(t);
+    values.resize(length * m);
+    if (m == 0 || length == 0)
+      return;
+
+    const auto B = store.GetChannelsPerBlock();
+    for (auto b = first / B; b <= (first + length - 1) / B; ++b)
+    {
+      const auto *chunk = store.ReadChunk(t, b, buffer);
+      const auto blockBegin = store.GetBlockBegin(b);
+      const auto c0 = std::max(first, blockBegin);
+      const auto c1 = std::min(first + length, blockBegin + store.GetBlockLength(b));
+      std::copy(chunk + (c0 - blockBegin) * m, chunk + (c1 - blockBegin) * m, values.data() + (c0 - first) * m);
+    }
+  }
+
+  itk::Index<3> ToIndex(const m2::TiledSpectrumStore::Spectrum &s)
+  {
+    return {{s.index[0], s.index[1], s.index[2]}};
+  }
+
+} // namespace
+
+void m2::TiledSpectrumImage::ReadSpectrum(unsigned int id, std::vector<double> *xs, std::vector<float> &ys) const
+{
+  const auto &store = *m_Store;
+  const auto &spectrum = store.GetSpectra()[id];
+
+  if (store.IsProcessed())
+  {
+    std::vector<char> buffer;
+    const auto tile = store.ReadProcessedTile(spectrum.tile, buffer);
+    const auto a = tile.offsets[spectrum.slot];
+    const auto b = tile.offsets[spectrum.slot + 1];
+    ys.assign(tile.ys + a, tile.ys + b);
+    if (xs)
+      xs->assign(tile.xs + a, tile.xs + b);
+    return;
+  }
+
+  const std::uint64_t m = store.GetTileLength(spectrum.tile);
+  ys.resize(store.GetNumberOfChannels());
+  std::vector<float> buffer;
+  for (std::uint64_t b = 0; b < store.GetNumberOfBlocks(); ++b)
+  {
+    const auto *chunk = store.ReadChunk(spectrum.tile, b, buffer);
+    const auto blockBegin = store.GetBlockBegin(b);
+    for (std::uint64_t c = 0; c < store.GetBlockLength(b); ++c)
+      ys[blockBegin + c] = chunk[c * m + spectrum.slot];
+  }
+  if (xs)
+    *xs = store.GetXAxis();
+}
+
+void m2::TiledSpectrumImage::GetYValues(unsigned int id, std::vector<double> *xs, std::vector<float> &ys) const
+{
+  ReadSpectrum(id, xs, ys);
+
+  const auto &spectrum = m_Store->GetSpectra()[id];
+  auto self = const_cast<TiledSpectrumImage *>(this);
+  mitk::ImagePixelReadAccessor<m2::NormImagePixelType, 3> normAccess(self->GetNormalizationImage());
+  const float norm = normAccess.GetPixelByIndex(ToIndex(spectrum));
+  std::transform(std::begin(ys), std::end(ys), std::begin(ys), [norm](auto v) { return v / norm; });
+
+  m2::Signal::SmoothingFunctor<float> smoother;
+  smoother.Initialize(GetSmoothingStrategy(), GetSmoothingHalfWindowSize());
+  m2::Signal::BaselineFunctor<float> baselineSubtractor;
+  baselineSubtractor.Initialize(GetBaselineCorrectionStrategy(), GetBaseLineCorrectionHalfWindowSize());
+  m2::Signal::IntensityTransformationFunctor<float> transformer;
+  transformer.Initialize(GetIntensityTransformationStrategy());
+
+  std::vector<float> baseline(ys.size());
+  smoother(std::begin(ys), std::end(ys));
+  baselineSubtractor(std::begin(ys), std::end(ys), std::begin(baseline));
+  transformer(std::begin(ys), std::end(ys));
+}
+
+void m2::TiledSpectrumImage::GetSpectrumFloat(unsigned int id, std::vector<float> &xs, std::vector<float> &ys) const
+{
+  std::vector<double> x;
+  GetYValues(id, &x, ys);
+  xs.assign(std::begin(x), std::end(x));
+}
+
+void m2::TiledSpectrumImage::GetSpectrum(unsigned int id, std::vector<double> &xs, std::vector<double> &ys) const
+{
+  std::vector<float> values;
+  GetYValues(id, &xs, values);
+  ys.assign(std::begin(values), std::end(values));
+}
+
+void m2::TiledSpectrumImage::GetIntensitiesFloat(unsigned int id, std::vector<float> &ys) const
+{
+  GetYValues(id, nullptr, ys);
+}
+
+void m2::TiledSpectrumImage::GetIntensities(unsigned int id, std::vector<double> &ys) const
+{
+  std::vector<float> values;
+  GetYValues(id, nullptr, values);
+  ys.assign(std::begin(values), std::end(values));
+}
+
+void m2::TiledSpectrumImage::GetImage(double x, double tol, const mitk::Image *mask, mitk::Image *destImage) const
+{
+  using namespace m2;
+  if (!destImage)
+    mitkThrow() << "Please provide an image into which the data can be written.";
+
+  auto self = const_cast<TiledSpectrumImage *>(this);
+  const auto currentType = GetNormalizationStrategy();
+  if (!self->GetNormalizationImageStatus(currentType))
+    self->InitializeNormalizationImage(currentType);
+
+  mitk::ImagePixelWriteAccessor<DisplayImagePixelType, 3> imageAccess(destImage);
+  mitk::ImagePixelReadAccessor<NormImagePixelType, 3> normAccess(self->GetNormalizationImage());
+  std::shared_ptr<mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>> maskAccess;
+  if (mask)
+    maskAccess.reset(new mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>(mask));
+
+  const auto bufferN =
+    std::accumulate(destImage->GetDimensions(), destImage->GetDimensions() + 3, 1, std::multiplies<>());
+  std::fill(imageAccess.GetData(), imageAccess.GetData() + bufferN, 0);
+
+  GetPropertyList()->SetProperty("m2aia.xs.selection.center", mitk::DoubleProperty::New(x));
+  GetPropertyList()->SetProperty("m2aia.xs.selection.tolerance", mitk::DoubleProperty::New(tol));
+  m_CurrentX = x;
+
+  const auto &store = *m_Store;
+  const auto &spectra = store.GetSpectra();
+  if (store.IsProcessed())
+  {
+    // each spectrum is searched on its own x axis, processed data is normalized only (as imzML)
+    m2::Process::Map(store.GetNumberOfTiles(),
+                     GetNumberOfThreads(),
+                     [&](unsigned int /*thread*/, unsigned int a, unsigned int b)
+                     {
+                       std::vector<char> buffer;
+                       std::vector<float> ints;
+                       for (unsigned int t = a; t < b; ++t)
+                       {
+                         const std::uint64_t m = store.GetTileLength(t);
+                         if (m == 0)
+                           continue;
+                         const auto tile = store.ReadProcessedTile(t, buffer);
+                         const auto *ids = store.GetTileSpectra(t);
+                         for (std::uint64_t slot = 0; slot < m; ++slot)
+                         {
+                           const auto index = ToIndex(spectra[ids[slot]]);
+                           if (maskAccess && maskAccess->GetPixelByIndex(index) == 0)
+                             continue;
+
+                           const auto *first = tile.xs + tile.offsets[slot];
+                           const auto *last = tile.xs + tile.offsets[slot + 1];
+                           const auto *s = std::lower_bound(first, last, x - tol);
+                           const auto *e = std::upper_bound(s, last, x + tol);
+                           if (s == e)
+                             continue;
+
+                           const float norm = normAccess.GetPixelByIndex(index);
+                           const auto *ys = tile.ys + (s - tile.xs);
+                           ints.resize(e - s);
+                           std::transform(ys, ys + ints.size(), ints.begin(), [norm](float v) { return v / norm; });
+                           imageAccess.SetPixelByIndex(
+                             index, Signal::RangePooling<float>(ints.begin(), ints.end(), GetRangePoolingStrategy()));
+                         }
+                       }
+                     });
+  }
+  else
+  {
+    const auto &xs = GetXAxis();
+    const auto subRes = m2::Signal::Subrange(xs, x - tol, x + tol);
+    if (subRes.second == 0)
+      return;
+
+    // pad the queried channel range for kernel based signal processing
+    std::uint64_t padding = 0;
+    if (GetBaselineCorrectionStrategy() != m2::BaselineCorrectionType::None)
+      padding = GetBaseLineCorrectionHalfWindowSize();
+    const std::uint64_t paddingLeft = std::min<std::uint64_t>(padding, subRes.first);
+    const std::uint64_t paddingRight = std::min<std::uint64_t>(padding, xs.size() - (subRes.first + subRes.second));
+    const std::uint64_t first = subRes.first - paddingLeft;
+    const std::uint64_t length = subRes.second + paddingLeft + paddingRight;
+
+    m2::Process::Map(
+      store.GetNumberOfTiles(),
+      GetNumberOfThreads(),
+      [&](unsigned int /*thread*/, unsigned int a, unsigned int b)
+      {
+        m2::Signal::SmoothingFunctor<float> smoother;
+        smoother.Initialize(GetSmoothingStrategy(), GetSmoothingHalfWindowSize());
+        m2::Signal::BaselineFunctor<float> baselineSubtractor;
+        baselineSubtractor.Initialize(GetBaselineCorrectionStrategy(), GetBaseLineCorrectionHalfWindowSize());
+        m2::Signal::IntensityTransformationFunctor<float> transformer;
+        transformer.Initialize(GetIntensityTransformationStrategy());
+
+        std::vector<float> values, buffer, ints(length), baseline(length);
+        const auto s = std::next(std::begin(ints), paddingLeft);
+        const auto e = std::prev(std::end(ints), paddingRight);
+
+        for (unsigned int t = a; t < b; ++t)
+        {
+          const std::uint64_t m = store.GetTileLength(t);
+          if (m == 0)
+            continue;
+          ReadTile(store, t, first, length, values, buffer);
+
+          const auto *ids = store.GetTileSpectra(t);
+          for (std::uint64_t slot = 0; slot < m; ++slot)
+          {
+            const auto index = ToIndex(spectra[ids[slot]]);
+            if (maskAccess && maskAccess->GetPixelByIndex(index) == 0)
+              continue;
+
+            const float norm = normAccess.GetPixelByIndex(index);
+            for (std::uint64_t k = 0; k < length; ++k)
+              ints[k] = values[k * m + slot] / norm;
+
+            smoother(std::begin(ints), std::end(ints));
+            baselineSubtractor(std::begin(ints), std::end(ints), std::begin(baseline));
+            transformer(std::begin(ints), std::end(ints));
+
+            imageAccess.SetPixelByIndex(index, Signal::RangePooling<float>(s, e, GetRangePoolingStrategy()));
+          }
+        }
+      });
+  }
+
+  // Spatial image normalization
+  std::shared_ptr<mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>> validAccess = maskAccess;
+  if (!validAccess)
+    validAccess.reset(new mitk::ImagePixelReadAccessor<mitk::LabelSetImage::PixelType, 3>(GetMaskImage()));
+  auto data = imageAccess.GetData();
+  switch (GetImageNormalizationStrategy())
+  {
+    case m2::ImageNormalizationStrategyType::zScore:
+      m2::Signal::StandardizeImage(data, data + bufferN, validAccess->GetData(), data);
+      break;
+    case m2::ImageNormalizationStrategyType::MinMax:
+      m2::Signal::MinMaxNormalizeImage(data, data + bufferN, validAccess->GetData(), data);
+      break;
+    case m2::ImageNormalizationStrategyType::ParetoScaling:
+      m2::Signal::ParetoScaling(data, data + bufferN, validAccess->GetData(), data);
+      break;
+    case m2::ImageNormalizationStrategyType::VastScaling:
+      m2::Signal::VastScaling(data, data + bufferN, validAccess->GetData(), data);
+      break;
+    case m2::ImageNormalizationStrategyType::RangeScaling:
+      m2::Signal::RangeScaling(data, data + bufferN, validAccess->GetData(), data);
+      break;
+    case m2::ImageNormalizationStrategyType::None:
+    default:
+      break;
+  }
+}
+
+void m2::TiledSpectrumImage::InitializeProcessor()
+{
+  // spectra are decoded from the store, no processor required
+}
+
+void m2::TiledSpectrumImage::InitializeGeometry()
+{
+  if (!m_Store)
+    mitkThrow() << "No tiled spectrum store set.";
+
+  const auto &geometry = m_Store->GetGeometry();
+  const auto &dims = geometry.Dimensions;
+
+  using ImageType = itk::Image<m2::DisplayImagePixelType, 3>;
+  auto itkIonImage = ImageType::New();
+  itkIonImage->SetRegions({{0, 0, 0}, {dims[0], dims[1], dims[2]}});
+  itkIonImage->Allocate();
+  itkIonImage->FillBuffer(0);
+
+  auto s = itkIonImage->GetSpacing();
+  auto o = itkIonImage->GetOrigin();
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    s[i] = geometry.Spacing[i];
+    o[i] = geometry.Origin[i];
+  }
+  itkIonImage->SetSpacing(s);
+  itkIonImage->SetOrigin(o);
+
+  const auto N = std::size_t(dims[0]) * dims[1] * dims[2];
+
+  InitializeByItk(itkIonImage.GetPointer());
+  {
+    mitk::ImagePixelWriteAccessor<m2::DisplayImagePixelType, 3> acc(this);
+    std::fill(acc.GetData(), acc.GetData() + N, 0);
+  }
+
+  {
+    using LocalImageType = itk::Image<m2::IndexImagePixelType, 3>;
+    auto caster = itk::CastImageFilter<ImageType, LocalImageType>::New();
+    caster->SetInput(itkIonImage);
+    caster->Update();
+    auto indexImage = mitk::Image::New();
+    indexImage->InitializeByItk(caster->GetOutput());
+    SetIndexImage(indexImage);
+  }
+
+  if (GetMaskImage().IsNull())
+  {
+    auto image = mitk::LabelSetImage::New();
+    image->SetProperty("m2aia.mask.initialization", mitk::StringProperty::New("internal"));
+    SetMaskImage(image.GetPointer());
+    image->Initialize((mitk::Image *)this);
+
+    mitk::Color color;
+    color.Set(0.0, 1, 0.0);
+    auto label = mitk::Label::New();
+    label->SetColor(color);
+    label->SetName("Valid");
+    label->SetOpacity(0.0);
+    label->SetLocked(true);
+    label->SetValue(1);
+    image->AddLabel(label, 0);
+
+    mitk::ImagePixelWriteAccessor<mitk::LabelSetImage::PixelType, 3> acc(image);
+    std::fill(acc.GetData(), acc.GetData() + N, 0);
+  }
+
+  for (auto type : m2::NormalizationStrategyTypeList)
+  {
+    using LocalImageType = itk::Image<m2::NormImagePixelType, 3>;
+    auto caster = itk::CastImageFilter<ImageType, LocalImageType>::New();
+    caster->SetInput(itkIonImage);
+    caster->Update();
+    auto normImage = mitk::Image::New();
+    normImage->InitializeByItk(caster->GetOutput());
+    {
+      mitk::ImagePixelWriteAccessor<m2::NormImagePixelType, 3> acc(normImage);
+      std::fill(acc.GetData(), acc.GetData() + N, 1.0);
+    }
+    SetNormalizationImage(normImage, type);
+    SetNormalizationImageStatus(type, false);
+  }
+
+  m_SpectrumType.Format = m_Store->GetFormat();
+  m_SpectrumType.XAxisLabel = m_Store->GetXAxisLabel();
+  m_XAxis = m_Store->GetXAxis();
+
+  SetImageGeometryInitialized(true);
+}
+
+void m2::TiledSpectrumImage::InitializeNormalizationImage(m2::NormalizationStrategyType type)
+{
+  if (GetNormalizationImageStatus(type))
+  {
+    MITK_WARN << "The normalization image is already initialized. "
+              << "type " << m2::to_string(type);
+    return;
+  }
+
+  mitk::ImagePixelWriteAccessor<NormImagePixelType, 3> accNorm(GetNormalizationImage(type));
+  const auto &store = *m_Store;
+  const auto &spectra = store.GetSpectra();
+  const auto &xs = GetXAxis();
+  const auto C = store.GetNumberOfChannels();
+  const bool processed = store.IsProcessed();
+
+  m2::Process::Map(store.GetNumberOfTiles(),
+                   GetNumberOfThreads(),
+                   [&](unsigned int /*thread*/, unsigned int a, unsigned int b)
+                   {
+                     std::vector<float> values, buffer, ys(processed ? 0 : C);
+                     std::vector<char> processedBuffer;
+                     m2::TiledSpectrumStore::ProcessedTile tile;
+                     for (unsigned int t = a; t < b; ++t)
+                     {
+                       const std::uint64_t m = store.GetTileLength(t);
+                       if (m == 0)
+                         continue;
+                       if (type != NormalizationStrategyType::Internal)
+                       {
+                         if (processed)
+                           tile = store.ReadProcessedTile(t, processedBuffer);
+                         else
+                           ReadTile(store, t, 0, C, values, buffer);
+                       }
+
+                       const auto *ids = store.GetTileSpectra(t);
+                       for (std::uint64_t slot = 0; slot < m; ++slot)
+                       {
+                         double v = 1;
+                         if (type != NormalizationStrategyType::Internal && processed)
+                         {
+                           const auto first = tile.offsets[slot], last = tile.offsets[slot + 1];
+                           v = m2::Signal::GetNormalizationFactor(
+                             type, tile.xs + first, tile.xs + last, tile.ys + first, tile.ys + last);
+                         }
+                         else if (type != NormalizationStrategyType::Internal)
+                         {
+                           for (std::uint64_t c = 0; c < C; ++c)
+                             ys[c] = values[c * m + slot];
+                           v = m2::Signal::GetNormalizationFactor(
+                             type, std::begin(xs), std::end(xs), std::begin(ys), std::end(ys));
+                         }
+                         accNorm.SetPixelByIndex(ToIndex(spectra[ids[slot]]), v);
+                       }
+                     }
+                   });
+
+  SetNormalizationImageStatus(type, true);
+}
+
+void m2::TiledSpectrumImage::InitializeImageAccess()
+{
+  using namespace m2;
+  SetImageAccessInitialized(false);
+
+  const auto currentType = GetNormalizationStrategy();
+  if (!GetNormalizationImageStatus(currentType))
+    InitializeNormalizationImage(currentType);
+
+  std::shared_ptr<mitk::ImagePixelWriteAccessor<mitk::LabelSetImage::PixelType, 3>> accMask;
+  auto prop = GetMaskImage()->GetProperty("m2aia.mask.initialization");
+  if (prop && prop->GetValueAsString() == "internal")
+    accMask = std::make_shared<mitk::ImagePixelWriteAccessor<mitk::LabelSetImage::PixelType, 3>>(GetMaskImage());
+  mitk::ImagePixelWriteAccessor<m2::IndexImagePixelType, 3> accIndex(GetIndexImage());
+  mitk::ImagePixelReadAccessor<m2::NormImagePixelType, 3> accNorm(GetNormalizationImage(currentType));
+
+  const auto &store = *m_Store;
+  const auto &spectra = store.GetSpectra();
+  const auto &xs = GetXAxis();
+  const auto C = store.GetNumberOfChannels();
+  const bool processed = store.IsProcessed();
+  const auto threads = GetNumberOfThreads();
+
+  SetPropertyValue<unsigned>("m2aia.xs.n", xs.size());
+  SetPropertyValue<double>("m2aia.xs.min", xs.front());
+  SetPropertyValue<double>("m2aia.xs.max", xs.back());
+
+  std::vector<std::vector<double>> skylineT(threads, std::vector<double>(C, 0));
+  std::vector<std::vector<double>> sumT(threads, std::vector<double>(C, 0));
+
+  m2::Process::Map(
+    store.GetNumberOfTiles(),
+    threads,
+    [&](unsigned int thread, unsigned int a, unsigned int b)
+    {
+      m2::Signal::SmoothingFunctor<float> smoother;
+      smoother.Initialize(GetSmoothingStrategy(), GetSmoothingHalfWindowSize());
+      m2::Signal::BaselineFunctor<float> baselineSubtractor;
+      baselineSubtractor.Initialize(GetBaselineCorrectionStrategy(), GetBaseLineCorrectionHalfWindowSize());
+      m2::Signal::IntensityTransformationFunctor<float> transformer;
+      transformer.Initialize(GetIntensityTransformationStrategy());
+
+      std::vector<float> values, buffer, ys(C), baseline(C);
+      std::vector<char> processedBuffer;
+      auto &sum = sumT[thread];
+      auto &skyline = skylineT[thread];
+
+      for (unsigned int t = a; t < b; ++t)
+      {
+        const std::uint64_t m = store.GetTileLength(t);
+        if (m == 0)
+          continue;
+        m2::TiledSpectrumStore::ProcessedTile tile;
+        if (processed)
+          tile = store.ReadProcessedTile(t, processedBuffer);
+        else
+          ReadTile(store, t, 0, C, values, buffer);
+
+        const auto *ids = store.GetTileSpectra(t);
+        for (std::uint64_t slot = 0; slot < m; ++slot)
+        {
+          const auto id = ids[slot];
+          const auto index = ToIndex(spectra[id]);
+          accIndex.SetPixelByIndex(index, id);
+          if (accMask)
+            accMask->SetPixelByIndex(index, 1);
+
+          const float norm = accNorm.GetPixelByIndex(index);
+          if (processed)
+          {
+            // overview spectra of processed data: normalized values at the nearest channel of the overview axis
+            for (auto k = tile.offsets[slot]; k < tile.offsets[slot + 1]; ++k)
+            {
+              auto it = std::lower_bound(xs.begin(), xs.end(), tile.xs[k]);
+              if (it == xs.end() || (it != xs.begin() && tile.xs[k] - *std::prev(it) < *it - tile.xs[k]))
+                it = std::prev(it);
+              const auto c = std::distance(xs.begin(), it);
+              const double v = tile.ys[k] / norm;
+              sum[c] += v;
+              skyline[c] = std::max(skyline[c], v);
+            }
+            continue;
+          }
+
+          for (std::uint64_t c = 0; c < C; ++c)
+            ys[c] = values[c * m + slot] / norm;
+
+          smoother(std::begin(ys), std::end(ys));
+          baselineSubtractor(std::begin(ys), std::end(ys), std::begin(baseline));
+          transformer(std::begin(ys), std::end(ys));
+
+          for (std::uint64_t c = 0; c < C; ++c)
+          {
+            sum[c] += ys[c];
+            skyline[c] = std::max<double>(skyline[c], ys[c]);
+          }
+        }
+      }
+    });
+
+  auto &skyline = GetSkylineSpectrum();
+  auto &sum = GetSumSpectrum();
+  auto &mean = GetMeanSpectrum();
+  skyline.assign(C, 0);
+  sum.assign(C, 0);
+  mean.assign(C, 0);
+  for (unsigned int t = 0; t < threads; ++t)
+    for (std::uint64_t c = 0; c < C; ++c)
+    {
+      skyline[c] = std::max(skyline[c], skylineT[t][c]);
+      sum[c] += sumT[t][c];
+    }
+  std::transform(sum.begin(), sum.end(), mean.begin(), [&](auto v) { return v / double(spectra.size()); });
+
+  SetNumberOfValidPixels(spectra.size());
+  SetImageAccessInitialized(true);
+}
+
+m2::TiledSpectrumImage::TiledSpectrumImage() {}
+
+m2::TiledSpectrumImage::~TiledSpectrumImage() {}
@@ -127,27 +127,33 @@ void m2::KMeansImageFilter::GenerateData()
 
   MITK_INFO << "Start filling data matrix ....";
   size_t offset = 0;
-  mitk::ProgressBar::GetInstance()->AddStepsToDo(m_Inputs.size() * m_Intervals.size());
+  mitk::ProgressBar::GetInstance()->AddStepsToDo(m_Inputs.size());
   for (auto [imageId, image] : m_Inputs)
   {
     auto validIndices = m_ValidIndicesMap[imageId];
     auto spectrumImage = dynamic_cast<m2::SpectrumImage *>(image.GetPointer());
 
-    // fill the data matrix
-    mitk::Image::Pointer ionImage = spectrumImage->mitk::Image::Clone();
-    for (size_t col = 0; col < m_Intervals.size(); ++col)
+    // fill the data matrix, all columns in one pass over the spectra
+    std::vector<double> mzs, tols;
+    for (const auto &interval : m_Intervals)
     {
-      const auto mz = m_Intervals.at(col).x.mean();
-      spectrumImage->GetImage(mz, spectrumImage->ApplyTolerance(mz), spectrumImage->GetMaskImage(), ionImage);
+      mzs.push_back(interval.x.mean());
+      tols.push_back(spectrumImage->ApplyTolerance(mzs.back()));
+    }
+    std::vector<m2::DisplayImagePixelType> values;
+    spectrumImage->GetImages(mzs, tols, spectrumImage->GetMaskImage(), values);
 
-      size_t v = offset;
-      for (auto index : validIndices)
-      {
-        mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType, 3> acc(ionImage);
-        data(v++, col) = acc.GetPixelByIndex(index);
-      }
-      mitk::ProgressBar::GetInstance()->Progress();
+    const auto dims = spectrumImage->GetDimensions();
+    const auto K = m_Intervals.size();
+    size_t v = offset;
+    for (auto index : validIndices)
+    {
+      const auto *row = values.data() + (index[0] + dims[0] * (index[1] + dims[1] * index[2])) * K;
+      for (size_t col = 0; col < K; ++col)
+        data(v, col) = row[col];
+      ++v;
     }
+    mitk::ProgressBar::GetInstance()->Progress();
     offset += validIndices.size();
   }
 
@@ -21,6 +21,7 @@ See LICENSE.txt for details.
 #include <mitkImage.h>
 #include <mitkImageCast.h>
 #include <mitkImagePixelReadAccessor.h>
+#include <mitkImageReadAccessor.h>
 
 #include <itkVectorImage.h>
 #include <itkImageRegionIterator.h>
@@ -52,6 +53,17 @@ void PcaImageFilter::initMatrix()
     totalPixels *= mitkImage->GetDimensions()[i];
   }
   
+  // A single vector image (e.g. from m2::SpectrumImage::GetVectorImage) holds all columns pixel by pixel
+  const auto numComponents = mitkImage->GetPixelType().GetNumberOfComponents();
+  if (input.size() == 1 && numComponents > 1) {
+    MITK_INFO << "Creating data matrix with dimensions " << totalPixels << " x " << numComponents;
+    mitk::ImageReadAccessor accessor(mitkImage);
+    using RowMajorMatrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    m_DataMatrix = Eigen::Map<const RowMajorMatrix>(
+      static_cast<const m2::DisplayImagePixelType *>(accessor.GetData()), totalPixels, numComponents);
+    return;
+  }
+
   // Set up data matrix dimensions (pixels × images)
   const unsigned long numRows = totalPixels;
   const unsigned long numColumns = input.size();
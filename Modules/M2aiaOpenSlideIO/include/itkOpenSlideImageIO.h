@@ -135,6 +135,25 @@ namespace itk
 		 * Call ReadImageInformation() again after calling this function. */
 		virtual bool SetLevelForDownsampleFactor(double dDownsampleFactor);
 
+		/** Sets the lowest resolution level whose pixel spacing (micro meters, see OpenSlide MPP) is
+		 * smaller or equal to the given spacing, e.g. the pixel size of a MSI image to co-register.
+		 * Returns false if the file has no MPP information.
+		 * This method overrides any previously selected associated image.
+		 * Call ReadImageInformation() again after calling this function. */
+		virtual bool SetLevelForSpacing(double dSpacing);
+
+		/** Returns the level SetLevelForSpacing would select, or -1 if there is none.
+		 * The currently selected level is not changed. */
+		virtual int GetLevelForSpacing(double dSpacing) const;
+
+		/** Level images are read tile by tile in parallel. Decoded tiles are kept in a LRU cache
+		 * that is shared by successive reads (e.g. neighbouring regions or streamed pieces).
+		 * Sets the maximum memory (in bytes) of the cache (default 256 MiB). */
+		virtual void SetTileCacheSize(size_t sizeInBytes);
+
+		/** Returns the maximum memory (in bytes) of the tile cache. */
+		virtual size_t GetTileCacheSize() const;
+
 		/** Returns all associated image names stored in the file. */
 		virtual AssociatedImageNameContainer GetAssociatedImageNames() const;
 
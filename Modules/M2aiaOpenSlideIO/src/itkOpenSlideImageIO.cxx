@@ -18,13 +18,21 @@
 
 #include <cctype>
 #include <algorithm>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <tuple>
+#include <vector>
 
 #include "itkIOCommon.h"
 #include "itkOpenSlideImageIO.h"
 #include "itksys/SystemTools.hxx"
 #include "itkMetaDataDictionary.h"
 #include "itkMetaDataObject.h"
+#include "itkMultiThreaderBase.h"
 
 // OpenSlide
 #include "openslide.h"
@@ -33,6 +41,77 @@
 namespace itk
 {
 
+// Bounded LRU cache of decoded level tiles (pre-multiplied ARGB as returned by OpenSlide).
+// Tiles are shared pointers, so a tile that is evicted while it is copied stays valid.
+class OpenSlideTileCache {
+public:
+  using KeyType = std::tuple<int32_t, int64_t, int64_t>; // level, tile x, tile y
+  using TileType = std::vector<uint32_t>;
+  using TilePointer = std::shared_ptr<const TileType>;
+
+  explicit OpenSlideTileCache(size_t sizeInBytes) : m_Capacity(sizeInBytes), m_Size(0) {}
+
+  TilePointer Get(const KeyType &key) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Index.find(key);
+    if (it == m_Index.end())
+      return TilePointer();
+
+    // move to the front (most recently used)
+    m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+    return it->second->second;
+  }
+
+  void Insert(const KeyType &key, const TilePointer &tile) {
+    const size_t bytes = tile->size() * sizeof(uint32_t);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (bytes > m_Capacity || m_Index.find(key) != m_Index.end())
+      return;
+
+    m_Entries.emplace_front(key, tile);
+    m_Index[key] = m_Entries.begin();
+    m_Size += bytes;
+
+    while (m_Size > m_Capacity) {
+      const auto &last = m_Entries.back();
+      m_Size -= last.second->size() * sizeof(uint32_t);
+      m_Index.erase(last.first);
+      m_Entries.pop_back();
+    }
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ClearUnlocked();
+  }
+
+  void SetCapacity(size_t sizeInBytes) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Capacity = sizeInBytes;
+    ClearUnlocked();
+  }
+
+  size_t GetCapacity() const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Capacity;
+  }
+
+private:
+  using EntryType = std::pair<KeyType, TilePointer>;
+
+  void ClearUnlocked() {
+    m_Entries.clear();
+    m_Index.clear();
+    m_Size = 0;
+  }
+
+  std::list<EntryType> m_Entries;
+  std::map<KeyType, std::list<EntryType>::iterator> m_Index;
+  size_t m_Capacity;
+  size_t m_Size;
+  mutable std::mutex m_Mutex;
+};
+
 // OpenSlide wrapper class
 // This is responsible for freeing the OpenSlide context on destruction
 // It also allows for seamless access to various levels and associated images through one set of functions (as opposed to two)
@@ -93,14 +172,29 @@ public:
     return openslide_get_version();
   }
 
+  // Default size of the tile cache (256 MiB) and tile size if the slide does not report one
+  static constexpr size_t DefaultTileCacheSize = size_t(256) << 20;
+  static constexpr int64_t DefaultTileSize = 512;
+
+  // Converts a pre-multiplied ARGB value of OpenSlide to the RGBA byte order of the ITK pixel
+  static uint32_t ToRGBA(uint32_t ui32ARGB) {
+    // XXX: Endianness?
+    RGBAPixel<unsigned char> clPixel;
+    clPixel.SetRed((ui32ARGB >> 16) & 0xff);
+    clPixel.SetGreen((ui32ARGB >> 8) & 0xff);
+    clPixel.SetBlue(ui32ARGB & 0xff);
+    clPixel.SetAlpha((ui32ARGB >> 24) & 0xff);
+    return *reinterpret_cast<uint32_t *>(clPixel.GetDataPointer());
+  }
+
   // Constructors
-  OpenSlideWrapper() {
+  OpenSlideWrapper() : m_TileCache(DefaultTileCacheSize) {
     m_Osr = NULL;
     m_Level = 0;
     m_ApproximateStreaming = false;
   }
 
-  OpenSlideWrapper(const char *p_cFileName) {
+  OpenSlideWrapper(const char *p_cFileName) : m_TileCache(DefaultTileCacheSize) {
     m_Osr = NULL;
     m_Level = 0;
     m_ApproximateStreaming = false;
@@ -138,6 +232,16 @@ public:
       openslide_close(m_Osr);
       m_Osr = NULL;
     }
+    m_TileCache.Clear();
+  }
+
+  // Limit the memory of cached tiles (0 disables the cache)
+  void SetTileCacheSize(size_t sizeInBytes) {
+    m_TileCache.SetCapacity(sizeInBytes);
+  }
+
+  size_t GetTileCacheSize() const {
+    return m_TileCache.GetCapacity();
   }
 
   // Checks weather a slide file is currently opened
@@ -206,6 +310,137 @@ public:
     return openslide_get_level_count(m_Osr);
   }
 
+  // Given a pixel spacing (in the unit of GetSpacing, i.e. micro meters), returns the lowest resolution level
+  // that is at least as fine as this spacing (-1 if the slide has no MPP information).
+  int32_t GetBestLevelForSpacing(double dSpacing) const {
+    if (m_Osr == NULL || dSpacing <= 0.0)
+      return -1;
+
+    double dMppX = 0.0;
+    if (!GetPropertyValue(OPENSLIDE_PROPERTY_NAME_MPP_X, dMppX) || dMppX <= 0.0)
+      return -1;
+
+    return openslide_get_best_level_for_downsample(m_Osr, dSpacing / dMppX);
+  }
+
+  // Selects the level returned by GetBestLevelForSpacing.
+  bool SetBestLevelForSpacing(double dSpacing) {
+    const int32_t i32Level = GetBestLevelForSpacing(dSpacing);
+
+    if (i32Level < 0)
+      return false;
+
+    SetLevel(i32Level);
+
+    return true;
+  }
+
+  // Tile grid used by ReadRegionTiled. Returns false if the current level can not be read tile by tile.
+  // The native tile size of the slide is used, rounded up to the grid of exactly streamable regions.
+  bool GetTileSize(int64_t &i64TileWidth, int64_t &i64TileHeight) const {
+    i64TileWidth = i64TileHeight = 0;
+
+    if (m_Osr == NULL || m_AssociatedImage.size() > 0)
+      return false;
+
+    const std::string strLevel = "openslide.level[" + std::to_string(m_Level) + "].";
+    if (!GetPropertyValue((strLevel + "tile-width").c_str(), i64TileWidth) || i64TileWidth <= 0)
+      i64TileWidth = DefaultTileSize;
+    if (!GetPropertyValue((strLevel + "tile-height").c_str(), i64TileHeight) || i64TileHeight <= 0)
+      i64TileHeight = DefaultTileSize;
+
+    int64_t i64MinWidth = 0, i64MinHeight = 0;
+    if (!ComputeMinimumStreamableRegionSize(i64MinWidth, i64MinHeight))
+      return false;
+
+    i64TileWidth = (i64TileWidth + i64MinWidth - 1) / i64MinWidth * i64MinWidth;
+    i64TileHeight = (i64TileHeight + i64MinHeight - 1) / i64MinHeight * i64MinHeight;
+
+    // tiles that do not fit into the cache would be decoded for every read
+    return (uint64_t)(i64TileWidth * i64TileHeight) * sizeof(uint32_t) <= m_TileCache.GetCapacity() / 4;
+  }
+
+  // Returns NULL for success
+  // Reads the region tile by tile in parallel. Tiles are taken from (or added to) the tile cache and copied
+  // into p_ui32Dest in RGBA byte order. The level must support tiled reading (see GetTileSize).
+  const char * ReadRegionTiled(uint32_t *p_ui32Dest, int64_t i64X, int64_t i64Y, int64_t i64Width, int64_t i64Height) const {
+    if (m_Osr == NULL)
+      return "OpenSlideWrapper has no file open.";
+
+    int64_t i64TileWidth = 0, i64TileHeight = 0;
+    if (!GetTileSize(i64TileWidth, i64TileHeight))
+      return "The current level can not be read tile by tile.";
+
+    int64_t i64LevelWidth = 0, i64LevelHeight = 0;
+    openslide_get_level_dimensions(m_Osr, m_Level, &i64LevelWidth, &i64LevelHeight);
+
+    const double dDownsampleFactor = openslide_get_level_downsample(m_Osr, m_Level);
+    if (dDownsampleFactor <= 0.0)
+      return "Could not get downsample factor.";
+
+    if (i64Width <= 0 || i64Height <= 0)
+      return NULL;
+
+    const int64_t i64FirstTileX = i64X / i64TileWidth;
+    const int64_t i64FirstTileY = i64Y / i64TileHeight;
+    const int64_t i64TilesX = (i64X + i64Width - 1) / i64TileWidth - i64FirstTileX + 1;
+    const int64_t i64TilesY = (i64Y + i64Height - 1) / i64TileHeight - i64FirstTileY + 1;
+
+    std::atomic<bool> bFailed(false);
+    auto clThreader = MultiThreaderBase::New();
+    clThreader->ParallelizeArray(
+      0,
+      (SizeValueType)(i64TilesX * i64TilesY),
+      [&](SizeValueType k) {
+        if (bFailed)
+          return;
+
+        const int64_t i64TileX = i64FirstTileX + (int64_t)k % i64TilesX;
+        const int64_t i64TileY = i64FirstTileY + (int64_t)k / i64TilesX;
+
+        // tile extent at the level (clipped at the image border)
+        const int64_t i64TX = i64TileX * i64TileWidth;
+        const int64_t i64TY = i64TileY * i64TileHeight;
+        const int64_t i64TW = std::min(i64TileWidth, i64LevelWidth - i64TX);
+        const int64_t i64TH = std::min(i64TileHeight, i64LevelHeight - i64TY);
+        if (i64TW <= 0 || i64TH <= 0)
+          return;
+
+        const OpenSlideTileCache::KeyType clKey(m_Level, i64TileX, i64TileY);
+        OpenSlideTileCache::TilePointer p_clTile = m_TileCache.Get(clKey);
+        if (!p_clTile) {
+          auto p_clNewTile = std::make_shared<OpenSlideTileCache::TileType>((size_t)(i64TW * i64TH));
+          // NOTE: API expects level 0 coordinates (see ReadRegion)
+          openslide_read_region(m_Osr,
+                                p_clNewTile->data(),
+                                (int64_t)(i64TX * dDownsampleFactor),
+                                (int64_t)(i64TY * dDownsampleFactor),
+                                m_Level,
+                                i64TW,
+                                i64TH);
+          if (openslide_get_error(m_Osr) != NULL) {
+            bFailed = true;
+            return;
+          }
+          p_clTile = p_clNewTile;
+          m_TileCache.Insert(clKey, p_clTile);
+        }
+
+        // copy the overlap of tile and region
+        const int64_t i64X0 = std::max(i64X, i64TX), i64X1 = std::min(i64X + i64Width, i64TX + i64TW);
+        const int64_t i64Y0 = std::max(i64Y, i64TY), i64Y1 = std::min(i64Y + i64Height, i64TY + i64TH);
+        for (int64_t y = i64Y0; y < i64Y1; ++y) {
+          const uint32_t *p_ui32Src = p_clTile->data() + (y - i64TY) * i64TW + (i64X0 - i64TX);
+          uint32_t *p_ui32Row = p_ui32Dest + (y - i64Y) * i64Width + (i64X0 - i64X);
+          for (int64_t x = i64X0; x < i64X1; ++x)
+            *p_ui32Row++ = ToRGBA(*p_ui32Src++);
+        }
+      },
+      nullptr);
+
+    return bFailed ? openslide_get_error(m_Osr) : NULL;
+  }
+
   // Returns NULL for success
   // NOTE: When reading associated images, x, y, width and height are ignored.
   const char * ReadRegion(uint32_t *p_ui32Dest, int64_t i64X, int64_t i64Y, int64_t i64Width, int64_t i64Height) const {
@@ -487,6 +722,7 @@ private:
   int32_t      m_Level;
   std::string  m_AssociatedImage;
   bool         m_ApproximateStreaming;
+  mutable OpenSlideTileCache m_TileCache;
 };
 
 OpenSlideImageIO::OpenSlideImageIO()
@@ -657,7 +893,13 @@ void OpenSlideImageIO::Read( void * buffer)
                        << "Reason: Requested region size in pixels overflows." );
   }
 
-  const char *p_cError = m_OpenSlideWrapper->ReadRegion(p_u32Buffer, clStart[0], clStart[1], clSize[0], clSize[1]);
+  // Level images are read tile by tile (cached, in parallel) directly in RGBA order
+  int64_t i64TileWidth = 0, i64TileHeight = 0;
+  const bool bTiled = m_OpenSlideWrapper->GetTileSize(i64TileWidth, i64TileHeight);
+
+  const char *p_cError = bTiled
+    ? m_OpenSlideWrapper->ReadRegionTiled(p_u32Buffer, clStart[0], clStart[1], clSize[0], clSize[1])
+    : m_OpenSlideWrapper->ReadRegion(p_u32Buffer, clStart[0], clStart[1], clSize[0], clSize[1]);
 
   if (p_cError != NULL) {
     std::string strError = p_cError; // Copy this since Close() may destroy the backing buffer
@@ -668,18 +910,13 @@ void OpenSlideImageIO::Read( void * buffer)
                        << "Reason: " << strError );
   }
 
+  if (bTiled)
+    return;
+
   // Re-order the bytes (ARGB -> RGBA)
   const int64_t i64TotalSize = clRegionToRead.GetNumberOfPixels();
-  for (int64_t i = 0; i < i64TotalSize; ++i) {
-    // XXX: Endianness?
-    RGBAPixel<unsigned char> clPixel;
-    clPixel.SetRed((p_u32Buffer[i] >> 16) & 0xff);
-    clPixel.SetGreen((p_u32Buffer[i] >> 8) & 0xff);
-    clPixel.SetBlue(p_u32Buffer[i] & 0xff);
-    clPixel.SetAlpha((p_u32Buffer[i] >> 24) & 0xff);
-
-    p_u32Buffer[i] = *reinterpret_cast<uint32_t *>(clPixel.GetDataPointer());
-  }
+  for (int64_t i = 0; i < i64TotalSize; ++i)
+    p_u32Buffer[i] = OpenSlideWrapper::ToRGBA(p_u32Buffer[i]);
 }
 
 bool OpenSlideImageIO::CanWriteFile( const char * /*name*/ )
@@ -802,6 +1039,35 @@ bool OpenSlideImageIO::SetLevelForDownsampleFactor(double dDownsampleFactor) {
   return m_OpenSlideWrapper->SetBestLevelForDownsample(dDownsampleFactor);
 }
 
+/** Sets the lowest resolution level with a pixel spacing (micro meters) smaller or equal to the given spacing.
+ * This method overrides any previously selected associated image.
+ * Call ReadImageInformation() again after calling this function. */
+bool OpenSlideImageIO::SetLevelForSpacing(double dSpacing) {
+  if (m_OpenSlideWrapper == NULL)
+    return false;
+
+  return m_OpenSlideWrapper->SetBestLevelForSpacing(dSpacing);
+}
+
+/** Returns the level SetLevelForSpacing would select (-1 if there is none) without changing the current level. */
+int OpenSlideImageIO::GetLevelForSpacing(double dSpacing) const {
+  if (m_OpenSlideWrapper == NULL)
+    return -1;
+
+  return m_OpenSlideWrapper->GetBestLevelForSpacing(dSpacing);
+}
+
+/** Sets the maximum memory (in bytes) used for cached tiles. */
+void OpenSlideImageIO::SetTileCacheSize(size_t sizeInBytes) {
+  if (m_OpenSlideWrapper != NULL)
+    m_OpenSlideWrapper->SetTileCacheSize(sizeInBytes);
+}
+
+/** Returns the maximum memory (in bytes) used for cached tiles. */
+size_t OpenSlideImageIO::GetTileCacheSize() const {
+  return m_OpenSlideWrapper != NULL ? m_OpenSlideWrapper->GetTileCacheSize() : 0;
+}
+
 /** Returns all associated image names stored in the file. */
 OpenSlideImageIO::AssociatedImageNameContainer OpenSlideImageIO::GetAssociatedImageNames() const {
   if (m_OpenSlideWrapper == NULL)
@@ -30,6 +30,7 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 // mitk image
 #include <m2ImzMLImageIO.h>
 #include <m2ImzMLSpectrumImage.h>
+#include <m2NpyExport.h>
 #include <m2SpectrumImage.h>
 #include <QmitkIOUtil.h>
 #include <mitkImage.h>
@@ -52,9 +53,12 @@ void m2ImzMLExportView::CreateQtPartControl(QWidget *parent)
   //                                     static_cast<unsigned>(m2::SpectrumFormat::ContinuousProfile));
   m_Controls.cmbBxOutputMode->addItem("Continuous Centroid",
                                       static_cast<unsigned>(m2::SpectrumFormat::ContinuousCentroid));
+  m_Controls.cmbBxOutputMode->addItem("Processed Centroid",
+                                      static_cast<unsigned>(m2::SpectrumFormat::ProcessedCentroid));
 
   m_Controls.cmbBxOutputDatatypeInt->addItem("Float", static_cast<unsigned>(m2::NumericType::Float));
   m_Controls.cmbBxOutputDatatypeInt->addItem("Double", static_cast<unsigned>(m2::NumericType::Double));
+  m_Controls.cmbBxOutputDatatypeInt->addItem("Half (16-bit float)", static_cast<unsigned>(m2::NumericType::Half));
 
   m_Controls.cmbBxOutputDatatypeMz->addItem("Float", static_cast<unsigned>(m2::NumericType::Float));
   m_Controls.cmbBxOutputDatatypeMz->addItem("Double", static_cast<unsigned>(m2::NumericType::Double));
@@ -74,6 +78,12 @@ void m2ImzMLExportView::CreateQtPartControl(QWidget *parent)
   m_Controls.listSelection->SetEmptyInfo(QString("PeakList selection"));
   m_Controls.listSelection->SetPopUpTitel(QString("PeakList"));
 
+  m_Controls.roiSelection->SetDataStorage(GetDataStorage());
+  m_Controls.roiSelection->SetNodePredicate(mitk::NodePredicateDataType::New("LabelSetImage"));
+  m_Controls.roiSelection->SetSelectionIsOptional(true);
+  m_Controls.roiSelection->SetEmptyInfo(QString("Region of interest selection"));
+  m_Controls.roiSelection->SetPopUpTitel(QString("Region of interest"));
+
   connect(m_Controls.btnExport,
           &QPushButton::clicked,
           this,
@@ -96,12 +106,68 @@ void m2ImzMLExportView::CreateQtPartControl(QWidget *parent)
                 io.SetDataTypeXAxis(xDataType);
                 io.SetDataTypeYAxis(yDataType);
                 io.SetSpectrumFormat(format);
+                io.SetUseZlibCompression(m_Controls.chkBxZlibCompression->isChecked());
+                io.SetComputeSHA1(m_Controls.chkBxComputeSHA1->isChecked());
                 io.SetOutputLocation(name.toStdString());
                 io.mitk::AbstractFileIOWriter::SetInput(node->GetData());
                 io.Write();
               }
             }
           });
+
+  connect(m_Controls.btnExportRegion,
+          &QPushButton::clicked,
+          this,
+          [this, parent]()
+          {
+            auto node = this->m_Controls.imageSelection->GetSelectedNode();
+            auto roiNode = this->m_Controls.roiSelection->GetSelectedNode();
+            if (!node || !roiNode || !dynamic_cast<m2::ImzMLSpectrumImage *>(node->GetData()))
+            {
+              QMessageBox::information(parent, "Export region of interest", "Select an imzML image and a segmentation.");
+              return;
+            }
+
+            const auto name = QFileDialog::getSaveFileName(parent);
+            if (name.isEmpty())
+              return;
+
+            m2::ImzMLImageIO io;
+            io.SetRegionOfInterest(dynamic_cast<mitk::Image *>(roiNode->GetData()));
+            io.SetComputeSHA1(m_Controls.chkBxComputeSHA1->isChecked());
+            io.SetOutputLocation(name.toStdString());
+            io.mitk::AbstractFileIOWriter::SetInput(node->GetData());
+            io.Write();
+          });
+
+  connect(m_Controls.btnExportNpy,
+          &QPushButton::clicked,
+          this,
+          [this, parent]()
+          {
+            auto node = this->m_Controls.imageSelection->GetSelectedNode();
+            auto listNode = this->m_Controls.listSelection->GetSelectedNode();
+            if (!node || !listNode)
+            {
+              QMessageBox::information(parent, "Export matrix", "Select a spectrum image and a peak list.");
+              return;
+            }
+
+            const auto name = QFileDialog::getSaveFileName(parent, "Export matrix", QString(), "NumPy array (*.npy)");
+            if (name.isEmpty())
+              return;
+
+            try
+            {
+              m2::NpyExport::Write(name.toStdString(),
+                                   dynamic_cast<m2::SpectrumImage *>(node->GetData()),
+                                   dynamic_cast<m2::IntervalVector *>(listNode->GetData()));
+            }
+            catch (std::exception &e)
+            {
+              QMessageBox::warning(parent, "Export matrix", e.what());
+            }
+          });
 }
 
 void m2ImzMLExportView::NodeAdded(const mitk::DataNode *)
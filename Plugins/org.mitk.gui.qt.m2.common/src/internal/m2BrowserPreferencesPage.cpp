@@ -59,6 +59,12 @@ void m2BrowserPreferencesPage::CreateQtControl(QWidget *parent)
   // m_Preferences->PutBool("m2aia.view.spectrum.showSamplingPoints",v);
   m_Ui->showSamplingPoints->setChecked(m_Preferences->GetBool("m2aia.view.spectrum.showSamplingPoints", false));
   m_Ui->minimalImagingArea->setChecked(m_Preferences->GetBool("m2aia.view.image.minimal_area", true));
+  m_Ui->channelCube->setChecked(m_Preferences->GetBool("m2aia.imzml.channel_cube", false));
+  m_Ui->compactMzAxes->setChecked(m_Preferences->GetBool("m2aia.imzml.compact_mz_axes", true));
+  m_Ui->wavenumberMajorCopy->setChecked(m_Preferences->GetBool("m2aia.spectra.wavenumber_major_copy", false));
+  m_Ui->sidecarNextToData->setChecked(m_Preferences->GetBool("m2aia.imzml.sidecar_next_to_data", false));
+  m_Ui->sidecarDirectory->setText(QString::fromStdString(m_Preferences->Get("m2aia.imzml.sidecar_directory", "")));
+  m_Ui->sidecarDirectory->setEnabled(!m_Ui->sidecarNextToData->isChecked());
 
 
   connect(m_Ui->spnBxBins, SIGNAL(valueChanged(int)), this, SLOT(OnBinsSpinBoxValueChanged(int)));
@@ -66,6 +72,11 @@ void m2BrowserPreferencesPage::CreateQtControl(QWidget *parent)
   connect(m_Ui->useMinIntensity, SIGNAL(toggled(bool)), this, SLOT(OnUseMinIntensity(bool)));
   connect(m_Ui->minimalImagingArea, SIGNAL(toggled(bool)), this, SLOT(OnUseMinimalImagingArea(bool)));
   connect(m_Ui->showSamplingPoints, SIGNAL(toggled(bool)), this, SLOT(OnUseSamplingPoints(bool)));
+  connect(m_Ui->channelCube, SIGNAL(toggled(bool)), this, SLOT(OnUseChannelCube(bool)));
+  connect(m_Ui->compactMzAxes, SIGNAL(toggled(bool)), this, SLOT(OnUseCompactMzAxes(bool)));
+  connect(m_Ui->wavenumberMajorCopy, SIGNAL(toggled(bool)), this, SLOT(OnUseWavenumberMajorCopy(bool)));
+  connect(m_Ui->sidecarNextToData, SIGNAL(toggled(bool)), this, SLOT(OnUseSidecarNextToData(bool)));
+  connect(m_Ui->sidecarDirectory, SIGNAL(editingFinished()), this, SLOT(OnSidecarDirectoryChanged()));
 }
 
 void m2BrowserPreferencesPage::OnBinsSpinBoxValueChanged(int value)
@@ -108,6 +119,32 @@ void m2BrowserPreferencesPage::OnUseMinimalImagingArea(bool v)
   m_Preferences->PutBool("m2aia.view.image.minimal_area", v);
 }
 
+void m2BrowserPreferencesPage::OnUseChannelCube(bool v)
+{
+  m_Preferences->PutBool("m2aia.imzml.channel_cube", v);
+}
+
+void m2BrowserPreferencesPage::OnUseCompactMzAxes(bool v)
+{
+  m_Preferences->PutBool("m2aia.imzml.compact_mz_axes", v);
+}
+
+void m2BrowserPreferencesPage::OnUseWavenumberMajorCopy(bool v)
+{
+  m_Preferences->PutBool("m2aia.spectra.wavenumber_major_copy", v);
+}
+
+void m2BrowserPreferencesPage::OnUseSidecarNextToData(bool v)
+{
+  m_Preferences->PutBool("m2aia.imzml.sidecar_next_to_data", v);
+  m_Ui->sidecarDirectory->setEnabled(!v);
+}
+
+void m2BrowserPreferencesPage::OnSidecarDirectoryChanged()
+{
+  m_Preferences->Put("m2aia.imzml.sidecar_directory", m_Ui->sidecarDirectory->text().trimmed().toStdString());
+}
+
 void m2BrowserPreferencesPage::Update()
 {
   // optin
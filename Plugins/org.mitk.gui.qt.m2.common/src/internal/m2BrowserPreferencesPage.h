@@ -50,6 +50,11 @@ public slots:
 	void OnUseMaxIntensity(bool v);
 	void OnUseSamplingPoints(bool v);
 	void OnUseMinimalImagingArea(bool v);
+	void OnUseChannelCube(bool v);
+	void OnUseCompactMzAxes(bool v);
+	void OnUseWavenumberMajorCopy(bool v);
+	void OnUseSidecarNextToData(bool v);
+	void OnSidecarDirectoryChanged();
 
 	void CreateQtControl(QWidget* parent) override;
 	QWidget* GetQtControl() const override;
@@ -21,6 +21,7 @@ See LICENSE.txt for details.
 #include <QPixmap>
 #include <QTransform>
 #include <QmitkNodeDescriptorManager.h>
+#include <algorithm>
 #include <itkImageDuplicator.h>
 #include <itkImageFileReader.h>
 #include <itkMetaDataObject.h>
@@ -220,8 +221,11 @@ void Qm2OpenSlideImageIOHelperDialog::UpdateImageInformation()
             m_Controls.warningLabel->setText(warn);
           });
 
-    // Preselect the first item
-    m_Controls.imageSelectionList->setCurrentRow(0);
+    // Preselect the level matching the MSI pixel spacing (OpenSlide spacing is in micro meter), else the first item
+    int row = 0;
+    if (m_TargetSpacing > 0)
+      row = std::max(0, std::min(IO->GetLevelForSpacing(m_TargetSpacing * 1e3), m_Controls.imageSelectionList->count() - 1));
+    m_Controls.imageSelectionList->setCurrentRow(row);
 }
 
 mitk::Image::Pointer Qm2OpenSlideImageIOHelperDialog::GetPreviewData()
@@ -42,6 +42,10 @@ public:
     return QDialog::exec();
   }
 
+  /// @brief Pixel spacing (mm) of the MSI data to co-register. If set, the level with the
+  /// lowest resolution that is still at least as fine as this spacing is preselected.
+  void SetTargetSpacing(double spacing) { m_TargetSpacing = spacing; }
+
   int GetSelectedLevel() { return m_SelectedLevel; }
   double GetSliceThickness() { return m_SliceThickness; }
   std::vector<mitk::Image::Pointer> GetData();
@@ -59,6 +63,7 @@ private:
   int m_TilesX;
   int m_TilesY;
   double m_SliceThickness = 1;
+  double m_TargetSpacing = 0;
 
   /*This function casts a itk RGBA Image, to a itk varaible lenght vector image with 3 components. */
   static itk::VectorImage<unsigned char, 3>::Pointer ConvertRGBAToVectorImage(
@@ -784,49 +784,35 @@ void m2Data::OnGenerateImageData(mitk::DataNode::Pointer node,
 
     mitk::Image::Pointer maskImage = data->GetMaskImage();
 
-    // The smartpointer will stay alive until all captured copies are relesed. Additional
-    // all connected signals must be disconnected to make sure that the future is not kept
-    // alive after the 'finished-callback' is processed.
-    auto future = std::make_shared<QFutureWatcher<mitk::Image::Pointer>>();
-
-    //*************** Worker Finished Callback ******************//
-    // capture holds a copy of the smartpointer, so it will stay alive. Make the lambda mutable to
-    // allow the manipulation of captured varaibles that are copied by '='.
-    const auto futureFinished = [future, node, this]() mutable
+    mitk::Image::Pointer target = data.GetPointer();
+    if (m_InitializeNewNode)
     {
-      auto image = future->result();
-      UpdateLevelWindow(node);
-      // UpdateSpectrumImageTable(node);
-      node->SetProperty("m2aia.xs.selection.center", image->GetProperty("m2aia.xs.selection.center"));
-      node->SetProperty("m2aia.xs.selection.tolerance", image->GetProperty("m2aia.xs.selection.tolerance"));
-      this->RequestRenderWindowUpdate();
-      future->disconnect();
-    };
+      auto geom = data->GetGeometry()->Clone();
+      target = mitk::Image::New();
+      target->Initialize(mitk::MakeScalarPixelType<m2::DisplayImagePixelType>(), *geom);
+    }
 
-    //*************** Worker Block******************//
-    const auto futureWorker = [xRangeCenter, xRangeTol, data, maskImage, this]()
+    //*************** Finished Callback ******************//
+    // Called on the scheduler thread. Requests superseded by a newer one (e.g. while dragging
+    // the m/z slider) finish with generated == false and are not rendered.
+    const auto onFinished = [node, data, this](bool generated)
     {
-      // m2::Timer t("Create image @[" + std::to_string(xRangeCenter) + " " + std::to_string(xRangeTol) + "]");
-      if (m_InitializeNewNode)
-      {
-        auto geom = data->GetGeometry()->Clone();
-        auto image = mitk::Image::New();
-        image->Initialize(mitk::MakeScalarPixelType<m2::DisplayImagePixelType>(), *geom);
-        data->GetImage(xRangeCenter, xRangeTol, maskImage, image);
-        return image;
-      }
-      else
-      {
-        data->GetImage(xRangeCenter, xRangeTol, maskImage, data);
-        mitk::Image::Pointer imagePtr = data.GetPointer();
-        return imagePtr;
-      }
+      if (!generated)
+        return;
+      QMetaObject::invokeMethod(
+        this,
+        [node, data, this]()
+        {
+          UpdateLevelWindow(node);
+          node->SetProperty("m2aia.xs.selection.center", data->GetProperty("m2aia.xs.selection.center"));
+          node->SetProperty("m2aia.xs.selection.tolerance", data->GetProperty("m2aia.xs.selection.tolerance"));
+          this->RequestRenderWindowUpdate();
+        },
+        Qt::QueuedConnection);
     };
 
-    //*************** Start Worker ******************//
-
-    connect(future.get(), &QFutureWatcher<mitk::Image::Pointer>::finished, future.get(), futureFinished);
-    future->setFuture(QtConcurrent::run(&m_pool, futureWorker));
+    //*************** Submit Request ******************//
+    m_IonImageScheduler.Submit(data, xRangeCenter, xRangeTol, maskImage, target, onFinished);
   }
 }
 
@@ -1025,6 +1011,17 @@ void m2Data::OpenSlideImageNodeAdded(const mitk::DataNode *node)
     const auto name = node->GetName();
     auto dialog = new Qm2OpenSlideImageIOHelperDialog(m_Parent);
     dialog->SetOpenSlideImageIOHelperObject(openSlideIOHelper);
+
+    // suggest the level matching the pixel size of the selected MSI data
+    for (const auto &selectedNode : this->GetDataManagerSelection())
+    {
+      if (auto image = dynamic_cast<m2::SpectrumImage *>(selectedNode->GetData()))
+      {
+        dialog->SetTargetSpacing(image->GetGeometry()->GetSpacing()[0]);
+        break;
+      }
+    }
+
     auto result = dialog->exec();
     if (result == QDialog::Accepted)
     {
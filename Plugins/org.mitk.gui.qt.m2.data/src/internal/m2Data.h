@@ -22,6 +22,7 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 #include <mitkTextAnnotation2D.h>
 #include <mitkColorBarAnnotation.h>
 
+#include <m2IonImageScheduler.h>
 #include <m2UIUtils.h>
 
 // #include <QThreadPool>
@@ -148,7 +149,6 @@ protected:
   QWidget * m_Parent = nullptr;
   bool m_InitializeNewNode = false;
 
-  QThreadPool m_pool;
   m2::SpectrumType m_CurrentOverviewSpectrumType = m2::SpectrumType::Maximum;
 
 
@@ -168,4 +168,7 @@ protected:
   const int FROM_GUI = -1;
 
   mitk::IPreferences * m_M2aiaPreferences;
+
+  // declared last: destroyed (and joined) before the members used by its callbacks
+  m2::IonImageScheduler m_IonImageScheduler;
 };
@@ -232,24 +232,11 @@ void QmitkDataCompressionView::OnStartPCA()
       auto filter = m2::PcaImageFilter::New();
       filter->SetMaskImage(image->GetMaskImage());
 
-      std::vector<mitk::Image::Pointer> temporaryImages;
       auto progressBar = mitk::ProgressBar::GetInstance();
-      progressBar->AddStepsToDo(intervals.size() + 1);
-      size_t inputIdx = 0;
-      for (size_t row = 0; row < intervals.size(); ++row)
+      progressBar->AddStepsToDo(2);
+      if (intervals.size() <= 2)
       {
-        progressBar->Progress();
-        temporaryImages.push_back(mitk::Image::New());
-        temporaryImages.back()->Initialize(image);
-        const auto mz = intervals.at(row).x.mean();
-        image->GetImage(mz, image->ApplyTolerance(mz), image->GetMaskImage(), temporaryImages.back());
-        filter->SetInput(inputIdx, temporaryImages.back());
-        ++inputIdx;
-      }
-
-      if (temporaryImages.size() <= 2)
-      {
-        progressBar->Progress();
+        progressBar->Progress(2);
         QMessageBox::warning(nullptr,
                              "Select image,s first!",
                              "Select at least three peaks!",
@@ -258,6 +245,13 @@ void QmitkDataCompressionView::OnStartPCA()
         continue;
       }
 
+      // all ion images are generated in one pass over the spectra
+      std::vector<double> mzs;
+      for (const auto &interval : intervals)
+        mzs.push_back(interval.x.mean());
+      filter->SetInput(0, image->GetVectorImage(mzs, image->GetMaskImage()));
+      progressBar->Progress();
+
       filter->SetNumberOfComponents(m_Controls.pca_dims->value());
       filter->Update();
       progressBar->Progress();
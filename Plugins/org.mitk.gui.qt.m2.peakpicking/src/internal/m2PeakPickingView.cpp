@@ -30,6 +30,9 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 #include <boost/algorithm/string.hpp>
 #include <boost/any.hpp>
 
+// std
+#include <numeric>
+
 // m2
 #include <m2CoreCommon.h>
 #include <m2ImzMLSpectrumImage.h>
@@ -53,6 +56,7 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 #include <mitkImageAccessByItk.h>
 #include <mitkImagePixelReadAccessor.h>
 #include <mitkImagePixelWriteAccessor.h>
+#include <mitkImageWriteAccessor.h>
 #include <mitkLabelSetImage.h>
 #include <mitkNodePredicateAnd.h>
 #include <mitkNodePredicateDataType.h>
@@ -262,7 +266,6 @@ void m2PeakPickingView::OnStartExportImages() {
   for(auto imageNode : imageNodes){
     auto image = dynamic_cast<m2::SpectrumImage *>(imageNode->GetData());
 
-    unsigned int component = 0 ;
     for(auto centroidNode : centroidNodes){
       auto centroids = dynamic_cast<m2::IntervalVector *>(centroidNode->GetData());
 
@@ -337,28 +340,35 @@ void m2PeakPickingView::OnStartExportImages() {
       stack->GetGeometry()->SetIndexToWorldTransform(ionImage->GetGeometry()->GetIndexToWorldTransform());
 
       std::string centroidValues;
-      
+      std::vector<double> mzs, tols;
       for(const m2::Interval & i: centroids->GetIntervals()){
-
         centroidValues = centroidValues + std::to_string(i.x.mean()) + ",";
         emit m2::UIUtils::Instance()->RequestTolerance(i.x.mean(), tol);
-        image->GetImage(i.x.mean(), tol, image->GetMaskImage(), image);
-        
-        if(helper)
-          ionImage = helper->WarpImage(image, "double");
-        else
-          ionImage = image;
-
-        mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType,3> imageAcc(ionImage);
-        imageAcc.GetData();
-        mitk::ImagePixelReadAccessor<PixelType,3> stackAcc(stack);
-        for(unsigned int x = 0; x < ionImage->GetDimensions()[0]; ++x)
-          for(unsigned int y = 0; y < ionImage->GetDimensions()[1]; ++y)
-            for(unsigned int z = 0; z < ionImage->GetDimensions()[2]; ++z){
-                auto v = stackAcc.GetConsecutivePixelsAsVector({x,y,z}, centroids->GetIntervals().size());
-                v[component] = imageAcc.GetPixelByIndex({x,y,z});
-            }
-        ++component;        
+        mzs.push_back(i.x.mean());
+        tols.push_back(tol);
+      }
+
+      const auto K = mzs.size();
+      const auto N = std::accumulate(dimensions, dimensions + 3, size_t(1), std::multiplies<size_t>());
+      {
+        mitk::ImageWriteAccessor stackAcc(stack);
+        auto stackData = static_cast<PixelType *>(stackAcc.GetData());
+        if(!helper){
+          // all ion images in one pass over the spectra, the buffer layout matches the vector image
+          std::vector<m2::DisplayImagePixelType> values;
+          image->GetImages(mzs, tols, image->GetMaskImage(), values);
+          std::copy(values.begin(), values.end(), stackData);
+        }else{
+          // warping requires single ion images
+          for(size_t k = 0; k < K; ++k){
+            image->GetImage(mzs[k], tols[k], image->GetMaskImage(), image);
+            ionImage = helper->WarpImage(image, "double");
+            mitk::ImagePixelReadAccessor<m2::DisplayImagePixelType,3> imageAcc(ionImage);
+            const auto imageData = imageAcc.GetData();
+            for(size_t i = 0; i < N; ++i)
+              stackData[i * K + k] = imageData[i];
+          }
+        }
       }
 
       if (!centroidValues.empty())
@@ -32,6 +32,7 @@ See LICENSE.txt or https://www.github.com/jtfcordes/m2aia for details.
 #include <mitkNodePredicateOr.h>
 #include <mitkImageAccessByItk.h>
 #include <mitkImageCast.h>
+#include <mitkImagePixelWriteAccessor.h>
 #include <mitkStringProperty.h>
 #include <itkNrrdImageIO.h>
 // #include <mitkImageWriter.h>
@@ -659,22 +660,47 @@ void m2Reconstruction3D::OnStartExport(){
     localStackImage->Initialize(stackImage);
 
 
-    for (auto I : intervals->GetIntervals())
+    // ion images of a block of intervals are generated in one pass over the data of each slice,
+    // the block size keeps the buffer at about 256 MB
+    const auto dims = localStackImage->GetDimensions();
+    const std::size_t N = std::size_t(dims[0]) * dims[1] * dims[2];
+    const std::size_t blockSize = std::max<std::size_t>(1, (std::size_t(256) << 20) / (N * sizeof(m2::DisplayImagePixelType)));
+    const auto &all = intervals->GetIntervals();
+    std::vector<m2::DisplayImagePixelType> values;
+    bool canceled = false;
+
+    for (std::size_t first = 0; first < all.size() && !canceled; first += blockSize)
     {
-      auto center = I.x.mean();
-      // tolerance in 5 ppm
-      auto tol = center * 5e-6;
-      
-      stackImage->GetImage(center, tol, nullptr, localStackImage);
+      const auto last = std::min(all.size(), first + blockSize);
+      std::vector<double> centers, tols;
+      for (auto j = first; j < last; ++j)
+      {
+        centers.push_back(all[j].x.mean());
+        // tolerance in 5 ppm
+        tols.push_back(centers.back() * 5e-6);
+      }
+      stackImage->GetImages(centers, tols, nullptr, values);
 
-      auto fileName = dir + "/Stack3D_" + QString("%1").arg(center, 6, 'f', 2) + ".nrrd";
-      mitk::IOUtil::Save(localStackImage, fileName.toStdString());
+      const auto K = centers.size();
+      for (std::size_t k = 0; k < K; ++k)
+      {
+        {
+          mitk::ImagePixelWriteAccessor<m2::DisplayImagePixelType, 3> acc(localStackImage);
+          auto *data = acc.GetData();
+          for (std::size_t p = 0; p < N; ++p)
+            data[p] = values[p * K + k];
+        }
 
-      if (futureInterface.isCanceled()) {
-        qDebug() << "Task canceled!";
-        break;
+        auto fileName = dir + "/Stack3D_" + QString("%1").arg(centers[k], 6, 'f', 2) + ".nrrd";
+        mitk::IOUtil::Save(localStackImage, fileName.toStdString());
+
+        if (futureInterface.isCanceled()) {
+          qDebug() << "Task canceled!";
+          canceled = true;
+          break;
+        }
+        futureInterface.setProgressValue(++progress);
       }
-      futureInterface.setProgressValue(++progress);
     }
 
     now = std::chrono::system_clock::now();